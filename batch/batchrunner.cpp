@@ -0,0 +1,357 @@
+#include "batchrunner.h"
+#include "../bmpstream.h"
+#include "../pipeline.h"
+#include "../kmeans.h"
+#include "../parallel.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThread>
+#include <QDebug>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+// 内存预算闸门：处理前申请预计内存，处理后归还；预算不足时阻塞等待
+class MemoryGate {
+public:
+    explicit MemoryGate(qint64 budget) : budget(budget), available(budget) {}
+
+    // 超过总预算的单个文件按总预算计，保证它最终能够独占执行
+    qint64 acquire(qint64 bytes) {
+        bytes = std::min(bytes, budget);
+        QMutexLocker locker(&mutex);
+        while (available < bytes) {
+            released.wait(&mutex);
+        }
+        available -= bytes;
+        return bytes;
+    }
+
+    // 不等待的申请，预算不足时返回 -1
+    qint64 tryAcquire(qint64 bytes) {
+        bytes = std::min(bytes, budget);
+        QMutexLocker locker(&mutex);
+        if (available < bytes) {
+            return -1;
+        }
+        available -= bytes;
+        return bytes;
+    }
+
+    void release(qint64 bytes) {
+        QMutexLocker locker(&mutex);
+        available += bytes;
+        released.wakeAll();
+    }
+
+private:
+    QMutex mutex;
+    QWaitCondition released;
+    const qint64 budget;
+    qint64 available;
+};
+
+}
+
+int BatchOp::intParam(const QString& key, int defaultValue) const {
+    if (!params.contains(key)) {
+        return defaultValue;
+    }
+    bool ok = false;
+    int value = params.value(key).toInt(&ok);
+    return ok ? value : defaultValue;
+}
+
+double BatchOp::doubleParam(const QString& key, double defaultValue) const {
+    if (!params.contains(key)) {
+        return defaultValue;
+    }
+    bool ok = false;
+    double value = params.value(key).toDouble(&ok);
+    return ok ? value : defaultValue;
+}
+
+BatchRunner::BatchRunner() {}
+
+bool BatchRunner::parseOps(const QString& chain, QVector<BatchOp>& ops, QString* error) {
+    ops.clear();
+    const QStringList items = chain.split(',', Qt::SkipEmptyParts);
+    for (const QString& item : items) {
+        // 格式：name[:key=value[:key=value...]]
+        QStringList parts = item.trimmed().split(':', Qt::SkipEmptyParts);
+        if (parts.isEmpty()) {
+            continue;
+        }
+        BatchOp op;
+        op.name = parts.takeFirst().trimmed().toLower();
+        if (op.name != "equalize" && op.name != "segment" && op.name != "sharpen" && op.name != "clahe"
+            && op.name != "median" && op.name != "bilateral") {
+            if (error) *error = QString("Unknown operation: %1").arg(op.name);
+            return false;
+        }
+        for (const QString& part : parts) {
+            int eq = part.indexOf('=');
+            if (eq <= 0) {
+                if (error) *error = QString("Bad parameter '%1' for %2").arg(part, op.name);
+                return false;
+            }
+            op.params.insert(part.left(eq).trimmed(), part.mid(eq + 1).trimmed());
+        }
+        // 簇号按字节存储，K 超出范围时直接报错而不是悄悄截断
+        if (op.name == "segment" && !KMeans::isValidK(op.intParam("K", 1))) {
+            if (error) *error = QString("K must be in [1, %1] for segment").arg(KMeans::kMaxClusters);
+            return false;
+        }
+        ops.append(op);
+    }
+    if (ops.isEmpty()) {
+        if (error) *error = "Empty operation chain";
+        return false;
+    }
+    return true;
+}
+
+bool BatchRunner::applyOps(MyQImage& image, const QVector<BatchOp>& ops) {
+    // 相邻的均衡化与锐化记入同一条流水线融合执行，遇到分割或链尾时再执行；
+    // 流水线只支持 Bgr24，其他像素格式逐个调用 MyQImage 的操作
+    const bool fused = image.getFormat() == PixelFormat::Bgr24;
+    ImagePipeline pipeline;
+    for (const BatchOp& op : ops) {
+        if (op.name == "equalize") {
+            if (fused) {
+                pipeline.equalize();
+            } else if (!image.HistogramEqualization()) {
+                return false;
+            }
+            continue;
+        }
+        if (op.name == "sharpen") {
+            if (fused) {
+                pipeline.sharpen();
+            } else if (!image.sharpen()) {
+                return false;
+            }
+            continue;
+        }
+        if (!image.applyPipeline(pipeline)) {
+            return false;
+        }
+        pipeline.clear();
+        bool ok = false;
+        if (op.name == "segment") {
+            image.changeK(op.intParam("K", 1));
+            image.changeSeed(op.intParam("seed", 1));
+            if (op.params.value("engine") == "histogram") {
+                image.setSegmentationEngine(KMeansEngine::ColorHistogram, op.intParam("bits", 8));
+            }
+            ok = image.segmentImage();
+        } else if (op.name == "clahe") {
+            ok = image.clahe(op.intParam("tile", 64), op.doubleParam("clip", 2.0));
+        } else if (op.name == "median") {
+            ok = image.medianFilter(op.intParam("r", 2));
+        } else if (op.name == "bilateral") {
+            ok = image.bilateralFilter(op.intParam("r", 4), op.doubleParam("range", 30));
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return image.applyPipeline(pipeline);
+}
+
+bool BatchRunner::supportsStreaming(const QVector<BatchOp>& ops, QString* error) {
+    // 流式分割只有逐条带累计的逐像素迭代，没有颜色直方图引擎（bits 只对该引擎有效）
+    for (const BatchOp& op : ops) {
+        if (op.name == "segment" && op.params.value("engine") == "histogram") {
+            if (error) *error = "engine=histogram for segment is not supported in streaming mode";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BatchRunner::applyOpsStreaming(const QString& inPath, const QString& outPath,
+                                    const QVector<BatchOp>& ops, qint64 memoryBudget) {
+    QString error;
+    if (!supportsStreaming(ops, &error)) {
+        qDebug() << "Batch:" << error;
+        return false;
+    }
+    StreamProcessor processor(memoryBudget);
+    QString current = inPath;
+    for (int i = 0; i < ops.size(); ++i) {
+        const BatchOp& op = ops[i];
+        // 最后一个操作直接写到输出，其余写到临时文件
+        QString target = (i == ops.size() - 1) ? outPath : outPath + QString(".part%1").arg(i);
+        bool ok = false;
+        if (op.name == "equalize") {
+            ok = processor.equalize(current, target);
+        } else if (op.name == "segment") {
+            ok = processor.segment(current, target, op.intParam("K", 1), 100, quint32(op.intParam("seed", 1)));
+        } else if (op.name == "sharpen") {
+            ok = processor.sharpen(current, target);
+        } else if (op.name == "clahe") {
+            ClaheOptions options;
+            options.tileSize = op.intParam("tile", 64);
+            options.clipLimit = op.doubleParam("clip", 2.0);
+            ok = processor.clahe(current, target, options);
+        } else if (op.name == "median") {
+            MedianOptions options;
+            options.radius = op.intParam("r", 2);
+            ok = processor.median(current, target, options);
+        } else if (op.name == "bilateral") {
+            BilateralOptions options;
+            options.radius = op.intParam("r", 4);
+            options.rangeSigma = op.doubleParam("range", 30);
+            ok = processor.bilateral(current, target, options);
+        }
+        if (current != inPath) {
+            QFile::remove(current);
+        }
+        if (!ok) {
+            QFile::remove(target);
+            return false;
+        }
+        current = target;
+    }
+    return true;
+}
+
+qint64 BatchRunner::estimateMemory(const QString& filePath, qint64 fileSize, const QVector<BatchOp>& ops) {
+    // 像素数据一份，锐化/分割的临时缓冲约再一份
+    const qint64 bytes = fileSize * 2;
+    const bool denoise = std::any_of(ops.begin(), ops.end(), [](const BatchOp& op) {
+        return op.name == "median" || op.name == "bilateral";
+    });
+    if (!denoise) {
+        return bytes;
+    }
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)
+        || file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader)) != qint64(sizeof(fileHeader))
+        || file.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader)) != qint64(sizeof(infoHeader))
+        || infoHeader.width <= 0) {
+        return bytes;
+    }
+    const int width = infoHeader.width;
+    const int channels = std::max(1, infoHeader.bitsPerPixel / 8);
+    qint64 scratch = 0;
+    for (const BatchOp& op : ops) {
+        if (op.name == "median") {
+            scratch = std::max(scratch, Denoise::medianScratchBytes(width, channels));
+        } else if (op.name == "bilateral") {
+            BilateralOptions options;
+            options.radius = op.intParam("r", 4);
+            options.rangeSigma = op.doubleParam("range", 30);
+            scratch = std::max(scratch, Denoise::bilateralScratchBytes(width, options));
+        }
+    }
+    // 去噪的每个线程各有一份工作内存
+    return bytes + scratch * parallelThreadCount();
+}
+
+BatchStats BatchRunner::run(const QString& inputDir, const QString& outputDir) {
+    BatchStats stats;
+
+    QDir in(inputDir);
+    const QFileInfoList files = in.entryInfoList(QStringList() << "*.bmp" << "*.BMP",
+                                                 QDir::Files, QDir::Name);
+    QDir().mkpath(outputDir);
+    QDir out(outputDir);
+
+    const int fileCount = files.size();
+    int workers = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+    workers = std::max(1, std::min(workers, fileCount));
+
+    MemoryGate gate(memoryBudget);
+    std::atomic<int> next(0);
+    std::atomic<int> processed(0), failed(0);
+    std::atomic<qint64> bytesIn(0), bytesOut(0);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto record = [&](bool ok, const QFileInfo& info, const QString& outPath) {
+        if (ok) {
+            ++processed;
+            bytesIn += info.size();
+            bytesOut += QFileInfo(outPath).size();
+        } else {
+            ++failed;
+            qDebug() << "Batch: failed to process" << info.absoluteFilePath();
+        }
+    };
+
+    auto worker = [&]() {
+        // 上一个文件在后台写出，与下一个文件的加载和处理重叠；写完后才归还其内存预算
+        std::future<bool> pendingSave;
+        int pendingIndex = -1;
+        qint64 pendingReserved = 0;
+        auto finishPending = [&]() {
+            if (pendingIndex < 0) {
+                return;
+            }
+            const QFileInfo& info = files[pendingIndex];
+            record(pendingSave.get(), info, out.filePath(info.fileName()));
+            gate.release(pendingReserved);
+            pendingIndex = -1;
+        };
+
+        for (int i = next++; i < fileCount; i = next++) {
+            const QFileInfo& info = files[i];
+            QString outPath = out.filePath(info.fileName());
+            if (streaming) {
+                // 流式模式下每个工作线程平分内存预算
+                record(applyOpsStreaming(info.absoluteFilePath(), outPath, ops, memoryBudget / workers),
+                       info, outPath);
+                continue;
+            }
+
+            // 预算不足时先等上一个文件写完并归还其预算，再阻塞等待：
+            // 持有预算时等待，单个线程会等自己，多个线程会互相等待
+            const qint64 needed = estimateMemory(info.absoluteFilePath(), info.size(), ops);
+            qint64 reserved = gate.tryAcquire(needed);
+            if (reserved < 0) {
+                finishPending();
+                reserved = gate.acquire(needed);
+            }
+            MyQImage image;
+            bool ok = image.load(info.absoluteFilePath()) && applyOps(image, ops);
+            finishPending();
+            if (!ok) {
+                gate.release(reserved);
+                record(false, info, outPath);
+                continue;
+            }
+            pendingSave = image.saveAsync(outPath);
+            pendingIndex = i;
+            pendingReserved = reserved;
+        }
+        finishPending();
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < workers; ++t) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+
+    stats.seconds = timer.nsecsElapsed() / 1e9;
+    stats.processed = processed;
+    stats.failed = failed;
+    stats.bytesIn = bytesIn;
+    stats.bytesOut = bytesOut;
+    return stats;
+}
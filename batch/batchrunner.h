@@ -0,0 +1,76 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QMap>
+#include "../myqimage.h"
+
+// 批处理中的单个操作，例如 "segment:K=6" 解析为 name="segment", params={K:6}
+struct BatchOp {
+    QString name;
+    QMap<QString, QString> params;
+
+    int intParam(const QString& key, int defaultValue) const;
+    double doubleParam(const QString& key, double defaultValue) const;
+};
+
+// 批处理的统计结果
+struct BatchStats {
+    int processed = 0;   // 成功处理的图像数
+    int failed = 0;      // 失败的图像数
+    qint64 bytesIn = 0;  // 读取的字节数
+    qint64 bytesOut = 0; // 写出的字节数
+    double seconds = 0;  // 总耗时（秒）
+
+    double imagesPerSecond() const { return seconds > 0 ? processed / seconds : 0; }
+    double megabytesPerSecond() const { return seconds > 0 ? bytesIn / (1024.0 * 1024.0) / seconds : 0; }
+};
+
+// 不依赖界面的批处理器：对目录中的每个 BMP 依次执行操作链，
+// 文件分配到有界的工作线程池中执行，并受固定内存预算约束
+class BatchRunner {
+public:
+    BatchRunner();
+
+    // 解析操作链，例如 "equalize,segment:K=6,sharpen"，失败时 error 给出原因
+    static bool parseOps(const QString& chain, QVector<BatchOp>& ops, QString* error = nullptr);
+
+    // 对单幅图像执行操作链，任一操作失败时返回 false
+    static bool applyOps(MyQImage& image, const QVector<BatchOp>& ops);
+
+    // 操作链能否流式执行（流式分割不支持 engine=histogram），不能时 error 给出原因
+    static bool supportsStreaming(const QVector<BatchOp>& ops, QString* error = nullptr);
+
+    void setOps(const QVector<BatchOp>& ops) { this->ops = ops; }
+
+    // 工作线程数，<=0 时使用 CPU 核数
+    void setThreadCount(int count) { threadCount = count; }
+
+    // 同时在处理中的图像所占内存上限（字节）。每个工作线程除正在处理的文件外，
+    // 还可能有一个上一个文件在后台写出，两者都计入预算；预算不足时先等写出完成
+    void setMemoryBudget(qint64 bytes) { memoryBudget = bytes; }
+
+    // 流式模式：按条带处理，不将整幅图像载入内存，适合大于内存的图像
+    void setStreaming(bool enabled) { streaming = enabled; }
+
+    // 处理 inputDir 中的所有 BMP，结果写入 outputDir（同名文件）
+    BatchStats run(const QString& inputDir, const QString& outputDir);
+
+    // 估算处理一个文件所需的内存（像素数据及算法的临时缓冲）。
+    // 操作链含去噪时从文件头读取宽度，计入每个并行条带的直方图或双边网格
+    static qint64 estimateMemory(const QString& filePath, qint64 fileSize, const QVector<BatchOp>& ops);
+
+    // 以流式方式对单个文件执行操作链，中间结果写入临时文件
+    static bool applyOpsStreaming(const QString& inPath, const QString& outPath,
+                                  const QVector<BatchOp>& ops, qint64 memoryBudget);
+
+private:
+    QVector<BatchOp> ops;
+    int threadCount = 0;
+    qint64 memoryBudget = qint64(1024) * 1024 * 1024;
+    bool streaming = false;
+};
+
+#endif // BATCHRUNNER_H
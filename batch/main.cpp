@@ -0,0 +1,92 @@
+#include "batchrunner.h"
+#include "../bufferpool.h"
+#include "../trace.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("myqimage-batch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Run a MyQImage operation chain over every BMP in a directory.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("ops", "Operation chain, e.g. equalize,segment:K=6,sharpen");
+    parser.addPositionalArgument("input", "Input directory");
+    parser.addPositionalArgument("output", "Output directory");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Number of worker threads (default: all cores).", "n");
+    QCommandLineOption memoryOption(QStringList() << "m" << "memory-mb",
+                                    "Memory budget for images in flight, in MB (default: 1024).", "mb");
+    QCommandLineOption streamOption(QStringList() << "s" << "stream",
+                                    "Process images in strips without loading them fully (for rasters larger than RAM).");
+    parser.addOption(threadsOption);
+    parser.addOption(memoryOption);
+    QCommandLineOption hugePagesOption(QStringList() << "H" << "huge-pages",
+                                       "Back large pixel buffers with huge pages where the OS supports it.");
+    parser.addOption(streamOption);
+    parser.addOption(hugePagesOption);
+#ifdef MYQIMAGE_TRACE
+    QCommandLineOption traceOption(QStringList() << "t" << "trace",
+                                   "Record a Chrome trace (chrome://tracing, ui.perfetto.dev) to this file.", "file");
+    parser.addOption(traceOption);
+#endif
+    parser.process(a);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 3) {
+        parser.showHelp(1);
+    }
+
+    QVector<BatchOp> ops;
+    QString error;
+    if (!BatchRunner::parseOps(args[0], ops, &error)) {
+        err << "Error: " << error << Qt::endl;
+        return 1;
+    }
+
+    BatchRunner runner;
+    runner.setOps(ops);
+    if (parser.isSet(threadsOption)) {
+        runner.setThreadCount(parser.value(threadsOption).toInt());
+    }
+    if (parser.isSet(memoryOption)) {
+        runner.setMemoryBudget(parser.value(memoryOption).toLongLong() * 1024 * 1024);
+    }
+
+    if (parser.isSet(streamOption) && !BatchRunner::supportsStreaming(ops, &error)) {
+        err << "Error: " << error << Qt::endl;
+        return 1;
+    }
+    runner.setStreaming(parser.isSet(streamOption));
+    BufferPool::instance().setHugePages(parser.isSet(hugePagesOption));
+
+#ifdef MYQIMAGE_TRACE
+    Trace::setEnabled(parser.isSet(traceOption));
+#endif
+
+    BatchStats stats = runner.run(args[1], args[2]);
+
+#ifdef MYQIMAGE_TRACE
+    if (parser.isSet(traceOption) && !Trace::writeChromeJson(parser.value(traceOption))) {
+        err << "Error: cannot write trace " << parser.value(traceOption) << Qt::endl;
+    }
+#endif
+
+    out << "Processed " << stats.processed << " images (" << stats.failed << " failed) in "
+        << QString::number(stats.seconds, 'f', 2) << " s" << Qt::endl;
+    out << "Throughput: " << QString::number(stats.imagesPerSecond(), 'f', 2) << " images/sec, "
+        << QString::number(stats.megabytesPerSecond(), 'f', 2) << " MB/sec" << Qt::endl;
+    const BufferPool::Stats pool = BufferPool::instance().stats();
+    out << "Buffer pool: peak " << QString::number(pool.peakBytes / (1024.0 * 1024.0), 'f', 1) << " MB, "
+        << pool.reusedAllocations << " of " << (pool.reusedAllocations + pool.systemAllocations)
+        << " allocations reused" << Qt::endl;
+    return stats.failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,449 @@
+#include "benchmark.h"
+#include "../bmpstream.h"
+#include "../bmpheader.h"
+#include "../bufferpool.h"
+#include "../histogram.h"
+#include "../convolution.h"
+#include "../pipeline.h"
+#include "../planar.h"
+#include "../colorconvert.h"
+#include "../clahe.h"
+#include "../segmentationsession.h"
+#include "../simd.h"
+#include <QDir>
+#include <QLabel>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// ---------------- 分配计数 ----------------
+// 替换全局 operator new/delete，只计数不改变行为；数组与带大小的形式默认转发到这里
+
+namespace {
+std::atomic<qint64> newCalls{0};
+}
+
+void* operator new(std::size_t size) {
+    newCalls.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// 微基准的图像边长：三通道 512x512 约 768KB，可留在 L2/L3 中
+const int kMicroSize = 512;
+// 微基准每项至少运行的时间
+const double kMicroSeconds = 0.2;
+
+// 每行独立播种的 xorshift，生成结果与行的生成顺序无关
+quint32 rowSeed(quint32 seed, int y) {
+    quint32 s = seed * 0x9E3779B9u ^ quint32(y + 1) * 0x85EBCA6Bu;
+    return s ? s : 1;
+}
+
+inline quint32 nextRandom(quint32& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void fillRow(unsigned char* row, int width, int height, int y, SyntheticPattern pattern, quint32 seed,
+             const std::vector<float>& columnWave) {
+    quint32 state = rowSeed(seed, y);
+    if (pattern == SyntheticPattern::Noise) {
+        for (int i = 0; i < width * 3; ++i) {
+            row[i] = static_cast<unsigned char>(nextRandom(state) >> 24);
+        }
+        return;
+    }
+    // 蓝色沿水平、绿色沿垂直方向渐变，红色为低频起伏，再叠加 ±6 的噪声
+    const float rowWave = std::cos(float(y) * 6.2831853f * 4 / std::max(1, height));
+    for (int x = 0; x < width; ++x) {
+        int noise = int(nextRandom(state) % 13) - 6;
+        int b = int(qint64(x) * 255 / std::max(1, width - 1)) + noise;
+        int g = int(qint64(y) * 255 / std::max(1, height - 1)) - noise;
+        int r = 128 + int(96 * columnWave[x] * rowWave) + noise;
+        row[x * 3] = static_cast<unsigned char>(std::min(255, std::max(0, b)));
+        row[x * 3 + 1] = static_cast<unsigned char>(std::min(255, std::max(0, g)));
+        row[x * 3 + 2] = static_cast<unsigned char>(std::min(255, std::max(0, r)));
+    }
+}
+
+std::vector<float> makeColumnWave(int width) {
+    std::vector<float> wave(width);
+    for (int x = 0; x < width; ++x) {
+        wave[x] = std::sin(float(x) * 6.2831853f * 5 / std::max(1, width));
+    }
+    return wave;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+}
+
+// ---------------- BenchmarkResult ----------------
+
+QJsonObject BenchmarkResult::toJson() const {
+    QJsonObject object;
+    object["operation"] = operation;
+    object["pattern"] = pattern;
+    object["width"] = width;
+    object["height"] = height;
+    object["megapixels"] = pixels() / 1e6;
+    object["repetitions"] = repetitions;
+    object["min_seconds"] = minSeconds;
+    object["median_seconds"] = medianSeconds;
+    object["ns_per_pixel"] = nsPerPixel();
+    object["gb_per_second"] = gigabytesPerSecond();
+    object["heap_allocations"] = double(heapAllocations);
+    object["pool_system_allocations"] = double(poolSystemAllocations);
+    object["pool_reused_allocations"] = double(poolReusedAllocations);
+    return object;
+}
+
+// ---------------- Benchmark ----------------
+
+Benchmark::Benchmark() : kValues{2, 4, 8, 16}, workDirectory(QDir::tempPath()) {}
+
+QSize Benchmark::sizeForMegapixels(double megapixels) {
+    double pixels = megapixels * 1e6;
+    int width = std::max(1, int(std::lround(std::sqrt(pixels * 4 / 3))));
+    int height = std::max(1, int(std::lround(pixels / width)));
+    return QSize(width, height);
+}
+
+QString Benchmark::patternName(SyntheticPattern pattern) {
+    return pattern == SyntheticPattern::Noise ? "noise" : "gradient";
+}
+
+qint64 Benchmark::heapAllocations() {
+    return newCalls.load(std::memory_order_relaxed);
+}
+
+bool Benchmark::writeSynthetic(const QString& filePath, int width, int height, SyntheticPattern pattern,
+                               quint32 seed) {
+    BmpStripWriter writer;
+    if (!writer.open(filePath, width, height)) {
+        return false;
+    }
+    const qint64 rowSize = bmpRowSize(width);
+    const int stripRows = int(std::max<qint64>(1, (qint64(8) << 20) / rowSize));
+    PooledBuffer strip(rowSize * stripRows, true);
+    const std::vector<float> columnWave = makeColumnWave(width);
+    for (int y0 = 0; y0 < height; y0 += stripRows) {
+        int rows = std::min(stripRows, height - y0);
+        for (int y = 0; y < rows; ++y) {
+            fillRow(strip.data() + y * rowSize, width, height, y0 + y, pattern, seed, columnWave);
+        }
+        if (!writer.writeRows(strip.data(), rows)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+void Benchmark::measure(const QString& operation, const QString& pattern, int width, int height,
+                        qint64 bytes, const std::function<void()>& setup,
+                        const std::function<void()>& body, int count, int loops) {
+    BenchmarkResult result;
+    result.operation = operation;
+    result.pattern = pattern;
+    result.width = width;
+    result.height = height;
+    result.bytes = bytes;
+    result.repetitions = count;
+
+    std::vector<double> seconds, heap, poolSystem, poolReused;
+    for (int r = 0; r < count; ++r) {
+        if (setup) {
+            setup();
+        }
+        const BufferPool::Stats before = BufferPool::instance().stats();
+        const qint64 allocationsBefore = heapAllocations();
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < loops; ++i) {
+            body();
+        }
+        seconds.push_back(timer.nsecsElapsed() / 1e9 / loops);
+        const BufferPool::Stats after = BufferPool::instance().stats();
+        heap.push_back(double(heapAllocations() - allocationsBefore) / loops);
+        poolSystem.push_back(double(after.systemAllocations - before.systemAllocations) / loops);
+        poolReused.push_back(double(after.reusedAllocations - before.reusedAllocations) / loops);
+    }
+    result.minSeconds = *std::min_element(seconds.begin(), seconds.end());
+    result.medianSeconds = median(seconds);
+    result.heapAllocations = std::llround(median(heap));
+    result.poolSystemAllocations = std::llround(median(poolSystem));
+    result.poolReusedAllocations = std::llround(median(poolReused));
+    report(result);
+}
+
+void Benchmark::report(const BenchmarkResult& result) {
+    collected.append(result);
+    QTextStream err(stderr);
+    err << QString("%1 %2 %3x%4: %5 ms, %6 ns/px, %7 GB/s, %8 allocs")
+               .arg(result.operation, -24)
+               .arg(result.pattern, -8)
+               .arg(result.width)
+               .arg(result.height)
+               .arg(result.minSeconds * 1e3, 0, 'f', 2)
+               .arg(result.nsPerPixel(), 0, 'f', 2)
+               .arg(result.gigabytesPerSecond(), 0, 'f', 2)
+               .arg(result.heapAllocations + result.poolSystemAllocations)
+        << Qt::endl;
+}
+
+bool Benchmark::runImage(double megapixels, SyntheticPattern pattern) {
+    const QSize size = sizeForMegapixels(megapixels);
+    const int width = size.width();
+    const int height = size.height();
+    const QString name = patternName(pattern);
+    const QString inputPath = QDir(workDirectory).filePath(QString("bench-%1-%2x%3.bmp").arg(name).arg(width).arg(height));
+    const QString outputPath = QDir(workDirectory).filePath("bench-save.bmp");
+    const qint64 bytes = bmpRowSize(width) * height;
+
+    if (!QFile::exists(inputPath) && !writeSynthetic(inputPath, width, height, pattern)) {
+        return false;
+    }
+
+    MyQImage base;
+    measure("load", name, width, height, bytes, nullptr, [&]() { base.load(inputPath); }, repetitions);
+    if (!base.getPixels()) {
+        return false;
+    }
+    {
+        MyQImage mapped;
+        measure("load_mapped", name, width, height, bytes, nullptr,
+                [&]() { mapped.load(inputPath, MyQImage::LoadMapped); }, repetitions);
+    }
+    measure("save", name, width, height, bytes, nullptr, [&]() { base.save(outputPath); }, repetitions);
+    QFile::remove(outputPath);
+
+    // 每次重复前复制出独占的像素，复制本身不计入操作时间
+    MyQImage work;
+    auto fresh = [&]() {
+        work = base;
+        work.getMutablePixels();
+    };
+
+    measure("equalize", name, width, height, bytes, fresh, [&]() { work.HistogramEqualization(); }, repetitions);
+    measure("sharpen", name, width, height, bytes, fresh, [&]() { work.sharpen(); }, repetitions);
+    // 去噪：半径从 1 到 15 的代价应基本相同
+    for (int radius : {1, 5, 15}) {
+        measure(QString("median_r%1").arg(radius), name, width, height, bytes, fresh,
+                [&]() { work.medianFilter(radius); }, repetitions);
+        measure(QString("bilateral_r%1").arg(radius), name, width, height, bytes, fresh,
+                [&]() { work.bilateralFilter(radius); }, repetitions);
+    }
+    for (int k : kValues) {
+        auto setup = [&, k]() {
+            fresh();
+            work.changeK(k);
+            work.setSegmentationEngine(engine);
+        };
+        measure(QString("segment_k%1").arg(k), name, width, height, bytes, setup,
+                [&]() { work.segmentImage(); }, repetitions);
+    }
+    // 热启动：会话中已缓存 K-1 的结果，分裂一个簇作为初始中心
+    for (int k : kValues) {
+        if (k < 2) {
+            continue;
+        }
+        SegmentationSession session;
+        auto setup = [&, k]() {
+            fresh();
+            work.setSegmentationEngine(engine);
+            session.clear();
+            work.changeK(k - 1);
+            session.segmentImage(work);
+            fresh();
+            work.changeK(k);
+        };
+        measure(QString("segment_warm_k%1").arg(k), name, width, height, bytes, setup,
+                [&]() { session.segmentImage(work); }, repetitions);
+    }
+    // 扫描 [最小 K, 最大 K] 的簇内平方误差曲线，多个 K 并行计算
+    if (!kValues.isEmpty()) {
+        const int minK = *std::min_element(kValues.begin(), kValues.end());
+        const int maxK = *std::max_element(kValues.begin(), kValues.end());
+        SegmentationSession session;
+        KMeansOptions options;
+        options.engine = engine;
+        auto setup = [&]() {
+            fresh();
+            session.clear();
+            session.setSource(work);
+        };
+        measure(QString("segment_sweep_k%1_%2").arg(minK).arg(maxK), name, width, height, bytes, setup,
+                [&]() { session.sweep(minK, maxK, options); }, repetitions);
+    }
+
+    // 连通区域：在最大 K 的分割簇号上标记区域并统计，平均颜色取自原图
+    if (!kValues.isEmpty()) {
+        MyQImage segmented = base;
+        segmented.changeK(*std::max_element(kValues.begin(), kValues.end()));
+        segmented.setSegmentationEngine(engine);
+        segmented.setKeepSegmentLabels(true);
+        segmented.segmentImage();
+        measure("components", name, width, height, bytes, nullptr,
+                [&]() { segmented.findRegions(ComponentOptions(), &base); }, repetitions);
+    }
+
+    // 显示：首次绘制需构建金字塔，之后的绘制复用缓存
+    QLabel label;
+    label.resize(800, 600);
+    measure("draw_to_label", name, width, height, bytes, fresh, [&]() { work.drawToLabel(&label); }, repetitions);
+    measure("draw_to_label_cached", name, width, height, bytes, nullptr,
+            [&]() { work.drawToLabel(&label); }, repetitions);
+    return true;
+}
+
+void Benchmark::runMicro() {
+    const int width = kMicroSize;
+    const int height = kMicroSize;
+    const qint64 rowSize = bmpRowSize(width);
+    const qint64 bytes = rowSize * height;
+    PooledBuffer source(bytes, true);
+    PooledBuffer target(bytes, true);
+    const std::vector<float> columnWave = makeColumnWave(width);
+    for (int y = 0; y < height; ++y) {
+        fillRow(source.data() + y * rowSize, width, height, y, SyntheticPattern::Gradient, 1, columnWave);
+    }
+
+    BgrHistogram hist;
+    accumulateBgrHistogram(source.data(), width, height, rowSize, hist);
+    BgrLut lut;
+    buildEqualizationLut(hist, lut);
+    ConvolutionOptions single;
+    single.threads = 1;
+    ImagePipeline pipeline;
+    pipeline.equalize().sharpen();
+    pipeline.setThreads(1);
+    PlanarBuffer planes(width, height);
+    planes.fromInterleaved(source.data(), rowSize, 1);
+    // 颜色空间转换的输出与逆转换的输入，不影响 planes 中供平面内核使用的数据
+    PlanarBuffer colorPlanes(width, height);
+    ClaheOptions clahe;
+    clahe.threads = 1;
+    auto toPlanes = [&](ColorSpace space) {
+        ColorConvert::bgrToPlanes(space, source.data(), rowSize, width, height, colorPlanes.plane(0),
+                                  colorPlanes.plane(1), colorPlanes.plane(2), colorPlanes.getStride(), 1);
+    };
+    auto fromPlanes = [&](ColorSpace space) {
+        ColorConvert::planesToBgr(space, colorPlanes.plane(0), colorPlanes.plane(1), colorPlanes.plane(2),
+                                  colorPlanes.getStride(), width, height, target.data(), rowSize, 1);
+    };
+
+    struct Kernel {
+        const char* name;
+        std::function<void()> body;
+    };
+    const QVector<Kernel> kernels = {
+        {"histogram", [&]() {
+             BgrHistogram h;
+             accumulateBgrHistogram(source.data(), width, height, rowSize, h);
+         }},
+        {"lut", [&]() { applyBgrLut(target.data(), width, height, rowSize, lut); }},
+        {"deinterleave", [&]() { planes.fromInterleaved(source.data(), rowSize, 1); }},
+        {"interleave", [&]() { planes.toInterleaved(target.data(), rowSize, 1); }},
+        {"histogram_planar", [&]() {
+             BgrHistogram h;
+             qint64* counts[3] = {h.b, h.g, h.r};
+             for (int c = 0; c < 3; ++c) {
+                 accumulatePlaneHistogram(planes.plane(c), width, height, planes.getStride(), counts[c]);
+             }
+         }},
+        {"lut_planar", [&]() {
+             const unsigned char* tables[3] = {lut.b, lut.g, lut.r};
+             for (int c = 0; c < 3; ++c) {
+                 applyPlaneLut(planes.plane(c), width, height, planes.getStride(), tables[c]);
+             }
+         }},
+        {"convolve_sharpen", [&]() {
+             Convolution::apply(source.data(), target.data(), width, height, rowSize, 3,
+                                ConvolutionKernel::sharpen(), single);
+         }},
+        {"convolve_gaussian5", [&]() {
+             Convolution::apply(source.data(), target.data(), width, height, rowSize, 3,
+                                ConvolutionKernel::gaussian(2, 0), single);
+         }},
+        {"pipeline_equalize_sharpen", [&]() {
+             pipeline.run(source.data(), target.data(), width, height, rowSize);
+         }},
+        {"bgr_to_gray", [&]() {
+             ColorConvert::bgrToGray(source.data(), rowSize, width, height, colorPlanes.plane(0),
+                                     colorPlanes.getStride(), 1);
+         }},
+        {"bgr_to_hsv", [&]() { toPlanes(ColorSpace::Hsv); }},
+        {"hsv_to_bgr", [&]() { fromPlanes(ColorSpace::Hsv); }},
+        {"bgr_to_ycbcr", [&]() { toPlanes(ColorSpace::YCbCr); }},
+        {"bgr_to_lab", [&]() { toPlanes(ColorSpace::Lab); }},
+        {"lab_to_bgr", [&]() { fromPlanes(ColorSpace::Lab); }},
+        // 原地处理 target，每次的输入是上一次的结果，耗时与内容基本无关
+        {"clahe", [&]() { Clahe::apply(target.data(), width, height, rowSize, 3, 3, clahe); }},
+    };
+
+    const bool simdAvailable = simdAvx2Enabled();
+    for (int simd = simdAvailable ? 1 : 0; simd >= 0; --simd) {
+        setSimdEnabled(simd);
+        for (const Kernel& kernel : kernels) {
+            // 先估计单次耗时，再确定每次计时内的循环次数
+            QElapsedTimer probe;
+            probe.start();
+            kernel.body();
+            const double once = std::max(1e-7, probe.nsecsElapsed() / 1e9);
+            const int loops = std::max(1, int(kMicroSeconds / repetitions / once));
+            measure(QString("micro_%1_%2").arg(kernel.name, simd ? "avx2" : "scalar"), "gradient",
+                    width, height, bytes, nullptr, kernel.body, repetitions, loops);
+        }
+    }
+    setSimdEnabled(true);
+}
+
+QJsonDocument Benchmark::toJson() const {
+    QJsonObject environment;
+    environment["cpu_architecture"] = QSysInfo::currentCpuArchitecture();
+    environment["kernel"] = QSysInfo::kernelType() + " " + QSysInfo::kernelVersion();
+    environment["threads"] = QThread::idealThreadCount();
+    environment["avx2"] = simdAvx2Enabled();
+    environment["qt_version"] = QString(qVersion());
+
+    QJsonArray array;
+    for (const BenchmarkResult& result : collected) {
+        array.append(result.toJson());
+    }
+
+    QJsonObject root;
+    root["schema"] = 1;
+    root["label"] = label;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["environment"] = environment;
+    root["results"] = array;
+    return QJsonDocument(root);
+}
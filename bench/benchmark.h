@@ -0,0 +1,90 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QVector>
+#include <QSize>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <functional>
+#include "../myqimage.h"
+
+// 合成测试图像的内容
+enum class SyntheticPattern {
+    Noise,     // 均匀随机噪声：直方图平坦，分割与压缩的最坏情况
+    Gradient   // 平滑渐变叠加低幅噪声，接近自然图像的统计特性
+};
+
+// 一项测量的结果；分配次数与时间一样按每次重复换算为单次操作，取各次重复的中位数
+struct BenchmarkResult {
+    QString operation;
+    QString pattern;
+    int width = 0;
+    int height = 0;
+    int repetitions = 0;
+    double minSeconds = 0;
+    double medianSeconds = 0;
+    qint64 bytes = 0;                  // 每次操作处理的像素数据字节数，用于计算 GB/s
+    qint64 heapAllocations = 0;        // operator new 的调用次数
+    qint64 poolSystemAllocations = 0;  // BufferPool 向系统申请的次数
+    qint64 poolReusedAllocations = 0;  // BufferPool 由缓存满足的次数
+
+    qint64 pixels() const { return qint64(width) * height; }
+    double nsPerPixel() const { return pixels() > 0 ? minSeconds * 1e9 / pixels() : 0; }
+    double gigabytesPerSecond() const { return minSeconds > 0 ? bytes / minSeconds / 1e9 : 0; }
+    QJsonObject toJson() const;
+};
+
+// MyQImage 各操作的基准测试：宏基准对整幅合成图像计时 load/save/均衡化/分割/锐化/显示，
+// 微基准在缓存可容纳的小图上反复执行直方图、查找表、卷积等内核，分别测 SIMD 与标量路径
+class Benchmark {
+public:
+    Benchmark();
+
+    // 按 4:3 的宽高比取约 megapixels 百万像素的尺寸
+    static QSize sizeForMegapixels(double megapixels);
+
+    // 逐条带写出确定性的合成 24 位 BMP，相同参数得到逐字节相同的文件
+    static bool writeSynthetic(const QString& filePath, int width, int height, SyntheticPattern pattern,
+                               quint32 seed = 1);
+
+    static QString patternName(SyntheticPattern pattern);
+
+    // 进程启动以来 operator new 的调用次数
+    static qint64 heapAllocations();
+
+    void setRepetitions(int count) { repetitions = qMax(1, count); }
+    void setKValues(const QVector<int>& values) { kValues = values; }
+    void setSegmentationEngine(KMeansEngine engine) { this->engine = engine; }
+    // 合成图像与 save 的输出放在该目录
+    void setWorkDirectory(const QString& path) { workDirectory = path; }
+    // 结果中附带的标签（如提交号），便于跨提交比较
+    void setLabel(const QString& text) { label = text; }
+
+    // 宏基准：生成 megapixels 百万像素的合成图像并测量各操作
+    bool runImage(double megapixels, SyntheticPattern pattern);
+
+    // 微基准
+    void runMicro();
+
+    const QVector<BenchmarkResult>& results() const { return collected; }
+
+    // 全部结果及运行环境（CPU、线程数、SIMD）
+    QJsonDocument toJson() const;
+
+private:
+    // 每次重复先执行 setup（不计时），再对连续执行 loops 次的 body 计时，结果按单次换算
+    void measure(const QString& operation, const QString& pattern, int width, int height, qint64 bytes,
+                 const std::function<void()>& setup, const std::function<void()>& body,
+                 int count, int loops = 1);
+    void report(const BenchmarkResult& result);
+
+    int repetitions = 3;
+    QVector<int> kValues;
+    KMeansEngine engine = KMeansEngine::Pixels;
+    QString workDirectory;
+    QString label;
+    QVector<BenchmarkResult> collected;
+};
+
+#endif // BENCHMARK_H
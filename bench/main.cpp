@@ -0,0 +1,127 @@
+#include "benchmark.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+
+int main(int argc, char *argv[])
+{
+    // drawToLabel 需要 QLabel；未指定平台插件时使用离屏平台，无需显示器
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    QApplication::setApplicationName("myqimage-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark every MyQImage operation on deterministic synthetic images "
+                                     "and print the results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption(QStringList() << "s" << "sizes",
+                                   "Comma-separated image sizes in megapixels (default: 0.25,1,4,16,64,200).", "mp");
+    QCommandLineOption patternsOption(QStringList() << "p" << "patterns",
+                                      "Comma-separated patterns: noise, gradient (default: both).", "list");
+    QCommandLineOption kOption(QStringList() << "k" << "k-values",
+                               "Comma-separated K values for segmentation (default: 2,4,8,16).", "list");
+    QCommandLineOption engineOption(QStringList() << "e" << "engine",
+                                    "Segmentation engine: pixels or histogram (default: pixels).", "name");
+    QCommandLineOption repetitionsOption(QStringList() << "r" << "repetitions",
+                                         "Timed repetitions per measurement; the minimum is reported (default: 3).", "n");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write the JSON report to this file instead of stdout.", "file");
+    QCommandLineOption workOption(QStringList() << "w" << "work-dir",
+                                  "Directory for the synthetic images; reused across runs when given.", "dir");
+    QCommandLineOption labelOption(QStringList() << "l" << "label",
+                                   "Label stored in the report, e.g. the commit being measured.", "text");
+    QCommandLineOption microOnlyOption("micro-only", "Run only the in-cache kernel micro-benchmarks.");
+    QCommandLineOption noMicroOption("no-micro", "Skip the kernel micro-benchmarks.");
+    parser.addOption(sizesOption);
+    parser.addOption(patternsOption);
+    parser.addOption(kOption);
+    parser.addOption(engineOption);
+    parser.addOption(repetitionsOption);
+    parser.addOption(outputOption);
+    parser.addOption(workOption);
+    parser.addOption(labelOption);
+    parser.addOption(microOnlyOption);
+    parser.addOption(noMicroOption);
+    parser.process(a);
+
+    QTextStream err(stderr);
+
+    QVector<double> sizes = {0.25, 1, 4, 16, 64, 200};
+    if (parser.isSet(sizesOption)) {
+        sizes.clear();
+        for (const QString& item : parser.value(sizesOption).split(',', Qt::SkipEmptyParts)) {
+            sizes.append(item.toDouble());
+        }
+    }
+    QVector<SyntheticPattern> patterns = {SyntheticPattern::Noise, SyntheticPattern::Gradient};
+    if (parser.isSet(patternsOption)) {
+        patterns.clear();
+        for (const QString& item : parser.value(patternsOption).split(',', Qt::SkipEmptyParts)) {
+            if (item == "noise") {
+                patterns.append(SyntheticPattern::Noise);
+            } else if (item == "gradient") {
+                patterns.append(SyntheticPattern::Gradient);
+            } else {
+                err << "Error: unknown pattern " << item << Qt::endl;
+                return 1;
+            }
+        }
+    }
+
+    Benchmark benchmark;
+    if (parser.isSet(kOption)) {
+        QVector<int> kValues;
+        for (const QString& item : parser.value(kOption).split(',', Qt::SkipEmptyParts)) {
+            kValues.append(item.toInt());
+        }
+        benchmark.setKValues(kValues);
+    }
+    if (parser.value(engineOption) == "histogram") {
+        benchmark.setSegmentationEngine(KMeansEngine::ColorHistogram);
+    }
+    if (parser.isSet(repetitionsOption)) {
+        benchmark.setRepetitions(parser.value(repetitionsOption).toInt());
+    }
+    benchmark.setLabel(parser.value(labelOption));
+
+    // 未指定目录时合成图像放在临时目录，结束时删除
+    QTemporaryDir temporary;
+    benchmark.setWorkDirectory(parser.isSet(workOption) ? parser.value(workOption) : temporary.path());
+    if (parser.isSet(workOption)) {
+        QDir().mkpath(parser.value(workOption));
+    }
+
+    if (!parser.isSet(noMicroOption)) {
+        benchmark.runMicro();
+    }
+    if (!parser.isSet(microOnlyOption)) {
+        for (double megapixels : sizes) {
+            for (SyntheticPattern pattern : patterns) {
+                if (!benchmark.runImage(megapixels, pattern)) {
+                    err << "Error: failed to benchmark " << Benchmark::patternName(pattern) << " image of "
+                        << megapixels << " MP" << Qt::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    const QByteArray json = benchmark.toJson().toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            err << "Error: cannot write " << parser.value(outputOption) << Qt::endl;
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "bmpheader.h"
+#include <QDebug>
+#include <limits>
+
+void makeBmpHeaders(int width, int height, BMPFileHeader& fileHeader, BMPInfoHeader& infoHeader,
+                    int bitsPerPixel) {
+    const qint64 imageSize = bmpRowSize(width, bitsPerPixel) * height;
+    const uint32_t colors = bitsPerPixel == 8 ? 256 : 0;
+    fileHeader = BMPFileHeader();
+    fileHeader.offset = uint32_t(sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + colors * 4);
+    fileHeader.size = uint32_t(fileHeader.offset + imageSize);
+    infoHeader = BMPInfoHeader();
+    infoHeader.width = width;
+    infoHeader.height = height;
+    infoHeader.bitsPerPixel = uint16_t(bitsPerPixel);
+    infoHeader.imageSize = uint32_t(imageSize);
+    infoHeader.colors = colors;
+}
+
+// 校验 BMP 头部：头部大小、图像尺寸以及像素阵列是否完整位于文件之内
+bool validateBmpHeaders(const BMPFileHeader& fileHeader, const BMPInfoHeader& infoHeader, qint64 fileSize) {
+    const qint64 headersSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+    if (fileSize < headersSize || infoHeader.size < sizeof(BMPInfoHeader)) {
+        qDebug() << "Error: Truncated BMP header.";
+        return false;
+    }
+    if (infoHeader.compression != 0) {
+        qDebug() << "Error: Compressed BMP files are not supported.";
+        return false;
+    }
+    if (infoHeader.width <= 0 || infoHeader.height <= 0) {
+        qDebug() << "Error: Invalid image size" << infoHeader.width << "x" << infoHeader.height;
+        return false;
+    }
+    if (fileHeader.offset < sizeof(BMPFileHeader) + infoHeader.size) {
+        qDebug() << "Error: Pixel offset overlaps the headers:" << fileHeader.offset;
+        return false;
+    }
+    const qint64 stride = bmpRowSize(infoHeader.width, infoHeader.bitsPerPixel);
+    const qint64 dataSize = stride * infoHeader.height;
+    if (stride > std::numeric_limits<int>::max() || fileHeader.offset + dataSize > fileSize) {
+        qDebug() << "Error: Pixel data exceeds file size, offset" << fileHeader.offset
+                 << "data" << dataSize << "file" << fileSize;
+        return false;
+    }
+    return true;
+}
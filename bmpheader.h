@@ -0,0 +1,45 @@
+#ifndef BMPHEADER_H
+#define BMPHEADER_H
+
+#include <QtGlobal>
+#include <cstdint>
+
+// BMP 文件头
+#pragma pack(push, 1)
+struct BMPFileHeader {
+    uint16_t type = 0x4D42;  // 'BM' 2字节
+    uint32_t size = 0;//4字节
+    uint16_t reserved1 = 0;//2字节
+    uint16_t reserved2 = 0;//2字节
+    uint32_t offset = 54;  // 54 字节偏移，跳过文件头和信息头，4字节
+};
+
+// BMP 信息头
+struct BMPInfoHeader {
+    uint32_t size = 40;  // 头部大小 4字节
+    int32_t width = 0;   // 图像宽度 4字节
+    int32_t height = 0;  // 图像高度 4字节
+    uint16_t planes = 1; // 目标设备的平面数，始终为1 2字节
+    uint16_t bitsPerPixel = 24; // 24位图像 2字节
+    uint32_t compression = 0; // 无压缩 4字节
+    uint32_t imageSize = 0;//数据大小 4字节
+    int32_t xResolution = 0;//水平分辨率 4字节
+    int32_t yResolution = 0;//垂直分辨率 4字节
+    uint32_t colors = 0;//颜色数 4字节
+    uint32_t importantColors = 0;//重要颜色数 4字节
+};
+#pragma pack(pop)
+
+// BMP 每行的字节数（对齐到 4 字节），默认 24 位
+inline qint64 bmpRowSize(qint64 width, int bitsPerPixel = 24) {
+    return ((width * bitsPerPixel + 31) / 32) * 4;
+}
+
+// 填写 width x height 的无压缩 BMP 的文件头与信息头；8 位时像素前有 256 项的调色板
+void makeBmpHeaders(int width, int height, BMPFileHeader& fileHeader, BMPInfoHeader& infoHeader,
+                    int bitsPerPixel = 24);
+
+// 校验 BMP 头部：头部大小、图像尺寸以及像素阵列是否完整位于文件之内（行宽按 bitsPerPixel 计算）
+bool validateBmpHeaders(const BMPFileHeader& fileHeader, const BMPInfoHeader& infoHeader, qint64 fileSize);
+
+#endif // BMPHEADER_H
@@ -0,0 +1,420 @@
+#include "bmpstream.h"
+#include "bufferpool.h"
+#include "convolution.h"
+#include "histogram.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include <QDebug>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+bool BmpStripReader::open(const QString& filePath) {
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error: Cannot open file" << filePath;
+        return false;
+    }
+    file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+    file.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
+    if (fileHeader.type != 0x4D42 || infoHeader.bitsPerPixel != 24) {
+        qDebug() << "Error: Only 24-bit BMP files are supported:" << filePath;
+        file.close();
+        return false;
+    }
+    if (!validateBmpHeaders(fileHeader, infoHeader, file.size())) {
+        file.close();
+        return false;
+    }
+    rowSize = bmpRowSize(infoHeader.width);
+    return true;
+}
+
+bool BmpStripReader::readRows(int firstRow, int count, unsigned char* dst) {
+    qint64 bytes = rowSize * count;
+    if (!file.seek(fileHeader.offset + rowSize * firstRow)) {
+        return false;
+    }
+    return file.read(reinterpret_cast<char*>(dst), bytes) == bytes;
+}
+
+bool BmpStripWriter::open(const QString& filePath, int width, int height) {
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to open file for writing" << filePath;
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    rowSize = bmpRowSize(width);
+    rowsWritten = 0;
+
+    // 占位头部，大小字段在 finish() 中回写
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    return true;
+}
+
+bool BmpStripWriter::writeRows(const unsigned char* src, int count) {
+    qint64 bytes = rowSize * count;
+    if (file.write(reinterpret_cast<const char*>(src), bytes) != bytes) {
+        return false;
+    }
+    rowsWritten += count;
+    return true;
+}
+
+bool BmpStripWriter::finish() {
+    if (rowsWritten != height) {
+        qDebug() << "Error: Stream wrote" << rowsWritten << "of" << height << "rows";
+        file.cancelWriting();
+        return false;
+    }
+
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    makeBmpHeaders(width, height, fileHeader, infoHeader);
+
+    bool ok = file.seek(0)
+              && file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader)) == sizeof(fileHeader)
+              && file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader)) == sizeof(infoHeader);
+    if (!ok) {
+        file.cancelWriting();
+        return false;
+    }
+    // 重命名为目标文件
+    return file.commit();
+}
+
+StreamProcessor::StreamProcessor(qint64 memoryBudget) : memoryBudget(memoryBudget) {}
+
+int StreamProcessor::stripRows(qint64 rowSize, int buffers, int haloRows, qint64 reserved) const {
+    qint64 rows = std::max<qint64>(0, memoryBudget - reserved) / (rowSize * buffers) - 2 * haloRows;
+    return int(std::max<qint64>(1, std::min<qint64>(rows, std::numeric_limits<int>::max())));
+}
+
+bool StreamProcessor::equalize(const QString& inPath, const QString& outPath) {
+    BmpStripReader reader;
+    if (!reader.open(inPath)) {
+        return false;
+    }
+    const int width = reader.getWidth();
+    const int height = reader.getHeight();
+    const qint64 rowSize = reader.getRowSize();
+    const int rows = std::min(height, stripRows(rowSize, 1, 0));
+    PooledBuffer strip(rowSize * rows);
+
+    // 第一遍：逐条带统计三个通道的直方图
+    BgrHistogram hist;
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        int count = std::min(rows, height - y0);
+        if (!reader.readRows(y0, count, strip.data())) {
+            return false;
+        }
+        accumulateBgrHistogram(strip.data(), width, count, rowSize, hist);
+    }
+
+    // 由累积分布函数生成查找表
+    BgrLut lut;
+    buildEqualizationLut(hist, lut);
+
+    // 第二遍：映射并增量写出
+    BmpStripWriter writer;
+    if (!writer.open(outPath, width, height)) {
+        return false;
+    }
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        int count = std::min(rows, height - y0);
+        if (!reader.readRows(y0, count, strip.data())) {
+            return false;
+        }
+        applyBgrLut(strip.data(), width, count, rowSize, lut);
+        if (!writer.writeRows(strip.data(), count)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool StreamProcessor::sharpen(const QString& inPath, const QString& outPath) {
+    BmpStripReader reader;
+    if (!reader.open(inPath)) {
+        return false;
+    }
+    const int width = reader.getWidth();
+    const int height = reader.getHeight();
+    const qint64 rowSize = reader.getRowSize();
+    const int rows = std::min(height, stripRows(rowSize, 2, 1));
+
+    // 输入条带上下各多读一行作为光晕
+    PooledBuffer in(rowSize * (rows + 2), true);
+    PooledBuffer out(rowSize * rows, true);
+
+    BmpStripWriter writer;
+    if (!writer.open(outPath, width, height)) {
+        return false;
+    }
+    const ConvolutionKernel kernel = ConvolutionKernel::sharpen();
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        int count = std::min(rows, height - y0);
+        int first = std::max(0, y0 - 1);
+        int last = std::min(height, y0 + count + 1);
+        // in 的第 0 行对应 y0-1
+        unsigned char* base = in.data() + (first - (y0 - 1)) * rowSize;
+        if (!reader.readRows(first, last - first, base)) {
+            return false;
+        }
+        // 与 MyQImage::sharpen 相同的卷积，图像上下边缘由引擎按重复边界处理
+        Convolution::convolveRows(kernel, width, height, 3, BorderMode::Replicate,
+            [&](int y) -> const unsigned char* { return in.data() + (y - (y0 - 1)) * rowSize; },
+            [&](int y) { return out.data() + (y - y0) * rowSize; },
+            y0, y0 + count);
+        if (!writer.writeRows(out.data(), count)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool StreamProcessor::filterStrips(const QString& inPath, const QString& outPath, int halo, int threads,
+                                   const std::function<qint64(int width)>& scratchBytes, const RowFilter& filter) {
+    BmpStripReader reader;
+    if (!reader.open(inPath)) {
+        return false;
+    }
+    const int width = reader.getWidth();
+    const int height = reader.getHeight();
+    const qint64 rowSize = reader.getRowSize();
+    const qint64 scratch = std::max<qint64>(1, scratchBytes(width));
+    threads = int(std::max<qint64>(1, std::min<qint64>(parallelThreadCount(threads), memoryBudget / 2 / scratch)));
+    const int rows = std::min(height, stripRows(rowSize, 2, halo, threads * scratch));
+
+    PooledBuffer in(rowSize * (rows + 2 * qint64(halo)), true);
+    PooledBuffer out(rowSize * rows, true);
+
+    BmpStripWriter writer;
+    if (!writer.open(outPath, width, height)) {
+        return false;
+    }
+    threads = parallelRowThreads(rows, threads);
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        const int count = std::min(rows, height - y0);
+        const int first = std::max(0, y0 - halo);
+        const int last = std::min(height, y0 + count + halo);
+        // in 的第 0 行对应 y0-halo
+        if (!reader.readRows(first, last - first, in.data() + (first - (y0 - halo)) * rowSize)) {
+            return false;
+        }
+        std::atomic<bool> completed(true);
+        parallelFor(y0, y0 + count, [&](int, int begin, int end) {
+            if (!filter(width, height,
+                        [&](int y) -> const unsigned char* { return in.data() + (y - (y0 - halo)) * rowSize; },
+                        [&](int y) { return out.data() + (y - y0) * rowSize; }, begin, end)) {
+                completed = false;
+            }
+        }, threads);
+        if (!completed || !writer.writeRows(out.data(), count)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool StreamProcessor::median(const QString& inPath, const QString& outPath, const MedianOptions& options) {
+    return filterStrips(inPath, outPath, std::max(1, std::min(options.radius, 15)), options.threads,
+        [](int width) { return Denoise::medianScratchBytes(width, 3); },
+        [&options](int width, int height, const std::function<const unsigned char*(int)>& rowAt,
+                   const std::function<unsigned char*(int)>& dstRow, int y0, int y1) {
+            return Denoise::medianRows(width, height, 3, options, rowAt, dstRow, y0, y1);
+        });
+}
+
+bool StreamProcessor::bilateral(const QString& inPath, const QString& outPath, const BilateralOptions& options) {
+    return filterStrips(inPath, outPath, Denoise::bilateralHalo(options), options.threads,
+        [&options](int width) { return Denoise::bilateralScratchBytes(width, options); },
+        [&options](int width, int height, const std::function<const unsigned char*(int)>& rowAt,
+                   const std::function<unsigned char*(int)>& dstRow, int y0, int y1) {
+            return Denoise::bilateralRows(width, height, 3, 3, options, rowAt, dstRow, y0, y1);
+        });
+}
+
+bool StreamProcessor::segment(const QString& inPath, const QString& outPath, int K,
+                              int maxIterations, quint32 seed) {
+    BmpStripReader reader;
+    if (!reader.open(inPath)) {
+        return false;
+    }
+    const int width = reader.getWidth();
+    const int height = reader.getHeight();
+    const qint64 rowSize = reader.getRowSize();
+    const int rows = std::min(height, stripRows(rowSize, 1, 0));
+    PooledBuffer strip(rowSize * rows);
+    K = std::max(1, K);
+
+    // 随机选取 K 个像素作为初始中心 (BGR)
+    QVector<int> centers(K * 3);
+    QRandomGenerator rng(seed);
+    for (int k = 0; k < K; ++k) {
+        int y = rng.bounded(height);
+        int x = rng.bounded(width);
+        if (!reader.readRows(y, 1, strip.data())) {
+            return false;
+        }
+        std::copy(strip.data() + x * 3, strip.data() + x * 3 + 3, centers.begin() + k * 3);
+    }
+
+    auto nearest = [&](const unsigned char* pixel) {
+        int best = 0;
+        int bestDistance = std::numeric_limits<int>::max();
+        for (int k = 0; k < K; ++k) {
+            int db = pixel[0] - centers[k * 3];
+            int dg = pixel[1] - centers[k * 3 + 1];
+            int dr = pixel[2] - centers[k * 3 + 2];
+            int distance = db * db + dg * dg + dr * dr;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        return best;
+    };
+
+    QVector<qint64> sums(K * 3);
+    QVector<qint64> counts(K);
+    bool converged = false;
+    for (int iteration = 0; !converged && iteration < maxIterations; ++iteration) {
+        sums.fill(0);
+        counts.fill(0);
+        // 逐条带分配并累计簇的和
+        for (int y0 = 0; y0 < height; y0 += rows) {
+            int count = std::min(rows, height - y0);
+            if (!reader.readRows(y0, count, strip.data())) {
+                return false;
+            }
+            for (int y = 0; y < count; ++y) {
+                const unsigned char* pixel = strip.data() + y * rowSize;
+                for (int x = 0; x < width; ++x, pixel += 3) {
+                    int k = nearest(pixel);
+                    sums[k * 3] += pixel[0];
+                    sums[k * 3 + 1] += pixel[1];
+                    sums[k * 3 + 2] += pixel[2];
+                    counts[k]++;
+                }
+            }
+        }
+
+        // 更新聚类中心，所有中心移动都不超过 1 时收敛
+        converged = true;
+        for (int k = 0; k < K; ++k) {
+            if (counts[k] == 0) {
+                continue;
+            }
+            for (int c = 0; c < 3; ++c) {
+                int value = static_cast<int>(sums[k * 3 + c] / counts[k]);
+                if (std::abs(value - centers[k * 3 + c]) > 1) {
+                    converged = false;
+                }
+                centers[k * 3 + c] = value;
+            }
+        }
+    }
+
+    // 最后一遍：用所属簇的中心颜色写出
+    BmpStripWriter writer;
+    if (!writer.open(outPath, width, height)) {
+        return false;
+    }
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        int count = std::min(rows, height - y0);
+        if (!reader.readRows(y0, count, strip.data())) {
+            return false;
+        }
+        for (int y = 0; y < count; ++y) {
+            unsigned char* pixel = strip.data() + y * rowSize;
+            for (int x = 0; x < width; ++x, pixel += 3) {
+                int k = nearest(pixel);
+                pixel[0] = centers[k * 3];
+                pixel[1] = centers[k * 3 + 1];
+                pixel[2] = centers[k * 3 + 2];
+            }
+        }
+        if (!writer.writeRows(strip.data(), count)) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool StreamProcessor::clahe(const QString& inPath, const QString& outPath, const ClaheOptions& options) {
+    BmpStripReader reader;
+    if (!reader.open(inPath)) {
+        return false;
+    }
+    const int width = reader.getWidth();
+    const int height = reader.getHeight();
+    const qint64 rowSize = reader.getRowSize();
+    const int rows = std::min(height, stripRows(rowSize, 1, 0));
+    PooledBuffer strip(rowSize * rows);
+
+    const ClaheGrid grid(width, height, 3, 3, options.tileSize);
+    const int tileSize = grid.getTileSize();
+    const qint64 lutRowBytes = grid.lutRowBytes();
+    // 两个槽位轮流存放相邻两行分块的 LUT
+    PooledBuffer luts(lutRowBytes * 2 + ClaheGrid::kLutPadding, true);
+    PooledBuffer histogram(grid.histogramSize() * qint64(sizeof(quint32)));
+    auto slot = [&](int tileRow) { return luts.data() + (tileRow % 2) * lutRowBytes; };
+
+    BmpStripWriter writer;
+    if (!writer.open(outPath, width, height)) {
+        return false;
+    }
+    int nextRow = 0;
+    for (int tileRow = 0; tileRow < grid.getTilesY(); ++tileRow) {
+        if (options.control && options.control->isCancelled()) {
+            return false;
+        }
+        // 统计这一行分块的直方图
+        std::memset(histogram.data(), 0, size_t(histogram.size()));
+        const int tileEnd = std::min(height, (tileRow + 1) * tileSize);
+        for (int y0 = tileRow * tileSize; y0 < tileEnd; y0 += rows) {
+            int count = std::min(rows, tileEnd - y0);
+            if (!reader.readRows(y0, count, strip.data())) {
+                return false;
+            }
+            grid.accumulate(strip.data(), rowSize, count, histogram.as<quint32>());
+        }
+        grid.buildLuts(tileRow, histogram.as<quint32>(), options.clipLimit, slot(tileRow));
+
+        // 写出下方分块行不超过当前分块行的所有行，它们的上方分块行至少为 tileRow - 1
+        int readyEnd = nextRow;
+        for (; readyEnd < height; ++readyEnd) {
+            int tileRow1, tileRow2, weight;
+            grid.rowTiles(readyEnd, tileRow1, tileRow2, weight);
+            if (tileRow2 > tileRow) {
+                break;
+            }
+        }
+        for (int y0 = nextRow; y0 < readyEnd; y0 += rows) {
+            int count = std::min(rows, readyEnd - y0);
+            if (!reader.readRows(y0, count, strip.data())) {
+                return false;
+            }
+            for (int y = 0; y < count; ++y) {
+                int tileRow1, tileRow2, weight;
+                grid.rowTiles(y0 + y, tileRow1, tileRow2, weight);
+                unsigned char* row = strip.data() + y * rowSize;
+                grid.mapRow(row, row, slot(tileRow1), slot(tileRow2), weight);
+            }
+            if (!writer.writeRows(strip.data(), count)) {
+                return false;
+            }
+        }
+        nextRow = readyEnd;
+    }
+    return writer.finish();
+}
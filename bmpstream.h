@@ -0,0 +1,96 @@
+#ifndef BMPSTREAM_H
+#define BMPSTREAM_H
+
+#include <QString>
+#include <QFile>
+#include <QSaveFile>
+#include <QVector>
+#include "bmpheader.h"
+#include "clahe.h"
+#include "denoise.h"
+#include <functional>
+
+// 按行条带读取 24 位 BMP，不将整幅图像载入内存
+// 行号按文件中的存储顺序（自底向上），与 MyQImage 的像素布局一致
+class BmpStripReader {
+public:
+    bool open(const QString& filePath);
+    void close() { file.close(); }
+
+    int getWidth() const { return infoHeader.width; }
+    int getHeight() const { return infoHeader.height; }
+    qint64 getRowSize() const { return rowSize; }
+
+    // 读取从 firstRow 开始的 count 行到 dst（每行 rowSize 字节）
+    bool readRows(int firstRow, int count, unsigned char* dst);
+
+private:
+    QFile file;
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    qint64 rowSize = 0;
+};
+
+// 增量写出 24 位 BMP：先写占位头部，逐条带追加像素行，finish() 时回写最终头部。
+// 写入同目录下的临时文件，finish() 成功后才原子地替换目标文件；未 finish 的输出被丢弃
+class BmpStripWriter {
+public:
+    bool open(const QString& filePath, int width, int height);
+
+    // 追加 count 行（每行 rowSize 字节，按存储顺序）
+    bool writeRows(const unsigned char* src, int count);
+
+    // 所有行写完后回写文件头与信息头中的大小字段，并提交为目标文件
+    bool finish();
+
+private:
+    QSaveFile file;
+    int width = 0;
+    int height = 0;
+    int rowsWritten = 0;
+    qint64 rowSize = 0;
+};
+
+// 超出内存的大图的流式处理：每次只在内存中保留有界的条带窗口
+class StreamProcessor {
+public:
+    explicit StreamProcessor(qint64 memoryBudget = qint64(64) * 1024 * 1024);
+
+    void setMemoryBudget(qint64 bytes) { memoryBudget = bytes; }
+
+    // 两遍：先统计直方图，再用查找表映射写出
+    bool equalize(const QString& inPath, const QString& outPath);
+
+    // 单遍：条带上下各带一行光晕（halo），卷积由 Convolution::convolveRows 完成
+    bool sharpen(const QString& inPath, const QString& outPath);
+
+    // K-means：每次迭代逐条带累计簇的和与计数，最后一遍写出聚类颜色
+    bool segment(const QString& inPath, const QString& outPath, int K,
+                 int maxIterations = 100, quint32 seed = 1);
+
+    // CLAHE：逐行分块统计直方图并生成 LUT，环形缓冲只保留相邻两行分块的 LUT，
+    // 上下两行分块的 LUT 都就绪的行立即映射写出；结果与 Clahe::apply 逐位相同
+    bool clahe(const QString& inPath, const QString& outPath, const ClaheOptions& options = ClaheOptions());
+
+    // 保边去噪：单遍，条带上下各带 radius（双边滤波为 Denoise::bilateralHalo）行光晕，
+    // 条带内按行并行；结果与 Denoise::median / Denoise::bilateral 逐位相同
+    bool median(const QString& inPath, const QString& outPath, const MedianOptions& options = MedianOptions());
+    bool bilateral(const QString& inPath, const QString& outPath, const BilateralOptions& options = BilateralOptions());
+
+private:
+    // 在内存预算内一次可处理的行数，buffers 为同时驻留的条带缓冲个数，reserved 为预算中另作他用的字节数
+    int stripRows(qint64 rowSize, int buffers, int haloRows, qint64 reserved = 0) const;
+
+    // 逐条带执行邻域滤波：条带上下各多读 halo 行（图像边缘处不足时由 filter 自行按边界处理），
+    // filter 计算 [y0, y1) 行，rowAt 只能访问条带及其光晕内的行。
+    // scratchBytes(width) 为 filter 每次调用的工作内存，按线程数计入预算：线程数最多用去一半预算，其余留给条带
+    using RowFilter = std::function<bool(int width, int height,
+                                         const std::function<const unsigned char*(int)>& rowAt,
+                                         const std::function<unsigned char*(int)>& dstRow, int y0, int y1)>;
+    bool filterStrips(const QString& inPath, const QString& outPath, int halo, int threads,
+                      const std::function<qint64(int width)>& scratchBytes, const RowFilter& filter);
+
+    qint64 memoryBudget;
+};
+
+#endif // BMPSTREAM_H
@@ -0,0 +1,187 @@
+#include "bmpwriter.h"
+#include "bmpheader.h"
+#include "bufferpool.h"
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#ifdef Q_OS_UNIX
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+// 逐行写出时每次组装的字节数
+const qint64 kStripBytes = qint64(4) << 20;
+
+// 将 iov 中的数据全部写出到 fd，处理部分写入与信号中断
+#ifdef Q_OS_UNIX
+bool writeAll(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = ::writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && size_t(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+#endif
+
+// 把 rows 行像素复制为文件中的行布局（行尾填充置 0）；每行有效字节 rowBytes，文件中每行 rowSize 字节
+void packRows(const unsigned char* src, qint64 stride, qint64 rowBytes, qint64 rowSize, int rows, unsigned char* dst) {
+    for (int y = 0; y < rows; ++y) {
+        std::memcpy(dst + y * rowSize, src + y * stride, size_t(rowBytes));
+        std::memset(dst + y * rowSize + rowBytes, 0, size_t(rowSize - rowBytes));
+    }
+}
+
+// 文件头、信息头与调色板（8 位灰度时为 256 级灰阶）
+QByteArray makeHeaders(int width, int height, int bitsPerPixel) {
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    makeBmpHeaders(width, height, fileHeader, infoHeader, bitsPerPixel);
+    QByteArray headers;
+    headers.append(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    headers.append(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    for (uint32_t i = 0; i < infoHeader.colors; ++i) {
+        const char entry[4] = {char(i), char(i), char(i), 0};
+        headers.append(entry, sizeof(entry));
+    }
+    return headers;
+}
+
+bool writeBuffered(QSaveFile& file, const QByteArray& headers, const unsigned char* pixels, int height,
+                   qint64 stride, qint64 rowBytes, qint64 rowSize) {
+    const qint64 payload = rowSize * height;
+
+    // 行布局与文件完全一致（无填充且行连续）时不需要组装
+    if (stride == rowSize && rowSize == rowBytes) {
+#ifdef Q_OS_UNIX
+        if (file.handle() >= 0) {
+            struct iovec iov[2];
+            iov[0].iov_base = const_cast<char*>(headers.constData());
+            iov[0].iov_len = size_t(headers.size());
+            iov[1].iov_base = const_cast<unsigned char*>(pixels);
+            iov[1].iov_len = size_t(payload);
+            return writeAll(file.handle(), iov, 2);
+        }
+#endif
+        return file.write(headers) == headers.size()
+               && file.write(reinterpret_cast<const char*>(pixels), payload) == payload;
+    }
+
+    if (file.write(headers) != headers.size()) {
+        return false;
+    }
+    const int stripRows = int(std::max<qint64>(1, std::min<qint64>(height, kStripBytes / rowSize)));
+    PooledBuffer strip(rowSize * stripRows);
+    for (int y0 = 0; y0 < height; y0 += stripRows) {
+        const int rows = std::min(stripRows, height - y0);
+        packRows(pixels + y0 * stride, stride, rowBytes, rowSize, rows, strip.data());
+        if (file.write(reinterpret_cast<const char*>(strip.data()), rowSize * rows) != rowSize * rows) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 把临时文件原子地替换为目标文件（目标已存在时直接覆盖）
+bool replaceFile(const QString& from, const QString& to) {
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(from).utf16()),
+                       reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(to).utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+// QSaveFile 只能以只写方式打开，无法映射；映射写出自行管理同目录下的临时文件
+bool writeMapped(const QString& filePath, const QByteArray& headers, const unsigned char* pixels, int height,
+                 qint64 stride, qint64 rowBytes, qint64 rowSize) {
+    const qint64 headersSize = headers.size();
+    const qint64 total = headersSize + rowSize * height;
+
+    QTemporaryFile file(filePath + ".XXXXXX");
+    if (!file.open() || !file.resize(total)) {
+        return false;
+    }
+    // 临时文件只有所有者可读写；沿用已有目标文件的权限，否则使用常规文件的默认权限
+    file.setPermissions(QFile::exists(filePath)
+                            ? QFile::permissions(filePath)
+                            : QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ReadGroup
+                                  | QFileDevice::ReadOther);
+    uchar* base = file.map(0, total);
+    if (!base) {
+        return false;
+    }
+    std::memcpy(base, headers.constData(), size_t(headersSize));
+    packRows(pixels, stride, rowBytes, rowSize, height, base + headersSize);
+    if (!file.unmap(base)) {
+        return false;
+    }
+#ifdef Q_OS_UNIX
+    // 与 QSaveFile 一样，重命名前先落盘，避免掉电后得到空文件
+    ::fsync(file.handle());
+#endif
+    const QString temporaryPath = file.fileName();
+    file.close();
+    if (!replaceFile(temporaryPath, filePath)) {
+        return false;
+    }
+    file.setAutoRemove(false);
+    return true;
+}
+
+}
+
+bool BmpWriter::write(const QString& filePath, const unsigned char* pixels, int width, int height,
+                      qint64 stride, Mode mode, int bitsPerPixel) {
+    if (!pixels || width <= 0 || height <= 0
+        || (bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32)) {
+        return false;
+    }
+    const QByteArray headers = makeHeaders(width, height, bitsPerPixel);
+    const qint64 rowBytes = qint64(width) * (bitsPerPixel / 8);
+    const qint64 rowSize = bmpRowSize(width, bitsPerPixel);
+
+    if (mode == Mapped) {
+        if (writeMapped(filePath, headers, pixels, height, stride, rowBytes, rowSize)) {
+            return true;
+        }
+        qDebug() << "Warning: Cannot map output, falling back to buffered write:" << filePath;
+    }
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to open file for writing" << filePath;
+        return false;
+    }
+    if (!writeBuffered(file, headers, pixels, height, stride, rowBytes, rowSize)) {
+        qDebug() << "Failed to write" << filePath;
+        file.cancelWriting();
+        return false;
+    }
+    // commit 把临时文件重命名为目标文件，失败时临时文件被删除
+    return file.commit();
+}
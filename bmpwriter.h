@@ -0,0 +1,23 @@
+#ifndef BMPWRITER_H
+#define BMPWRITER_H
+
+#include <QString>
+#include <QtGlobal>
+
+// 整幅 BMP（8 位灰度、24 位、32 位）的写出器。
+// 先写到同目录下的临时文件，全部写完并落盘后原子地重命名为目标文件，
+// 写出过程中进程被终止也不会留下截断的输出，原有的同名文件保持不变
+class BmpWriter {
+public:
+    enum Mode {
+        Buffered,  // 按行组装为大块写出；行布局与文件一致且无填充时头部与像素一次聚集写出
+        Mapped     // 预先分配文件大小并映射，像素直接复制进映射区；无法映射时退回 Buffered
+    };
+
+    // pixels 为自下而上的行（bitsPerPixel 为 8 时是灰度，24 时是 BGR，32 时是 BGRA），
+    // 相邻两行相距 stride 字节；填充字节总是写 0，8 位灰度附带 256 级灰阶的调色板
+    static bool write(const QString& filePath, const unsigned char* pixels, int width, int height,
+                      qint64 stride, Mode mode = Buffered, int bitsPerPixel = 24);
+};
+
+#endif // BMPWRITER_H
@@ -0,0 +1,231 @@
+#include "bufferpool.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const qint64 Alignment = 64;
+const qint64 HugePageThreshold = qint64(2) << 20;   // 不小于 2MB 的块直接向系统映射页面
+const qint64 ScratchChunkSize = qint64(1) << 20;    // 临时内存块的最小大小
+
+}
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    trim();
+}
+
+qint64 BufferPool::sizeClass(qint64 size) {
+    if (size <= Alignment) {
+        return Alignment;
+    }
+    // 取 size-1 的最高位，级别步长为其四分之一
+    int top = 63;
+    while (!((size - 1) >> top & 1)) {
+        --top;
+    }
+    qint64 step = std::max(Alignment, qint64(1) << std::max(0, top - 2));
+    return (size + step - 1) / step * step;
+}
+
+void* BufferPool::allocate(qint64 size) {
+    const qint64 bytes = sizeClass(size);
+    {
+        QMutexLocker locker(&mutex);
+        counters.currentBytes += bytes;
+        counters.peakBytes = std::max(counters.peakBytes, counters.currentBytes);
+        auto it = freeBlocks.find(bytes);
+        if (it != freeBlocks.end() && !it.value().isEmpty()) {
+            void* block = it.value().takeLast();
+            counters.cachedBytes -= bytes;
+            counters.reusedAllocations++;
+            return block;
+        }
+        counters.systemAllocations++;
+    }
+    void* block = systemAllocate(bytes);
+    if (!block) {
+        QMutexLocker locker(&mutex);
+        counters.currentBytes -= bytes;
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void BufferPool::release(void* block, qint64 size) {
+    if (!block) {
+        return;
+    }
+    const qint64 bytes = sizeClass(size);
+    {
+        QMutexLocker locker(&mutex);
+        counters.currentBytes -= bytes;
+        if (counters.cachedBytes + bytes <= cacheLimit) {
+            freeBlocks[bytes].append(block);
+            counters.cachedBytes += bytes;
+            return;
+        }
+    }
+    systemRelease(block, bytes);
+}
+
+void BufferPool::setHugePages(bool enabled) {
+    QMutexLocker locker(&mutex);
+    hugePages = enabled;
+}
+
+bool BufferPool::hugePagesEnabled() const {
+    QMutexLocker locker(&mutex);
+    return hugePages;
+}
+
+void BufferPool::setCacheLimit(qint64 bytes) {
+    {
+        QMutexLocker locker(&mutex);
+        cacheLimit = std::max<qint64>(0, bytes);
+    }
+    trim();
+}
+
+void BufferPool::trim() {
+    QMap<qint64, QVector<void*>> blocks;
+    {
+        QMutexLocker locker(&mutex);
+        blocks.swap(freeBlocks);
+        counters.cachedBytes = 0;
+    }
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        for (void* block : it.value()) {
+            systemRelease(block, it.key());
+        }
+    }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    QMutexLocker locker(&mutex);
+    return counters;
+}
+
+void* BufferPool::systemAllocate(qint64 size) {
+#ifdef Q_OS_LINUX
+    if (size >= HugePageThreshold) {
+        void* block = mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED) {
+            return nullptr;
+        }
+#ifdef MADV_HUGEPAGE
+        if (hugePagesEnabled()) {
+            madvise(block, size_t(size), MADV_HUGEPAGE);
+        }
+#endif
+        return block;
+    }
+#endif
+    return ::operator new(size_t(size), std::align_val_t(Alignment), std::nothrow);
+}
+
+void BufferPool::systemRelease(void* block, qint64 size) {
+    Q_UNUSED(size);
+#ifdef Q_OS_LINUX
+    if (size >= HugePageThreshold) {
+        munmap(block, size_t(size));
+        return;
+    }
+#endif
+    ::operator delete(block, std::align_val_t(Alignment));
+}
+
+// ---------------- PooledBuffer ----------------
+
+PooledBuffer::PooledBuffer(qint64 size, bool zeroed)
+    : bytes(static_cast<unsigned char*>(BufferPool::instance().allocate(size))), length(size) {
+    if (zeroed) {
+        std::memset(bytes, 0, size_t(size));
+    }
+}
+
+PooledBuffer::~PooledBuffer() {
+    BufferPool::instance().release(bytes, length);
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept : bytes(other.bytes), length(other.length) {
+    other.bytes = nullptr;
+    other.length = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    std::swap(bytes, other.bytes);
+    std::swap(length, other.length);
+    return *this;
+}
+
+// ---------------- ScratchArena ----------------
+
+ScratchArena& ScratchArena::local() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+ScratchArena::~ScratchArena() {
+    for (const Chunk& chunk : chunks) {
+        BufferPool::instance().release(chunk.data, chunk.size);
+    }
+}
+
+void* ScratchArena::allocateBytes(qint64 bytes) {
+    Q_ASSERT(depth > 0);
+    bytes = std::max(Alignment, (bytes + Alignment - 1) / Alignment * Alignment);
+    // 当前块之后的块都是空的，依次寻找放得下的块
+    for (; current < int(chunks.size()); ++current) {
+        Chunk& chunk = chunks[current];
+        if (chunk.used + bytes <= chunk.size) {
+            void* block = chunk.data + chunk.used;
+            chunk.used += bytes;
+            return block;
+        }
+    }
+    Chunk chunk;
+    chunk.size = std::max(bytes, ScratchChunkSize);
+    chunk.data = static_cast<unsigned char*>(BufferPool::instance().allocate(chunk.size));
+    chunk.used = bytes;
+    chunks.push_back(chunk);
+    current = int(chunks.size()) - 1;
+    return chunk.data;
+}
+
+ScratchArena::Scope::Scope() : arena(ScratchArena::local()) {
+    chunk = arena.current;
+    used = arena.chunks.empty() ? 0 : arena.chunks[chunk].used;
+    arena.depth++;
+}
+
+ScratchArena::Scope::~Scope() {
+    arena.depth--;
+    if (arena.chunks.empty()) {
+        return;
+    }
+    for (int i = chunk + 1; i < int(arena.chunks.size()); ++i) {
+        arena.chunks[i].used = 0;
+    }
+    arena.chunks[chunk].used = used;
+    arena.current = chunk;
+    if (arena.depth == 0) {
+        // 大块临时内存交还内存池，供其它线程复用。第一块常被线程的第一次分配撑到图像大小，
+        // 超过默认大小时同样交还，下次分配时再按默认大小重新申请
+        const int keep = arena.chunks[0].size > ScratchChunkSize ? 0 : 1;
+        for (int i = keep; i < int(arena.chunks.size()); ++i) {
+            BufferPool::instance().release(arena.chunks[i].data, arena.chunks[i].size);
+        }
+        arena.chunks.resize(keep);
+        arena.current = 0;
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QtGlobal>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include <vector>
+
+// 进程级的大块内存池：分配按 64 字节对齐，释放的块按大小级别缓存，
+// 之后同一级别的请求直接复用，避免批处理中反复申请同样大小的图像缓冲时的缺页与分配器争用
+class BufferPool {
+public:
+    struct Stats {
+        qint64 currentBytes = 0;       // 已借出的字节数
+        qint64 peakBytes = 0;          // 借出字节数的峰值
+        qint64 cachedBytes = 0;        // 空闲缓存中的字节数
+        qint64 systemAllocations = 0;  // 向系统申请的次数
+        qint64 reusedAllocations = 0;  // 由缓存满足的次数
+    };
+
+    static BufferPool& instance();
+
+    // 分配至少 size 字节，64 字节对齐，内容未初始化
+    void* allocate(qint64 size);
+    // 归还 allocate 得到的块，size 必须与分配时相同
+    void release(void* block, qint64 size);
+
+    // 大块（>= 2MB）使用大页；目前仅 Linux 上通过透明大页生效
+    void setHugePages(bool enabled);
+    bool hugePagesEnabled() const;
+
+    // 空闲缓存的上限，超出时直接归还系统；默认 1GB
+    void setCacheLimit(qint64 bytes);
+    // 将所有空闲块归还系统
+    void trim();
+
+    Stats stats() const;
+
+    // 请求大小对应的级别：每个 2 的幂区间分 4 级，浪费不超过 25%
+    static qint64 sizeClass(qint64 size);
+
+private:
+    BufferPool() = default;
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    void* systemAllocate(qint64 size);
+    void systemRelease(void* block, qint64 size);
+
+    mutable QMutex mutex;
+    QMap<qint64, QVector<void*>> freeBlocks;  // 级别 -> 空闲块
+    Stats counters;
+    qint64 cacheLimit = qint64(1) << 30;
+    bool hugePages = false;
+};
+
+// 从 BufferPool 借出的一块内存，析构时归还
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    explicit PooledBuffer(qint64 size, bool zeroed = false);
+    ~PooledBuffer();
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    unsigned char* data() const { return bytes; }
+    qint64 size() const { return length; }
+    template <typename T>
+    T* as() const { return reinterpret_cast<T*>(bytes); }
+
+private:
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    unsigned char* bytes = nullptr;
+    qint64 length = 0;
+};
+
+// 线程局部的临时内存：在 Scope 内按顺序分配，Scope 结束时一次性收回。
+// 内存块取自 BufferPool 并在同一线程的后续调用中复用，算法的临时缓冲都从这里分配
+class ScratchArena {
+public:
+    // 当前线程的 arena
+    static ScratchArena& local();
+
+    // 分配 count 个 T，64 字节对齐，内容未初始化；必须处于某个 Scope 之内
+    template <typename T>
+    T* allocate(qint64 count) { return static_cast<T*>(allocateBytes(count * qint64(sizeof(T)))); }
+    void* allocateBytes(qint64 bytes);
+
+    // 作用域：析构时收回作用域内的所有分配；最外层作用域结束时只保留默认大小的第一个内存块，
+    // 更大的块（例如图像尺寸的临时缓冲）全部交还 BufferPool
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+    private:
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ScratchArena& arena;
+        int chunk;
+        qint64 used;
+    };
+
+private:
+    struct Chunk {
+        unsigned char* data;
+        qint64 size;
+        qint64 used;
+    };
+
+    ScratchArena() = default;
+    ~ScratchArena();
+
+    std::vector<Chunk> chunks;
+    int current = 0;
+    int depth = 0;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,259 @@
+#include "clahe.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// 映射时进度报告的行数粒度
+const int kProgressRows = 64;
+
+// 坐标 p 落在第 t1、t2 两个分块中心之间，weight 为 t2 的权重（0..256）；
+// 位于首个分块中心之前或最后一个分块中心之后时只用一个分块
+void axisTiles(int p, int tileSize, int tiles, int& t1, int& t2, int& weight) {
+    const double position = (p + 0.5) / tileSize - 0.5;
+    if (position <= 0) {
+        t1 = t2 = 0;
+        weight = 0;
+        return;
+    }
+    t1 = int(position);
+    if (t1 >= tiles - 1) {
+        t1 = t2 = tiles - 1;
+        weight = 0;
+        return;
+    }
+    t2 = t1 + 1;
+    weight = int(std::lround((position - t1) * 256));
+}
+
+// 先水平后垂直的定点双线性插值，两个方向各 8 位小数，标量与 AVX2 路径逐位相同
+inline int interpolate(int a, int b, int c, int d, int weightX, int weightY) {
+    const int top = (a << 8) + (b - a) * weightX;
+    const int bottom = (c << 8) + (d - c) * weightX;
+    return ((top << 8) + (bottom - top) * weightY + 32768) >> 16;
+}
+
+void mapRowScalar(const unsigned char* src, unsigned char* dst, qint64 begin, qint64 end,
+                  const qint32* left, const qint32* right, const qint32* weights,
+                  const unsigned char* luts1, const unsigned char* luts2, int weight) {
+    for (qint64 i = begin; i < end; ++i) {
+        const int v = src[i];
+        dst[i] = uchar(interpolate(luts1[left[i] + v], luts1[right[i] + v],
+                                   luts2[left[i] + v], luts2[right[i] + v], weights[i], weight));
+    }
+}
+
+#if MYQIMAGE_X86_SIMD
+// 每次 8 个字节：四次按字节偏移的 gather 取 LUT 项（读 4 字节后取低 8 位）
+MYQIMAGE_TARGET_AVX2
+qint64 mapRowAvx2(const unsigned char* src, unsigned char* dst, qint64 count,
+                  const qint32* left, const qint32* right, const qint32* weights,
+                  const unsigned char* luts1, const unsigned char* luts2, int weight) {
+    const int* base1 = reinterpret_cast<const int*>(luts1);
+    const int* base2 = reinterpret_cast<const int*>(luts2);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i weightY = _mm256_set1_epi32(weight);
+    const __m256i round = _mm256_set1_epi32(32768);
+    // 每个 32 位元素的低字节收拢到低 8 字节
+    const __m256i gatherBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i gatherLanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    qint64 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        const __m256i indexLeft = _mm256_add_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)), v);
+        const __m256i indexRight = _mm256_add_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)), v);
+        const __m256i weightX = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+
+        const __m256i a = _mm256_and_si256(_mm256_i32gather_epi32(base1, indexLeft, 1), byteMask);
+        const __m256i b = _mm256_and_si256(_mm256_i32gather_epi32(base1, indexRight, 1), byteMask);
+        const __m256i c = _mm256_and_si256(_mm256_i32gather_epi32(base2, indexLeft, 1), byteMask);
+        const __m256i d = _mm256_and_si256(_mm256_i32gather_epi32(base2, indexRight, 1), byteMask);
+
+        const __m256i top = _mm256_add_epi32(_mm256_slli_epi32(a, 8),
+                                             _mm256_mullo_epi32(_mm256_sub_epi32(b, a), weightX));
+        const __m256i bottom = _mm256_add_epi32(_mm256_slli_epi32(c, 8),
+                                                _mm256_mullo_epi32(_mm256_sub_epi32(d, c), weightX));
+        __m256i out = _mm256_add_epi32(_mm256_slli_epi32(top, 8),
+                                       _mm256_mullo_epi32(_mm256_sub_epi32(bottom, top), weightY));
+        out = _mm256_srli_epi32(_mm256_add_epi32(out, round), 16);
+        out = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(out, gatherBytes), gatherLanes);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(out));
+    }
+    return i;
+}
+#endif
+
+}
+
+ClaheGrid::ClaheGrid(int width, int height, int channels, int colorChannels, int tileSize)
+    : width(width), height(height), channels(channels), colorChannels(colorChannels),
+      tileSize(std::max(1, tileSize)) {
+    tilesX = std::max(1, (width + this->tileSize - 1) / this->tileSize);
+    tilesY = std::max(1, (height + this->tileSize - 1) / this->tileSize);
+
+    const qint64 rowBytes = qint64(width) * channels;
+    const qint32 oddHistogram = qint32(tilesX) * channels * 256;
+    offsetLeft.resize(size_t(rowBytes));
+    offsetRight.resize(size_t(rowBytes));
+    weightRight.resize(size_t(rowBytes));
+    histogramOffset.resize(size_t(rowBytes));
+    for (int x = 0; x < width; ++x) {
+        int left, right, weight;
+        axisTiles(x, this->tileSize, tilesX, left, right, weight);
+        const int tile = x / this->tileSize;
+        for (int c = 0; c < channels; ++c) {
+            const qint64 i = qint64(x) * channels + c;
+            offsetLeft[i] = (left * channels + c) * 256;
+            offsetRight[i] = (right * channels + c) * 256;
+            weightRight[i] = weight;
+            histogramOffset[i] = (tile * channels + c) * 256 + (x & 1) * oddHistogram;
+        }
+    }
+}
+
+void ClaheGrid::accumulate(const unsigned char* src, qint64 stride, int rows, quint32* histogram) const {
+    const qint64 rowBytes = qint64(width) * channels;
+    const qint32* offsets = histogramOffset.data();
+    for (int y = 0; y < rows; ++y) {
+        const unsigned char* row = src + y * stride;
+        for (qint64 i = 0; i < rowBytes; ++i) {
+            histogram[offsets[i] + row[i]]++;
+        }
+    }
+}
+
+void ClaheGrid::buildLuts(int tileRow, quint32* histogram, double clipLimit, unsigned char* luts) const {
+    const int rows = std::min(tileSize, height - tileRow * tileSize);
+    const qint64 oddHistogram = qint64(tilesX) * channels * 256;
+    for (int tx = 0; tx < tilesX; ++tx) {
+        const int columns = std::min(tileSize, width - tx * tileSize);
+        const qint64 pixels = qint64(rows) * columns;
+        const qint64 limit = clipLimit > 0 ? std::max<qint64>(1, qint64(clipLimit * pixels / 256)) : 0;
+        for (int c = 0; c < channels; ++c) {
+            unsigned char* lut = luts + (tx * channels + c) * 256;
+            if (c >= colorChannels) {
+                for (int v = 0; v < 256; ++v) {
+                    lut[v] = uchar(v);
+                }
+                continue;
+            }
+            quint32* hist = histogram + (tx * channels + c) * 256;
+            for (int v = 0; v < 256; ++v) {
+                hist[v] += hist[oddHistogram + v];
+            }
+
+            // 剪切超过上限的计数，均匀分给所有灰度级，余数按固定步长分散
+            if (limit > 0) {
+                qint64 clipped = 0;
+                for (int v = 0; v < 256; ++v) {
+                    if (hist[v] > limit) {
+                        clipped += hist[v] - limit;
+                        hist[v] = quint32(limit);
+                    }
+                }
+                const quint32 batch = quint32(clipped / 256);
+                const int residual = int(clipped % 256);
+                for (int v = 0; v < 256; ++v) {
+                    hist[v] += batch;
+                }
+                if (residual > 0) {
+                    const int step = std::max(256 / residual, 1);
+                    for (int v = 0, left = residual; v < 256 && left > 0; v += step, --left) {
+                        hist[v]++;
+                    }
+                }
+            }
+
+            qint64 cdf = 0;
+            for (int v = 0; v < 256; ++v) {
+                cdf += hist[v];
+                lut[v] = uchar(std::min<qint64>(255, (cdf * 255 + pixels / 2) / pixels));
+            }
+        }
+    }
+}
+
+void ClaheGrid::rowTiles(int y, int& tileRow1, int& tileRow2, int& weight) const {
+    axisTiles(y, tileSize, tilesY, tileRow1, tileRow2, weight);
+}
+
+void ClaheGrid::mapRow(const unsigned char* src, unsigned char* dst, const unsigned char* luts1,
+                       const unsigned char* luts2, int weight) const {
+    const qint64 rowBytes = qint64(width) * channels;
+    qint64 done = 0;
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        done = mapRowAvx2(src, dst, rowBytes, offsetLeft.data(), offsetRight.data(), weightRight.data(),
+                          luts1, luts2, weight);
+    }
+#endif
+    mapRowScalar(src, dst, done, rowBytes, offsetLeft.data(), offsetRight.data(), weightRight.data(),
+                 luts1, luts2, weight);
+}
+
+bool Clahe::apply(unsigned char* pixels, int width, int height, qint64 stride, int channels,
+                  int colorChannels, const ClaheOptions& options) {
+    if (!pixels || width <= 0 || height <= 0) {
+        return true;
+    }
+    JobControl* control = options.control;
+    const ClaheGrid grid(width, height, channels, colorChannels, options.tileSize);
+    const int tilesY = grid.getTilesY();
+    const int tileSize = grid.getTileSize();
+    const qint64 lutRowBytes = grid.lutRowBytes();
+    PooledBuffer luts(lutRowBytes * tilesY + ClaheGrid::kLutPadding, true);
+
+    // 第一遍：按分块行并行统计直方图，统计完一行分块立即生成其 LUT
+    if (control) {
+        control->beginStage(0, 30, tilesY);
+    }
+    parallelFor(0, tilesY, [&](int, int ty0, int ty1) {
+        PooledBuffer histogram(grid.histogramSize() * qint64(sizeof(quint32)));
+        for (int ty = ty0; ty < ty1; ++ty) {
+            if (control && control->isCancelled()) {
+                return;
+            }
+            std::memset(histogram.data(), 0, size_t(histogram.size()));
+            const int y0 = ty * tileSize;
+            grid.accumulate(pixels + y0 * stride, stride, std::min(tileSize, height - y0),
+                            histogram.as<quint32>());
+            grid.buildLuts(ty, histogram.as<quint32>(), options.clipLimit, luts.data() + ty * lutRowBytes);
+            if (control) {
+                control->advance(1);
+            }
+        }
+    }, options.threads);
+    if (control && control->isCancelled()) {
+        return false;
+    }
+
+    // 第二遍：按行并行插值映射，每行只依赖上下两行分块的 LUT
+    if (control) {
+        control->beginStage(30, 100, height);
+    }
+    const int threads = parallelRowThreads(height, options.threads);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        for (int strip = y0; strip < y1; strip += kProgressRows) {
+            const int stripEnd = std::min(y1, strip + kProgressRows);
+            for (int y = strip; y < stripEnd; ++y) {
+                int tileRow1, tileRow2, weight;
+                grid.rowTiles(y, tileRow1, tileRow2, weight);
+                unsigned char* row = pixels + y * stride;
+                grid.mapRow(row, row, luts.data() + tileRow1 * lutRowBytes, luts.data() + tileRow2 * lutRowBytes,
+                            weight);
+            }
+            if (control && !control->advance(stripEnd - strip)) {
+                return;
+            }
+        }
+    }, threads);
+    return !(control && control->isCancelled());
+}
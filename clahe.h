@@ -0,0 +1,74 @@
+#ifndef CLAHE_H
+#define CLAHE_H
+
+#include <QtGlobal>
+#include <vector>
+
+class JobControl;
+
+// 限制对比度的自适应直方图均衡化（CLAHE）参数
+struct ClaheOptions {
+    int tileSize = 64;          // 分块边长（像素），图像边缘的分块可能更小
+    double clipLimit = 2.0;     // 每个灰度级的计数上限为分块平均计数的 clipLimit 倍，超出部分均匀分给所有灰度级；<= 0 不限制
+    int threads = 0;            // 线程数，<= 0 取 CPU 核数
+    JobControl* control = nullptr;  // 进度与取消
+};
+
+// 分块网格：每个分块、每个颜色通道各有一张 256 项的查找表（LUT），
+// 像素的结果由相邻四个分块中心的 LUT 按位置双线性插值得到。
+// 所有 LUT 按分块行存放，一行分块的 LUT 连续（lutRowBytes 字节），
+// 流式处理时只需同时保留相邻两行分块的 LUT
+class ClaheGrid {
+public:
+    // channels 为每像素字节数，前 colorChannels 个通道参与均衡化，其余（alpha）保持不变
+    ClaheGrid(int width, int height, int channels, int colorChannels, int tileSize);
+
+    int getTilesX() const { return tilesX; }
+    int getTilesY() const { return tilesY; }
+    int getTileSize() const { return tileSize; }
+
+    // 一行分块的 LUT 字节数
+    qint64 lutRowBytes() const { return qint64(tilesX) * channels * 256; }
+    // 一行分块的直方图计数个数（奇偶像素各计一份，相邻同值像素的计数不互相等待）
+    qint64 histogramSize() const { return qint64(tilesX) * channels * 256 * 2; }
+    // 存放 LUT 的缓冲区需要在末尾多留的字节（AVX2 按 4 字节收集单个字节）
+    static const int kLutPadding = 4;
+
+    // 将同属一行分块的 rows 行像素累加到该行分块的直方图
+    void accumulate(const unsigned char* src, qint64 stride, int rows, quint32* histogram) const;
+
+    // 由第 tileRow 行分块的直方图生成其 LUT（直方图在剪切时被修改）
+    void buildLuts(int tileRow, quint32* histogram, double clipLimit, unsigned char* luts) const;
+
+    // 第 y 行插值所用的上下两行分块及其中下一行的权重（0..256）
+    void rowTiles(int y, int& tileRow1, int& tileRow2, int& weight) const;
+
+    // 用两行分块的 LUT 插值映射一行像素，src 与 dst 可以相同
+    void mapRow(const unsigned char* src, unsigned char* dst, const unsigned char* luts1,
+                const unsigned char* luts2, int weight) const;
+
+private:
+    int width;
+    int height;
+    int channels;
+    int colorChannels;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    // 行内第 i 个字节所属分块与通道的 LUT 偏移（左、右两个分块）及右侧分块的权重（0..256）
+    std::vector<qint32> offsetLeft;
+    std::vector<qint32> offsetRight;
+    std::vector<qint32> weightRight;
+    // 行内第 i 个字节计入的直方图偏移，奇数列像素计入后一半（alpha 通道也计数但不使用，省去逐字节判断）
+    std::vector<qint32> histogramOffset;
+};
+
+class Clahe {
+public:
+    // 原地处理 width x height、每像素 channels 字节的 8 位图像，前 colorChannels 个通道各自独立均衡化。
+    // 各分块的直方图按分块行并行统计，最后一遍按行并行插值写出；返回 false 表示被取消
+    static bool apply(unsigned char* pixels, int width, int height, qint64 stride, int channels,
+                      int colorChannels, const ClaheOptions& options = ClaheOptions());
+};
+
+#endif // CLAHE_H
@@ -0,0 +1,573 @@
+#include "colorconvert.h"
+#include "parallel.h"
+#include "planar.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// 交错像素每次拆分到栈上临时平面的像素数
+const int kChunk = 256;
+
+const int kShift = 14;
+const int kHalf = 1 << (kShift - 1);
+
+inline int clampByte(int v) {
+    return std::min(255, std::max(0, v));
+}
+
+// ---------------- 线性变换（灰度、YCbCr） ----------------
+
+// out = clamp((w0 a + w1 b + w2 c + offset) >> 14)，系数须在 int16 范围内
+struct Linear {
+    int w0, w1, w2, offset;
+};
+
+// 输入依次为 B、G、R
+const Linear kGray = {1868, 9617, 4899, kHalf};
+const Linear kY = kGray;
+const Linear kCb = {8192, -5427, -2765, (128 << kShift) + kHalf};
+const Linear kCr = {-1332, -6860, 8192, (128 << kShift) + kHalf};
+// 输入依次为 Y、Cb、Cr
+const Linear kB = {16384, 29032, 0, -128 * 29032 + kHalf};
+const Linear kG = {16384, -5638, -11700, 128 * (5638 + 11700) + kHalf};
+const Linear kR = {16384, 0, 22970, -128 * 22970 + kHalf};
+
+void linearRowScalar(const unsigned char* a, const unsigned char* b, const unsigned char* c, int n,
+                     const Linear& w, unsigned char* out) {
+    for (int x = 0; x < n; ++x) {
+        out[x] = static_cast<unsigned char>(clampByte((w.w0 * a[x] + w.w1 * b[x] + w.w2 * c[x] + w.offset) >> kShift));
+    }
+}
+
+// ---------------- HSV ----------------
+
+const int kHsvShift = 12;
+
+// 逆变换中 s f 的最大值：S 最大 255，扇区内的位置 f 最大 30
+const int kHsvSpan = 255 * 30;
+
+// 除法表：sdiv[v] = 255 * 2^12 / v，hdiv[d] = 180 * 2^12 / (6 d)；
+// 逆变换的系数表 scale[k] = (1 - k / 7650) * 2^16，v 乘以它即 p、q、t
+struct HsvTables {
+    alignas(32) int sdiv[256];
+    alignas(32) int hdiv[256];
+    alignas(32) int scale[kHsvSpan + 1];
+
+    HsvTables() {
+        sdiv[0] = hdiv[0] = 0;
+        for (int i = 1; i < 256; ++i) {
+            sdiv[i] = int(std::lround((255 << kHsvShift) / double(i)));
+            hdiv[i] = int(std::lround((180 << kHsvShift) / (6.0 * i)));
+        }
+        for (int k = 0; k <= kHsvSpan; ++k) {
+            scale[k] = int(std::lround((kHsvSpan - k) * 65536.0 / kHsvSpan));
+        }
+    }
+};
+
+const HsvTables& hsvTables() {
+    static const HsvTables tables;
+    return tables;
+}
+
+void bgrToHsvRowScalar(const unsigned char* b, const unsigned char* g, const unsigned char* r, int n,
+                       unsigned char* h, unsigned char* s, unsigned char* v) {
+    const HsvTables& t = hsvTables();
+    for (int x = 0; x < n; ++x) {
+        int vmax = std::max({b[x], g[x], r[x]});
+        int diff = vmax - std::min({b[x], g[x], r[x]});
+        int hue;
+        if (vmax == r[x]) {
+            hue = g[x] - b[x];
+        } else if (vmax == g[x]) {
+            hue = b[x] - r[x] + 2 * diff;
+        } else {
+            hue = r[x] - g[x] + 4 * diff;
+        }
+        hue = (hue * t.hdiv[diff] + (1 << (kHsvShift - 1))) >> kHsvShift;
+        if (hue < 0) {
+            hue += 180;
+        }
+        h[x] = static_cast<unsigned char>(hue);
+        s[x] = static_cast<unsigned char>((diff * t.sdiv[vmax] + (1 << (kHsvShift - 1))) >> kHsvShift);
+        v[x] = static_cast<unsigned char>(vmax);
+    }
+}
+
+// 每个 60 度扇区中 R、G、B 分别取 v、p、q、t 中的哪一个（0 = v，1 = p，2 = q，3 = t）
+const int kSectorR[6] = {0, 2, 1, 1, 3, 0};
+const int kSectorG[6] = {3, 0, 0, 2, 1, 1};
+const int kSectorB[6] = {1, 1, 3, 0, 0, 2};
+
+void hsvToBgrRowScalar(const unsigned char* h, const unsigned char* s, const unsigned char* v, int n,
+                       unsigned char* b, unsigned char* g, unsigned char* r) {
+    const HsvTables& t = hsvTables();
+    for (int x = 0; x < n; ++x) {
+        int hue = h[x] >= 180 ? h[x] - 180 : h[x];
+        int sector = hue / 30;
+        int f = hue - sector * 30;
+        int values[4];
+        values[0] = v[x];
+        values[1] = (v[x] * t.scale[30 * s[x]] + 32768) >> 16;
+        values[2] = (v[x] * t.scale[s[x] * f] + 32768) >> 16;
+        values[3] = (v[x] * t.scale[s[x] * (30 - f)] + 32768) >> 16;
+        b[x] = static_cast<unsigned char>(values[kSectorB[sector]]);
+        g[x] = static_cast<unsigned char>(values[kSectorG[sector]]);
+        r[x] = static_cast<unsigned char>(values[kSectorR[sector]]);
+    }
+}
+
+// ---------------- Lab ----------------
+
+const int kLabShift = 12;
+const int kLabOne = 1 << kLabShift;
+// 逆变换中 f(t) 的取值范围（Q12），由 L、a、b 的取值范围决定
+const int kFinvMin = -2560;
+const int kFinvMax = 7168;
+
+struct LabTables {
+    alignas(32) int linear[256];            // sRGB 编码值 -> 线性亮度（Q12）
+    alignas(32) int cbrt[kLabOne + 1];      // t（Q12）-> f(t)（Q12）
+    alignas(32) int encode[kLabOne + 1];    // 线性亮度（Q12）-> sRGB 编码值
+    alignas(32) int fyOfL[256];             // L（8 位）-> f(Y)（Q12）
+    alignas(32) int aOffset[256];           // a（8 位）-> f(X) - f(Y)（Q12）
+    alignas(32) int bOffset[256];           // b（8 位）-> f(Y) - f(Z)（Q12）
+    alignas(32) int finv[kFinvMax - kFinvMin + 1];  // f（Q12，减去 kFinvMin）-> t（Q12）
+    int toXyz[3][3];    // 行为 X/Xn、Y、Z/Zn，列为 B、G、R（Q12，每行之和为 2^12，白色正好映射到 1）
+    int toRgb[3][3];    // 行为 B、G、R，列为 X、Y、Z（已乘白点，Q12）
+    int lScale, lOffset;  // L（8 位）= (lScale f(Y) + lOffset) >> 14
+
+    LabTables() {
+        const double xyz[3][3] = {{0.412453, 0.357580, 0.180423},
+                                  {0.212671, 0.715160, 0.072169},
+                                  {0.019334, 0.119193, 0.950227}};
+        const double rgb[3][3] = {{3.240479, -1.537150, -0.498535},
+                                  {-0.969256, 1.875992, 0.041556},
+                                  {0.055648, -0.204043, 1.057311}};
+        const double white[3] = {0.950456, 1.0, 1.088754};
+        for (int row = 0; row < 3; ++row) {
+            int sum = 0;
+            int largest = 0;
+            for (int c = 0; c < 3; ++c) {
+                // xyz 的列为 R、G、B，这里换成 B、G、R
+                toXyz[row][c] = int(std::lround(xyz[row][2 - c] / white[row] * kLabOne));
+                sum += toXyz[row][c];
+                if (toXyz[row][c] > toXyz[row][largest]) {
+                    largest = c;
+                }
+            }
+            toXyz[row][largest] += kLabOne - sum;
+            for (int c = 0; c < 3; ++c) {
+                toRgb[row][c] = int(std::lround(rgb[2 - row][c] * white[c] * kLabOne));
+            }
+        }
+
+        for (int i = 0; i < 256; ++i) {
+            double c = i / 255.0;
+            double l = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            linear[i] = int(std::lround(l * kLabOne));
+            fyOfL[i] = int(std::lround((i / 2.55 + 16.0) / 116.0 * kLabOne));
+            aOffset[i] = int(std::lround((i - 128) / 500.0 * kLabOne));
+            bOffset[i] = int(std::lround((i - 128) / 200.0 * kLabOne));
+        }
+        for (int i = 0; i <= kLabOne; ++i) {
+            double t = double(i) / kLabOne;
+            double f = t > 0.008856 ? std::cbrt(t) : 7.787 * t + 16.0 / 116.0;
+            cbrt[i] = int(std::lround(f * kLabOne));
+            double e = t <= 0.0031308 ? 12.92 * t : 1.055 * std::pow(t, 1 / 2.4) - 0.055;
+            encode[i] = clampByte(int(std::lround(e * 255)));
+        }
+        for (int i = kFinvMin; i <= kFinvMax; ++i) {
+            double f = double(i) / kLabOne;
+            double t = f > 6.0 / 29.0 ? f * f * f : (f - 16.0 / 116.0) / 7.787;
+            finv[i - kFinvMin] = std::max(0, int(std::lround(t * kLabOne)));
+        }
+        // L = 116 f(Y) - 16，放大 2.55 倍；f(Y) 为 Q12，结果取 Q14
+        lScale = int(std::lround(116 * 2.55 * (1 << kShift) / kLabOne));
+        lOffset = -int(std::lround(16 * 2.55 * (1 << kShift))) + kHalf;
+    }
+};
+
+const LabTables& labTables() {
+    static const LabTables tables;
+    return tables;
+}
+
+inline int clampLinear(int v) {
+    return std::min(kLabOne, std::max(0, v));
+}
+
+inline int clampFinv(int f) {
+    return std::min(kFinvMax, std::max(kFinvMin, f)) - kFinvMin;
+}
+
+void bgrToLabRowScalar(const unsigned char* b, const unsigned char* g, const unsigned char* r, int n,
+                       unsigned char* lOut, unsigned char* aOut, unsigned char* bOut) {
+    const LabTables& t = labTables();
+    const int round = 1 << (kLabShift - 1);
+    for (int x = 0; x < n; ++x) {
+        int lb = t.linear[b[x]], lg = t.linear[g[x]], lr = t.linear[r[x]];
+        int f[3];
+        for (int row = 0; row < 3; ++row) {
+            int v = (t.toXyz[row][0] * lb + t.toXyz[row][1] * lg + t.toXyz[row][2] * lr + round) >> kLabShift;
+            f[row] = t.cbrt[clampLinear(v)];
+        }
+        lOut[x] = static_cast<unsigned char>(clampByte((t.lScale * f[1] + t.lOffset) >> kShift));
+        aOut[x] = static_cast<unsigned char>(clampByte((500 * (f[0] - f[1]) + (128 << kLabShift) + round) >> kLabShift));
+        bOut[x] = static_cast<unsigned char>(clampByte((200 * (f[1] - f[2]) + (128 << kLabShift) + round) >> kLabShift));
+    }
+}
+
+void labToBgrRowScalar(const unsigned char* lIn, const unsigned char* aIn, const unsigned char* bIn, int n,
+                       unsigned char* b, unsigned char* g, unsigned char* r) {
+    const LabTables& t = labTables();
+    const int round = 1 << (kLabShift - 1);
+    unsigned char* out[3] = {b, g, r};
+    for (int x = 0; x < n; ++x) {
+        int fy = t.fyOfL[lIn[x]];
+        int xyz[3] = {t.finv[clampFinv(fy + t.aOffset[aIn[x]])], t.finv[clampFinv(fy)],
+                      t.finv[clampFinv(fy - t.bOffset[bIn[x]])]};
+        for (int row = 0; row < 3; ++row) {
+            int v = (t.toRgb[row][0] * xyz[0] + t.toRgb[row][1] * xyz[1] + t.toRgb[row][2] * xyz[2] + round)
+                    >> kLabShift;
+            out[row][x] = static_cast<unsigned char>(t.encode[clampLinear(v)]);
+        }
+    }
+}
+
+// ---------------- AVX2 ----------------
+
+#if MYQIMAGE_X86_SIMD
+MYQIMAGE_TARGET_AVX2
+inline __m256i load8(const unsigned char* p) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+// 8 个 32 位值饱和到 [0, 255] 后写出 8 字节
+MYQIMAGE_TARGET_AVX2
+inline void store8(unsigned char* p, __m256i v) {
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v, v), v);
+    __m128i bytes = _mm_unpacklo_epi32(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), bytes);
+}
+
+MYQIMAGE_TARGET_AVX2
+inline __m256i pairWeights(int low, int high) {
+    return _mm256_set1_epi32(int((quint32(high) << 16) | (quint32(low) & 0xffff)));
+}
+
+// 每次 16 个像素：8 位扩展为 16 位，(a, b) 与 (c, 0) 交错成对后用 madd 得到 32 位的加权和
+MYQIMAGE_TARGET_AVX2
+void linearRowAvx2(const unsigned char* a, const unsigned char* b, const unsigned char* c, int n,
+                   const Linear& w, unsigned char* out) {
+    const __m256i wab = pairWeights(w.w0, w.w1);
+    const __m256i wc = pairWeights(w.w2, 0);
+    const __m256i offset = _mm256_set1_epi32(w.offset);
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x)));
+        __m256i vc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c + x)));
+        __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb), wab),
+                                      _mm256_madd_epi16(_mm256_unpacklo_epi16(vc, zero), wc));
+        __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb), wab),
+                                      _mm256_madd_epi16(_mm256_unpackhi_epi16(vc, zero), wc));
+        lo = _mm256_srai_epi32(_mm256_add_epi32(lo, offset), kShift);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(hi, offset), kShift);
+        // unpack 与 pack 都在各自的 128 位内进行，两次交错相互抵消，16 位结果已按像素顺序排列
+        __m256i words = _mm256_packs_epi32(lo, hi);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm256_castsi256_si128(bytes));
+    }
+    linearRowScalar(a + x, b + x, c + x, n - x, w, out + x);
+}
+
+MYQIMAGE_TARGET_AVX2
+void bgrToHsvRowAvx2(const unsigned char* b, const unsigned char* g, const unsigned char* r, int n,
+                     unsigned char* h, unsigned char* s, unsigned char* v) {
+    const HsvTables& t = hsvTables();
+    const __m256i round = _mm256_set1_epi32(1 << (kHsvShift - 1));
+    const __m256i full = _mm256_set1_epi32(180);
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i vb = load8(b + x);
+        __m256i vg = load8(g + x);
+        __m256i vr = load8(r + x);
+        __m256i vmax = _mm256_max_epi32(_mm256_max_epi32(vb, vg), vr);
+        __m256i diff = _mm256_sub_epi32(vmax, _mm256_min_epi32(_mm256_min_epi32(vb, vg), vr));
+        // 与标量相同的优先级：最大值为 R，否则为 G，否则为 B
+        __m256i isR = _mm256_cmpeq_epi32(vmax, vr);
+        __m256i isG = _mm256_cmpeq_epi32(vmax, vg);
+        __m256i hueR = _mm256_sub_epi32(vg, vb);
+        __m256i hueG = _mm256_add_epi32(_mm256_sub_epi32(vb, vr), _mm256_slli_epi32(diff, 1));
+        __m256i hueB = _mm256_add_epi32(_mm256_sub_epi32(vr, vg), _mm256_slli_epi32(diff, 2));
+        __m256i hue = _mm256_blendv_epi8(_mm256_blendv_epi8(hueB, hueG, isG), hueR, isR);
+        __m256i hdiv = _mm256_i32gather_epi32(t.hdiv, diff, 4);
+        __m256i sdiv = _mm256_i32gather_epi32(t.sdiv, vmax, 4);
+        hue = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(hue, hdiv), round), kHsvShift);
+        hue = _mm256_add_epi32(hue, _mm256_and_si256(_mm256_cmpgt_epi32(zero, hue), full));
+        __m256i sat = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), round), kHsvShift);
+        store8(h + x, hue);
+        store8(s + x, sat);
+        store8(v + x, vmax);
+    }
+    bgrToHsvRowScalar(b + x, g + x, r + x, n - x, h + x, s + x, v + x);
+}
+
+// v 乘以 scale[k] 后取 Q16 的四舍五入
+MYQIMAGE_TARGET_AVX2
+inline __m256i scaleValueAvx2(const HsvTables& t, __m256i v, __m256i k) {
+    __m256i product = _mm256_mullo_epi32(v, _mm256_i32gather_epi32(t.scale, k, 4));
+    return _mm256_srli_epi32(_mm256_add_epi32(product, _mm256_set1_epi32(32768)), 16);
+}
+
+MYQIMAGE_TARGET_AVX2
+void hsvToBgrRowAvx2(const unsigned char* h, const unsigned char* s, const unsigned char* v, int n,
+                     unsigned char* b, unsigned char* g, unsigned char* r) {
+    const HsvTables& t = hsvTables();
+    const __m256i c30 = _mm256_set1_epi32(30);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i hue = load8(h + x);
+        __m256i sat = load8(s + x);
+        __m256i val = load8(v + x);
+        hue = _mm256_sub_epi32(hue, _mm256_and_si256(_mm256_cmpgt_epi32(hue, _mm256_set1_epi32(179)),
+                                                     _mm256_set1_epi32(180)));
+        // hue < 180 时 (hue * 2185) >> 16 等于 hue / 30
+        __m256i sector = _mm256_srli_epi32(_mm256_mullo_epi32(hue, _mm256_set1_epi32(2185)), 16);
+        __m256i f = _mm256_sub_epi32(hue, _mm256_mullo_epi32(sector, c30));
+        __m256i p = scaleValueAvx2(t, val, _mm256_mullo_epi32(sat, c30));
+        __m256i q = scaleValueAvx2(t, val, _mm256_mullo_epi32(sat, f));
+        __m256i tt = scaleValueAvx2(t, val, _mm256_mullo_epi32(sat, _mm256_sub_epi32(c30, f)));
+        __m256i m1 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(1));
+        __m256i m2 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(2));
+        __m256i m3 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(3));
+        __m256i m4 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(4));
+        __m256i m5 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(5));
+        // 与 kSectorR/G/B 相同的选择
+        __m256i vr = _mm256_blendv_epi8(val, q, m1);
+        vr = _mm256_blendv_epi8(vr, p, _mm256_or_si256(m2, m3));
+        vr = _mm256_blendv_epi8(vr, tt, m4);
+        __m256i vg = _mm256_blendv_epi8(tt, val, _mm256_or_si256(m1, m2));
+        vg = _mm256_blendv_epi8(vg, q, m3);
+        vg = _mm256_blendv_epi8(vg, p, _mm256_or_si256(m4, m5));
+        __m256i vb = _mm256_blendv_epi8(p, tt, m2);
+        vb = _mm256_blendv_epi8(vb, val, _mm256_or_si256(m3, m4));
+        vb = _mm256_blendv_epi8(vb, q, m5);
+        store8(b + x, vb);
+        store8(g + x, vg);
+        store8(r + x, vr);
+    }
+    hsvToBgrRowScalar(h + x, s + x, v + x, n - x, b + x, g + x, r + x);
+}
+
+MYQIMAGE_TARGET_AVX2
+inline __m256i clampAvx2(__m256i v, int high) {
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(high));
+}
+
+// 3x3 定点矩阵乘一行：(m0 a + m1 b + m2 c + round) >> 12
+MYQIMAGE_TARGET_AVX2
+inline __m256i matrixRowAvx2(const int* m, __m256i a, __m256i b, __m256i c) {
+    __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_set1_epi32(m[0])),
+                                   _mm256_mullo_epi32(b, _mm256_set1_epi32(m[1])));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(c, _mm256_set1_epi32(m[2])));
+    return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(1 << (kLabShift - 1))), kLabShift);
+}
+
+MYQIMAGE_TARGET_AVX2
+void bgrToLabRowAvx2(const unsigned char* b, const unsigned char* g, const unsigned char* r, int n,
+                     unsigned char* lOut, unsigned char* aOut, unsigned char* bOut) {
+    const LabTables& t = labTables();
+    const __m256i center = _mm256_set1_epi32((128 << kLabShift) + (1 << (kLabShift - 1)));
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i lb = _mm256_i32gather_epi32(t.linear, load8(b + x), 4);
+        __m256i lg = _mm256_i32gather_epi32(t.linear, load8(g + x), 4);
+        __m256i lr = _mm256_i32gather_epi32(t.linear, load8(r + x), 4);
+        __m256i fx = _mm256_i32gather_epi32(t.cbrt, clampAvx2(matrixRowAvx2(t.toXyz[0], lb, lg, lr), kLabOne), 4);
+        __m256i fy = _mm256_i32gather_epi32(t.cbrt, clampAvx2(matrixRowAvx2(t.toXyz[1], lb, lg, lr), kLabOne), 4);
+        __m256i fz = _mm256_i32gather_epi32(t.cbrt, clampAvx2(matrixRowAvx2(t.toXyz[2], lb, lg, lr), kLabOne), 4);
+        __m256i l = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(fy, _mm256_set1_epi32(t.lScale)),
+                                                       _mm256_set1_epi32(t.lOffset)), kShift);
+        __m256i a = _mm256_srai_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(fx, fy), _mm256_set1_epi32(500)), center), kLabShift);
+        __m256i bb = _mm256_srai_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(fy, fz), _mm256_set1_epi32(200)), center), kLabShift);
+        store8(lOut + x, l);
+        store8(aOut + x, a);
+        store8(bOut + x, bb);
+    }
+    bgrToLabRowScalar(b + x, g + x, r + x, n - x, lOut + x, aOut + x, bOut + x);
+}
+
+MYQIMAGE_TARGET_AVX2
+inline __m256i finvAvx2(const LabTables& t, __m256i f) {
+    f = _mm256_min_epi32(_mm256_max_epi32(f, _mm256_set1_epi32(kFinvMin)), _mm256_set1_epi32(kFinvMax));
+    return _mm256_i32gather_epi32(t.finv, _mm256_sub_epi32(f, _mm256_set1_epi32(kFinvMin)), 4);
+}
+
+MYQIMAGE_TARGET_AVX2
+void labToBgrRowAvx2(const unsigned char* lIn, const unsigned char* aIn, const unsigned char* bIn, int n,
+                     unsigned char* b, unsigned char* g, unsigned char* r) {
+    const LabTables& t = labTables();
+    unsigned char* out[3] = {b, g, r};
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i fy = _mm256_i32gather_epi32(t.fyOfL, load8(lIn + x), 4);
+        __m256i fx = _mm256_add_epi32(fy, _mm256_i32gather_epi32(t.aOffset, load8(aIn + x), 4));
+        __m256i fz = _mm256_sub_epi32(fy, _mm256_i32gather_epi32(t.bOffset, load8(bIn + x), 4));
+        __m256i vx = finvAvx2(t, fx);
+        __m256i vy = finvAvx2(t, fy);
+        __m256i vz = finvAvx2(t, fz);
+        for (int row = 0; row < 3; ++row) {
+            __m256i v = clampAvx2(matrixRowAvx2(t.toRgb[row], vx, vy, vz), kLabOne);
+            store8(out[row] + x, _mm256_i32gather_epi32(t.encode, v, 4));
+        }
+    }
+    labToBgrRowScalar(lIn + x, aIn + x, bIn + x, n - x, b + x, g + x, r + x);
+}
+#endif
+
+// ---------------- 分派 ----------------
+
+void linearRow(const unsigned char* a, const unsigned char* b, const unsigned char* c, int n,
+               const Linear& w, unsigned char* out) {
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        linearRowAvx2(a, b, c, n, w, out);
+        return;
+    }
+#endif
+    linearRowScalar(a, b, c, n, w, out);
+}
+
+// 三个输入平面到三个输出平面的一段像素
+using RowKernel = void (*)(const unsigned char*, const unsigned char*, const unsigned char*, int,
+                           unsigned char*, unsigned char*, unsigned char*);
+
+void bgrToYCbCrRow(const unsigned char* b, const unsigned char* g, const unsigned char* r, int n,
+                   unsigned char* y, unsigned char* cb, unsigned char* cr) {
+    linearRow(b, g, r, n, kY, y);
+    linearRow(b, g, r, n, kCb, cb);
+    linearRow(b, g, r, n, kCr, cr);
+}
+
+void yCbCrToBgrRow(const unsigned char* y, const unsigned char* cb, const unsigned char* cr, int n,
+                   unsigned char* b, unsigned char* g, unsigned char* r) {
+    linearRow(y, cb, cr, n, kB, b);
+    linearRow(y, cb, cr, n, kG, g);
+    linearRow(y, cb, cr, n, kR, r);
+}
+
+RowKernel forwardKernel(ColorSpace space) {
+    const bool avx2 = simdAvx2Enabled();
+    switch (space) {
+    case ColorSpace::Hsv:
+#if MYQIMAGE_X86_SIMD
+        if (avx2) {
+            return bgrToHsvRowAvx2;
+        }
+#endif
+        return bgrToHsvRowScalar;
+    case ColorSpace::Lab:
+#if MYQIMAGE_X86_SIMD
+        if (avx2) {
+            return bgrToLabRowAvx2;
+        }
+#endif
+        return bgrToLabRowScalar;
+    case ColorSpace::YCbCr:
+        break;
+    }
+    Q_UNUSED(avx2);
+    return bgrToYCbCrRow;
+}
+
+RowKernel inverseKernel(ColorSpace space) {
+    const bool avx2 = simdAvx2Enabled();
+    switch (space) {
+    case ColorSpace::Hsv:
+#if MYQIMAGE_X86_SIMD
+        if (avx2) {
+            return hsvToBgrRowAvx2;
+        }
+#endif
+        return hsvToBgrRowScalar;
+    case ColorSpace::Lab:
+#if MYQIMAGE_X86_SIMD
+        if (avx2) {
+            return labToBgrRowAvx2;
+        }
+#endif
+        return labToBgrRowScalar;
+    case ColorSpace::YCbCr:
+        break;
+    }
+    Q_UNUSED(avx2);
+    return yCbCrToBgrRow;
+}
+
+// 交错像素按 kChunk 分段拆到栈上的三个临时平面，再交给 fn(b, g, r, n, y, x)
+template <typename Fn>
+void forEachChunk(const unsigned char* src, qint64 srcStride, int width, int y0, int y1, Fn fn) {
+    alignas(64) unsigned char b[kChunk];
+    alignas(64) unsigned char g[kChunk];
+    alignas(64) unsigned char r[kChunk];
+    for (int y = y0; y < y1; ++y) {
+        const unsigned char* row = src + y * srcStride;
+        for (int x = 0; x < width; x += kChunk) {
+            int n = std::min(kChunk, width - x);
+            deinterleaveBgr(row + x * 3, 0, n, 1, b, g, r, 0);
+            fn(b, g, r, n, y, x);
+        }
+    }
+}
+
+}
+
+void ColorConvert::bgrToGray(const unsigned char* src, qint64 srcStride, int width, int height,
+                             unsigned char* gray, qint64 grayStride, int threads) {
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        forEachChunk(src, srcStride, width, y0, y1,
+                     [&](const unsigned char* b, const unsigned char* g, const unsigned char* r, int n, int y, int x) {
+            linearRow(b, g, r, n, kGray, gray + y * grayStride + x);
+        });
+    }, parallelRowThreads(height, threads));
+}
+
+void ColorConvert::bgrToPlanes(ColorSpace space, const unsigned char* src, qint64 srcStride, int width, int height,
+                               unsigned char* c0, unsigned char* c1, unsigned char* c2, qint64 planeStride,
+                               int threads) {
+    const RowKernel kernel = forwardKernel(space);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        forEachChunk(src, srcStride, width, y0, y1,
+                     [&](const unsigned char* b, const unsigned char* g, const unsigned char* r, int n, int y, int x) {
+            qint64 o = y * planeStride + x;
+            kernel(b, g, r, n, c0 + o, c1 + o, c2 + o);
+        });
+    }, parallelRowThreads(height, threads));
+}
+
+void ColorConvert::planesToBgr(ColorSpace space, const unsigned char* c0, const unsigned char* c1,
+                               const unsigned char* c2, qint64 planeStride, int width, int height,
+                               unsigned char* dst, qint64 dstStride, int threads) {
+    const RowKernel kernel = inverseKernel(space);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        alignas(64) unsigned char b[kChunk];
+        alignas(64) unsigned char g[kChunk];
+        alignas(64) unsigned char r[kChunk];
+        for (int y = y0; y < y1; ++y) {
+            for (int x = 0; x < width; x += kChunk) {
+                int n = std::min(kChunk, width - x);
+                qint64 o = y * planeStride + x;
+                kernel(c0 + o, c1 + o, c2 + o, n, b, g, r);
+                interleaveBgr(b, g, r, 0, n, 1, dst + y * dstStride + x * 3, 0);
+            }
+        }
+    }, parallelRowThreads(height, threads));
+}
@@ -0,0 +1,36 @@
+#ifndef COLORCONVERT_H
+#define COLORCONVERT_H
+
+#include <QtGlobal>
+
+// 三通道颜色空间在 8 位平面中的取值：
+// Hsv：H 为色相角的一半 [0, 180)，S = 255 (max - min) / max，V = max
+// YCbCr：JPEG 使用的全范围 BT.601，Cb、Cr 以 128 为零点
+// Lab：CIE L*a*b*（sRGB，D65 白点），L 放大到 [0, 255]，a、b 以 128 为零点
+enum class ColorSpace {
+    Hsv,
+    YCbCr,
+    Lab
+};
+
+// 整幅图像的颜色空间转换：交错的 BGR 像素（MyQImage 的 Bgr24 布局）与调用方提供的 8 位平面之间互转，
+// 按行分给多个线程。内核全部为定点运算（Q14 系数，除法与非线性部分查表），
+// 支持 AVX2 时每次处理 8 或 16 个像素，标量路径与 AVX2 路径的结果逐位相同
+class ColorConvert {
+public:
+    // 灰度：(4899 r + 9617 g + 1868 b + 8192) >> 14，即 0.299/0.587/0.114 加权后四舍五入
+    static void bgrToGray(const unsigned char* src, qint64 srcStride, int width, int height,
+                          unsigned char* gray, qint64 grayStride, int threads = 0);
+
+    // BGR 转为 space 的三个平面：c0、c1、c2 依次为 H/S/V、Y/Cb/Cr 或 L/a/b，共用 planeStride
+    static void bgrToPlanes(ColorSpace space, const unsigned char* src, qint64 srcStride, int width, int height,
+                            unsigned char* c0, unsigned char* c1, unsigned char* c2, qint64 planeStride,
+                            int threads = 0);
+
+    // 由 space 的三个平面转回交错的 BGR，行尾的填充字节不写；H 不小于 180 时按减去 180 处理
+    static void planesToBgr(ColorSpace space, const unsigned char* c0, const unsigned char* c1,
+                            const unsigned char* c2, qint64 planeStride, int width, int height,
+                            unsigned char* dst, qint64 dstStride, int threads = 0);
+};
+
+#endif // COLORCONVERT_H
@@ -0,0 +1,367 @@
+#include "connectedcomponents.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// 每个条带至少的行数，进度也按这个粒度报告
+const int kMinRowsPerStrip = 64;
+
+// 一行中簇号相同的一段像素 [x0, x1)
+struct Run {
+    qint32 x0;
+    qint32 x1;
+    qint32 y;
+    qint32 label;
+};
+
+// 一个条带的游程，rowStart[r] 为条带第 r 行的第一个游程
+struct Strip {
+    int y0 = 0;
+    int y1 = 0;
+    std::vector<Run> runs;
+    std::vector<quint32> rowStart;
+    std::vector<quint32> parent;  // 条带内的并查集（局部下标），合并后复制到全局
+    qint64 base = 0;              // 第一个游程的全局下标
+};
+
+struct Accumulator {
+    qint64 area = 0;
+    qint64 sumX = 0;
+    qint64 sumY = 0;
+    qint64 sumB = 0;
+    qint64 sumG = 0;
+    qint64 sumR = 0;
+    int left = std::numeric_limits<int>::max();
+    int right = -1;
+    int top = std::numeric_limits<int>::max();
+    int bottom = -1;
+    int label = 0;
+
+    void merge(const Accumulator& other) {
+        area += other.area;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        sumB += other.sumB;
+        sumG += other.sumG;
+        sumR += other.sumR;
+        left = std::min(left, other.left);
+        right = std::max(right, other.right);
+        top = std::min(top, other.top);
+        bottom = std::max(bottom, other.bottom);
+        label = other.label;
+    }
+};
+
+// 路径减半；根总是集合中下标最小的游程，因此 parent[i] <= i
+inline quint32 findRoot(quint32* parent, quint32 i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+inline void unite(quint32* parent, quint32 a, quint32 b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+// 把一行拆成游程，整 8 字节相同时一次跳过
+void extractRuns(const unsigned char* row, int width, int y, std::vector<Run>& runs) {
+    int x = 0;
+    while (x < width) {
+        const unsigned char c = row[x];
+        const quint64 pattern = 0x0101010101010101ull * c;
+        int end = x + 1;
+        while (end + 8 <= width) {
+            quint64 word;
+            std::memcpy(&word, row + end, sizeof(word));
+            if (word != pattern) {
+                break;
+            }
+            end += 8;
+        }
+        while (end < width && row[end] == c) {
+            ++end;
+        }
+        runs.push_back({x, end, y, c});
+        x = end;
+    }
+}
+
+// 合并上下相邻两行中相连且簇号相同的游程：两行游程分别为 upper、lower 中 [begin, end) 的部分，
+// 下标加上各自的 offset 后为 parent 中的下标。reach 为 1 时（8 连通）对角相邻也算相连。
+// merged 非空时记录与上一行合并过的下一行游程（全局下标）
+void mergeRows(const Run* upper, quint32 upperBegin, quint32 upperEnd, qint64 upperOffset,
+               const Run* lower, quint32 lowerBegin, quint32 lowerEnd, qint64 lowerOffset,
+               int reach, quint32* parent, std::vector<quint32>* merged) {
+    quint32 i = upperBegin;
+    for (quint32 j = lowerBegin; j < lowerEnd; ++j) {
+        const Run& run = lower[j];
+        while (i < upperEnd && upper[i].x1 + reach <= run.x0) {
+            ++i;
+        }
+        for (quint32 k = i; k < upperEnd && upper[k].x0 < run.x1 + reach; ++k) {
+            if (upper[k].label == run.label) {
+                unite(parent, quint32(upperOffset + k), quint32(lowerOffset + j));
+                if (merged) {
+                    merged->push_back(quint32(lowerOffset + j));
+                }
+            }
+        }
+    }
+}
+
+void accumulateRun(const Run& run, int imageY, const unsigned char* pixels, qint64 pixelStride,
+                   Accumulator& acc) {
+    const qint64 length = run.x1 - run.x0;
+    acc.area += length;
+    acc.sumX += (qint64(run.x0) + run.x1 - 1) * length / 2;
+    acc.sumY += qint64(imageY) * length;
+    acc.left = std::min(acc.left, int(run.x0));
+    acc.right = std::max(acc.right, int(run.x1) - 1);
+    acc.top = std::min(acc.top, imageY);
+    acc.bottom = std::max(acc.bottom, imageY);
+    acc.label = run.label;
+    if (pixels) {
+        const unsigned char* p = pixels + run.y * pixelStride + qint64(run.x0) * 3;
+        qint64 b = 0, g = 0, r = 0;
+        for (qint64 x = 0; x < length; ++x, p += 3) {
+            b += p[0];
+            g += p[1];
+            r += p[2];
+        }
+        acc.sumB += b;
+        acc.sumG += g;
+        acc.sumR += r;
+    }
+}
+
+}
+
+ComponentResult ConnectedComponents::label(const unsigned char* labels, int width, int height, qint64 labelStride,
+                                           const unsigned char* pixels, qint64 pixelStride,
+                                           const ComponentOptions& options, quint32* regionMap) {
+    MYQIMAGE_TRACE_SCOPE("ConnectedComponents::label");
+    ComponentResult result;
+    if (!labels || width <= 0 || height <= 0) {
+        return result;
+    }
+    JobControl* control = options.control;
+    const int reach = options.connectivity == 8 ? 1 : 0;
+    const int stripCount = parallelRowThreads(height, options.threads, kMinRowsPerStrip);
+    std::vector<Strip> strips(stripCount);
+    for (int s = 0; s < stripCount; ++s) {
+        strips[s].y0 = int(qint64(height) * s / stripCount);
+        strips[s].y1 = int(qint64(height) * (s + 1) / stripCount);
+    }
+
+    // 第一遍：各条带独立拆分游程并在条带内合并，最后把条带内的并查集压平
+    if (control) {
+        control->beginStage(0, 60, height);
+    }
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            Strip& strip = strips[s];
+            for (int y = strip.y0; y < strip.y1; ++y) {
+                const quint32 begin = quint32(strip.runs.size());
+                strip.rowStart.push_back(begin);
+                extractRuns(labels + y * labelStride, width, y, strip.runs);
+                for (quint32 i = begin; i < strip.runs.size(); ++i) {
+                    strip.parent.push_back(i);
+                }
+                if (y > strip.y0) {
+                    const quint32 upper = strip.rowStart[strip.rowStart.size() - 2];
+                    mergeRows(strip.runs.data(), upper, begin, 0, strip.runs.data(), begin,
+                              quint32(strip.runs.size()), 0, reach, strip.parent.data(), nullptr);
+                }
+                if ((y - strip.y0 + 1) % kMinRowsPerStrip == 0 && control && !control->advance(kMinRowsPerStrip)) {
+                    return;
+                }
+            }
+            strip.rowStart.push_back(quint32(strip.runs.size()));
+            if (control) {
+                control->advance((strip.y1 - strip.y0) % kMinRowsPerStrip);
+            }
+            for (size_t i = 0; i < strip.parent.size(); ++i) {
+                strip.parent[i] = strip.parent[strip.parent[i]];
+            }
+        }
+    }, stripCount);
+    if (control && control->isCancelled()) {
+        result.cancelled = true;
+        return result;
+    }
+
+    // 条带内的并查集复制到全局（下标加上条带偏移），再依次合并条带边界
+    qint64 runCount = 0;
+    for (Strip& strip : strips) {
+        strip.base = runCount;
+        runCount += qint64(strip.runs.size());
+    }
+    std::vector<quint32> parent(runCount);
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const Strip& strip = strips[s];
+            quint32* out = parent.data() + strip.base;
+            for (size_t i = 0; i < strip.parent.size(); ++i) {
+                out[i] = quint32(strip.base + strip.parent[i]);
+            }
+        }
+    }, stripCount);
+    std::vector<quint32> borderRuns;
+    for (int s = 1; s < stripCount; ++s) {
+        const Strip& upper = strips[s - 1];
+        const Strip& lower = strips[s];
+        const quint32 upperBegin = upper.rowStart[upper.rowStart.size() - 2];
+        mergeRows(upper.runs.data(), upperBegin, quint32(upper.runs.size()), upper.base,
+                  lower.runs.data(), lower.rowStart[0], lower.rowStart[1], lower.base, reach, parent.data(),
+                  &borderRuns);
+    }
+
+    // 每个游程所属的根；根按全局下标顺序编号，parent 中根的位置改存区域编号
+    std::vector<quint32> region(runCount);
+    std::vector<qint64> rootsBefore(stripCount + 1, 0);
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const Strip& strip = strips[s];
+            qint64 roots = 0;
+            for (qint64 i = strip.base; i < strip.base + qint64(strip.runs.size()); ++i) {
+                quint32 root = parent[i];
+                while (parent[root] != root) {
+                    root = parent[root];
+                }
+                region[i] = root;
+                roots += root == quint32(i);
+            }
+            rootsBefore[s + 1] = roots;
+        }
+    }, stripCount);
+    for (int s = 0; s < stripCount; ++s) {
+        rootsBefore[s + 1] += rootsBefore[s];
+    }
+    const qint64 regionCount = rootsBefore[stripCount];
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const Strip& strip = strips[s];
+            quint32 next = quint32(rootsBefore[s]);
+            for (qint64 i = strip.base; i < strip.base + qint64(strip.runs.size()); ++i) {
+                if (region[i] == quint32(i)) {
+                    parent[i] = next++;
+                }
+            }
+        }
+    }, stripCount);
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const Strip& strip = strips[s];
+            for (qint64 i = strip.base; i < strip.base + qint64(strip.runs.size()); ++i) {
+                region[i] = parent[region[i]];
+            }
+        }
+    }, stripCount);
+
+    // 跨条带的区域由多个线程共同统计，各线程先累加到自己的小表里；其余区域只属于一个条带，直接写入总表
+    std::vector<qint32> sharedSlot(regionCount, -1);
+    int sharedCount = 0;
+    for (quint32 run : borderRuns) {
+        qint32& slot = sharedSlot[region[run]];
+        if (slot < 0) {
+            slot = sharedCount++;
+        }
+    }
+    std::vector<Accumulator> totals(regionCount);
+    std::vector<std::vector<Accumulator>> sharedPartial(stripCount);
+    if (control) {
+        control->beginStage(60, 100, height);
+    }
+    parallelFor(0, stripCount, [&](int, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const Strip& strip = strips[s];
+            std::vector<Accumulator>& partial = sharedPartial[s];
+            partial.resize(size_t(sharedCount));
+            for (int r = 0; r + 1 < int(strip.rowStart.size()); ++r) {
+                const int y = strip.y0 + r;
+                const int imageY = options.bottomUp ? height - 1 - y : y;
+                for (quint32 i = strip.rowStart[r]; i < strip.rowStart[r + 1]; ++i) {
+                    const quint32 id = region[strip.base + i];
+                    const qint32 slot = sharedSlot[id];
+                    accumulateRun(strip.runs[i], imageY, pixels, pixelStride, slot < 0 ? totals[id] : partial[slot]);
+                }
+                if ((r + 1) % kMinRowsPerStrip == 0 && control && !control->advance(kMinRowsPerStrip)) {
+                    return;
+                }
+            }
+            if (control) {
+                control->advance((strip.y1 - strip.y0) % kMinRowsPerStrip);
+            }
+        }
+    }, stripCount);
+    if (control && control->isCancelled()) {
+        result.cancelled = true;
+        return result;
+    }
+    for (qint64 id = 0; id < regionCount; ++id) {
+        if (sharedSlot[id] >= 0) {
+            for (const std::vector<Accumulator>& partial : sharedPartial) {
+                if (partial[sharedSlot[id]].area > 0) {
+                    totals[id].merge(partial[sharedSlot[id]]);
+                }
+            }
+        }
+    }
+
+    // 按面积筛选，生成紧凑的区域表
+    std::vector<quint32> finalIndex(regionCount, kNoRegion);
+    for (qint64 id = 0; id < regionCount; ++id) {
+        const Accumulator& acc = totals[id];
+        if (acc.area < options.minArea) {
+            result.removedRegions++;
+            result.removedArea += acc.area;
+            continue;
+        }
+        ComponentRegion item;
+        item.label = acc.label;
+        item.area = acc.area;
+        item.left = acc.left;
+        item.right = acc.right;
+        item.top = acc.top;
+        item.bottom = acc.bottom;
+        item.centroidX = double(acc.sumX) / acc.area;
+        item.centroidY = double(acc.sumY) / acc.area;
+        if (pixels) {
+            item.meanB = double(acc.sumB) / acc.area;
+            item.meanG = double(acc.sumG) / acc.area;
+            item.meanR = double(acc.sumR) / acc.area;
+        }
+        finalIndex[id] = quint32(result.regions.size());
+        result.regions.append(item);
+    }
+
+    if (regionMap) {
+        parallelFor(0, stripCount, [&](int, int s0, int s1) {
+            for (int s = s0; s < s1; ++s) {
+                const Strip& strip = strips[s];
+                for (size_t i = 0; i < strip.runs.size(); ++i) {
+                    const Run& run = strip.runs[i];
+                    quint32* out = regionMap + qint64(run.y) * width;
+                    std::fill(out + run.x0, out + run.x1, finalIndex[region[strip.base + i]]);
+                }
+            }
+        }, stripCount);
+    }
+    MYQIMAGE_TRACE_COUNTER("components.runs", runCount);
+    MYQIMAGE_TRACE_COUNTER("components.regions", regionCount);
+    return result;
+}
@@ -0,0 +1,57 @@
+#ifndef CONNECTEDCOMPONENTS_H
+#define CONNECTEDCOMPONENTS_H
+
+#include <QtGlobal>
+#include <QVector>
+
+class JobControl;
+
+// 连通区域标记参数
+struct ComponentOptions {
+    int connectivity = 4;      // 4 或 8 连通
+    qint64 minArea = 0;        // 面积（像素数）小于该值的区域从结果中去掉，<= 1 时全部保留
+    bool bottomUp = false;     // 行序自下而上（MyQImage 的布局）：结果中的 y 换算为自上而下的图像坐标
+    int threads = 0;           // 线程数，<= 0 取 CPU 核数
+    JobControl* control = nullptr;  // 进度与取消
+};
+
+// 一个连通区域：簇号相同且相连的像素
+struct ComponentRegion {
+    int label = 0;             // 区域的簇号
+    qint64 area = 0;           // 像素数
+    int left = 0;              // 外接矩形（含边界）
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    double centroidX = 0;      // 质心（像素中心坐标的平均值）
+    double centroidY = 0;
+    double meanB = 0;          // 区域内像素的平均颜色，未提供像素时为 0
+    double meanG = 0;
+    double meanR = 0;
+};
+
+struct ComponentResult {
+    QVector<ComponentRegion> regions;  // 按区域最上（行序中最先出现）的像素排列
+    qint64 removedRegions = 0;         // 因面积不足被去掉的区域数
+    qint64 removedArea = 0;            // 被去掉的像素数
+    bool cancelled = false;
+};
+
+// 连通区域标记：每个线程处理一个行条带，把每行拆成同簇号的游程（run），
+// 与上一行重叠的游程用并查集合并；条带之间只需合并边界行的游程。
+// 面积、外接矩形、质心与平均颜色在最后一遍逐游程统计，不生成整幅的区域编号图
+class ConnectedComponents {
+public:
+    // 值表示区域被去掉（regionMap 中）
+    static const quint32 kNoRegion = 0xFFFFFFFFu;
+
+    // labels 为 width x height 的簇号（每像素 1 字节，每行 labelStride 字节）。
+    // pixels 非空时为同尺寸的 Bgr24 像素（每行 pixelStride 字节），用于计算平均颜色；
+    // regionMap 非空时写出每个像素所属区域在结果中的下标（每像素 4 字节，每行 width 个），被去掉的为 kNoRegion
+    static ComponentResult label(const unsigned char* labels, int width, int height, qint64 labelStride,
+                                 const unsigned char* pixels, qint64 pixelStride,
+                                 const ComponentOptions& options = ComponentOptions(),
+                                 quint32* regionMap = nullptr);
+};
+
+#endif // CONNECTEDCOMPONENTS_H
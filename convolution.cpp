@@ -0,0 +1,652 @@
+#include "convolution.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// 将坐标 i 按边界方式映射到 [0, n)；Constant 模式下越界返回 -1
+int mapBorder(int i, int n, BorderMode mode) {
+    if (i >= 0 && i < n) {
+        return i;
+    }
+    switch (mode) {
+    case BorderMode::Constant:
+        return -1;
+    case BorderMode::Replicate:
+        return i < 0 ? 0 : n - 1;
+    case BorderMode::Reflect:
+        if (n == 1) {
+            return 0;
+        }
+        while (i < 0 || i >= n) {
+            i = i < 0 ? -i : 2 * (n - 1) - i;
+        }
+        return i;
+    case BorderMode::Wrap:
+        i %= n;
+        return i < 0 ? i + n : i;
+    }
+    return -1;
+}
+
+int absSum(const QVector<int>& values) {
+    int sum = 0;
+    for (int v : values) {
+        sum += std::abs(v);
+    }
+    return sum;
+}
+
+// 卷积执行计划：根据核的系数范围选择 16 位或 32 位中间结果，以及结果的归一化方式
+struct Plan {
+    int kw, kh;
+    int ax, ay;               // 锚点（核中心）
+    bool separable;
+    bool horizontal16;        // 水平一维卷积的结果可用 16 位保存
+    bool direct16;            // 二维卷积的累加可用 16 位完成
+    std::vector<qint16> row16, column16, coefficients16;
+    std::vector<int> row32, column32, coefficients32;
+    int divisor;
+    int divisorShift;         // divisor 为 2 的幂时的移位量，否则为 -1
+    float inverse;
+
+    explicit Plan(const ConvolutionKernel& kernel) {
+        kw = kernel.getWidth();
+        kh = kernel.getHeight();
+        ax = kw / 2;
+        ay = kh / 2;
+        separable = kernel.isSeparable();
+        divisor = std::max(1, kernel.getDivisor());
+        divisorShift = -1;
+        for (int s = 0; s < 31; ++s) {
+            if ((1 << s) == divisor) {
+                divisorShift = s;
+            }
+        }
+        inverse = 1.0f / divisor;
+
+        if (separable) {
+            for (int v : kernel.getRowVector()) {
+                row32.push_back(v);
+                row16.push_back(qint16(v));
+            }
+            for (int v : kernel.getColumnVector()) {
+                column32.push_back(v);
+                column16.push_back(qint16(v));
+            }
+            horizontal16 = absSum(kernel.getRowVector()) * 255 <= SHRT_MAX
+                           && absSum(kernel.getColumnVector()) <= SHRT_MAX;
+            direct16 = false;
+        } else {
+            int sum = 0;
+            for (int y = 0; y < kh; ++y) {
+                for (int x = 0; x < kw; ++x) {
+                    int c = kernel.coefficient(x, y);
+                    coefficients32.push_back(c);
+                    coefficients16.push_back(qint16(c));
+                    sum += std::abs(c);
+                }
+            }
+            horizontal16 = false;
+            direct16 = sum * 255 <= SHRT_MAX;
+        }
+    }
+
+    // 标量归一化，与 AVX2 路径逐位一致
+    int normalize(int v) const {
+        if (divisor == 1) {
+            return v;
+        }
+        if (divisorShift >= 0) {
+            return (v + (1 << divisorShift >> 1)) >> divisorShift;
+        }
+        return int(std::lrintf(float(v) * inverse));
+    }
+};
+
+// ---------------- 标量内核 ----------------
+
+void horizontalScalar(const Plan& plan, const unsigned char* padded, int n, int channels,
+                      qint16* out16, qint32* out32) {
+    for (int i = 0; i < n; ++i) {
+        int acc = 0;
+        for (int kx = 0; kx < plan.kw; ++kx) {
+            acc += plan.row32[kx] * padded[i + kx * channels];
+        }
+        if (out16) {
+            out16[i] = qint16(acc);
+        } else {
+            out32[i] = acc;
+        }
+    }
+}
+
+void verticalScalar16(const Plan& plan, const qint16* const* rows, int n, qint32* acc) {
+    for (int i = 0; i < n; ++i) {
+        int sum = 0;
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            sum += plan.column32[ky] * rows[ky][i];
+        }
+        acc[i] = sum;
+    }
+}
+
+void verticalScalar32(const Plan& plan, const qint32* const* rows, int n, qint32* acc) {
+    for (int i = 0; i < n; ++i) {
+        int sum = 0;
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            sum += plan.column32[ky] * rows[ky][i];
+        }
+        acc[i] = sum;
+    }
+}
+
+void directScalar(const Plan& plan, const unsigned char* const* rows, int n, int channels, qint32* acc) {
+    for (int i = 0; i < n; ++i) {
+        int sum = 0;
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            const int* c = &plan.coefficients32[ky * plan.kw];
+            const unsigned char* row = rows[ky] + i;
+            for (int kx = 0; kx < plan.kw; ++kx) {
+                sum += c[kx] * row[kx * channels];
+            }
+        }
+        acc[i] = sum;
+    }
+}
+
+void finishScalar(const Plan& plan, const qint32* acc, int from, int n, unsigned char* out8, qint16* out16) {
+    for (int i = from; i < n; ++i) {
+        int v = plan.normalize(acc[i]);
+        if (out8) {
+            out8[i] = static_cast<unsigned char>(std::min(255, std::max(0, v)));
+        } else {
+            out16[i] = static_cast<qint16>(std::min<int>(SHRT_MAX, std::max<int>(SHRT_MIN, v)));
+        }
+    }
+}
+
+// ---------------- AVX2 内核 ----------------
+
+#if MYQIMAGE_X86_SIMD
+MYQIMAGE_TARGET_AVX2
+void horizontalAvx2(const Plan& plan, const unsigned char* padded, int n, int channels, qint16* out) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int kx = 0; kx < plan.kw; ++kx) {
+            if (plan.row16[kx] == 0) {
+                continue;
+            }
+            __m256i v = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + i + kx * channels)));
+            acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(v, _mm256_set1_epi16(plan.row16[kx])));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), acc);
+    }
+    for (; i < n; ++i) {
+        int acc = 0;
+        for (int kx = 0; kx < plan.kw; ++kx) {
+            acc += plan.row32[kx] * padded[i + kx * channels];
+        }
+        out[i] = qint16(acc);
+    }
+}
+
+// 两行一组交错后用 madd 同时完成乘法与相加，得到 32 位结果
+MYQIMAGE_TARGET_AVX2
+void verticalAvx2(const Plan& plan, const qint16* const* rows, int n, qint32* acc) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = _mm256_setzero_si256();
+        __m256i hi = _mm256_setzero_si256();
+        for (int ky = 0; ky < plan.kh; ky += 2) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[ky] + i));
+            __m256i b = _mm256_setzero_si256();
+            qint16 cb = 0;
+            if (ky + 1 < plan.kh) {
+                b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[ky + 1] + i));
+                cb = plan.column16[ky + 1];
+            }
+            __m256i c = _mm256_set1_epi32(int(quint16(plan.column16[ky])) | (int(quint16(cb)) << 16));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+        }
+        // unpack 在每个 128 位通道内交错，重排回连续顺序
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    for (; i < n; ++i) {
+        int sum = 0;
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            sum += plan.column32[ky] * rows[ky][i];
+        }
+        acc[i] = sum;
+    }
+}
+
+MYQIMAGE_TARGET_AVX2
+void directAvx2(const Plan& plan, const unsigned char* const* rows, int n, int channels, qint32* acc) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            const qint16* c = &plan.coefficients16[ky * plan.kw];
+            for (int kx = 0; kx < plan.kw; ++kx) {
+                if (c[kx] == 0) {
+                    continue;
+                }
+                __m256i v = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[ky] + i + kx * channels)));
+                sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(v, _mm256_set1_epi16(c[kx])));
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i),
+                            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(sum)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i + 8),
+                            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(sum, 1)));
+    }
+    for (; i < n; ++i) {
+        int sum = 0;
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            const int* c = &plan.coefficients32[ky * plan.kw];
+            for (int kx = 0; kx < plan.kw; ++kx) {
+                sum += c[kx] * rows[ky][i + kx * channels];
+            }
+        }
+        acc[i] = sum;
+    }
+}
+
+MYQIMAGE_TARGET_AVX2
+inline __m256i normalizeAvx2(const Plan& plan, __m256i v) {
+    if (plan.divisor == 1) {
+        return v;
+    }
+    if (plan.divisorShift >= 0) {
+        v = _mm256_add_epi32(v, _mm256_set1_epi32(1 << plan.divisorShift >> 1));
+        return _mm256_sra_epi32(v, _mm_cvtsi32_si128(plan.divisorShift));
+    }
+    return _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(plan.inverse)));
+}
+
+MYQIMAGE_TARGET_AVX2
+void finishAvx2(const Plan& plan, const qint32* acc, int n, unsigned char* out8, qint16* out16) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = normalizeAvx2(plan, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)));
+        __m256i b = normalizeAvx2(plan, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i + 8)));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        if (out8) {
+            __m256i bytes = _mm256_packus_epi16(packed, packed);
+            bytes = _mm256_permute4x64_epi64(bytes, 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out8 + i), _mm256_castsi256_si128(bytes));
+        } else {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out16 + i), packed);
+        }
+    }
+    finishScalar(plan, acc, i, n, out8, out16);
+}
+#endif
+
+// 单线程处理一段连续行的工作者：环形缓存 kh 行的补边行（及水平卷积结果），
+// 顺序输出时每个输入行只补边、水平卷积一次
+class RowWorker {
+public:
+    RowWorker(const Plan& plan, int width, int height, int channels, BorderMode border,
+              const std::function<const unsigned char*(int)>& rowAt)
+        : plan(plan), width(width), height(height), channels(channels), border(border), rowAt(rowAt),
+          n(width * channels), paddedLength((width + plan.kw - 1) * channels),
+          avx2(simdAvx2Enabled()) {
+        // 所有缓冲取自当前线程的临时内存，调用方需处于 ScratchArena::Scope 之内
+        ScratchArena& arena = ScratchArena::local();
+        slotRow = arena.allocate<int>(plan.kh);
+        std::fill(slotRow, slotRow + plan.kh, INT_MIN);
+        accumulator = arena.allocate<qint32>(n);
+        paddedRows = arena.allocate<const unsigned char*>(plan.kh);
+        rows16 = arena.allocate<const qint16*>(plan.kh);
+        rows32 = arena.allocate<const qint32*>(plan.kh);
+        if (!plan.separable) {
+            padded = arena.allocate<unsigned char>(qint64(plan.kh) * paddedLength);
+        } else {
+            scratch = arena.allocate<unsigned char>(paddedLength);
+            if (plan.horizontal16) {
+                horizontal16 = arena.allocate<qint16>(qint64(plan.kh) * n);
+            } else {
+                horizontal32 = arena.allocate<qint32>(qint64(plan.kh) * n);
+            }
+        }
+    }
+
+    // 计算第 y 行并写入 out8 或 out16
+    void process(int y, unsigned char* out8, qint16* out16) {
+        for (int ky = 0; ky < plan.kh; ++ky) {
+            int r = y - plan.ay + ky;
+            int slot = ((r % plan.kh) + plan.kh) % plan.kh;
+            if (slotRow[slot] != r) {
+                prepare(slot, r);
+            }
+            if (plan.separable) {
+                rows16[ky] = horizontal16 + qint64(slot) * n;
+                rows32[ky] = horizontal32 + qint64(slot) * n;
+            } else {
+                paddedRows[ky] = padded + qint64(slot) * paddedLength;
+            }
+        }
+
+        qint32* acc = accumulator;
+#if MYQIMAGE_X86_SIMD
+        if (avx2) {
+            if (plan.separable && plan.horizontal16) {
+                verticalAvx2(plan, rows16, n, acc);
+            } else if (plan.separable) {
+                verticalScalar32(plan, rows32, n, acc);
+            } else if (plan.direct16) {
+                directAvx2(plan, paddedRows, n, channels, acc);
+            } else {
+                directScalar(plan, paddedRows, n, channels, acc);
+            }
+            finishAvx2(plan, acc, n, out8, out16);
+            return;
+        }
+#endif
+        if (plan.separable && plan.horizontal16) {
+            verticalScalar16(plan, rows16, n, acc);
+        } else if (plan.separable) {
+            verticalScalar32(plan, rows32, n, acc);
+        } else {
+            directScalar(plan, paddedRows, n, channels, acc);
+        }
+        finishScalar(plan, acc, 0, n, out8, out16);
+    }
+
+private:
+    // 将输入行 r（可能越界）补边后放入缓存槽，可分离核同时完成水平卷积
+    void prepare(int slot, int r) {
+        slotRow[slot] = r;
+        unsigned char* dst = plan.separable ? scratch : padded + qint64(slot) * paddedLength;
+        int mapped = mapBorder(r, height, border);
+        if (mapped < 0) {
+            std::fill(dst, dst + paddedLength, 0);
+        } else {
+            const unsigned char* src = rowAt(mapped);
+            std::copy(src, src + n, dst + plan.ax * channels);
+            for (int px = 0; px < plan.kw - 1; ++px) {
+                // 左侧 ax 个、右侧 kw-1-ax 个补边像素
+                int x = px < plan.ax ? px - plan.ax : width + (px - plan.ax);
+                int target = px < plan.ax ? px : width + px;
+                int sx = mapBorder(x, width, border);
+                for (int c = 0; c < channels; ++c) {
+                    dst[target * channels + c] = sx < 0 ? 0 : src[sx * channels + c];
+                }
+            }
+        }
+        if (!plan.separable) {
+            return;
+        }
+#if MYQIMAGE_X86_SIMD
+        if (avx2 && plan.horizontal16) {
+            horizontalAvx2(plan, dst, n, channels, horizontal16 + qint64(slot) * n);
+            return;
+        }
+#endif
+        horizontalScalar(plan, dst, n, channels,
+                         plan.horizontal16 ? horizontal16 + qint64(slot) * n : nullptr,
+                         plan.horizontal16 ? nullptr : horizontal32 + qint64(slot) * n);
+    }
+
+    const Plan& plan;
+    const int width, height, channels;
+    const BorderMode border;
+    const std::function<const unsigned char*(int)>& rowAt;
+    const int n;
+    const int paddedLength;
+    const bool avx2;
+    int* slotRow;                         // 每个缓存槽当前存放的输入行号
+    unsigned char* padded = nullptr;      // kh 行补边后的输入（二维核）
+    qint16* horizontal16 = nullptr;       // kh 行水平卷积结果（可分离核，16 位）
+    qint32* horizontal32 = nullptr;       // kh 行水平卷积结果（可分离核，32 位）
+    unsigned char* scratch = nullptr;     // 可分离核补边用的单行缓冲
+    qint32* accumulator;
+    const unsigned char** paddedRows;
+    const qint16** rows16;
+    const qint32** rows32;
+};
+
+// 按分块并行处理整幅图像
+void runTiled(const ConvolutionKernel& kernel, const unsigned char* src, int width, int height, qint64 stride,
+              int channels, const ConvolutionOptions& options,
+              const std::function<void(RowWorker&, int)>& processRow) {
+    Plan plan(kernel);
+    std::function<const unsigned char*(int)> rowAt = [src, stride](int y) { return src + y * stride; };
+    const int tileRows = std::max(1, options.tileRows);
+    const int tiles = (height + tileRows - 1) / tileRows;
+    parallelFor(0, tiles, [&](int, int t0, int t1) {
+        ScratchArena::Scope scope;
+        RowWorker worker(plan, width, height, channels, options.border, rowAt);
+        for (int t = t0; t < t1; ++t) {
+            if (options.control && options.control->isCancelled()) {
+                return;
+            }
+            int y1 = std::min(height, (t + 1) * tileRows);
+            for (int y = t * tileRows; y < y1; ++y) {
+                processRow(worker, y);
+            }
+            if (options.control) {
+                options.control->advance(y1 - t * tileRows);
+            }
+        }
+    }, options.threads);
+}
+
+}
+
+// ---------------- ConvolutionRowFilter ----------------
+
+struct ConvolutionRowFilter::Impl {
+    Impl(const ConvolutionKernel& kernel, int width, int height, int channels, BorderMode border,
+         const std::function<const unsigned char*(int)>& rowAt)
+        : plan(kernel), rowAt(rowAt), worker(plan, width, height, channels, border, this->rowAt) {}
+
+    Plan plan;
+    std::function<const unsigned char*(int)> rowAt;
+    RowWorker worker;
+};
+
+ConvolutionRowFilter::ConvolutionRowFilter(const ConvolutionKernel& kernel, int width, int height, int channels,
+                                           BorderMode border,
+                                           const std::function<const unsigned char*(int)>& rowAt)
+    : d(new Impl(kernel, width, height, channels, border, rowAt)) {}
+
+ConvolutionRowFilter::~ConvolutionRowFilter() = default;
+
+void ConvolutionRowFilter::process(int y, unsigned char* dst) {
+    d->worker.process(y, dst, nullptr);
+}
+
+// ---------------- ConvolutionKernel ----------------
+
+ConvolutionKernel::ConvolutionKernel() : coefficients(1, 1) {}
+
+ConvolutionKernel::ConvolutionKernel(int width, int height, const QVector<int>& coefficients, int divisor)
+    : width(width), height(height), coefficients(coefficients), divisor(std::max(1, divisor)) {
+    decompose();
+}
+
+ConvolutionKernel ConvolutionKernel::separable(const QVector<int>& row, const QVector<int>& column, int divisor) {
+    QVector<int> coefficients(row.size() * column.size());
+    for (int y = 0; y < column.size(); ++y) {
+        for (int x = 0; x < row.size(); ++x) {
+            coefficients[y * row.size() + x] = column[y] * row[x];
+        }
+    }
+    ConvolutionKernel kernel(row.size(), column.size(), coefficients, divisor);
+    kernel.rowVector = row;
+    kernel.columnVector = column;
+    return kernel;
+}
+
+// 整数秩一分解：以绝对值最大的系数所在行（除以公约数）作为行向量，验证每一行都是它的整数倍
+void ConvolutionKernel::decompose() {
+    rowVector.clear();
+    columnVector.clear();
+    int pivot = 0;
+    for (int i = 0; i < coefficients.size(); ++i) {
+        if (std::abs(coefficients[i]) > std::abs(coefficients[pivot])) {
+            pivot = i;
+        }
+    }
+    if (coefficients.isEmpty() || coefficients[pivot] == 0 || (width == 1 && height == 1)) {
+        return;
+    }
+    int py = pivot / width;
+    int px = pivot % width;
+    int g = 0;
+    for (int x = 0; x < width; ++x) {
+        int a = std::abs(coefficients[py * width + x]);
+        while (a) {
+            int t = g % a;
+            g = a;
+            a = t;
+        }
+    }
+    QVector<int> row(width), column(height);
+    for (int x = 0; x < width; ++x) {
+        row[x] = coefficients[py * width + x] / g;
+    }
+    for (int y = 0; y < height; ++y) {
+        int c = coefficients[y * width + px];
+        if (c % row[px] != 0) {
+            return;
+        }
+        column[y] = c / row[px];
+        for (int x = 0; x < width; ++x) {
+            if (coefficients[y * width + x] != column[y] * row[x]) {
+                return;
+            }
+        }
+    }
+    rowVector = row;
+    columnVector = column;
+}
+
+ConvolutionKernel ConvolutionKernel::sharpen() {
+    return ConvolutionKernel(3, 3, { 0, -1,  0,
+                                    -1,  5, -1,
+                                     0, -1,  0 });
+}
+
+ConvolutionKernel ConvolutionKernel::box(int radius) {
+    radius = std::max(0, radius);
+    QVector<int> ones(2 * radius + 1, 1);
+    return separable(ones, ones, ones.size() * ones.size());
+}
+
+ConvolutionKernel ConvolutionKernel::gaussian(int radius, double sigma) {
+    radius = std::max(0, radius);
+    if (sigma <= 0) {
+        sigma = 0.3 * (radius - 1) + 0.8;
+    }
+    // 每维系数和为 128，使水平卷积结果落在 16 位范围内；中心系数吸收舍入误差
+    QVector<double> weights(2 * radius + 1);
+    double total = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        weights[i + radius] = std::exp(-(i * i) / (2 * sigma * sigma));
+        total += weights[i + radius];
+    }
+    QVector<int> taps(2 * radius + 1);
+    int sum = 0;
+    for (int i = 0; i < taps.size(); ++i) {
+        taps[i] = int(std::lround(128 * weights[i] / total));
+        sum += taps[i];
+    }
+    taps[radius] += 128 - sum;
+    return separable(taps, taps, 128 * 128);
+}
+
+ConvolutionKernel ConvolutionKernel::sobelX() {
+    return separable({ -1, 0, 1 }, { 1, 2, 1 });
+}
+
+ConvolutionKernel ConvolutionKernel::sobelY() {
+    return separable({ 1, 2, 1 }, { -1, 0, 1 });
+}
+
+// ---------------- Convolution ----------------
+
+void Convolution::apply(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                        int channels, const ConvolutionKernel& kernel, const ConvolutionOptions& options) {
+    runTiled(kernel, src, width, height, stride, channels, options, [&](RowWorker& worker, int y) {
+        worker.process(y, dst + y * stride, nullptr);
+    });
+}
+
+void Convolution::applySigned(const unsigned char* src, qint16* dst, int width, int height, qint64 stride,
+                              int channels, const ConvolutionKernel& kernel, const ConvolutionOptions& options) {
+    const qint64 n = qint64(width) * channels;
+    runTiled(kernel, src, width, height, stride, channels, options, [&](RowWorker& worker, int y) {
+        worker.process(y, nullptr, dst + y * n);
+    });
+}
+
+void Convolution::convolveRows(const ConvolutionKernel& kernel, int width, int height, int channels,
+                               BorderMode border,
+                               const std::function<const unsigned char*(int)>& rowAt,
+                               const std::function<unsigned char*(int)>& dstRow,
+                               int y0, int y1) {
+    ScratchArena::Scope scope;
+    ConvolutionRowFilter filter(kernel, width, height, channels, border, rowAt);
+    for (int y = y0; y < y1; ++y) {
+        filter.process(y, dstRow(y));
+    }
+}
+
+int Convolution::borderIndex(int i, int n, BorderMode mode) {
+    return mapBorder(i, n, mode);
+}
+
+void Convolution::sobel(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                        int channels, const ConvolutionOptions& options) {
+    const qint64 n = qint64(width) * channels;
+    ScratchArena::Scope scope;
+    qint16* gx = ScratchArena::local().allocate<qint16>(n * height);
+    qint16* gy = ScratchArena::local().allocate<qint16>(n * height);
+    applySigned(src, gx, width, height, stride, channels, ConvolutionKernel::sobelX(), options);
+    applySigned(src, gy, width, height, stride, channels, ConvolutionKernel::sobelY(), options);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const qint16* a = gx + y * n;
+            const qint16* b = gy + y * n;
+            unsigned char* out = dst + y * stride;
+            for (qint64 i = 0; i < n; ++i) {
+                out[i] = static_cast<unsigned char>(std::min(255, std::abs(a[i]) + std::abs(b[i])));
+            }
+        }
+    }, options.threads);
+}
+
+void Convolution::unsharpMask(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                              int channels, int radius, double sigma, double amount,
+                              const ConvolutionOptions& options) {
+    // 先把模糊结果写到 dst，再原地与原图组合；amount 以 8 位定点参与整数运算
+    apply(src, dst, width, height, stride, channels, ConvolutionKernel::gaussian(radius, sigma), options);
+    const int weight = int(std::lround(amount * 256));
+    const qint64 n = qint64(width) * channels;
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char* s = src + y * stride;
+            unsigned char* d = dst + y * stride;
+            for (qint64 i = 0; i < n; ++i) {
+                int v = s[i] + (((s[i] - d[i]) * weight + 128) >> 8);
+                d[i] = static_cast<unsigned char>(std::min(255, std::max(0, v)));
+            }
+        }
+    }, options.threads);
+}
@@ -0,0 +1,119 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <functional>
+#include <memory>
+
+class JobControl;
+
+// 边界处理方式（以 abc|边界 为例）
+enum class BorderMode {
+    Constant,   // 边界外取 0
+    Replicate,  // 重复边缘像素：...ccc
+    Reflect,    // 以边缘像素为轴镜像：...cba 中的 b、a
+    Wrap        // 周期延拓：从另一侧取
+};
+
+// 整数卷积核，结果为 Σ(系数*像素) / divisor（四舍五入）；divisor 取 2 的幂即为定点核
+class ConvolutionKernel {
+public:
+    ConvolutionKernel();
+    ConvolutionKernel(int width, int height, const QVector<int>& coefficients, int divisor = 1);
+
+    // 由行向量与列向量构造可分离核
+    static ConvolutionKernel separable(const QVector<int>& row, const QVector<int>& column, int divisor = 1);
+
+    // 预设
+    static ConvolutionKernel sharpen();                         // 3x3 拉普拉斯锐化
+    static ConvolutionKernel box(int radius);                   // 均值模糊
+    static ConvolutionKernel gaussian(int radius, double sigma);// 高斯模糊
+    static ConvolutionKernel sobelX();                          // Sobel 水平梯度
+    static ConvolutionKernel sobelY();                          // Sobel 垂直梯度
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getDivisor() const { return divisor; }
+    int coefficient(int x, int y) const { return coefficients[y * width + x]; }
+
+    // 是否可分解为 列向量 x 行向量（构造时自动检测整数分解）
+    bool isSeparable() const { return !rowVector.isEmpty(); }
+    const QVector<int>& getRowVector() const { return rowVector; }
+    const QVector<int>& getColumnVector() const { return columnVector; }
+
+private:
+    void decompose();
+
+    int width = 1;
+    int height = 1;
+    QVector<int> coefficients;
+    int divisor = 1;
+    QVector<int> rowVector;
+    QVector<int> columnVector;
+};
+
+struct ConvolutionOptions {
+    BorderMode border = BorderMode::Replicate;
+    int threads = 0;     // 线程数，<=0 时使用 CPU 核数
+    int tileRows = 64;   // 每个分块的行数，分块内逐行复用缓存中的中间结果
+    JobControl* control = nullptr;  // 每完成一个分块按行数推进进度；请求取消后不再开始新的分块
+};
+
+// 通用卷积引擎：对 channels 个字节/像素交错存储的 8 位图像做卷积，各通道独立
+// 可分离核先做水平一维卷积（16 位中间结果），再做垂直一维卷积；不可分离核直接二维卷积。
+// 支持 AVX2 时内层循环一次处理 16 个通道值，否则走标量路径（结果相同）
+class Convolution {
+public:
+    // 整幅图像卷积，src 与 dst 不能重叠；stride 为每行字节数
+    static void apply(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                      int channels, const ConvolutionKernel& kernel,
+                      const ConvolutionOptions& options = ConvolutionOptions());
+
+    // 输出不截断的有符号结果（饱和到 16 位），用于梯度等需要负值的场合
+    static void applySigned(const unsigned char* src, qint16* dst, int width, int height, qint64 stride,
+                            int channels, const ConvolutionKernel& kernel,
+                            const ConvolutionOptions& options = ConvolutionOptions());
+
+    // 计算 [y0, y1) 行的卷积。rowAt(y) 返回第 y 行（0 <= y < height）的输入，
+    // dstRow(y) 返回第 y 行输出的位置；供流式处理与融合流水线按需提供行数据
+    static void convolveRows(const ConvolutionKernel& kernel, int width, int height, int channels,
+                             BorderMode border,
+                             const std::function<const unsigned char*(int)>& rowAt,
+                             const std::function<unsigned char*(int)>& dstRow,
+                             int y0, int y1);
+
+    // 将坐标 i 按边界方式映射到 [0, n)；Constant 模式下越界返回 -1
+    static int borderIndex(int i, int n, BorderMode mode);
+
+    // Sobel 梯度幅值 min(255, |gx|+|gy|)
+    static void sobel(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                      int channels, const ConvolutionOptions& options = ConvolutionOptions());
+
+    // 反锐化掩模：dst = src + amount * (src - gaussian(src))
+    static void unsharpMask(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                            int channels, int radius, double sigma, double amount,
+                            const ConvolutionOptions& options = ConvolutionOptions());
+};
+
+// 逐行卷积器：缓存 kernel 高度行的输入，按行号递增调用 process 时每个输入行只通过 rowAt 取一次，
+// rowAt 返回的行只需在该次调用返回前有效。供融合流水线把多级卷积串接起来逐行求值。
+// 缓冲取自当前线程的 ScratchArena，须在同一线程的 ScratchArena::Scope 内构造、使用和析构
+class ConvolutionRowFilter {
+public:
+    ConvolutionRowFilter(const ConvolutionKernel& kernel, int width, int height, int channels, BorderMode border,
+                         const std::function<const unsigned char*(int)>& rowAt);
+    ~ConvolutionRowFilter();
+
+    // 计算第 y 行（0 <= y < height）写入 dst
+    void process(int y, unsigned char* dst);
+
+private:
+    ConvolutionRowFilter(const ConvolutionRowFilter&) = delete;
+    ConvolutionRowFilter& operator=(const ConvolutionRowFilter&) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
+
+#endif // CONVOLUTION_H
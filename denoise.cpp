@@ -0,0 +1,446 @@
+#include "denoise.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int kMaxMedianRadius = 15;
+const int kMaxBilateralRadius = 32;
+// 网格在每个方向两侧留出的格数（5 点高斯核的半宽）
+const int kGridPad = 2;
+// 一段网格的内存上限，超过时把条带再切成更短的段，一行网格就超过时再按列切块
+const qint64 kGridChunkBytes = qint64(32) * 1024 * 1024;
+// 每段至少覆盖的网格行数
+const int kMinChunkRows = 4;
+
+// 16 个计数一组的加减，定长循环由编译器向量化
+inline void addHistogram(quint16* dst, const quint16* src) {
+    for (int i = 0; i < 16; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+inline void slideHistogram(quint16* dst, const quint16* add, const quint16* sub) {
+    for (int i = 0; i < 16; ++i) {
+        dst[i] += add[i] - sub[i];
+    }
+}
+
+inline int clampIndex(int i, int n) {
+    return std::max(0, std::min(i, n - 1));
+}
+
+// 5 点高斯核 [1 4 6 4 1] 沿一条线原地模糊，每格 4 个 float，线外为 0。
+// 没有除以 16：切片时取的是颜色和与权重的比值，不受整体缩放影响
+void blurLine(float* data, qint64 stride, int count, float* line) {
+    std::fill(line, line + 8, 0.0f);
+    std::fill(line + (count + 2) * 4, line + (count + 4) * 4, 0.0f);
+    for (int i = 0; i < count; ++i) {
+        std::memcpy(line + (i + 2) * 4, data + i * stride, 4 * sizeof(float));
+    }
+    for (int i = 0; i < count; ++i) {
+        const float* t = line + i * 4;
+        float* out = data + i * stride;
+        for (int c = 0; c < 4; ++c) {
+            out[c] = (t[c] + t[16 + c]) + 4.0f * (t[4 + c] + t[12 + c]) + 6.0f * t[8 + c];
+        }
+    }
+}
+
+// 彩色像素的亮度（BT.601 定点近似），灰度图像直接取值
+inline int guideValue(const unsigned char* p, int colorChannels) {
+    return colorChannels >= 3 ? (p[0] * 29 + p[1] * 150 + p[2] * 77 + 128) >> 8 : p[0];
+}
+
+// 空间标准差为 1 像素时网格比图像还密：直接在 5x5 窗口内加权，值域权重按亮度差查表
+bool bilateralDirect(int width, int height, int channels, int colorChannels, const BilateralOptions& options,
+                     const std::function<const unsigned char*(int)>& rowAt,
+                     const std::function<unsigned char*(int)>& dstRow, int y0, int y1) {
+    float spatial[5][5];
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+            spatial[dy + 2][dx + 2] = float(std::exp(-(dx * dx + dy * dy) / 2.0));
+        }
+    }
+    const double rangeSigma = std::max(1.0, options.rangeSigma);
+    float range[256];
+    for (int d = 0; d < 256; ++d) {
+        range[d] = float(std::exp(-d * d / (2.0 * rangeSigma * rangeSigma)));
+    }
+    std::vector<qint32> columns(size_t(width) + 4);
+    for (int x = -2; x < width + 2; ++x) {
+        columns[x + 2] = clampIndex(x, width) * channels;
+    }
+    // 条带（含上下各两行光晕）的亮度预先算好，左右按重复边界各扩展两列
+    const qint64 guideStride = qint64(width) + 4;
+    PooledBuffer guideBuffer(guideStride * (y1 - y0 + 4));
+    for (int y = y0 - 2; y < y1 + 2; ++y) {
+        const unsigned char* row = rowAt(clampIndex(y, height));
+        unsigned char* guide = guideBuffer.data() + (y - y0 + 2) * guideStride;
+        for (int x = 0; x < width + 4; ++x) {
+            guide[x] = uchar(guideValue(row + columns[x], colorChannels));
+        }
+    }
+
+    for (int y = y0; y < y1; ++y) {
+        const unsigned char* rows[5];
+        const unsigned char* guides[5];
+        for (int dy = -2; dy <= 2; ++dy) {
+            rows[dy + 2] = rowAt(clampIndex(y + dy, height));
+            guides[dy + 2] = guideBuffer.data() + (y - y0 + 2 + dy) * guideStride;
+        }
+        const unsigned char* center = rows[2];
+        unsigned char* out = dstRow(y);
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* p = center + qint64(x) * channels;
+            const int value = guides[2][x + 2];
+            float sum[3] = {0, 0, 0};
+            float weights = 0;
+            for (int dy = 0; dy < 5; ++dy) {
+                for (int dx = 0; dx < 5; ++dx) {
+                    const unsigned char* q = rows[dy] + columns[x + dx];
+                    const float w = spatial[dy][dx] * range[std::abs(guides[dy][x + dx] - value)];
+                    for (int c = 0; c < colorChannels; ++c) {
+                        sum[c] += w * q[c];
+                    }
+                    weights += w;
+                }
+            }
+            unsigned char* o = out + qint64(x) * channels;
+            for (int c = 0; c < colorChannels; ++c) {
+                o[c] = uchar(std::min(255.0f, sum[c] / weights + 0.5f));
+            }
+            for (int c = colorChannels; c < channels; ++c) {
+                o[c] = p[c];
+            }
+        }
+        if (options.control && !options.control->advance(1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+bool Denoise::medianRows(int width, int height, int channels, const MedianOptions& options,
+                         const std::function<const unsigned char*(int)>& rowAt,
+                         const std::function<unsigned char*(int)>& dstRow, int y0, int y1) {
+    const int radius = std::max(1, std::min(options.radius, kMaxMedianRadius));
+    const int window = 2 * radius + 1;
+    const int threshold = window * window / 2;
+    const qint64 columns = qint64(width) * channels;
+    JobControl* control = options.control;
+
+    // 每列（每个通道）一份窗口高度内的直方图：16 个粗分箱（高 4 位）与 256 个细分箱
+    PooledBuffer coarseBuffer(columns * 16 * qint64(sizeof(quint16)), true);
+    PooledBuffer fineBuffer(columns * 256 * qint64(sizeof(quint16)), true);
+    quint16* coarse = coarseBuffer.as<quint16>();
+    quint16* fine = fineBuffer.as<quint16>();
+    auto updateColumns = [&](int y, int delta) {
+        const unsigned char* row = rowAt(clampIndex(y, height));
+        for (qint64 i = 0; i < columns; ++i) {
+            const int v = row[i];
+            coarse[i * 16 + (v >> 4)] += quint16(delta);
+            fine[i * 256 + v] += quint16(delta);
+        }
+    };
+    for (int dy = -radius; dy <= radius; ++dy) {
+        updateColumns(y0 + dy, 1);
+    }
+
+    quint16 kernelCoarse[16];
+    quint16 kernelFine[256];
+    int updatedTo[16];  // 每段细分箱已计入的列为 [updatedTo - window, updatedTo)
+    for (int y = y0; y < y1; ++y) {
+        if (y > y0) {
+            updateColumns(y - radius - 1, -1);
+            updateColumns(y + radius, 1);
+        }
+        unsigned char* out = dstRow(y);
+        for (int c = 0; c < channels; ++c) {
+            auto coarseAt = [&](int x) { return coarse + (qint64(clampIndex(x, width)) * channels + c) * 16; };
+            auto fineAt = [&](int x, int k) {
+                return fine + (qint64(clampIndex(x, width)) * channels + c) * 256 + k * 16;
+            };
+            std::fill(kernelCoarse, kernelCoarse + 16, quint16(0));
+            for (int x = -radius; x <= radius; ++x) {
+                addHistogram(kernelCoarse, coarseAt(x));
+            }
+            std::fill(updatedTo, updatedTo + 16, -radius);
+
+            for (int x = 0; x < width; ++x) {
+                if (x > 0) {
+                    slideHistogram(kernelCoarse, coarseAt(x + radius), coarseAt(x - radius - 1));
+                }
+                // 先在粗分箱中找到中值所在的一段，再只补齐这一段的细分箱
+                int sum = 0;
+                int k = 0;
+                for (; k < 15 && sum + kernelCoarse[k] <= threshold; ++k) {
+                    sum += kernelCoarse[k];
+                }
+                quint16* segment = kernelFine + k * 16;
+                if (updatedTo[k] <= x - radius) {
+                    // 落后一整个窗口以上，重新累加比逐列滑动便宜
+                    std::fill(segment, segment + 16, quint16(0));
+                    for (int column = x - radius; column <= x + radius; ++column) {
+                        addHistogram(segment, fineAt(column, k));
+                    }
+                } else {
+                    for (int column = updatedTo[k]; column <= x + radius; ++column) {
+                        slideHistogram(segment, fineAt(column, k), fineAt(column - window, k));
+                    }
+                }
+                updatedTo[k] = x + radius + 1;
+                int j = 0;
+                for (; j < 15; ++j) {
+                    sum += segment[j];
+                    if (sum > threshold) {
+                        break;
+                    }
+                }
+                out[qint64(x) * channels + c] = uchar(k * 16 + j);
+            }
+        }
+        if (control && !control->advance(1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Denoise::median(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                     int channels, const MedianOptions& options) {
+    MYQIMAGE_TRACE_SCOPE("Denoise::median");
+    if (!src || !dst || width <= 0 || height <= 0) {
+        return true;
+    }
+    // 每个条带从各自的起始行重新建立列直方图，上下光晕直接从 src 读取
+    const int threads = parallelRowThreads(height, options.threads);
+    std::atomic<bool> completed(true);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        if (!medianRows(width, height, channels, options,
+                        [&](int y) { return src + y * stride; },
+                        [&](int y) { return dst + y * stride; }, y0, y1)) {
+            completed = false;
+        }
+    }, threads);
+    return completed;
+}
+
+int Denoise::bilateralHalo(const BilateralOptions& options) {
+    return 4 * std::max(1, std::min(options.radius, kMaxBilateralRadius));
+}
+
+namespace {
+
+// 双边网格的尺寸与分段。一段覆盖 rowsPerChunk 个网格行，上下各多算几行（散布的舍入、模糊核半宽与插值的下一行）；
+// 一块覆盖 tileCells 个网格列，左右多算两侧的模糊半宽与插值的下一列。
+// 很宽的图像配很小的亮度间隔时一行网格就可能超过上限，此时按列切块，使每段网格不超过 kGridChunkBytes
+struct GridLayout {
+    int spacing = 1;
+    double rangeSpacing = 1;
+    int gridX = 0;
+    int gridZ = 0;
+    int tileCells = 0;      // 每块切片用到的网格列数
+    int tileColumns = 0;    // 每块网格的列数上限
+    int rowsPerChunk = 0;
+    qint64 cellFloats = 0;  // 一块中一行网格的 float 数
+
+    GridLayout(int width, const BilateralOptions& options) {
+        spacing = std::max(1, std::min(options.radius, kMaxBilateralRadius));
+        rangeSpacing = std::max(1.0, options.rangeSigma);
+        gridX = (width - 1) / spacing + 2 + 2 * kGridPad;
+        gridZ = int(255 / rangeSpacing) + 2 + 2 * kGridPad;
+        const qint64 columnBytes = qint64(gridZ) * 4 * qint64(sizeof(float));
+        const qint64 minChunkBytes = columnBytes * (kMinChunkRows + 6);
+        tileColumns = gridX;
+        tileCells = gridX;
+        if (gridX * minChunkBytes > kGridChunkBytes) {
+            tileColumns = int(std::max<qint64>(6, kGridChunkBytes / minChunkBytes));
+            tileCells = tileColumns - 5;
+        }
+        cellFloats = qint64(tileColumns) * gridZ * 4;
+        rowsPerChunk = int(std::max<qint64>(kMinChunkRows,
+                                            std::min<qint64>(std::max(16, 256 / spacing),
+                                                             kGridChunkBytes / (cellFloats * 4) - 6)));
+    }
+
+    qint64 scratchBytes() const {
+        return (rowsPerChunk + 6) * cellFloats * qint64(sizeof(float))
+               + (std::max(tileColumns, std::max(gridZ, rowsPerChunk + 6)) + 4) * 4 * qint64(sizeof(float));
+    }
+};
+
+}
+
+qint64 Denoise::medianScratchBytes(int width, int channels) {
+    return qint64(width) * channels * (16 + 256) * qint64(sizeof(quint16));
+}
+
+qint64 Denoise::bilateralScratchBytes(int width, const BilateralOptions& options) {
+    if (std::max(1, std::min(options.radius, kMaxBilateralRadius)) == 1) {
+        return qint64(width + 4) * qint64(sizeof(qint32));
+    }
+    return GridLayout(width, options).scratchBytes() + qint64(width) * 3 * 4;
+}
+
+bool Denoise::bilateralRows(int width, int height, int channels, int colorChannels,
+                            const BilateralOptions& options,
+                            const std::function<const unsigned char*(int)>& rowAt,
+                            const std::function<unsigned char*(int)>& dstRow, int y0, int y1) {
+    const GridLayout layout(width, options);
+    const int spacing = layout.spacing;
+    const double rangeSpacing = layout.rangeSpacing;
+    colorChannels = std::max(1, std::min(colorChannels, std::min(channels, 3)));
+    JobControl* control = options.control;
+    if (spacing == 1) {
+        return bilateralDirect(width, height, channels, colorChannels, options, rowAt, dstRow, y0, y1);
+    }
+
+    // 像素 x 散布到最近的格（splat），切片时在相邻两格间插值（slice）；亮度同理，按 256 项查表
+    const int gridX = layout.gridX;
+    const int gridZ = layout.gridZ;
+    std::vector<qint32> splatX(width), sliceX(width);
+    std::vector<float> weightX(width);
+    for (int x = 0; x < width; ++x) {
+        splatX[x] = (x + spacing / 2) / spacing + kGridPad;
+        sliceX[x] = x / spacing + kGridPad;
+        weightX[x] = float(x % spacing) / spacing;
+    }
+    qint32 splatZ[256], sliceZ[256];
+    float weightZ[256];
+    for (int v = 0; v < 256; ++v) {
+        const double position = v / rangeSpacing;
+        splatZ[v] = int(position + 0.5) + kGridPad;
+        sliceZ[v] = int(position) + kGridPad;
+        weightZ[v] = float(position - int(position));
+    }
+
+    // 条带再按网格行切成段，段内再按网格列切块
+    const int rowsPerChunk = layout.rowsPerChunk;
+    const int tileCells = layout.tileCells;
+    PooledBuffer gridBuffer((rowsPerChunk + 6) * layout.cellFloats * qint64(sizeof(float)));
+    std::vector<float> line((std::max(layout.tileColumns, std::max(gridZ, rowsPerChunk + 6)) + 4) * 4);
+
+    for (int chunk = y0; chunk < y1; chunk += rowsPerChunk * spacing) {
+        const int chunkEnd = std::min(y1, chunk + rowsPerChunk * spacing);
+        const int firstRow = chunk / spacing + kGridPad - 2;
+        const int lastRow = (chunkEnd - 1) / spacing + kGridPad + 3;
+        const int gridY = lastRow - firstRow + 1;
+        const int splatBegin = std::max(0, (firstRow - kGridPad) * spacing - spacing / 2);
+        const int splatEnd = std::min(height, (lastRow - kGridPad + 1) * spacing - spacing / 2);
+
+        // 每块切片网格列 [tile, tile + tileCells) 上的像素，网格取其左右各多两列（模糊半宽）与插值的下一列；
+        // 块边缘多算的列只用于模糊，结果与不切块时逐位相同
+        for (int tile = kGridPad; (tile - kGridPad) * spacing < width; tile += tileCells) {
+            const int xBegin = (tile - kGridPad) * spacing;
+            const int xEnd = std::min(width, (tile + tileCells - kGridPad) * spacing);
+            const int cellBegin = std::max(0, tile - 2);
+            const int cellEnd = std::min(gridX, tile + tileCells + 3);
+            const qint64 cellFloats = qint64(cellEnd - cellBegin) * gridZ * 4;
+            float* grid = gridBuffer.as<float>();
+            std::fill(grid, grid + gridY * cellFloats, 0.0f);
+
+            // 散布：每格累加 B、G、R（灰度图只用第一个）与像素数
+            const int splatXBegin = std::max(0, (cellBegin - kGridPad) * spacing - spacing / 2);
+            const int splatXEnd = std::min(width, (cellEnd - kGridPad) * spacing - spacing / 2);
+            for (int y = splatBegin; y < splatEnd; ++y) {
+                const int row = (y + spacing / 2) / spacing + kGridPad - firstRow;
+                if (row < 0 || row >= gridY) {
+                    continue;
+                }
+                const unsigned char* p = rowAt(y) + qint64(splatXBegin) * channels;
+                float* gridRow = grid + row * cellFloats;
+                for (int x = splatXBegin; x < splatXEnd; ++x, p += channels) {
+                    float* cell = gridRow
+                                  + (qint64(splatX[x] - cellBegin) * gridZ + splatZ[guideValue(p, colorChannels)]) * 4;
+                    for (int c = 0; c < colorChannels; ++c) {
+                        cell[c] += p[c];
+                    }
+                    cell[3] += 1.0f;
+                }
+            }
+
+            // 沿亮度、x、y 三个方向可分离模糊
+            for (int row = 0; row < gridY; ++row) {
+                float* gridRow = grid + row * cellFloats;
+                for (int x = 0; x < cellEnd - cellBegin; ++x) {
+                    blurLine(gridRow + qint64(x) * gridZ * 4, 4, gridZ, line.data());
+                }
+                for (int z = 0; z < gridZ; ++z) {
+                    blurLine(gridRow + z * 4, qint64(gridZ) * 4, cellEnd - cellBegin, line.data());
+                }
+            }
+            for (qint64 offset = 0; offset < cellFloats; offset += 4) {
+                blurLine(grid + offset, cellFloats, gridY, line.data());
+            }
+
+            // 切片：按位置与亮度三线性插值，颜色和除以权重
+            for (int y = chunk; y < chunkEnd; ++y) {
+                const int row = y / spacing + kGridPad - firstRow;
+                const float wy = float(y % spacing) / spacing;
+                const float* top = grid + row * cellFloats;
+                const float* bottom = top + cellFloats;
+                const unsigned char* p = rowAt(y) + qint64(xBegin) * channels;
+                unsigned char* out = dstRow(y) + qint64(xBegin) * channels;
+                for (int x = xBegin; x < xEnd; ++x, p += channels, out += channels) {
+                    const int v = guideValue(p, colorChannels);
+                    const qint64 index = (qint64(sliceX[x] - cellBegin) * gridZ + sliceZ[v]) * 4;
+                    const float wx = weightX[x];
+                    const float wz = weightZ[v];
+                    const float w[8] = {(1 - wy) * (1 - wx) * (1 - wz), (1 - wy) * (1 - wx) * wz,
+                                        (1 - wy) * wx * (1 - wz),       (1 - wy) * wx * wz,
+                                        wy * (1 - wx) * (1 - wz),       wy * (1 - wx) * wz,
+                                        wy * wx * (1 - wz),             wy * wx * wz};
+                    const float* cells[8] = {top + index, top + index + 4,
+                                             top + index + gridZ * 4, top + index + gridZ * 4 + 4,
+                                             bottom + index, bottom + index + 4,
+                                             bottom + index + gridZ * 4, bottom + index + gridZ * 4 + 4};
+                    float sum[4] = {0, 0, 0, 0};
+                    for (int i = 0; i < 8; ++i) {
+                        for (int c = 0; c < 4; ++c) {
+                            sum[c] += w[i] * cells[i][c];
+                        }
+                    }
+                    for (int c = 0; c < colorChannels; ++c) {
+                        out[c] = sum[3] > 0 ? uchar(std::min(255.0f, sum[c] / sum[3] + 0.5f)) : p[c];
+                    }
+                    for (int c = colorChannels; c < channels; ++c) {
+                        out[c] = p[c];
+                    }
+                }
+            }
+        }
+        if (control && !control->advance(chunkEnd - chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Denoise::bilateral(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                        int channels, int colorChannels, const BilateralOptions& options) {
+    MYQIMAGE_TRACE_SCOPE("Denoise::bilateral");
+    if (!src || !dst || width <= 0 || height <= 0) {
+        return true;
+    }
+    const int threads = parallelRowThreads(height, options.threads);
+    std::atomic<bool> completed(true);
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        if (!bilateralRows(width, height, channels, colorChannels, options,
+                           [&](int y) { return src + y * stride; },
+                           [&](int y) { return dst + y * stride; }, y0, y1)) {
+            completed = false;
+        }
+    }, threads);
+    return completed;
+}
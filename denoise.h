@@ -0,0 +1,62 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <QtGlobal>
+#include <functional>
+
+class JobControl;
+
+// 中值滤波参数
+struct MedianOptions {
+    int radius = 2;             // 窗口为 (2*radius+1)^2，取值 [1, 15]
+    int threads = 0;            // 线程数，<= 0 取 CPU 核数
+    JobControl* control = nullptr;  // 每写完一行推进一个单位
+};
+
+// 双边滤波（双边网格近似）参数
+struct BilateralOptions {
+    int radius = 4;             // 空间标准差（像素），也是网格的空间采样间隔，取值 [1, 32]
+    double rangeSigma = 30;     // 灰度（亮度）标准差，也是网格的灰度采样间隔
+    int threads = 0;
+    JobControl* control = nullptr;
+};
+
+// 保边去噪。两种滤波每个像素的代价都与半径基本无关：
+// 中值滤波为每列维护窗口高度内的直方图（16 个粗分箱 + 256 个细分箱），窗口右移一列时只加减一列直方图，
+// 细分箱只在中值落入时才补齐（Perreault & Hébert 的常数时间中值）；
+// 双边滤波把像素按位置与亮度散布到三维网格（每格累加 B、G、R 与权重），在网格上做可分离的高斯模糊，
+// 再按位置与亮度三线性插值取回，彩色图像以亮度为值域引导，各通道共用同一组权重；
+// 空间标准差为 1 时网格比图像还密，改为 5x5 窗口直接加权（值域权重查表）。
+// 两者都按行条带并行，每个条带自行读取上下的光晕行，结果与条带划分无关
+class Denoise {
+public:
+    // 对 width x height、每像素 channels 字节的 8 位图像做中值滤波（各通道独立，边界重复），src 与 dst 不能重叠
+    static bool median(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                       int channels, const MedianOptions& options = MedianOptions());
+
+    // 计算 [y0, y1) 行的中值。rowAt(y) 返回第 y 行（0 <= y < height）的输入，只会访问 [y0-radius, y1+radius) 内的行；
+    // dstRow(y) 返回第 y 行输出的位置。供条带并行与流式处理共用
+    static bool medianRows(int width, int height, int channels, const MedianOptions& options,
+                           const std::function<const unsigned char*(int)>& rowAt,
+                           const std::function<unsigned char*(int)>& dstRow, int y0, int y1);
+
+    // 双边滤波，前 colorChannels 个通道参与滤波（其余通道原样复制），src 与 dst 不能重叠
+    static bool bilateral(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                          int channels, int colorChannels, const BilateralOptions& options = BilateralOptions());
+
+    // 计算 [y0, y1) 行的双边滤波，只会访问 [y0-bilateralHalo, y1+bilateralHalo) 内的输入行
+    static bool bilateralRows(int width, int height, int channels, int colorChannels,
+                              const BilateralOptions& options,
+                              const std::function<const unsigned char*(int)>& rowAt,
+                              const std::function<unsigned char*(int)>& dstRow, int y0, int y1);
+
+    // 双边滤波的条带上下各需多读的行数
+    static int bilateralHalo(const BilateralOptions& options);
+
+    // medianRows / bilateralRows 每次调用（即每个并行条带）另行申请的工作内存（字节），不含输入输出。
+    // 中值为每列的直方图，双边为一段网格（不超过 32 MB，过宽时按列切块）
+    static qint64 medianScratchBytes(int width, int channels);
+    static qint64 bilateralScratchBytes(int width, const BilateralOptions& options);
+};
+
+#endif // DENOISE_H
@@ -0,0 +1,627 @@
+#include "formatkernels.h"
+#include "colorconvert.h"
+#include "histogram.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "trace.h"
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+// 按条带处理，每个条带之后报告进度并检查取消
+const int kStripRows = 256;
+
+template <typename F>
+inline const typename F::Channel* channelRow(const unsigned char* pixels, qint64 stride, int y) {
+    return reinterpret_cast<const typename F::Channel*>(pixels + y * stride);
+}
+
+template <typename F>
+inline typename F::Channel* channelRow(unsigned char* pixels, qint64 stride, int y) {
+    return reinterpret_cast<typename F::Channel*>(pixels + y * stride);
+}
+
+// ---------------- 均衡化 ----------------
+
+template <typename F>
+bool equalizeImpl(unsigned char* pixels, int width, int height, qint64 stride, JobControl* control) {
+    if (control) {
+        control->beginStage(0, 50, height);
+    }
+    if constexpr (F::format == PixelFormat::Bgr24) {
+        BgrHistogram hist;
+        for (int y0 = 0; y0 < height; y0 += kStripRows) {
+            int rows = std::min(kStripRows, height - y0);
+            accumulateBgrHistogram(pixels + y0 * stride, width, rows, stride, hist);
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+        BgrLut lut;
+        buildEqualizationLut(hist, lut);
+        if (control) {
+            control->beginStage(50, 100, height);
+        }
+        for (int y0 = 0; y0 < height; y0 += kStripRows) {
+            int rows = std::min(kStripRows, height - y0);
+            applyBgrLut(pixels + y0 * stride, width, rows, stride, lut);
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        using Channel = typename F::Channel;
+        constexpr int bins = F::maxValue + 1;
+        std::vector<qint64> hist(size_t(bins) * F::colorChannels, 0);
+        for (int y0 = 0; y0 < height; y0 += kStripRows) {
+            int rows = std::min(kStripRows, height - y0);
+            for (int y = y0; y < y0 + rows; ++y) {
+                const Channel* p = channelRow<F>(pixels, stride, y);
+                for (int x = 0; x < width; ++x, p += F::channels) {
+                    for (int c = 0; c < F::colorChannels; ++c) {
+                        hist[c * bins + p[c]]++;
+                    }
+                }
+            }
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+
+        // 与 buildEqualizationLut 相同的计算顺序；8 位格式用 float 以保证与 Bgr24 逐位一致
+        using Real = std::conditional_t<sizeof(Channel) == 1, float, double>;
+        std::vector<Channel> lut(hist.size());
+        const Real pixelCount = static_cast<Real>(qint64(width) * height);
+        for (int c = 0; c < F::colorChannels; ++c) {
+            Real cdf = 0;
+            for (int i = 0; i < bins; ++i) {
+                cdf += static_cast<Real>(hist[c * bins + i]);
+                lut[c * bins + i] = static_cast<Channel>(cdf / pixelCount * F::maxValue);
+            }
+        }
+
+        if (control) {
+            control->beginStage(50, 100, height);
+        }
+        for (int y0 = 0; y0 < height; y0 += kStripRows) {
+            int rows = std::min(kStripRows, height - y0);
+            for (int y = y0; y < y0 + rows; ++y) {
+                Channel* p = channelRow<F>(pixels, stride, y);
+                for (int x = 0; x < width; ++x, p += F::channels) {
+                    for (int c = 0; c < F::colorChannels; ++c) {
+                        p[c] = lut[c * bins + p[c]];
+                    }
+                }
+            }
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// ---------------- 格式转换 ----------------
+
+// 通道位深转换：8 到 16 位乘 257（255 映射为 65535），16 到 8 位四舍五入
+template <typename To, typename From>
+inline typename To::Channel convertDepth(typename From::Channel v) {
+    if constexpr (sizeof(typename To::Channel) == sizeof(typename From::Channel)) {
+        return v;
+    } else if constexpr (sizeof(typename To::Channel) == 2) {
+        return static_cast<typename To::Channel>(v * 257);
+    } else {
+        return static_cast<typename To::Channel>((v + 128) / 257);
+    }
+}
+
+template <typename Src, typename Dst>
+void convertRow(const typename Src::Channel* s, typename Dst::Channel* d, int width) {
+    for (int x = 0; x < width; ++x, s += Src::channels, d += Dst::channels) {
+        if constexpr (Dst::isGray && Src::isGray) {
+            d[0] = convertDepth<Dst, Src>(s[0]);
+        } else if constexpr (Dst::isGray) {
+            // 与 ColorConvert::bgrToGray 相同的 Q14 加权并四舍五入，灰色像素（b = g = r）转换后不变
+            auto gray = static_cast<typename Src::Channel>((4899 * s[2] + 9617 * s[1] + 1868 * s[0] + 8192) >> 14);
+            d[0] = convertDepth<Dst, Src>(gray);
+        } else if constexpr (Src::isGray) {
+            d[0] = d[1] = d[2] = convertDepth<Dst, Src>(s[0]);
+        } else {
+            d[0] = convertDepth<Dst, Src>(s[0]);
+            d[1] = convertDepth<Dst, Src>(s[1]);
+            d[2] = convertDepth<Dst, Src>(s[2]);
+        }
+        if constexpr (Dst::hasAlpha && Src::hasAlpha) {
+            d[3] = convertDepth<Dst, Src>(s[3]);
+        } else if constexpr (Dst::hasAlpha) {
+            d[3] = static_cast<typename Dst::Channel>(Dst::maxValue);
+        }
+    }
+}
+
+// ---------------- 卷积 ----------------
+
+// 与 Convolution 引擎相同的归一化：2 的幂除数用移位四舍五入，其余四舍五入到最近整数
+inline qint64 normalizeSum(qint64 v, int divisor, int shift) {
+    if (divisor == 1) {
+        return v;
+    }
+    if (shift >= 0) {
+        return (v + (qint64(1) << shift >> 1)) >> shift;
+    }
+    return std::llrint(double(v) / divisor);
+}
+
+// 16 位格式的直接卷积：每个输出行先把用到的输入行按边界方式补边，内层循环没有边界判断
+template <typename F>
+void convolveDirect(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                    const ConvolutionKernel& kernel, const ConvolutionOptions& options) {
+    using Channel = typename F::Channel;
+    constexpr int C = F::channels;
+    const int kw = kernel.getWidth();
+    const int kh = kernel.getHeight();
+    const int ax = kw / 2;
+    const int ay = kh / 2;
+    const int divisor = std::max(1, kernel.getDivisor());
+    int shift = -1;
+    for (int s = 0; s < 31; ++s) {
+        if ((1 << s) == divisor) {
+            shift = s;
+        }
+    }
+    std::vector<int> coefficients(size_t(kw) * kh);
+    for (int y = 0; y < kh; ++y) {
+        for (int x = 0; x < kw; ++x) {
+            coefficients[y * kw + x] = kernel.coefficient(x, y);
+        }
+    }
+    // 补边后第 i 列对应的输入列
+    std::vector<int> columns(size_t(width) + kw - 1);
+    for (int i = 0; i < int(columns.size()); ++i) {
+        columns[i] = Convolution::borderIndex(i - ax, width, options.border);
+    }
+
+    const int tileRows = std::max(1, options.tileRows);
+    const int tiles = (height + tileRows - 1) / tileRows;
+    parallelFor(0, tiles, [&](int, int t0, int t1) {
+        ScratchArena::Scope scope;
+        const qint64 paddedWidth = qint64(columns.size());
+        Channel* padded = ScratchArena::local().allocate<Channel>(paddedWidth * C * kh);
+        qint64* acc = ScratchArena::local().allocate<qint64>(qint64(width) * C);
+        for (int t = t0; t < t1; ++t) {
+            if (options.control && options.control->isCancelled()) {
+                return;
+            }
+            const int y0 = t * tileRows;
+            const int y1 = std::min(height, y0 + tileRows);
+            for (int y = y0; y < y1; ++y) {
+                for (int ky = 0; ky < kh; ++ky) {
+                    Channel* row = padded + ky * paddedWidth * C;
+                    int sy = Convolution::borderIndex(y + ky - ay, height, options.border);
+                    if (sy < 0) {
+                        std::fill(row, row + paddedWidth * C, Channel(0));
+                        continue;
+                    }
+                    const Channel* in = channelRow<F>(src, stride, sy);
+                    for (qint64 i = 0; i < paddedWidth; ++i) {
+                        int sx = columns[i];
+                        for (int c = 0; c < C; ++c) {
+                            row[i * C + c] = sx < 0 ? Channel(0) : in[sx * C + c];
+                        }
+                    }
+                }
+
+                std::fill(acc, acc + qint64(width) * C, 0);
+                for (int ky = 0; ky < kh; ++ky) {
+                    const Channel* row = padded + ky * paddedWidth * C;
+                    for (int kx = 0; kx < kw; ++kx) {
+                        const qint64 k = coefficients[ky * kw + kx];
+                        if (k == 0) {
+                            continue;
+                        }
+                        const Channel* in = row + kx * C;
+                        for (qint64 i = 0; i < qint64(width) * C; ++i) {
+                            acc[i] += k * in[i];
+                        }
+                    }
+                }
+
+                Channel* out = channelRow<F>(dst, stride, y);
+                for (int x = 0; x < width; ++x) {
+                    for (int c = 0; c < F::colorChannels; ++c) {
+                        qint64 v = normalizeSum(acc[x * C + c], divisor, shift);
+                        out[x * C + c] = static_cast<Channel>(std::min<qint64>(F::maxValue, std::max<qint64>(0, v)));
+                    }
+                    if constexpr (F::hasAlpha) {
+                        out[x * C + 3] = channelRow<F>(src, stride, y)[x * C + 3];
+                    }
+                }
+            }
+            if (options.control) {
+                options.control->advance(y1 - y0);
+            }
+        }
+    }, options.threads);
+}
+
+template <typename F>
+void convolveImpl(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                  const ConvolutionKernel& kernel, const ConvolutionOptions& options) {
+    if constexpr (sizeof(typename F::Channel) == 1) {
+        Convolution::apply(src, dst, width, height, stride, F::channels, kernel, options);
+        if constexpr (F::hasAlpha) {
+            // 引擎把 alpha 当作普通通道一起卷积，再恢复为原值
+            for (int y = 0; y < height; ++y) {
+                const unsigned char* s = src + y * stride;
+                unsigned char* d = dst + y * stride;
+                for (int x = 0; x < width; ++x) {
+                    d[x * F::channels + 3] = s[x * F::channels + 3];
+                }
+            }
+        }
+    } else {
+        convolveDirect<F>(src, dst, width, height, stride, kernel, options);
+    }
+}
+
+// ---------------- 缩小 ----------------
+
+// 每个目标像素取源图像中对应矩形区域（按比例划分，至少一个像素）的平均值；
+// 先把区域内的源行逐列累加，再横向合并
+template <typename F>
+void downscaleImpl(const unsigned char* src, qint64 srcStride, int width, int height,
+                   unsigned char* dst, qint64 dstStride, int targetWidth, int targetHeight, int threads) {
+    using Channel = typename F::Channel;
+    constexpr int C = F::channels;
+    std::vector<int> columnBegin(targetWidth + 1);
+    for (int x = 0; x <= targetWidth; ++x) {
+        columnBegin[x] = int(qint64(x) * width / targetWidth);
+    }
+    parallelFor(0, targetHeight, [&](int, int y0, int y1) {
+        std::vector<quint64> sums(size_t(width) * C);
+        for (int y = y0; y < y1; ++y) {
+            const int rowBegin = int(qint64(y) * height / targetHeight);
+            const int rowEnd = int(qint64(y + 1) * height / targetHeight);
+            std::fill(sums.begin(), sums.end(), 0);
+            for (int sy = rowBegin; sy < rowEnd; ++sy) {
+                const Channel* row = channelRow<F>(src, srcStride, sy);
+                for (qint64 i = 0; i < qint64(width) * C; ++i) {
+                    sums[i] += row[i];
+                }
+            }
+            Channel* out = channelRow<F>(dst, dstStride, y);
+            for (int x = 0; x < targetWidth; ++x) {
+                const int begin = columnBegin[x];
+                const int end = columnBegin[x + 1];
+                const quint64 count = quint64(end - begin) * quint64(rowEnd - rowBegin);
+                for (int c = 0; c < C; ++c) {
+                    quint64 sum = 0;
+                    for (int sx = begin; sx < end; ++sx) {
+                        sum += sums[size_t(sx) * C + c];
+                    }
+                    out[x * C + c] = Channel((sum + count / 2) / count);
+                }
+            }
+        }
+    }, parallelRowThreads(targetHeight, threads));
+}
+
+// ---------------- K-means ----------------
+
+// 中心移动不超过一个 8 位灰阶时收敛（16 位格式按比例放大）
+template <typename F>
+constexpr qint64 convergenceThreshold() {
+    return F::maxValue / 255;
+}
+
+// 与 KMeans::run 相同：给定的初始中心优先，否则从随机像素取初始中心
+template <typename F>
+std::vector<qint64> initialCenters(const unsigned char* pixels, int width, int height, qint64 stride,
+                                   int K, const KMeansOptions& options) {
+    std::vector<qint64> centers(size_t(K) * F::colorChannels);
+    QRandomGenerator rng(options.seed);
+    for (int k = 0; k < K; ++k) {
+        if (options.initialCenters.size() == K) {
+            const KMeansCenter& given = options.initialCenters[k];
+            const int channel[3] = {given.b, given.g, given.r};
+            for (int c = 0; c < F::colorChannels; ++c) {
+                centers[k * F::colorChannels + c] = channel[c];
+            }
+            continue;
+        }
+        int y = rng.bounded(height);
+        int x = rng.bounded(width);
+        const typename F::Channel* p = channelRow<F>(pixels, stride, y) + x * F::channels;
+        for (int c = 0; c < F::colorChannels; ++c) {
+            centers[k * F::colorChannels + c] = p[c];
+        }
+    }
+    return centers;
+}
+
+template <typename F>
+inline int nearestCenter(const typename F::Channel* p, const qint64* centers, int K) {
+    int best = 0;
+    qint64 bestDistance = std::numeric_limits<qint64>::max();
+    for (int k = 0; k < K; ++k) {
+        qint64 distance = 0;
+        for (int c = 0; c < F::colorChannels; ++c) {
+            qint64 d = p[c] - centers[k * F::colorChannels + c];
+            distance += d * d;
+        }
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = k;
+        }
+    }
+    return best;
+}
+
+// 由 sums/counts 更新中心，返回是否收敛
+template <typename F>
+bool updateCenters(std::vector<qint64>& centers, const std::vector<qint64>& sums, const std::vector<qint64>& counts) {
+    bool converged = true;
+    for (int k = 0; k < int(counts.size()); ++k) {
+        if (counts[k] == 0) {
+            continue;
+        }
+        for (int c = 0; c < F::colorChannels; ++c) {
+            qint64 value = sums[k * F::colorChannels + c] / counts[k];
+            if (std::abs(value - centers[k * F::colorChannels + c]) > convergenceThreshold<F>()) {
+                converged = false;
+            }
+            centers[k * F::colorChannels + c] = value;
+        }
+    }
+    return converged;
+}
+
+template <typename F>
+void fillResult(KMeansResult& result, const std::vector<qint64>& centers, const std::vector<qint64>& sums,
+                const std::vector<qint64>& counts) {
+    const int K = int(counts.size());
+    result.centers.resize(K);
+    result.counts.resize(K);
+    result.sums.resize(K * 3);
+    for (int k = 0; k < K; ++k) {
+        int channel[3];
+        for (int c = 0; c < 3; ++c) {
+            int source = F::isGray ? 0 : c;
+            channel[c] = int(centers[k * F::colorChannels + source]);
+            result.sums[k * 3 + c] = sums[k * F::colorChannels + source];
+        }
+        result.centers[k].b = channel[0];
+        result.centers[k].g = channel[1];
+        result.centers[k].r = channel[2];
+        result.counts[k] = counts[k];
+    }
+}
+
+// 灰度格式：在灰度直方图上迭代，每次迭代的代价与灰阶数而不是像素数成正比
+template <typename F>
+KMeansResult segmentGray(unsigned char* pixels, int width, int height, qint64 stride, const KMeansOptions& options) {
+    using Channel = typename F::Channel;
+    constexpr int bins = F::maxValue + 1;
+    const int K = options.K;
+
+    std::vector<qint64> hist(bins, 0);
+    for (int y = 0; y < height; ++y) {
+        const Channel* p = channelRow<F>(pixels, stride, y);
+        for (int x = 0; x < width; ++x) {
+            hist[p[x * F::channels]]++;
+        }
+    }
+    std::vector<int> used;
+    for (int i = 0; i < bins; ++i) {
+        if (hist[i]) {
+            used.push_back(i);
+        }
+    }
+
+    std::vector<qint64> centers = initialCenters<F>(pixels, width, height, stride, K, options);
+    std::vector<qint64> sums(K), counts(K);
+    std::vector<unsigned char> labels(bins, 0);
+    KMeansResult result;
+    bool converged = false;
+    while (!converged && result.iterations < options.maxIterations) {
+        if (options.control && options.control->isCancelled()) {
+            result.cancelled = true;
+            return result;
+        }
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int value : used) {
+            Channel v = static_cast<Channel>(value);
+            int k = nearestCenter<F>(&v, centers.data(), K);
+            labels[value] = static_cast<unsigned char>(k);
+            sums[k] += hist[value] * value;
+            counts[k] += hist[value];
+        }
+        converged = updateCenters<F>(centers, sums, counts);
+        ++result.iterations;
+        if (options.control) {
+            options.control->advance(1);
+        }
+    }
+    fillResult<F>(result, centers, sums, counts);
+
+    std::vector<Channel> lut(bins);
+    for (int i = 0; i < bins; ++i) {
+        lut[i] = static_cast<Channel>(centers[labels[i]]);
+    }
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            Channel* p = channelRow<F>(pixels, stride, y);
+            for (int x = 0; x < width; ++x) {
+                p[x * F::channels] = lut[p[x * F::channels]];
+            }
+        }
+    }, options.threads);
+    return result;
+}
+
+// 彩色格式：与 KMeans::run 相同的逐像素迭代，分配与累加合并为一遍多线程扫描
+template <typename F>
+KMeansResult segmentPixels(unsigned char* pixels, int width, int height, qint64 stride, const KMeansOptions& options) {
+    using Channel = typename F::Channel;
+    constexpr int CC = F::colorChannels;
+    const int K = options.K;
+    const int threads = std::min(parallelThreadCount(options.threads), std::max(1, height));
+
+    ScratchArena::Scope scope;
+    unsigned char* labels = ScratchArena::local().allocate<unsigned char>(qint64(width) * height);
+    std::vector<qint64> centers = initialCenters<F>(pixels, width, height, stride, K, options);
+    std::vector<std::vector<qint64>> threadSums(threads, std::vector<qint64>(K * CC));
+    std::vector<std::vector<qint64>> threadCounts(threads, std::vector<qint64>(K));
+    std::vector<qint64> sums(K * CC), counts(K);
+    ParallelTeam team(threads);
+
+    KMeansResult result;
+    bool converged = false;
+    while (!converged && result.iterations < options.maxIterations) {
+        if (options.control && options.control->isCancelled()) {
+            result.cancelled = true;
+            return result;
+        }
+        MYQIMAGE_TRACE_SCOPE("FormatKernels::segment iteration");
+        team.forRange(0, height, [&](int t, int y0, int y1) {
+            std::vector<qint64>& s = threadSums[t];
+            std::vector<qint64>& n = threadCounts[t];
+            std::fill(s.begin(), s.end(), 0);
+            std::fill(n.begin(), n.end(), 0);
+            for (int y = y0; y < y1; ++y) {
+                const Channel* p = channelRow<F>(pixels, stride, y);
+                unsigned char* label = labels + qint64(y) * width;
+                for (int x = 0; x < width; ++x, p += F::channels) {
+                    int k = nearestCenter<F>(p, centers.data(), K);
+                    label[x] = static_cast<unsigned char>(k);
+                    for (int c = 0; c < CC; ++c) {
+                        s[k * CC + c] += p[c];
+                    }
+                    n[k]++;
+                }
+            }
+        });
+
+        // 按线程序号顺序归约
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int t = 0; t < threads; ++t) {
+            for (int i = 0; i < K * CC; ++i) {
+                sums[i] += threadSums[t][i];
+            }
+            for (int k = 0; k < K; ++k) {
+                counts[k] += threadCounts[t][k];
+            }
+        }
+        converged = updateCenters<F>(centers, sums, counts);
+        ++result.iterations;
+        if (options.control) {
+            options.control->advance(1);
+        }
+    }
+    fillResult<F>(result, centers, sums, counts);
+
+    team.forRange(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            Channel* p = channelRow<F>(pixels, stride, y);
+            const unsigned char* label = labels + qint64(y) * width;
+            for (int x = 0; x < width; ++x, p += F::channels) {
+                const qint64* c = centers.data() + label[x] * CC;
+                for (int i = 0; i < CC; ++i) {
+                    p[i] = static_cast<Channel>(c[i]);
+                }
+            }
+        }
+    });
+    return result;
+}
+
+template <typename F>
+KMeansResult segmentImpl(unsigned char* pixels, int width, int height, qint64 stride, const KMeansOptions& options) {
+    if constexpr (F::format == PixelFormat::Bgr24) {
+        ScratchArena::Scope scope;
+        unsigned char* labels = ScratchArena::local().allocate<unsigned char>(qint64(width) * height);
+        KMeansResult result = KMeans::segment(pixels, width, height, stride, options, labels);
+        if (!result.cancelled && !result.invalid) {
+            KMeans::recolor(pixels, width, height, stride, labels, result.centers, options.threads);
+        }
+        return result;
+    } else if constexpr (F::isGray) {
+        return segmentGray<F>(pixels, width, height, stride, options);
+    } else {
+        return segmentPixels<F>(pixels, width, height, stride, options);
+    }
+}
+
+}
+
+bool FormatKernels::equalize(PixelFormat format, unsigned char* pixels, int width, int height, qint64 stride,
+                             JobControl* control) {
+    return dispatchPixelFormat(format, [&](auto traits) {
+        return equalizeImpl<decltype(traits)>(pixels, width, height, stride, control);
+    });
+}
+
+void FormatKernels::convert(PixelFormat from, const unsigned char* src, qint64 srcStride,
+                            PixelFormat to, unsigned char* dst, qint64 dstStride, int width, int height,
+                            int threads) {
+    // 最常用的 BGR 转灰度走向量化的颜色转换内核
+    if (from == PixelFormat::Bgr24 && to == PixelFormat::Gray8) {
+        ColorConvert::bgrToGray(src, srcStride, width, height, dst, dstStride, threads);
+        return;
+    }
+    dispatchPixelFormat(from, [&](auto source) {
+        dispatchPixelFormat(to, [&](auto target) {
+            using Src = decltype(source);
+            using Dst = decltype(target);
+            parallelFor(0, height, [&](int, int y0, int y1) {
+                for (int y = y0; y < y1; ++y) {
+                    if constexpr (Src::format == Dst::format) {
+                        std::memcpy(dst + y * dstStride, src + y * srcStride, size_t(width) * Src::bytesPerPixel);
+                    } else {
+                        convertRow<Src, Dst>(channelRow<Src>(src, srcStride, y), channelRow<Dst>(dst, dstStride, y), width);
+                    }
+                }
+            }, threads);
+        });
+    });
+}
+
+void FormatKernels::downscale(PixelFormat format, const unsigned char* src, qint64 srcStride, int width, int height,
+                              unsigned char* dst, qint64 dstStride, int targetWidth, int targetHeight, int threads) {
+    if (targetWidth <= 0 || targetHeight <= 0 || targetWidth > width || targetHeight > height) {
+        return;
+    }
+    dispatchPixelFormat(format, [&](auto traits) {
+        downscaleImpl<decltype(traits)>(src, srcStride, width, height, dst, dstStride, targetWidth, targetHeight,
+                                        threads);
+    });
+}
+
+void FormatKernels::convolve(PixelFormat format, const unsigned char* src, unsigned char* dst, int width, int height,
+                             qint64 stride, const ConvolutionKernel& kernel, const ConvolutionOptions& options) {
+    dispatchPixelFormat(format, [&](auto traits) {
+        convolveImpl<decltype(traits)>(src, dst, width, height, stride, kernel, options);
+    });
+}
+
+KMeansResult FormatKernels::segment(PixelFormat format, unsigned char* pixels, int width, int height, qint64 stride,
+                                    const KMeansOptions& options) {
+    if (!KMeans::isValidK(options.K)) {
+        KMeansResult result;
+        result.invalid = true;
+        return result;
+    }
+    return dispatchPixelFormat(format, [&](auto traits) {
+        return segmentImpl<decltype(traits)>(pixels, width, height, stride, options);
+    });
+}
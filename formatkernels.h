@@ -0,0 +1,40 @@
+#ifndef FORMATKERNELS_H
+#define FORMATKERNELS_H
+
+#include "pixelformat.h"
+#include "convolution.h"
+#include "kmeans.h"
+
+class JobControl;
+
+// 按像素格式分派的核心算法。每个入口只在整幅图像上按 format 分派一次，
+// 之后进入为该格式实例化的模板循环，循环内没有按格式的分支。
+// Bgr24 直接使用已有的向量化内核（histogram、Convolution、KMeans），其余格式使用通用模板；
+// 所有算法只处理颜色通道，alpha 保持不变
+class FormatKernels {
+public:
+    // 直方图均衡化，各颜色通道独立；返回 false 表示被取消
+    static bool equalize(PixelFormat format, unsigned char* pixels, int width, int height, qint64 stride,
+                         JobControl* control = nullptr);
+
+    // 像素格式转换：灰度化（与 MyQImage::rgbToGray 相同的 Q14 定点加权，四舍五入）、灰度扩展为彩色、8/16 位互转、增减 alpha
+    static void convert(PixelFormat from, const unsigned char* src, qint64 srcStride,
+                        PixelFormat to, unsigned char* dst, qint64 dstStride, int width, int height,
+                        int threads = 0);
+
+    // 按面积平均缩小到 targetWidth x targetHeight（不大于原尺寸），用于交互预览的代理图像
+    static void downscale(PixelFormat format, const unsigned char* src, qint64 srcStride, int width, int height,
+                          unsigned char* dst, qint64 dstStride, int targetWidth, int targetHeight, int threads = 0);
+
+    // 卷积，src 与 dst 不能重叠。8 位格式交给 Convolution 引擎，16 位格式使用通用的直接卷积
+    static void convolve(PixelFormat format, const unsigned char* src, unsigned char* dst, int width, int height,
+                         qint64 stride, const ConvolutionKernel& kernel,
+                         const ConvolutionOptions& options = ConvolutionOptions());
+
+    // K-means 分割并把像素替换为所属簇中心的颜色。灰度格式在灰度直方图上迭代（结果与逐像素迭代相同），
+    // 结果中灰度中心的 b、g、r 相同；K 超出范围时不修改像素，结果标记为 invalid
+    static KMeansResult segment(PixelFormat format, unsigned char* pixels, int width, int height, qint64 stride,
+                                const KMeansOptions& options);
+};
+
+#endif // FORMATKERNELS_H
@@ -0,0 +1,229 @@
+#include "histogram.h"
+#include "simd.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const int kBanks = 4;
+// 每组计数器为 32 位，累计到该像素数时合并到 64 位总数，防止溢出
+const qint64 kFlushPixels = qint64(1) << 30;
+
+struct HistogramBanks {
+    quint32 counts[kBanks][3][256];
+};
+
+void flushBanks(HistogramBanks& banks, BgrHistogram& hist) {
+    for (int k = 0; k < kBanks; ++k) {
+        for (int i = 0; i < 256; ++i) {
+            hist.b[i] += banks.counts[k][0][i];
+            hist.g[i] += banks.counts[k][1][i];
+            hist.r[i] += banks.counts[k][2][i];
+        }
+    }
+    std::memset(&banks, 0, sizeof(banks));
+}
+
+// 标量查找表映射，lut 为 3*256 项，按 B、G、R 顺序排列
+void applyLutRowScalar(unsigned char* row, int width, const unsigned char* lut) {
+    const unsigned char* lutB = lut;
+    const unsigned char* lutG = lut + 256;
+    const unsigned char* lutR = lut + 512;
+    for (int x = 0; x < width; ++x, row += 3) {
+        row[0] = lutB[row[0]];
+        row[1] = lutG[row[1]];
+        row[2] = lutR[row[2]];
+    }
+}
+
+#if MYQIMAGE_X86_SIMD
+// AVX2：每次处理 8 个像素（24 字节），分三组 8 字节零扩展为 32 位索引，
+// 加上各字节所属通道的表偏移后 gather，再打包回 24 字节
+MYQIMAGE_TARGET_AVX2
+void applyLutRowAvx2(unsigned char* row, int width, const qint32* lut32, const unsigned char* lut) {
+    const __m256i offset0 = _mm256_setr_epi32(0, 256, 512, 0, 256, 512, 0, 256);
+    const __m256i offset1 = _mm256_setr_epi32(512, 0, 256, 512, 0, 256, 512, 0);
+    const __m256i offset2 = _mm256_setr_epi32(256, 512, 0, 256, 512, 0, 256, 512);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        unsigned char* p = row + x * 3;
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 8)));
+        __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 16)));
+        a = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut32), _mm256_add_epi32(a, offset0), 4);
+        b = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut32), _mm256_add_epi32(b, offset1), 4);
+        c = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut32), _mm256_add_epi32(c, offset2), 4);
+
+        // 每个 128 位通道内得到 [a b c c] 四个双字，重排为 a0 a1 b0 b1 c0 c1
+        __m256i ab = _mm256_packus_epi32(a, b);
+        __m256i cc = _mm256_packus_epi32(c, c);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cc), order);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p + 16), _mm256_extracti128_si256(packed, 1));
+    }
+    applyLutRowScalar(row + x * 3, width - x, lut);
+}
+
+// 平面查表：同一平面的字节都查同一张表，不需要按通道加偏移，每次 gather 16 个字节
+MYQIMAGE_TARGET_AVX2
+void applyPlaneLutRowAvx2(unsigned char* row, int width, const qint32* lut32, const unsigned char* lut) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        unsigned char* p = row + x;
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 8)));
+        a = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut32), a, 4);
+        b = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut32), b, 4);
+
+        // 打包后各 128 位通道内为 [a0-3 b0-3 | a4-7 b4-7]，两次跨通道重排得到 a0-7 b0-7
+        __m256i ab = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(ab, ab), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+    }
+    for (; x < width; ++x) {
+        row[x] = lut[row[x]];
+    }
+}
+#endif
+
+// 累计 CDF，除以像素数，再乘 255 截断
+template <typename Real>
+void buildEqualizationLutAs(const BgrHistogram& hist, BgrLut& lut) {
+    Real cdfB = 0, cdfG = 0, cdfR = 0;
+    const Real pixel_num = static_cast<Real>(hist.pixelCount);
+    for (int i = 0; i < 256; ++i) {
+        cdfB += static_cast<Real>(hist.b[i]);
+        cdfG += static_cast<Real>(hist.g[i]);
+        cdfR += static_cast<Real>(hist.r[i]);
+        Real normB = cdfB / pixel_num;
+        Real normG = cdfG / pixel_num;
+        Real normR = cdfR / pixel_num;
+        lut.b[i] = static_cast<unsigned char>(normB * 255);
+        lut.g[i] = static_cast<unsigned char>(normG * 255);
+        lut.r[i] = static_cast<unsigned char>(normR * 255);
+    }
+}
+
+}
+
+void accumulateBgrHistogram(const unsigned char* pixels, int width, int rows, qint64 rowSize,
+                            BgrHistogram& hist) {
+    static thread_local HistogramBanks banks;
+    std::memset(&banks, 0, sizeof(banks));
+
+    qint64 pending = 0;
+    for (int y = 0; y < rows; ++y) {
+        const unsigned char* p = pixels + y * rowSize;
+        int x = 0;
+        // 相邻 4 个像素分别计入 4 组直方图
+        for (; x + kBanks <= width; x += kBanks, p += 3 * kBanks) {
+            banks.counts[0][0][p[0]]++; banks.counts[0][1][p[1]]++; banks.counts[0][2][p[2]]++;
+            banks.counts[1][0][p[3]]++; banks.counts[1][1][p[4]]++; banks.counts[1][2][p[5]]++;
+            banks.counts[2][0][p[6]]++; banks.counts[2][1][p[7]]++; banks.counts[2][2][p[8]]++;
+            banks.counts[3][0][p[9]]++; banks.counts[3][1][p[10]]++; banks.counts[3][2][p[11]]++;
+        }
+        for (; x < width; ++x, p += 3) {
+            banks.counts[0][0][p[0]]++;
+            banks.counts[0][1][p[1]]++;
+            banks.counts[0][2][p[2]]++;
+        }
+        pending += width;
+        if (pending >= kFlushPixels) {
+            flushBanks(banks, hist);
+            pending = 0;
+        }
+    }
+    flushBanks(banks, hist);
+    hist.pixelCount += qint64(width) * rows;
+}
+
+void accumulatePlaneHistogram(const unsigned char* plane, int width, int rows, qint64 stride, qint64* counts) {
+    static thread_local quint32 banks[kBanks][256];
+    std::memset(banks, 0, sizeof(banks));
+
+    qint64 pending = 0;
+    auto flush = [&]() {
+        for (int k = 0; k < kBanks; ++k) {
+            for (int i = 0; i < 256; ++i) {
+                counts[i] += banks[k][i];
+            }
+        }
+        std::memset(banks, 0, sizeof(banks));
+    };
+    for (int y = 0; y < rows; ++y) {
+        const unsigned char* p = plane + y * stride;
+        int x = 0;
+        for (; x + kBanks <= width; x += kBanks) {
+            banks[0][p[x]]++;
+            banks[1][p[x + 1]]++;
+            banks[2][p[x + 2]]++;
+            banks[3][p[x + 3]]++;
+        }
+        for (; x < width; ++x) {
+            banks[0][p[x]]++;
+        }
+        pending += width;
+        if (pending >= kFlushPixels) {
+            flush();
+            pending = 0;
+        }
+    }
+    flush();
+}
+
+void buildEqualizationLut(const BgrHistogram& hist, BgrLut& lut) {
+    // 像素数在 int 范围内时保持原实现的 float 运算顺序（结果逐位一致）；
+    // 流式处理的超大图像计数超过 2^31，改用 double，避免截断
+    if (hist.pixelCount <= std::numeric_limits<int>::max()) {
+        buildEqualizationLutAs<float>(hist, lut);
+    } else {
+        buildEqualizationLutAs<double>(hist, lut);
+    }
+}
+
+void applyBgrLut(unsigned char* pixels, int width, int rows, qint64 rowSize, const BgrLut& lut) {
+    static_assert(sizeof(BgrLut) == 768, "BgrLut must be three packed 256-entry tables");
+    const unsigned char* table = lut.b;
+
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        qint32 lut32[768];
+        for (int i = 0; i < 768; ++i) {
+            lut32[i] = table[i];
+        }
+        for (int y = 0; y < rows; ++y) {
+            applyLutRowAvx2(pixels + y * rowSize, width, lut32, table);
+        }
+        return;
+    }
+#endif
+
+    for (int y = 0; y < rows; ++y) {
+        applyLutRowScalar(pixels + y * rowSize, width, table);
+    }
+}
+
+void applyPlaneLut(unsigned char* plane, int width, int rows, qint64 stride, const unsigned char* lut) {
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        qint32 lut32[256];
+        for (int i = 0; i < 256; ++i) {
+            lut32[i] = lut[i];
+        }
+        for (int y = 0; y < rows; ++y) {
+            applyPlaneLutRowAvx2(plane + y * stride, width, lut32, lut);
+        }
+        return;
+    }
+#endif
+
+    for (int y = 0; y < rows; ++y) {
+        unsigned char* p = plane + y * stride;
+        for (int x = 0; x < width; ++x) {
+            p[x] = lut[p[x]];
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtGlobal>
+
+// 24 位 BGR 图像的三通道直方图
+struct BgrHistogram {
+    qint64 b[256] = {};
+    qint64 g[256] = {};
+    qint64 r[256] = {};
+    qint64 pixelCount = 0;
+};
+
+// 三通道的 8 位查找表
+struct BgrLut {
+    unsigned char b[256];
+    unsigned char g[256];
+    unsigned char r[256];
+};
+
+// 将 rows 行像素累加到 hist 中（可多次调用，便于按条带统计）
+// 内部使用多组直方图交替计数，避免连续相同像素值造成的存储-加载停顿
+void accumulateBgrHistogram(const unsigned char* pixels, int width, int rows, qint64 rowSize,
+                            BgrHistogram& hist);
+
+// 由直方图生成均衡化查找表，结果与原先逐像素的 float CDF*255 计算逐位一致
+void buildEqualizationLut(const BgrHistogram& hist, BgrLut& lut);
+
+// 对 rows 行像素原地应用查找表；支持 AVX2 时用 gather 整行处理，否则走标量路径
+void applyBgrLut(unsigned char* pixels, int width, int rows, qint64 rowSize, const BgrLut& lut);
+
+// 平面布局下单个通道平面的版本：直方图累加到 counts（256 项），不更新像素数
+void accumulatePlaneHistogram(const unsigned char* plane, int width, int rows, qint64 stride, qint64* counts);
+
+// 对单个通道平面原地查表；支持 AVX2 时每次 gather 16 个字节
+void applyPlaneLut(unsigned char* plane, int width, int rows, qint64 stride, const unsigned char* lut);
+
+#endif // HISTOGRAM_H
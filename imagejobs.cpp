@@ -0,0 +1,102 @@
+#include "imagejobs.h"
+#include <QDebug>
+
+ImageJobRunner::ImageJobRunner(QObject* parent) : QObject(parent) {
+    qRegisterMetaType<ImageJobRequest>("ImageJobRequest");
+    qRegisterMetaType<MyQImage>("MyQImage");
+    // 作业依次执行，算法内部自行使用多线程
+    pool.setMaxThreadCount(1);
+}
+
+ImageJobRunner::~ImageJobRunner() {
+    cancel();
+    pool.waitForDone();
+}
+
+void ImageJobRunner::submit(const ImageJobRequest& request, const MyQImage& input, bool coalesce) {
+    if (!isBusy()) {
+        start(request, input);
+        return;
+    }
+    if (coalesce && !pending.isEmpty() && pending.last() == request) {
+        qDebug() << "Job coalesced with the queued one";
+        return;
+    }
+    if (pending.isEmpty() && current->isCancelled()) {
+        // 已取消的作业仍在退出，它的结果会被丢弃，之后的请求从提交时的图像开始
+        restartInput = input;
+    }
+    pending.append(request);
+}
+
+void ImageJobRunner::cancel() {
+    pending.clear();
+    restartInput = MyQImage();
+    if (current) {
+        current->cancel();
+    }
+}
+
+bool ImageJobRunner::runJob(const ImageJobRequest& request, MyQImage& image, JobControl* control) {
+    switch (request.type) {
+    case ImageJobType::Equalize:
+        return image.HistogramEqualization(control);
+    case ImageJobType::Segment:
+        image.changeK(request.K);
+        image.setInitialCenters(request.initialCenters);
+        if (request.session && image.getFormat() == PixelFormat::Bgr24) {
+            return request.session->segmentImage(image, control);
+        }
+        return image.segmentImage(control);
+    case ImageJobType::Sharpen:
+        return image.sharpen(control);
+    case ImageJobType::Clahe:
+        return image.clahe(request.tileSize, request.clipLimit, control);
+    case ImageJobType::Median:
+        return image.medianFilter(request.radius, control);
+    case ImageJobType::Bilateral:
+        return image.bilateralFilter(request.radius, request.rangeSigma, control);
+    }
+    return false;
+}
+
+void ImageJobRunner::start(const ImageJobRequest& request, const MyQImage& input) {
+    std::shared_ptr<JobControl> control = std::make_shared<JobControl>([this](int percent) {
+        emit progressChanged(percent);
+    });
+    current = control;
+    emit jobStarted(request);
+    emit progressChanged(0);
+
+    // 输入与界面上的图像共享像素，作业第一次写入时才复制，界面上的图像不受影响
+    pool.start([this, request, input, control]() {
+        MyQImage image = input;
+        bool completed = runJob(request, image, control.get()) && !control->isCancelled();
+        QMetaObject::invokeMethod(this, [this, request, input, image, completed, control]() {
+            onWorkerDone(request, input, image, completed, control);
+        }, Qt::QueuedConnection);
+    });
+}
+
+// 在界面线程执行：发出结果并开始队列中的下一个作业
+void ImageJobRunner::onWorkerDone(const ImageJobRequest& request, const MyQImage& input, const MyQImage& result,
+                                  bool completed, const std::shared_ptr<JobControl>& control) {
+    if (control != current) {
+        return;
+    }
+    current.reset();
+    if (!completed || control->isCancelled()) {
+        emit jobCancelled(request);
+        // 结果不可用：取消后提交的请求从提交时的图像开始，失败时从本作业的输入开始
+        const MyQImage next = control->isCancelled() ? restartInput : input;
+        restartInput = MyQImage();
+        if (!pending.isEmpty()) {
+            start(pending.takeFirst(), next);
+        }
+        return;
+    }
+    emit jobFinished(request, result);
+    if (!pending.isEmpty()) {
+        start(pending.takeFirst(), result);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef IMAGEJOBS_H
+#define IMAGEJOBS_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QList>
+#include <QMetaType>
+#include <memory>
+#include "myqimage.h"
+#include "jobcontrol.h"
+#include "segmentationsession.h"
+
+// 可在后台执行的图像操作
+enum class ImageJobType {
+    Equalize,
+    Segment,
+    Sharpen,
+    Clahe,
+    Median,
+    Bilateral
+};
+
+// 一个作业请求：操作类型及其参数
+struct ImageJobRequest {
+    ImageJobType type = ImageJobType::Equalize;
+    int K = 1;  // 图像分割的簇数
+    int tileSize = 64;      // CLAHE 分块边长
+    double clipLimit = 2.0; // CLAHE 剪切上限
+    int radius = 2;         // 去噪半径（双边滤波为空间标准差）
+    double rangeSigma = 30; // 双边滤波的亮度标准差
+    QVector<KMeansCenter> initialCenters;  // 图像分割的初始中心（来自预览代理），为空时随机选取
+    // 图像分割使用的会话（缓存各 K 的结果，改变 K 时热启动并分割原图），为空时直接分割输入
+    std::shared_ptr<SegmentationSession> session;
+
+    bool operator==(const ImageJobRequest& other) const {
+        return type == other.type
+               && (type != ImageJobType::Segment || (K == other.K && initialCenters == other.initialCenters))
+               && (type != ImageJobType::Clahe || (tileSize == other.tileSize && clipLimit == other.clipLimit))
+               && (type != ImageJobType::Median || radius == other.radius)
+               && (type != ImageJobType::Bilateral || (radius == other.radius && rangeSigma == other.rangeSigma));
+    }
+};
+
+// 异步作业层：在线程池中执行 MyQImage 的耗时操作，界面线程不再阻塞。
+// 同一时刻只运行一个作业，其余请求排队，并以前一个作业的结果为输入；
+// 新请求与队尾相同时合并（连续点击只排队一次）。作业被取消或失败后，队列中的请求继续执行：
+// 取消后提交的请求以提交时的图像为输入，失败时以失败作业的输入为输入。
+// 进度与结果通过信号送回：进度信号在工作线程发出，跨线程自动排队；结果在界面线程发出
+class ImageJobRunner : public QObject {
+    Q_OBJECT
+public:
+    explicit ImageJobRunner(QObject* parent = nullptr);
+    ~ImageJobRunner() override;
+
+    // 提交作业；空闲时以 input 为输入立即开始，否则排队。coalesce 为 false 时与队尾相同也照常排队
+    // （预览提交的操作序列中重复的操作是有意为之）
+    void submit(const ImageJobRequest& request, const MyQImage& input, bool coalesce = true);
+
+    // 取消正在运行的作业并清空队列
+    void cancel();
+
+    bool isBusy() const { return current != nullptr; }
+    int pendingCount() const { return pending.size(); }
+
+    // 在调用线程中同步执行一个作业，供异步路径与批处理共用
+    static bool runJob(const ImageJobRequest& request, MyQImage& image, JobControl* control = nullptr);
+
+signals:
+    void progressChanged(int percent);
+    void jobStarted(ImageJobRequest request);
+    void jobFinished(ImageJobRequest request, MyQImage result);
+    void jobCancelled(ImageJobRequest request);
+
+private:
+    void start(const ImageJobRequest& request, const MyQImage& input);
+    void onWorkerDone(const ImageJobRequest& request, const MyQImage& input, const MyQImage& result,
+                      bool completed, const std::shared_ptr<JobControl>& control);
+
+    QThreadPool pool;
+    std::shared_ptr<JobControl> current;  // 正在运行的作业，空闲时为空
+    QList<ImageJobRequest> pending;
+    MyQImage restartInput;  // 取消后、作业退出前提交的第一个请求的输入，队列从这里重新开始
+};
+
+Q_DECLARE_METATYPE(ImageJobRequest)
+Q_DECLARE_METATYPE(MyQImage)
+
+#endif // IMAGEJOBS_H
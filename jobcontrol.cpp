@@ -0,0 +1,29 @@
+#include "jobcontrol.h"
+#include <algorithm>
+
+JobControl::JobControl(ProgressCallback callback) : callback(std::move(callback)) {}
+
+// 阶段在工作线程开始推进之前由调用线程设置
+void JobControl::beginStage(int fromPercent, int toPercent, qint64 units) {
+    stageFrom = fromPercent;
+    stageTo = toPercent;
+    stageUnits = std::max<qint64>(1, units);
+    done.store(0, std::memory_order_relaxed);
+    advance(0);
+}
+
+bool JobControl::advance(qint64 units) {
+    qint64 total = done.fetch_add(units, std::memory_order_relaxed) + units;
+    int value = stageFrom + int((stageTo - stageFrom) * std::min(total, stageUnits) / stageUnits);
+    // 只有把百分比调大的线程才调用回调，避免重复与倒退
+    int previous = lastPercent.load(std::memory_order_relaxed);
+    while (value > previous) {
+        if (lastPercent.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+            if (callback) {
+                callback(value);
+            }
+            break;
+        }
+    }
+    return !isCancelled();
+}
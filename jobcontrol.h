@@ -0,0 +1,39 @@
+#ifndef JOBCONTROL_H
+#define JOBCONTROL_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <functional>
+
+// 长时间运行的算法与调用方之间的进度与取消通道，可在多个工作线程中同时使用。
+// 算法按阶段报告进度：每个阶段占总进度的一段百分比，阶段内以行数、迭代次数等为单位推进；
+// 百分比变化时调用回调（在推进进度的线程中调用）
+class JobControl {
+public:
+    typedef std::function<void(int percent)> ProgressCallback;
+
+    explicit JobControl(ProgressCallback callback = ProgressCallback());
+
+    // 请求取消；算法在下一个检查点（一个分块、一次迭代）停止
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+    // 开始新阶段：占总进度的 [fromPercent, toPercent]，工作量为 units
+    void beginStage(int fromPercent, int toPercent, qint64 units);
+
+    // 完成 units 个单位的工作；返回 false 表示已请求取消，调用方应尽快停止
+    bool advance(qint64 units);
+
+    int percent() const { return lastPercent.load(std::memory_order_relaxed); }
+
+private:
+    ProgressCallback callback;
+    std::atomic<bool> cancelled{false};
+    std::atomic<qint64> done{0};
+    std::atomic<int> lastPercent{0};
+    qint64 stageUnits = 1;
+    int stageFrom = 0;
+    int stageTo = 100;
+};
+
+#endif // JOBCONTROL_H
@@ -0,0 +1,541 @@
+#include "kmeans.h"
+#include "parallel.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "trace.h"
+#include <QDebug>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// 单个线程的累加器
+struct Accumulator {
+    std::vector<qint64> sums;    // 3K，B、G、R
+    std::vector<qint64> counts;  // K
+    qint64 changes = 0;          // 本次迭代中簇号改变的像素（颜色）数
+};
+
+// 最近中心，平方距离相同时取序号较小者（与原先 float 距离的比较结果一致）
+inline int nearestCenter(const unsigned char* p, const int* centers, int K) {
+    int best = 0;
+    int bestDistance = std::numeric_limits<int>::max();
+    for (int k = 0; k < K; ++k) {
+        const int* c = centers + k * 3;
+        int db = p[0] - c[0];
+        int dg = p[1] - c[1];
+        int dr = p[2] - c[2];
+        int distance = db * db + dg * dg + dr * dr;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = k;
+        }
+    }
+    return best;
+}
+
+}
+
+KMeansResult KMeans::run(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                         const KMeansOptions& options, unsigned char* labels) {
+    KMeansResult result;
+    if (!isValidK(options.K)) {
+        qDebug() << "KMeans: K out of range [1," << kMaxClusters << "]:" << options.K;
+        result.invalid = true;
+        return result;
+    }
+    const int K = options.K;
+    const int threads = std::min(parallelThreadCount(options.threads), std::max(1, height));
+
+    // 中心按 B、G、R 连续存放，便于内层循环访问
+    std::vector<int> centers(K * 3);
+    QRandomGenerator rng(options.seed);
+    for (int k = 0; k < K; ++k) {
+        if (options.initialCenters.size() == K) {
+            const KMeansCenter& c = options.initialCenters[k];
+            centers[k * 3] = c.b;
+            centers[k * 3 + 1] = c.g;
+            centers[k * 3 + 2] = c.r;
+            continue;
+        }
+        int y = rng.bounded(height);
+        int x = rng.bounded(width);
+        const unsigned char* p = pixels + y * rowSize + x * 3;
+        centers[k * 3] = p[0];
+        centers[k * 3 + 1] = p[1];
+        centers[k * 3 + 2] = p[2];
+    }
+
+    // 所有缓冲在迭代开始前一次分配，迭代中不再分配内存
+    std::fill(labels, labels + qint64(width) * height, 0xFF);
+    std::vector<Accumulator> accumulators(threads);
+    for (Accumulator& acc : accumulators) {
+        acc.sums.resize(K * 3);
+        acc.counts.resize(K);
+    }
+    std::vector<qint64> sums(K * 3);
+    std::vector<qint64> counts(K);
+    // 同一组线程执行所有迭代
+    ParallelTeam team(threads);
+
+    bool converged = false;
+    while (!converged && result.iterations < options.maxIterations) {
+        if (options.control && options.control->isCancelled()) {
+            result.cancelled = true;
+            break;
+        }
+        MYQIMAGE_TRACE_SCOPE("KMeans::run iteration");
+        // 分配与累加合并为一遍按行扫描
+        team.forRange(0, height, [&](int t, int y0, int y1) {
+            Accumulator& acc = accumulators[t];
+            std::fill(acc.sums.begin(), acc.sums.end(), 0);
+            std::fill(acc.counts.begin(), acc.counts.end(), 0);
+            acc.changes = 0;
+            const int* c = centers.data();
+            for (int y = y0; y < y1; ++y) {
+                const unsigned char* p = pixels + y * rowSize;
+                unsigned char* label = labels + qint64(y) * width;
+                for (int x = 0; x < width; ++x, p += 3) {
+                    int k = nearestCenter(p, c, K);
+                    if (label[x] != k) {
+                        label[x] = static_cast<unsigned char>(k);
+                        acc.changes++;
+                    }
+                    acc.sums[k * 3] += p[0];
+                    acc.sums[k * 3 + 1] += p[1];
+                    acc.sums[k * 3 + 2] += p[2];
+                    acc.counts[k]++;
+                }
+            }
+        });
+
+        // 按线程序号顺序归约
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        qint64 changes = 0;
+        for (const Accumulator& acc : accumulators) {
+            for (int i = 0; i < K * 3; ++i) {
+                sums[i] += acc.sums[i];
+            }
+            for (int k = 0; k < K; ++k) {
+                counts[k] += acc.counts[k];
+            }
+            changes += acc.changes;
+        }
+        MYQIMAGE_TRACE_COUNTER("kmeans.label_changes", changes);
+        Q_UNUSED(changes);
+
+        // 更新聚类中心，所有中心移动都不超过 1 时收敛
+        converged = true;
+        for (int k = 0; k < K; ++k) {
+            if (counts[k] == 0) {
+                continue;
+            }
+            for (int c = 0; c < 3; ++c) {
+                int value = static_cast<int>(sums[k * 3 + c] / counts[k]);
+                if (std::abs(value - centers[k * 3 + c]) > 1) {
+                    converged = false;
+                }
+                centers[k * 3 + c] = value;
+            }
+        }
+        ++result.iterations;
+        MYQIMAGE_TRACE_COUNTER("kmeans.iterations", result.iterations);
+        if (options.control) {
+            options.control->advance(1);
+        }
+    }
+
+    result.centers.resize(K);
+    for (int k = 0; k < K; ++k) {
+        result.centers[k].b = centers[k * 3];
+        result.centers[k].g = centers[k * 3 + 1];
+        result.centers[k].r = centers[k * 3 + 2];
+    }
+    result.counts = QVector<qint64>(counts.begin(), counts.end());
+    result.sums = QVector<qint64>(sums.begin(), sums.end());
+    return result;
+}
+
+void KMeans::recolor(unsigned char* pixels, int width, int height, qint64 rowSize,
+                     const unsigned char* labels, const QVector<KMeansCenter>& centers,
+                     int threads) {
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            unsigned char* p = pixels + y * rowSize;
+            const unsigned char* label = labels + qint64(y) * width;
+            for (int x = 0; x < width; ++x, p += 3) {
+                const KMeansCenter& c = centers[label[x]];
+                // 注意：存储时仍然是BGR顺序
+                p[0] = static_cast<unsigned char>(c.b);
+                p[1] = static_cast<unsigned char>(c.g);
+                p[2] = static_cast<unsigned char>(c.r);
+            }
+        }
+    }, threads);
+}
+
+namespace {
+
+// 压缩后的颜色点集：每个点是一个（量化后的）颜色及其像素数与颜色之和
+struct ColorPoints {
+    std::vector<double> values;   // 3n，点的平均颜色 B、G、R
+    std::vector<qint64> weights;  // n，像素数
+    std::vector<qint64> sums;     // 3n，该颜色下所有像素 B、G、R 之和
+    int size() const { return int(weights.size()); }
+};
+
+inline double distance3(const double* a, const double* b) {
+    double db = a[0] - b[0];
+    double dg = a[1] - b[1];
+    double dr = a[2] - b[2];
+    return std::sqrt(db * db + dg * dg + dr * dr);
+}
+
+inline quint32 colorIndex(const unsigned char* p, int bits) {
+    const int shift = 8 - bits;
+    return (quint32(p[0] >> shift) << (2 * bits)) | (quint32(p[1] >> shift) << bits) | quint32(p[2] >> shift);
+}
+
+// K-means++：第一个中心按像素数加权随机选取，之后按到最近中心距离平方乘以像素数加权选取
+void seedPlusPlus(const ColorPoints& points, int K, QRandomGenerator& rng, std::vector<double>& centers) {
+    const int n = points.size();
+    std::vector<double> nearest(n, std::numeric_limits<double>::max());
+    qint64 totalWeight = 0;
+    for (qint64 w : points.weights) {
+        totalWeight += w;
+    }
+
+    auto pick = [&](const std::vector<double>& scores, double total) {
+        double target = rng.generateDouble() * total;
+        for (int i = 0; i < n; ++i) {
+            target -= scores[i];
+            if (target < 0) {
+                return i;
+            }
+        }
+        return n - 1;
+    };
+
+    std::vector<double> scores(n);
+    for (int i = 0; i < n; ++i) {
+        scores[i] = double(points.weights[i]);
+    }
+    int chosen = pick(scores, double(totalWeight));
+    for (int k = 0; k < K; ++k) {
+        std::copy(points.values.begin() + chosen * 3, points.values.begin() + chosen * 3 + 3,
+                  centers.begin() + k * 3);
+        if (k == K - 1) {
+            break;
+        }
+        double total = 0;
+        for (int i = 0; i < n; ++i) {
+            double d = distance3(&points.values[i * 3], &centers[k * 3]);
+            nearest[i] = std::min(nearest[i], d * d);
+            scores[i] = nearest[i] * points.weights[i];
+            total += scores[i];
+        }
+        // 颜色数少于 K 时所有点都已被选为中心，剩余中心重复最后一个
+        chosen = total > 0 ? pick(scores, total) : chosen;
+    }
+}
+
+}
+
+KMeansResult KMeans::runCompressed(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                                   const KMeansOptions& options, unsigned char* labels) {
+    KMeansResult result;
+    if (!isValidK(options.K)) {
+        qDebug() << "KMeans: K out of range [1," << kMaxClusters << "]:" << options.K;
+        result.invalid = true;
+        return result;
+    }
+    const int K = options.K;
+    const int bits = std::max(1, std::min(options.colorBits, 8));
+    const int threads = parallelThreadCount(options.threads);
+    const quint32 tableSize = quint32(1) << (3 * bits);
+    const bool exact = bits == 8;
+
+    // 1. 统计颜色直方图并压缩为点集。
+    //    精确颜色时颜色即索引，只需计数；量化时每个桶还需累计实际颜色之和，以桶内平均颜色作为点的位置。
+    //    像素远少于颜色表项时（小图的精确颜色），改用排序去重，避免分配和扫描 64MB 的计数表
+    ColorPoints points;
+    auto addPoint = [&points](qint64 count, qint64 sb, qint64 sg, qint64 sr) {
+        points.weights.push_back(count);
+        points.sums.push_back(sb);
+        points.sums.push_back(sg);
+        points.sums.push_back(sr);
+        points.values.push_back(double(sb) / count);
+        points.values.push_back(double(sg) / count);
+        points.values.push_back(double(sr) / count);
+    };
+
+    // 与像素数或颜色表同规模的临时数组都取自线程局部的临时内存
+    ScratchArena::Scope scope;
+    ScratchArena& arena = ScratchArena::local();
+    const qint64 numPixels = qint64(width) * height;
+    const bool sorted = exact && numPixels * 4 < tableSize;
+    quint32* table = nullptr;       // 颜色索引 -> 点序号+1（0 表示不存在）
+    quint32* pixelPoint = nullptr;  // 排序去重时每个像素所属的点序号
+    if (sorted) {
+        // 高 32 位为颜色，低 32 位为像素序号，排序后相同颜色相邻
+        quint64* keys = arena.allocate<quint64>(numPixels);
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* p = pixels + y * rowSize;
+            quint64* key = keys + qint64(y) * width;
+            for (int x = 0; x < width; ++x, p += 3) {
+                key[x] = (quint64(colorIndex(p, bits)) << 32) | quint64(qint64(y) * width + x);
+            }
+        }
+        std::sort(keys, keys + numPixels);
+        pixelPoint = arena.allocate<quint32>(numPixels);
+        for (qint64 i = 0; i < numPixels;) {
+            quint32 index = quint32(keys[i] >> 32);
+            qint64 j = i;
+            for (; j < numPixels && quint32(keys[j] >> 32) == index; ++j) {
+                pixelPoint[quint32(keys[j])] = quint32(points.size());
+            }
+            qint64 count = qint64(j - i);
+            addPoint(count, qint64(index >> 16) * count, qint64((index >> 8) & 0xFF) * count,
+                     qint64(index & 0xFF) * count);
+            i = j;
+        }
+    } else {
+        table = arena.allocate<quint32>(tableSize);
+        std::fill(table, table + tableSize, 0);
+        qint64* binSums = nullptr;
+        if (!exact) {
+            binSums = arena.allocate<qint64>(qint64(tableSize) * 3);
+            std::fill(binSums, binSums + qint64(tableSize) * 3, 0);
+        }
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* p = pixels + y * rowSize;
+            for (int x = 0; x < width; ++x, p += 3) {
+                quint32 index = colorIndex(p, bits);
+                table[index]++;
+                if (!exact) {
+                    binSums[size_t(index) * 3] += p[0];
+                    binSums[size_t(index) * 3 + 1] += p[1];
+                    binSums[size_t(index) * 3 + 2] += p[2];
+                }
+            }
+        }
+        // 计数表原地改写为 颜色索引 -> 点序号+1
+        for (quint32 index = 0; index < tableSize; ++index) {
+            quint32 count = table[index];
+            if (count == 0) {
+                continue;
+            }
+            if (exact) {
+                addPoint(count, qint64(index >> 16) * count, qint64((index >> 8) & 0xFF) * count,
+                         qint64(index & 0xFF) * count);
+            } else {
+                addPoint(count, binSums[size_t(index) * 3], binSums[size_t(index) * 3 + 1],
+                         binSums[size_t(index) * 3 + 2]);
+            }
+            table[index] = quint32(points.size());
+        }
+    }
+
+    const int n = points.size();
+    QRandomGenerator rng(options.seed);
+    std::vector<double> centers(K * 3);
+    if (options.initialCenters.size() == K) {
+        for (int k = 0; k < K; ++k) {
+            centers[k * 3] = options.initialCenters[k].b;
+            centers[k * 3 + 1] = options.initialCenters[k].g;
+            centers[k * 3 + 2] = options.initialCenters[k].r;
+        }
+    } else {
+        seedPlusPlus(points, K, rng, centers);
+    }
+
+    // 3. Hamerly：每个点保存到所属中心距离的上界与到次近中心距离的下界
+    int* assign = arena.allocate<int>(n);
+    double* upper = arena.allocate<double>(n);
+    double* lower = arena.allocate<double>(n);
+    std::vector<double> halfGap(K), moved(K), oldCenters(K * 3);
+    std::vector<qint64> sums(K * 3), counts(K);
+    // 初始分配、每次迭代的各遍扫描与最后的映射都由同一组线程执行
+    ParallelTeam team(threads);
+
+    auto assignFully = [&](int i) {
+        const double* x = &points.values[i * 3];
+        double d1 = std::numeric_limits<double>::max();
+        double d2 = std::numeric_limits<double>::max();
+        int best = 0;
+        for (int k = 0; k < K; ++k) {
+            double d = distance3(x, &centers[k * 3]);
+            if (d < d1) {
+                d2 = d1;
+                d1 = d;
+                best = k;
+            } else if (d < d2) {
+                d2 = d;
+            }
+        }
+        assign[i] = best;
+        upper[i] = d1;
+        lower[i] = d2;
+    };
+
+    team.forRange(0, n, [&](int, int b, int e) {
+        for (int i = b; i < e; ++i) {
+            assignFully(i);
+        }
+    });
+
+    std::vector<Accumulator> accumulators(threads);
+    for (Accumulator& acc : accumulators) {
+        acc.sums.resize(K * 3);
+        acc.counts.resize(K);
+    }
+
+    bool converged = false;
+    while (!converged && result.iterations < options.maxIterations) {
+        if (options.control && options.control->isCancelled()) {
+            result.cancelled = true;
+            break;
+        }
+        MYQIMAGE_TRACE_SCOPE("KMeans::runCompressed iteration");
+        if (result.iterations > 0) {
+            // 每个中心到其它中心最近距离的一半
+            for (int k = 0; k < K; ++k) {
+                double nearest = std::numeric_limits<double>::max();
+                for (int j = 0; j < K; ++j) {
+                    if (j != k) {
+                        nearest = std::min(nearest, distance3(&centers[k * 3], &centers[j * 3]));
+                    }
+                }
+                halfGap[k] = K > 1 ? nearest / 2 : std::numeric_limits<double>::max();
+            }
+            team.forRange(0, n, [&](int t, int b, int e) {
+                Accumulator& acc = accumulators[t];
+                acc.changes = 0;
+                for (int i = b; i < e; ++i) {
+                    double bound = std::max(halfGap[assign[i]], lower[i]);
+                    if (upper[i] <= bound) {
+                        continue;
+                    }
+                    // 收紧上界后仍无法排除，才计算到所有中心的距离
+                    upper[i] = distance3(&points.values[i * 3], &centers[assign[i] * 3]);
+                    if (upper[i] <= bound) {
+                        continue;
+                    }
+                    int previous = assign[i];
+                    assignFully(i);
+                    acc.changes += assign[i] != previous;
+                }
+            });
+            qint64 changes = 0;
+            for (const Accumulator& acc : accumulators) {
+                changes += acc.changes;
+            }
+            MYQIMAGE_TRACE_COUNTER("kmeans.label_changes", changes);
+            if (changes == 0) {
+                break;
+            }
+        }
+
+        // 由整数颜色和重新计算中心，归约顺序固定，与线程数无关
+        team.forRange(0, n, [&](int t, int b, int e) {
+            Accumulator& acc = accumulators[t];
+            std::fill(acc.sums.begin(), acc.sums.end(), 0);
+            std::fill(acc.counts.begin(), acc.counts.end(), 0);
+            for (int i = b; i < e; ++i) {
+                int k = assign[i];
+                acc.sums[k * 3] += points.sums[i * 3];
+                acc.sums[k * 3 + 1] += points.sums[i * 3 + 1];
+                acc.sums[k * 3 + 2] += points.sums[i * 3 + 2];
+                acc.counts[k] += points.weights[i];
+            }
+        });
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int t = 0; t < threads; ++t) {
+            const Accumulator& acc = accumulators[t];
+            for (int i = 0; i < K * 3; ++i) {
+                sums[i] += acc.sums[i];
+            }
+            for (int k = 0; k < K; ++k) {
+                counts[k] += acc.counts[k];
+            }
+        }
+
+        oldCenters = centers;
+        double maxMove = 0, secondMove = 0;
+        int maxMoved = 0;
+        for (int k = 0; k < K; ++k) {
+            if (counts[k] > 0) {
+                for (int c = 0; c < 3; ++c) {
+                    centers[k * 3 + c] = double(sums[k * 3 + c]) / counts[k];
+                }
+            }
+            moved[k] = distance3(&centers[k * 3], &oldCenters[k * 3]);
+            if (moved[k] > maxMove) {
+                secondMove = maxMove;
+                maxMove = moved[k];
+                maxMoved = k;
+            } else if (moved[k] > secondMove) {
+                secondMove = moved[k];
+            }
+        }
+        ++result.iterations;
+        MYQIMAGE_TRACE_COUNTER("kmeans.iterations", result.iterations);
+        if (options.control) {
+            options.control->advance(1);
+        }
+        // 与逐像素引擎相同：所有中心移动都不超过 1 时收敛
+        if (maxMove <= 1.0) {
+            converged = true;
+            break;
+        }
+
+        // 按中心移动量放宽上下界
+        team.forRange(0, n, [&](int, int b, int e) {
+            for (int i = b; i < e; ++i) {
+                upper[i] += moved[assign[i]];
+                lower[i] -= assign[i] == maxMoved ? secondMove : maxMove;
+            }
+        });
+    }
+
+    // 4. 颜色 -> 簇号查找表映射回每个像素
+    unsigned char* pointLabel = arena.allocate<unsigned char>(n);
+    for (int i = 0; i < n; ++i) {
+        pointLabel[i] = static_cast<unsigned char>(assign[i]);
+    }
+    team.forRange(0, height, [&](int, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char* p = pixels + y * rowSize;
+            unsigned char* label = labels + qint64(y) * width;
+            for (int x = 0; x < width; ++x, p += 3) {
+                int point = sorted ? int(pixelPoint[qint64(y) * width + x])
+                                   : int(table[colorIndex(p, bits)]) - 1;
+                label[x] = pointLabel[point];
+            }
+        }
+    });
+
+    result.centers.resize(K);
+    for (int k = 0; k < K; ++k) {
+        result.centers[k].b = int(centers[k * 3]);
+        result.centers[k].g = int(centers[k * 3 + 1]);
+        result.centers[k].r = int(centers[k * 3 + 2]);
+    }
+    result.counts = QVector<qint64>(counts.begin(), counts.end());
+    result.sums = QVector<qint64>(sums.begin(), sums.end());
+    return result;
+}
+
+KMeansResult KMeans::segment(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                             const KMeansOptions& options, unsigned char* labels) {
+    if (options.engine == KMeansEngine::ColorHistogram) {
+        return runCompressed(pixels, width, height, rowSize, options, labels);
+    }
+    return run(pixels, width, height, rowSize, options, labels);
+}
@@ -0,0 +1,75 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <QtGlobal>
+#include <QVector>
+
+class JobControl;
+
+// 聚类中心（BGR）
+struct KMeansCenter {
+    int b = 0;
+    int g = 0;
+    int r = 0;
+
+    bool operator==(const KMeansCenter& other) const { return b == other.b && g == other.g && r == other.r; }
+};
+
+// 聚类引擎：逐像素聚类，或先压缩为颜色直方图再聚类
+enum class KMeansEngine {
+    Pixels,
+    ColorHistogram
+};
+
+struct KMeansOptions {
+    int K = 1;                // 簇数，取值 [1, KMeans::kMaxClusters]，超出范围时不执行聚类
+    int maxIterations = 100;  // 最大迭代次数
+    quint32 seed = 1;         // 初始中心的随机种子，相同种子结果相同
+    int threads = 0;          // 线程数，<=0 时使用 CPU 核数
+    KMeansEngine engine = KMeansEngine::Pixels;
+    int colorBits = 8;        // 颜色直方图引擎每通道保留的位数：8 为精确颜色，5/6 为量化颜色
+    JobControl* control = nullptr;  // 每次迭代推进一个单位的进度；请求取消后在迭代之间停止
+    // 恰好 K 个时作为初始中心（例如预览代理上的聚类结果），不再随机选取，通常几次迭代即可收敛
+    QVector<KMeansCenter> initialCenters;
+};
+
+struct KMeansResult {
+    QVector<KMeansCenter> centers;
+    QVector<qint64> counts;   // 最后一次分配中每个簇的像素数
+    QVector<qint64> sums;     // 最后一次分配中每个簇的 B、G、R 之和，长度 3K
+    int iterations = 0;
+    bool cancelled = false;   // 迭代因取消而中止，结果不完整
+    bool invalid = false;     // K 超出范围，没有执行聚类，结果为空
+};
+
+// 对 24 位 BGR 像素做 K-means 聚类
+class KMeans {
+public:
+    // 簇号按字节存储，K 最大为 255
+    static const int kMaxClusters = 255;
+
+    static bool isValidK(int K) { return K >= 1 && K <= kMaxClusters; }
+
+    // 多线程执行：每次迭代在一遍按行扫描中同时完成分配与累加，
+    // 每个线程有独立的累加器，按线程序号固定顺序归约；距离使用整数平方距离
+    // labels 为 width*height 字节的输出缓冲，按行优先记录每个像素的簇号
+    static KMeansResult run(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                            const KMeansOptions& options, unsigned char* labels);
+
+    // 颜色直方图引擎：将图像压缩为带权重的不同颜色集合，用 K-means++ 选初始中心，
+    // 再以 Hamerly 三角不等式上下界剪枝迭代，最后经颜色到簇号的查找表映射回像素。
+    // 每次迭代的代价由 O(像素数*K) 降为约 O(颜色数*K)
+    static KMeansResult runCompressed(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                                      const KMeansOptions& options, unsigned char* labels);
+
+    // 按 options.engine 选择 run() 或 runCompressed()
+    static KMeansResult segment(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                                const KMeansOptions& options, unsigned char* labels);
+
+    // 按簇号将像素替换为对应中心的颜色
+    static void recolor(unsigned char* pixels, int width, int height, qint64 rowSize,
+                        const unsigned char* labels, const QVector<KMeansCenter>& centers,
+                        int threads = 0);
+};
+
+#endif // KMEANS_H
@@ -1,8 +1,20 @@
 #include "MyQImage.h"
+#include "histogram.h"
+#include "kmeans.h"
+#include "convolution.h"
+#include "bufferpool.h"
+#include "jobcontrol.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "tiledimage.h"
+#include "formatkernels.h"
+#include "clahe.h"
+#include "denoise.h"
 #include <QFile>
 #include <QDataStream>
 #include <QDebug>
 #include <QPixmap>
+#include <QImage>
 #include <algorithm>
 #include <QRandomGenerator>
 #include <QQueue>
@@ -10,28 +22,42 @@
 #include <map>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <tuple>
+#include <vector>
 
 
 using namespace std;
 
-MyQImage::MyQImage() : width(0), height(0), pixels(nullptr) {}
+MyQImage::MyQImage() : width(0), height(0), pixels(nullptr), rowSize(0) {}
 
 MyQImage::~MyQImage() {
-    delete[] pixels;
+    releasePixels();
 }
 
-// 拷贝构造函数
+// 拷贝构造函数：共享像素存储与显示缓存，不复制像素
 MyQImage::MyQImage(const MyQImage& other)
-    : width(other.width), height(other.height), rowSize(other.rowSize) {
-    // 深拷贝像素数据
-    if (other.pixels) {
-        pixels = new unsigned char[rowSize * height];
-        copy(other.pixels, other.pixels + rowSize * height, pixels);
-    } else {
-        pixels = nullptr;
-    }
+    : fileHeader(other.fileHeader), infoHeader(other.infoHeader),
+      width(other.width), height(other.height), pixels(other.pixels), rowSize(other.rowSize),
+      format(other.format), K(other.K), seed(other.seed), engine(other.engine), colorBits(other.colorBits),
+      initialCenters(other.initialCenters), segmentCenters(other.segmentCenters),
+      keepSegmentLabels(other.keepSegmentLabels), segmentLabels(other.segmentLabels),
+      buffer(other.buffer), planar(other.planar), interleavedStale(other.interleavedStale),
+      storageLayout(other.storageLayout), displayPyramid(other.displayPyramid) {}
+
+// 移动构造函数：接管 other 的存储，other 变为空图像
+MyQImage::MyQImage(MyQImage&& other) noexcept
+    : fileHeader(other.fileHeader), infoHeader(other.infoHeader),
+      width(other.width), height(other.height), pixels(other.pixels), rowSize(other.rowSize),
+      format(other.format), K(other.K), seed(other.seed), engine(other.engine), colorBits(other.colorBits),
+      initialCenters(other.initialCenters), segmentCenters(other.segmentCenters),
+      keepSegmentLabels(other.keepSegmentLabels), segmentLabels(other.segmentLabels),
+      buffer(std::move(other.buffer)), planar(std::move(other.planar)), interleavedStale(other.interleavedStale),
+      storageLayout(other.storageLayout), displayPyramid(std::move(other.displayPyramid)) {
+    other.pixels = nullptr;
+    other.interleavedStale = false;
+    other.width = other.height = other.rowSize = 0;
 }
 
 MyQImage& MyQImage::operator=(const MyQImage& other) {
@@ -39,90 +65,394 @@ MyQImage& MyQImage::operator=(const MyQImage& other) {
     if (this == &other) {
         return *this;
     }
-    // 释放当前对象已有的像素数据
-    delete[] pixels;
-
-    // 复制其他对象的数据
+    // 复制其他对象的数据，像素存储只增加引用计数
+    fileHeader = other.fileHeader;
+    infoHeader = other.infoHeader;
     width = other.width;
     height = other.height;
     rowSize = other.rowSize;
-
-    if (other.pixels) {
-        pixels = new unsigned char[rowSize * height];
-        copy(other.pixels, other.pixels + rowSize * height, pixels);
-    } else {
-        pixels = nullptr;
-    }
+    format = other.format;
+    K = other.K;
+    seed = other.seed;
+    engine = other.engine;
+    colorBits = other.colorBits;
+    initialCenters = other.initialCenters;
+    segmentCenters = other.segmentCenters;
+    keepSegmentLabels = other.keepSegmentLabels;
+    segmentLabels = other.segmentLabels;
+    buffer = other.buffer;
+    pixels = other.pixels;
+    planar = other.planar;
+    interleavedStale = other.interleavedStale;
+    storageLayout = other.storageLayout;
+    displayPyramid = other.displayPyramid;
 
     // 返回当前对象的引用
     return *this;
 }
 
+MyQImage& MyQImage::operator=(MyQImage&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    fileHeader = other.fileHeader;
+    infoHeader = other.infoHeader;
+    width = other.width;
+    height = other.height;
+    rowSize = other.rowSize;
+    format = other.format;
+    K = other.K;
+    seed = other.seed;
+    engine = other.engine;
+    colorBits = other.colorBits;
+    initialCenters = other.initialCenters;
+    segmentCenters = other.segmentCenters;
+    keepSegmentLabels = other.keepSegmentLabels;
+    segmentLabels = other.segmentLabels;
+    buffer = std::move(other.buffer);
+    pixels = other.pixels;
+    planar = std::move(other.planar);
+    interleavedStale = other.interleavedStale;
+    storageLayout = other.storageLayout;
+    displayPyramid = std::move(other.displayPyramid);
+
+    other.buffer.reset();
+    other.planar.reset();
+    other.interleavedStale = false;
+    other.displayPyramid.clear();
+    other.pixels = nullptr;
+    other.width = other.height = other.rowSize = 0;
+    return *this;
+}
+
 // 加载 BMP 文件
-bool MyQImage::load(const QString& filePath) {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
+bool MyQImage::load(const QString& filePath, LoadMode mode) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::load");
+    if (TiledImageFile::isTiledFile(filePath)) {
+        return loadRegion(filePath, QRect(0, 0, std::numeric_limits<int>::max(), std::numeric_limits<int>::max()));
+    }
+    QFile* file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
         qDebug() << "Error: Cannot open file" << filePath;
+        delete file;
         return false;
     }
 
+    // 释放之前加载的图像
+    releasePixels();
+    width = height = 0;
+
     // 读取 BMP 文件头 (14字节)
-    file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+    file->read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
     qDebug() << "File Header: Type" << QString::number(fileHeader.type, 16)
              << "  Size" << fileHeader.size
              << "  Offset" << fileHeader.offset;
     if (fileHeader.type != 0x4D42) {  // 'BM'
         qDebug() << "Error: Not a valid BMP file.";
+        delete file;
         return false;
     }
 
 
     // 读取位图信息头 (40字节)
-    file.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
+    file->read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
     qDebug() << "Info Header: Size" << infoHeader.size
              << "Width" << infoHeader.width
              << "Height" << infoHeader.height
              << "Bits per pixel" << infoHeader.bitsPerPixel;
 
-    // 获取图像宽度和高度
-    width = infoHeader.width;
-    height = infoHeader.height;
-    qDebug() << "Bits per pixel:" << infoHeader.bitsPerPixel;
+    // 支持 8 位（调色板）、24 位与 32 位
+    const int bitsPerPixel = infoHeader.bitsPerPixel;
+    if (bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32) {
+        qDebug() << "Error: Only 8-, 24- and 32-bit BMP files are supported.";
+        delete file;
+        return false;
+    }
 
-    // 确保图像的颜色深度是 24 位
-    if (infoHeader.bitsPerPixel != 24) {
-        qDebug() << "Error: Only 24-bit BMP files are supported.";
+    // 在读取或映射像素之前校验头部大小与像素偏移
+    if (!validateBmpHeaders(fileHeader, infoHeader, file->size())) {
+        delete file;
         return false;
     }
 
+    // 获取图像宽度和高度
+    width = infoHeader.width;
+    height = infoHeader.height;
+
     // 计算每一行的字节数，BMP 行数据通常会对齐到4字节的倍数
-    rowSize = (width * 3 + 3) & ~3;
+    rowSize = bmpRowSize(width, bitsPerPixel);
+    format = bitsPerPixel == 8 ? PixelFormat::Gray8 : bitsPerPixel == 24 ? PixelFormat::Bgr24 : PixelFormat::Bgra32;
+
+    // 8 位图像：调色板是 0..255 的灰阶时按 Gray8 使用，否则按调色板展开为 Bgr24
+    if (bitsPerPixel == 8) {
+        const int colors = infoHeader.colors > 0 && infoHeader.colors < 256 ? int(infoHeader.colors) : 256;
+        unsigned char palette[256 * 4] = {};
+        file->seek(sizeof(fileHeader) + infoHeader.size);
+        file->read(reinterpret_cast<char*>(palette), colors * 4);
+        bool gray = true;
+        for (int i = 0; i < colors && gray; ++i) {
+            gray = palette[i * 4] == i && palette[i * 4 + 1] == i && palette[i * 4 + 2] == i;
+        }
+        if (!gray) {
+            std::vector<unsigned char> indices(static_cast<size_t>(qint64(rowSize) * height));
+            file->seek(fileHeader.offset);
+            file->read(reinterpret_cast<char*>(indices.data()), qint64(indices.size()));
+            file->close();
+            delete file;
+
+            format = PixelFormat::Bgr24;
+            const int indexRowSize = rowSize;
+            rowSize = bmpRowSize(width);
+            PixelBuffer* expanded = new PixelBuffer(qint64(rowSize) * height, true);
+            for (int y = 0; y < height; ++y) {
+                const unsigned char* src = indices.data() + qint64(y) * indexRowSize;
+                unsigned char* dst = expanded->data() + qint64(y) * rowSize;
+                for (int x = 0; x < width; ++x) {
+                    std::memcpy(dst + x * 3, palette + src[x] * 4, 3);
+                }
+            }
+            updateHeaders();
+            setBuffer(expanded);
+            MYQIMAGE_TRACE_COUNTER("bytes_read", fileHeader.offset + qint64(indices.size()));
+            qDebug() << "Image loaded successfully:" << filePath;
+            return true;
+        }
+    }
 
     // 读取像素数据
-    int dataSize = rowSize * height;
-    pixels = new unsigned char[dataSize];
-    file.seek(fileHeader.offset);
-    file.read(reinterpret_cast<char*>(pixels), dataSize);
+    qint64 dataSize = qint64(rowSize) * height;
+    if (mode == LoadMapped) {
+        // 映射整个文件，像素阵列原地作为存储；文件关闭后映射仍然有效
+        uchar* base = file->map(0, file->size());
+        if (base) {
+            file->close();
+            setBuffer(new PixelBuffer(file, base, fileHeader.offset, dataSize));
+            MYQIMAGE_TRACE_COUNTER("bytes_mapped", dataSize);
+            qDebug() << "Image mapped successfully:" << filePath;
+            return true;
+        }
+        qDebug() << "Warning: Cannot map file, falling back to copy:" << filePath;
+    }
+
+    setBuffer(new PixelBuffer(dataSize));
+    file->seek(fileHeader.offset);
+    file->read(reinterpret_cast<char*>(pixels), dataSize);
+    MYQIMAGE_TRACE_COUNTER("bytes_read", sizeof(fileHeader) + sizeof(infoHeader) + dataSize);
 
-    file.close();
+    file->close();
+    delete file;
     qDebug() << "Image loaded successfully:" << filePath;
     return true;
 }
 
+bool MyQImage::loadRegion(const QString& filePath, const QRect& region) {
+    TiledImageFile tiled;
+    if (!tiled.open(filePath)) {
+        return false;
+    }
+    QRect clipped = region.intersected(tiled.bounds());
+    if (clipped.isEmpty()) {
+        qDebug() << "Error: Region is outside the image:" << filePath;
+        return false;
+    }
+
+    int regionRowSize = bmpRowSize(clipped.width());
+    PixelBuffer* regionBuffer = new PixelBuffer(qint64(regionRowSize) * clipped.height(), true);
+    if (!tiled.readRegion(clipped, regionBuffer->data(), regionRowSize)) {
+        delete regionBuffer;
+        return false;
+    }
+
+    releasePixels();
+    width = clipped.width();
+    height = clipped.height();
+    rowSize = regionRowSize;
+    format = PixelFormat::Bgr24;
+    updateHeaders();
+    setBuffer(regionBuffer);
+    qDebug() << "Image loaded successfully:" << filePath;
+    return true;
+}
+
+MyQImage MyQImage::fromPixels(PixelFormat format, int width, int height, const unsigned char* data, qint64 stride) {
+    MyQImage image;
+    if (!data || width <= 0 || height <= 0) {
+        return image;
+    }
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.rowSize = int(pixelRowSize(format, width));
+    PixelBuffer* copied = new PixelBuffer(qint64(image.rowSize) * height, true);
+    const size_t rowBytes = size_t(width) * bytesPerPixel(format);
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(copied->data() + qint64(y) * image.rowSize, data + y * stride, rowBytes);
+    }
+    image.updateHeaders();
+    image.setBuffer(copied);
+    return image;
+}
+
+MyQImage MyQImage::scaledToFit(const QSize& size) const {
+    if (!pixels || size.width() <= 0 || size.height() <= 0) {
+        return MyQImage();
+    }
+    // 与 drawToLabel 相同的等比例缩放；已经放得下时直接共享像素
+    const double scale = std::min(1.0, std::min(double(size.width()) / width, double(size.height()) / height));
+    const int targetWidth = std::max(1, int(width * scale));
+    const int targetHeight = std::max(1, int(height * scale));
+    if (targetWidth == width && targetHeight == height) {
+        return *this;
+    }
+    syncInterleaved();
+    MyQImage scaled(*this);
+    scaled.width = targetWidth;
+    scaled.height = targetHeight;
+    scaled.rowSize = int(pixelRowSize(format, targetWidth));
+    PixelBuffer* downscaled = new PixelBuffer(qint64(scaled.rowSize) * targetHeight, true);
+    FormatKernels::downscale(format, pixels, rowSize, width, height, downscaled->data(), scaled.rowSize,
+                             targetWidth, targetHeight);
+    scaled.updateHeaders();
+    scaled.setBuffer(downscaled);
+    return scaled;
+}
+
+bool MyQImage::convertToFormat(PixelFormat target) {
+    if (!pixels) {
+        return false;
+    }
+    if (target == format) {
+        return true;
+    }
+    syncInterleaved();
+    const qint64 targetRowSize = pixelRowSize(target, width);
+    PixelBuffer* converted = new PixelBuffer(targetRowSize * height, true);
+    FormatKernels::convert(format, pixels, rowSize, target, converted->data(), targetRowSize, width, height);
+    format = target;
+    rowSize = int(targetRowSize);
+    updateHeaders();
+    setBuffer(converted);
+    return true;
+}
+
+bool MyQImage::toColorPlanes(ColorSpace space, unsigned char* c0, unsigned char* c1, unsigned char* c2,
+                             qint64 planeStride, int threads) const {
+    if (!pixels) {
+        return false;
+    }
+    if (format != PixelFormat::Bgr24) {
+        MyQImage converted(*this);
+        return converted.convertToFormat(PixelFormat::Bgr24)
+               && converted.toColorPlanes(space, c0, c1, c2, planeStride, threads);
+    }
+    syncInterleaved();
+    ColorConvert::bgrToPlanes(space, pixels, rowSize, width, height, c0, c1, c2, planeStride, threads);
+    return true;
+}
+
+void MyQImage::updateHeaders() {
+    makeBmpHeaders(width, height, fileHeader, infoHeader, bytesPerPixel(bmpFormat(format)) * 8);
+}
+
+// 释放对像素存储的引用；最后一个引用释放时，映射的像素解除映射，堆上的像素直接释放
+void MyQImage::releasePixels() {
+    displayPyramid.clear();
+    segmentLabels.reset();
+    buffer.reset();
+    planar.reset();
+    interleavedStale = false;
+    pixels = nullptr;
+}
+
+// 写时复制：写入共享或映射的像素之前，复制出独占的堆内存；像素即将改变，显示缓存与保留的簇号随之失效
+void MyQImage::detach() {
+    displayPyramid.clear();
+    segmentLabels.reset();
+    if (!buffer) {
+        return;
+    }
+    // 交错像素即将被改写，平面副本随之失效
+    syncInterleaved();
+    planar.reset();
+    if (buffer->isMapped()) {
+        setBuffer(new PixelBuffer(*buffer));
+    } else {
+        buffer.detach();
+        pixels = buffer->data();
+    }
+}
+
+void MyQImage::setBuffer(PixelBuffer* newBuffer) {
+    displayPyramid.clear();
+    segmentLabels.reset();
+    buffer = QExplicitlySharedDataPointer<PixelBuffer>(newBuffer);
+    pixels = buffer->data();
+    planar.reset();
+    interleavedStale = false;
+}
+
+// 过期的交错存储若与其他图像共享或映射自文件，换成新的堆内存再写回，不影响其他持有者
+void MyQImage::syncInterleaved() const {
+    if (!interleavedStale) {
+        return;
+    }
+    if (buffer->isMapped() || buffer->ref.loadRelaxed() > 1) {
+        buffer = QExplicitlySharedDataPointer<PixelBuffer>(new PixelBuffer(qint64(rowSize) * height, true));
+        pixels = buffer->data();
+    }
+    planar->toInterleaved(pixels, rowSize);
+    interleavedStale = false;
+}
+
+// 没有平面副本时由交错像素拆分出来；已有的平面与其他图像共享时先复制
+void MyQImage::preparePlanar() {
+    displayPyramid.clear();
+    segmentLabels.reset();
+    if (!planar) {
+        planar = QExplicitlySharedDataPointer<PlanarBuffer>(new PlanarBuffer(width, height));
+        planar->fromInterleaved(pixels, rowSize);
+    } else {
+        planar.detach();
+    }
+    interleavedStale = true;
+}
+
+PixelLayout MyQImage::chooseLayout(bool supportsPlanar) {
+    if (supportsPlanar && storageLayout == PixelLayout::Planar && format == PixelFormat::Bgr24) {
+        preparePlanar();
+        return PixelLayout::Planar;
+    }
+    return PixelLayout::Interleaved;
+}
+
 // 显示图像的 RGB 数据（以调试为主）
 void MyQImage::show() const {
     if (!pixels) {
         qDebug() << "Error: No image to display!";
         return;
     }
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            unsigned char* pixel = &pixels[(y * rowSize) + (x * 3)];
-            qDebug() << "(" << (int)pixel[2] << ", " << (int)pixel[1] << ", " << (int)pixel[0] << ")";
+    syncInterleaved();
+
+    // 按 R、G、B（、A）的顺序输出各通道，灰度图只输出一个值
+    dispatchPixelFormat(format, [this](auto traits) {
+        using F = decltype(traits);
+        using Channel = typename F::Channel;
+        for (int y = 0; y < height; ++y) {
+            const Channel* row = reinterpret_cast<const Channel*>(pixels + qint64(y) * rowSize);
+            for (int x = 0; x < width; ++x) {
+                const Channel* pixel = row + x * F::channels;
+                if constexpr (F::isGray) {
+                    qDebug() << "(" << (int)pixel[0] << ")";
+                } else if constexpr (F::hasAlpha) {
+                    qDebug() << "(" << (int)pixel[2] << ", " << (int)pixel[1] << ", " << (int)pixel[0]
+                             << ", " << (int)pixel[3] << ")";
+                } else {
+                    qDebug() << "(" << (int)pixel[2] << ", " << (int)pixel[1] << ", " << (int)pixel[0] << ")";
+                }
+            }
+            qDebug() << "";
         }
-        qDebug() << "";
-    }
+    });
 }
 
 // 将图像绘制到指定的 QLabel 上，保持等比例缩放
@@ -131,6 +461,7 @@ void MyQImage::drawToLabel(QLabel* label) {
         qDebug() << "Error: Invalid input, pixels or label is null!";
         return;
     }
+    syncInterleaved();
 
     // 获取 QLabel 的大小
     int maxWidth = label->width();
@@ -157,143 +488,239 @@ void MyQImage::drawToLabel(QLabel* label) {
         return;
     }
 
-    // 创建 QPixmap 对象用于绘制
-    QPixmap pixmap(newWidth, newHeight);
-    pixmap.fill(Qt::white);  // 填充背景色，避免透明背景问题
-
-    // 使用 QPainter 在 QPixmap 上绘制图像
-    QPainter painter(&pixmap);
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    // 第 0 层直接包装像素缓冲区（不复制，行序自下而上）；其他格式先转换为 BGR 再显示
+    if (displayPyramid.isEmpty()) {
+        if (format == PixelFormat::Bgr24) {
+            displayPyramid.append(QImage(static_cast<const uchar*>(pixels), width, height, rowSize,
+                                         QImage::Format_BGR888));
+        } else {
+            QImage converted(width, height, QImage::Format_BGR888);
+            FormatKernels::convert(format, pixels, rowSize, PixelFormat::Bgr24, converted.bits(),
+                                   converted.bytesPerLine(), width, height);
+            displayPyramid.append(converted);
+        }
+    }
+    // 选取仍不小于目标尺寸的最小一层，剩余不足一半的缩放交给一次平滑缩放完成
+    int level = 0;
+    while (displayPyramid[level].width() / 2 >= newWidth && displayPyramid[level].height() / 2 >= newHeight) {
+        if (level + 1 == displayPyramid.size()) {
+            displayPyramid.append(halveImage(displayPyramid[level], level == 0));
+        }
+        ++level;
+    }
 
-    // 计算图像缩放后每个像素的 RGB 值并绘制
-    for (int y = 0; y < newHeight; ++y) {
-        // 计算源图像的 Y 坐标，反转 Y 坐标，使图像正确显示
-        int srcY = (newHeight - 1 - y) * height / newHeight; // 反转 Y 坐标
-        for (int x = 0; x < newWidth; ++x) {
-            // 计算源图像的 X 坐标，跳过必要的像素列
-            int srcX = x * width / newWidth;
+    QImage scaled = displayPyramid[level].scaled(newWidth, newHeight, Qt::IgnoreAspectRatio,
+                                                 Qt::SmoothTransformation);
+    if (level == 0) {
+        scaled = scaled.mirrored(false, true);  // 第 0 层自下而上，翻转为正常行序
+    }
+    label->setPixmap(QPixmap::fromImage(scaled));
+}
 
-            // 确保 srcX 和 srcY 在有效范围内 [0, width-1] 和 [0, height-1]
-            if (srcX < 0 || srcX >= width || srcY < 0 || srcY >= height) {
-                qDebug() << "Error: srcX or srcY out of bounds, srcX:" << srcX << "srcY:" << srcY;
-                continue;
+// 2x2 均值缩小一半，得到自上而下的 BGR 图像；flip 表示 src 的行序自下而上
+QImage MyQImage::halveImage(const QImage& src, bool flip) {
+    const int w = src.width() / 2;
+    const int h = src.height() / 2;
+    QImage dst(w, h, QImage::Format_BGR888);
+    ScratchArena::Scope scope;
+    quint16* sum = ScratchArena::local().allocate<quint16>(qint64(w) * 6);
+    for (int y = 0; y < h; ++y) {
+        int y0 = flip ? src.height() - 1 - 2 * y : 2 * y;
+        int y1 = flip ? y0 - 1 : y0 + 1;
+        const uchar* a = src.constScanLine(y0);
+        const uchar* b = src.constScanLine(y1);
+        // 先纵向相加整行（便于向量化），再横向合并相邻像素
+        for (int i = 0; i < w * 6; ++i) {
+            sum[i] = quint16(a[i] + b[i]);
+        }
+        uchar* d = dst.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                d[x * 3 + c] = uchar((sum[x * 6 + c] + sum[x * 6 + 3 + c] + 2) >> 2);
             }
-
-            // 获取原始图像的 RGB 值
-            unsigned char* pixel = &pixels[(srcY * rowSize) + (srcX * 3)];
-            QColor color(pixel[2], pixel[1], pixel[0]);
-
-            // 在 QPixmap 上绘制每个像素点
-            painter.setPen(color);
-            painter.drawPoint(x, y);
         }
     }
-
-    // 使用 QPainter 在 QLabel 上绘制 QPixmap
-    label->setPixmap(pixmap);
+    return dst;
 }
 
-void MyQImage::HistogramEqualization(){
+bool MyQImage::HistogramEqualization(JobControl* control){
+    MYQIMAGE_TRACE_SCOPE("MyQImage::HistogramEqualization");
     if (!pixels) {
         qDebug() << "Error: No image to process!";
-        return;
+        return false;
     }
 
-    //定义三个颜色通道的直方图
-    QVector<int> histR(256, 0);
-    QVector<int> histG(256, 0);
-    QVector<int> histB(256, 0);
-
-    //计算每个颜色通道的直方图
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            unsigned char* pixel = &pixels[(y * rowSize) + (x * 3)];
-            histB[pixel[0]]++;
-            histG[pixel[1]]++;
-            histR[pixel[2]]++;
-        }
+    // 其他格式使用按格式实例化的通用实现
+    if (format != PixelFormat::Bgr24) {
+        detach();
+        return FormatKernels::equalize(format, pixels, width, height, rowSize, control);
     }
 
-    //计算累积分布函数（CDF）
-    QVector<float> cdfR(256, 0), cdfG(256, 0), cdfB(256, 0);
-    cdfR[0] = histR[0];
-    cdfG[0] = histG[0];
-    cdfB[0] = histB[0];
+    // 按条带处理，每个条带之后报告进度并检查取消
+    const int stripRows = 256;
+
+    // 平面布局：三个通道各自连续，直方图与查表都是逐字节的简单循环
+    if (chooseLayout(true) == PixelLayout::Planar) {
+        const qint64 stride = planar->getStride();
+        BgrHistogram hist;
+        qint64* counts[3] = {hist.b, hist.g, hist.r};
+        if (control) {
+            control->beginStage(0, 50, height);
+        }
+        for (int y0 = 0; y0 < height; y0 += stripRows) {
+            int rows = std::min(stripRows, height - y0);
+            for (int c = 0; c < 3; ++c) {
+                accumulatePlaneHistogram(planar->plane(c) + y0 * stride, width, rows, stride, counts[c]);
+            }
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+        hist.pixelCount = qint64(width) * height;
 
-    for (int i = 1; i < 256; ++i) {
-        cdfR[i] = cdfR[i - 1] + histR[i];
-        cdfG[i] = cdfG[i - 1] + histG[i];
-        cdfB[i] = cdfB[i - 1] + histB[i];
+        BgrLut lut;
+        buildEqualizationLut(hist, lut);
+        const unsigned char* tables[3] = {lut.b, lut.g, lut.r};
+        if (control) {
+            control->beginStage(50, 100, height);
+        }
+        for (int y0 = 0; y0 < height; y0 += stripRows) {
+            int rows = std::min(stripRows, height - y0);
+            for (int c = 0; c < 3; ++c) {
+                applyPlaneLut(planar->plane(c) + y0 * stride, width, rows, stride, tables[c]);
+            }
+            if (control && !control->advance(rows)) {
+                return false;
+            }
+        }
+        return true;
     }
+    detach();
 
-    //归一化累计直方图
-    int pixel_num=height*width;
-    for(int i=0;i<256;++i){
-        cdfR[i]/=pixel_num;
-        cdfG[i]/=pixel_num;
-        cdfB[i]/=pixel_num;
+    //计算每个颜色通道的直方图（多组直方图交替计数）
+    BgrHistogram hist;
+    if (control) {
+        control->beginStage(0, 50, height);
+    }
+    for (int y0 = 0; y0 < height; y0 += stripRows) {
+        int rows = std::min(stripRows, height - y0);
+        accumulateBgrHistogram(pixels + qint64(y0) * rowSize, width, rows, rowSize, hist);
+        if (control && !control->advance(rows)) {
+            return false;
+        }
     }
 
-    //映射到新像素值
-    for(int y=0;y<height;y++){
-        for(int x=0;x<width;x++){
-            unsigned char* pixel=&pixels[(y*rowSize)+(x*3)];
-            pixel[0]=cdfB[pixel[0]]*255;
-            pixel[1]=cdfG[pixel[1]]*255;
-            pixel[2]=cdfR[pixel[2]]*255;
+    //由累积分布函数（CDF）生成归一化后的 8 位查找表
+    BgrLut lut;
+    buildEqualizationLut(hist, lut);
+
+    //映射到新像素值（支持 AVX2 时整行向量化查表）
+    if (control) {
+        control->beginStage(50, 100, height);
+    }
+    for (int y0 = 0; y0 < height; y0 += stripRows) {
+        int rows = std::min(stripRows, height - y0);
+        applyBgrLut(pixels + qint64(y0) * rowSize, width, rows, rowSize, lut);
+        if (control && !control->advance(rows)) {
+            return false;
         }
     }
+    return true;
 }
 
-bool MyQImage::save(const QString &filePath){
-    //打开文件进行写入
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qDebug() << "Failed to open file for writing";
+bool MyQImage::clahe(int tileSize, double clipLimit, JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::clahe");
+    if (!pixels) {
+        qDebug() << "Error: No image to process!";
         return false;
     }
+    if (format != PixelFormat::Gray8 && format != PixelFormat::Bgr24 && format != PixelFormat::Bgra32) {
+        qDebug() << "Error: CLAHE only supports 8-bit images.";
+        return false;
+    }
+    detach();
+    ClaheOptions options;
+    options.tileSize = tileSize;
+    options.clipLimit = clipLimit;
+    options.control = control;
+    const int channels = bytesPerPixel(format);
+    return Clahe::apply(pixels, width, height, rowSize, channels, std::min(channels, 3), options);
+}
 
-    //计算每行的填充字节数，BMP 格式要求每行字节数是 4 的倍数
-    int padding = (4 - (width * 3) % 4) % 4; // 每行的填充字节数
-    int rowSize = width * 3 + padding;  // 每行的总字节数
-
-    //计算图像的总数据大小
-    int imageSize = rowSize * height;
-
-    //写入文件头
-    BMPFileHeader fileHeader;
-    fileHeader.size = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + imageSize;
-    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
-
-    //写入信息头
-    BMPInfoHeader infoHeader;
-    infoHeader.width = width;
-    infoHeader.height = height;
-    infoHeader.imageSize = imageSize;
-    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
-
-    //写入像素数据
-    for (int y = 0; y <height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            // 获取当前像素的 RGB 值
-            unsigned char* pixel = &pixels[(y * rowSize) + (x * 3)];
-            // 写入 RGB 值
-            file.write(reinterpret_cast<const char*>(&pixel[0]), 1);  //Blue
-            file.write(reinterpret_cast<const char*>(&pixel[1]), 1);  //Green
-            file.write(reinterpret_cast<const char*>(&pixel[2]), 1);  //Red
-
-        }
-        //填充字节（每行必须是 4 的倍数）
-        for (int i = 0; i < padding; ++i) {
-            file.write("\0", 1); // 使用 write 写入填充字节
-        }
+bool MyQImage::medianFilter(int radius, JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::medianFilter");
+    if (!pixels) {
+        qDebug() << "Error: No image to process!";
+        return false;
+    }
+    if (format != PixelFormat::Gray8 && format != PixelFormat::Bgr24 && format != PixelFormat::Bgra32) {
+        qDebug() << "Error: Median filter only supports 8-bit images.";
+        return false;
     }
+    MedianOptions options;
+    options.radius = radius;
+    options.control = control;
+    return applyChannelFilter([this, &options](const unsigned char* src, unsigned char* dst, qint64 stride, int channels) {
+        Denoise::median(src, dst, width, height, stride, channels, options);
+    }, control);
+}
 
-    file.close();
+bool MyQImage::bilateralFilter(int radius, double rangeSigma, JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::bilateralFilter");
+    if (!pixels) {
+        qDebug() << "Error: No image to process!";
+        return false;
+    }
+    if (format != PixelFormat::Gray8 && format != PixelFormat::Bgr24 && format != PixelFormat::Bgra32) {
+        qDebug() << "Error: Bilateral filter only supports 8-bit images.";
+        return false;
+    }
+    BilateralOptions options;
+    options.radius = radius;
+    options.rangeSigma = rangeSigma;
+    options.control = control;
+    if (control) {
+        control->beginStage(0, 100, height);
+    }
+    // 各通道共用亮度引导的权重，需要交错像素
+    const int channels = bytesPerPixel(format);
+    return applyFilter([this, &options, channels](const unsigned char* src, unsigned char* dst) {
+        Denoise::bilateral(src, dst, width, height, rowSize, channels, std::min(channels, 3), options);
+    }, control);
+}
 
+bool MyQImage::save(const QString &filePath, BmpWriter::Mode mode){
+    MYQIMAGE_TRACE_SCOPE("MyQImage::save");
+    if (!pixels) {
+        qDebug() << "Error: No image to save!";
+        return false;
+    }
+    syncInterleaved();
+    const bool tiled = filePath.endsWith(".mqt", Qt::CaseInsensitive);
+    // .mqt 只存 BGR；BMP 没有 16 位通道，16 位格式降为同通道数的 8 位格式写出
+    const PixelFormat target = tiled ? PixelFormat::Bgr24 : bmpFormat(format);
+    if (target != format) {
+        MyQImage converted(*this);
+        return converted.convertToFormat(target) && converted.save(filePath, mode);
+    }
+    if (tiled) {
+        return TiledImageFile::write(filePath, pixels, width, height, rowSize);
+    }
+    //整行（或整块）写出到临时文件，完成后原子地替换目标文件
+    if (!BmpWriter::write(filePath, pixels, width, height, rowSize, mode, bytesPerPixel(format) * 8)) {
+        return false;
+    }
+    MYQIMAGE_TRACE_COUNTER("bytes_written", fileHeader.size);
     return true;
 }
+
+std::future<bool> MyQImage::saveAsync(const QString& filePath, BmpWriter::Mode mode) const {
+    // 副本与本图像共享像素；之后本图像被修改时会先复制出自己的像素，写出的内容不受影响
+    MyQImage snapshot(*this);
+    return std::async(std::launch::async, [snapshot, filePath, mode]() mutable {
+        return snapshot.save(filePath, mode);
+    });
+}
 /*
 void MyQImage::segmentImage() {
     if (!pixels) {
@@ -341,134 +768,81 @@ void MyQImage::segmentImage() {
 }*/
 
 
-void MyQImage::segmentImage() {
+KMeansOptions MyQImage::getSegmentationOptions() const {
+    KMeansOptions options;
+    options.K = K;
+    options.seed = seed;
+    options.engine = engine;
+    options.colorBits = colorBits;
+    options.initialCenters = initialCenters;
+    return options;
+}
+
+bool MyQImage::segmentImage(JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::segmentImage");
     if (!pixels) {
         qDebug() << "No pixel data available for segmentation.";
-        return;
+        return false;
     }
+    if (!KMeans::isValidK(K)) {
+        qDebug() << "Segmentation K out of range [1," << KMeans::kMaxClusters << "]:" << K;
+        return false;
+    }
+    detach();
 
-    int numPixels = width * height;
-
-    const int maxIterations = 100;  // 最大迭代次数
-    float convergenceThreshold = 1.0f;  // 收敛阈值
-
-    //存储K个聚类中心的RGB值
-    QVector<std::tuple<int, int, int>> centers(K);
-
-    //存储每个像素的簇标签
-    QVector<int> labels(numPixels);
-
-    //初始化K个聚类中心，随机选择像素的RGB值作为初始中心
-    for (int i = 0; i < K; ++i) {
-        int randomIndex = rand() % (width * height);  // 随机选择一个像素
-        int row = randomIndex / width;
-        int col = randomIndex % width;
-        int index = (row * rowSize + col * 3);
-        unsigned char b = pixels[index];
-        unsigned char g = pixels[index + 1];
-        unsigned char r = pixels[index + 2];
-
-        centers[i] = std::make_tuple(r, g, b);  // 初始化中心 (RGB)
-    }
-
-    //K-means算法迭代过程
-    bool converged = false;
-    int iteration = 0;
-    while (!converged && iteration < maxIterations) {
-        converged = true;
-
-        //每个像素点分配到最近的中心点
-        for (int i = 0; i < numPixels; ++i) {
-            int row = i / width;
-            int col = i % width;
-            int index = (row * rowSize + col * 3);
-            unsigned char b = pixels[index];
-            unsigned char g = pixels[index + 1];
-            unsigned char r = pixels[index + 2];
-
-            //计算该像素点到每个中心点的距离
-            int closestCluster = -1;
-            float minDistance = std::numeric_limits<float>::max();
-            for (int j = 0; j < K; ++j) {
-                int centerR, centerG, centerB;
-                std::tie(centerR, centerG, centerB) = centers[j];
-
-                //计算当前像素与聚类中心的距离
-                float distance = std::sqrt(std::pow(r - centerR, 2) + std::pow(g - centerG, 2) + std::pow(b - centerB, 2));
-                if (distance < minDistance) {
-                    minDistance = distance;
-                    closestCluster = j;
-                }
-            }
-
-            //如果像素的簇标签发生变化，则继续迭代
-            if (labels[i] != closestCluster) {
-                labels[i] = closestCluster;
-                converged = false;  // 如果有像素的标签发生改变，说明还没有收敛
-            }
-        }
-
-        //更新每个簇的中心点（计算每个簇内的像素的平均值）
-        QVector<int> count(K, 0);
-        QVector<long long> sumR(K, 0);
-        QVector<long long> sumG(K, 0);
-        QVector<long long> sumB(K, 0);
-
-        //计算每个簇的像素总和，并计算每个簇内的像素数量
-        for (int i = 0; i < numPixels; ++i) {
-            int label = labels[i];
-            int row = i / width;
-            int col = i % width;
-            int index = (row * rowSize + col * 3);
-            unsigned char b = pixels[index];
-            unsigned char g = pixels[index + 1];
-            unsigned char r = pixels[index + 2];
-
-            sumR[label] += r;
-            sumG[label] += g;
-            sumB[label] += b;
-            count[label] += 1;
-        }
-
-        //更新聚类中心
-        converged = true;
-        for (int i = 0; i < K; ++i) {
-            if (count[i] > 0) {
-                int newR = static_cast<int>(sumR[i] / count[i]);
-                int newG = static_cast<int>(sumG[i] / count[i]);
-                int newB = static_cast<int>(sumB[i] / count[i]);
-
-                int oldR, oldG, oldB;
-                std::tie(oldR, oldG, oldB) = centers[i];
-
-                // 如果中心点发生变化，说明算法没有收敛
-                if (std::abs(newR - oldR) > 1 || std::abs(newG - oldG) > 1 || std::abs(newB - oldB) > 1) {
-                    converged = false;
-                }
+    KMeansOptions options = getSegmentationOptions();
+    options.control = control;
+    if (control) {
+        // 迭代次数事先未知，按最大迭代次数推进，收敛后直接完成
+        control->beginStage(0, 100, options.maxIterations);
+    }
+    if (format != PixelFormat::Bgr24) {
+        KMeansResult result = FormatKernels::segment(format, pixels, width, height, rowSize, options);
+        segmentCenters = result.centers;
+        segmentLabels.reset();
+        return !result.cancelled && !result.invalid;
+    }
 
-                centers[i] = std::make_tuple(newR, newG, newB);  // 更新中心
-            }
-        }
+    //存储每个像素的簇标签：需要保留时放进独立的缓冲区，否则用线程局部的临时内存
+    ScratchArena::Scope scope;
+    std::shared_ptr<PooledBuffer> kept;
+    unsigned char* labels;
+    if (keepSegmentLabels) {
+        kept = std::make_shared<PooledBuffer>(qint64(width) * height);
+        labels = kept->data();
+    } else {
+        labels = ScratchArena::local().allocate<unsigned char>(qint64(width) * height);
+    }
 
-        ++iteration;
+    //K-means：逐像素引擎分配与累加合并为一遍多线程扫描；颜色直方图引擎在不同颜色集合上迭代
+    KMeansResult result = KMeans::segment(pixels, width, height, rowSize, options, labels);
+    if (result.cancelled) {
+        return false;
     }
+    segmentCenters = result.centers;
+    segmentLabels = kept;
 
     //根据每个像素的簇标签，更新像素值为其对应的聚类中心颜色
-    for (int i = 0; i < numPixels; ++i) {
-        int row = i / width;
-        int col = i % width;
-        int index = (row * rowSize + col * 3);
-        int label = labels[i];
+    KMeans::recolor(pixels, width, height, rowSize, labels, result.centers);
+    return true;
+}
 
-        // 将像素值替换为其对应的聚类中心的颜色
-        unsigned char r, g, b;
-        std::tie(r, g, b) = centers[label];
+void MyQImage::setSegmentResult(const QVector<KMeansCenter>& centers, std::shared_ptr<const PooledBuffer> labels) {
+    segmentCenters = centers;
+    segmentLabels = keepSegmentLabels ? std::move(labels) : nullptr;
+}
 
-        // 注意：存储时仍然是BGR顺序
-        pixels[index] = b;
-        pixels[index + 1] = g;
-        pixels[index + 2] = r;
+ComponentResult MyQImage::findRegions(const ComponentOptions& options, const MyQImage* colorSource) const {
+    if (!segmentLabels || segmentLabels->size() != qint64(width) * height) {
+        return ComponentResult();
     }
+    const MyQImage& colors = colorSource ? *colorSource : *this;
+    const bool hasColors = colors.getPixels() && colors.format == PixelFormat::Bgr24
+                           && colors.width == width && colors.height == height;
+    ComponentOptions regionOptions = options;
+    regionOptions.bottomUp = true;
+    return ConnectedComponents::label(segmentLabels->data(), width, height, width,
+                                      hasColors ? colors.getPixels() : nullptr, colors.rowSize, regionOptions);
 }
 
 
@@ -591,71 +965,133 @@ void MyQImage::sharpen() {
     pixels = newPixels;
 }*/
 
-void MyQImage::sharpen() {
+bool MyQImage::sharpen(JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("MyQImage::sharpen");
     if (!pixels || width <= 0 || height <= 0) {
-        return; // 如果像素数据为空或图像无效，直接返回
+        return false; // 如果像素数据为空或图像无效，直接返回
     }
+    // 拉普拉斯锐化核 {0,-1,0; -1,5,-1; 0,-1,0}，边缘像素按重复边界处理
+    return applyKernel(ConvolutionKernel::sharpen(), ConvolutionOptions(), control);
+}
 
-    // 创建一个临时数组，用于存储锐化后的像素数据
-    unsigned char* sharpenedPixels = new unsigned char[width * height * 3];
-
-    // 定义拉普拉斯算子的卷积核（用于增强边缘）
-    int kernel[3][3] = {
-        { 0, -1,  0 },
-        { -1,  5, -1 },
-        { 0, -1,  0 }
-    };
+void MyQImage::boxBlur(int radius) {
+    if (!pixels || width <= 0 || height <= 0) {
+        return;
+    }
+    applyKernel(ConvolutionKernel::box(radius), ConvolutionOptions());
+}
 
-    // 遍历每个像素
-    for (int y = 1; y < height - 1; y++) {
-        for (int x = 1; x < width - 1; x++) {
-            int r = 0, g = 0, b = 0;
+void MyQImage::gaussianBlur(int radius, double sigma) {
+    if (!pixels || width <= 0 || height <= 0) {
+        return;
+    }
+    applyKernel(ConvolutionKernel::gaussian(radius, sigma), ConvolutionOptions());
+}
 
-            // 应用拉普拉斯算子
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int px = (x + kx);
-                    int py = (y + ky);
-
-                    // 获取当前像素的 RGB 值
-                    unsigned char* currentPixel = pixels + (py * rowSize + px * 3);
-                    unsigned char currentR = currentPixel[2];
-                    unsigned char currentG = currentPixel[1];
-                    unsigned char currentB = currentPixel[0];
-
-                    // 卷积操作
-                    r += currentR * kernel[ky + 1][kx + 1];
-                    g += currentG * kernel[ky + 1][kx + 1];
-                    b += currentB * kernel[ky + 1][kx + 1];
-                }
-            }
+void MyQImage::sobel() {
+    if (!pixels || width <= 0 || height <= 0) {
+        return;
+    }
+    if (format != PixelFormat::Gray8 && format != PixelFormat::Bgr24) {
+        qDebug() << "Error: Sobel only supports Gray8 and Bgr24 images.";
+        return;
+    }
+    applyChannelFilter([this](const unsigned char* src, unsigned char* dst, qint64 stride, int channels) {
+        Convolution::sobel(src, dst, width, height, stride, channels);
+    });
+}
 
-            // 将拉普拉斯结果叠加到原图上（锐化公式）
-            int newR = r;
-            int newG = g;
-            int newB = b;
+void MyQImage::unsharpMask(int radius, double sigma, double amount) {
+    if (!pixels || width <= 0 || height <= 0) {
+        return;
+    }
+    if (format != PixelFormat::Gray8 && format != PixelFormat::Bgr24) {
+        qDebug() << "Error: Unsharp mask only supports Gray8 and Bgr24 images.";
+        return;
+    }
+    applyChannelFilter([this, radius, sigma, amount](const unsigned char* src, unsigned char* dst, qint64 stride, int channels) {
+        Convolution::unsharpMask(src, dst, width, height, stride, channels, radius, sigma, amount);
+    });
+}
 
+bool MyQImage::applyPipeline(const ImagePipeline& pipeline, JobControl* control) {
+    if (!pixels || width <= 0 || height <= 0) {
+        return false;
+    }
+    if (pipeline.isEmpty()) {
+        return true;
+    }
+    if (format != PixelFormat::Bgr24) {
+        qDebug() << "Error: Pipelines only support Bgr24 images.";
+        return false;
+    }
+    if (!pipeline.hasStencil()) {
+        detach();
+        return pipeline.run(pixels, pixels, width, height, rowSize, control);
+    }
+    return applyFilter([this, &pipeline, control](const unsigned char* src, unsigned char* dst) {
+        pipeline.run(src, dst, width, height, rowSize, control);
+    }, control);
+}
 
-            // 限制 RGB 值范围到 [0, 255]
-            newR = std::min(255, std::max(0, newR));
-            newG = std::min(255, std::max(0, newG));
-            newB = std::min(255, std::max(0, newB));
+// 卷积不能原地进行：结果写入新缓冲区（行尾填充字节置 0）后替换原像素；取消时保留原像素
+bool MyQImage::applyFilter(const std::function<void(const unsigned char*, unsigned char*)>& filter,
+                           JobControl* control) {
+    syncInterleaved();
+    PixelBuffer* filtered = new PixelBuffer(qint64(rowSize) * height, true);
+    filter(pixels, filtered->data());
+    if (control && control->isCancelled()) {
+        delete filtered;
+        return false;
+    }
+    setBuffer(filtered);
+    return true;
+}
 
-            // 保存锐化后的像素值
-            unsigned char* sharpenedPixel = sharpenedPixels + (y * rowSize + x * 3);
-            sharpenedPixel[2] = static_cast<unsigned char>(newR);
-            sharpenedPixel[1] = static_cast<unsigned char>(newG);
-            sharpenedPixel[0] = static_cast<unsigned char>(newB);
+// 平面布局下结果写入新的平面存储，交错存储保持过期；取消时保留原像素
+bool MyQImage::applyChannelFilter(const std::function<void(const unsigned char*, unsigned char*, qint64, int)>& filter,
+                                  JobControl* control) {
+    if (storageLayout != PixelLayout::Planar || format != PixelFormat::Bgr24) {
+        if (control) {
+            control->beginStage(0, 100, height);
         }
+        const int channels = bytesPerPixel(format);
+        return applyFilter([this, &filter, channels](const unsigned char* src, unsigned char* dst) {
+            filter(src, dst, rowSize, channels);
+        }, control);
     }
 
-    // 替换原有像素数据
-    delete[] pixels;
-    pixels = sharpenedPixels;
-
-
+    // 只读取现有的平面，不必复制出独占的平面存储
+    if (!planar) {
+        preparePlanar();
+    }
+    if (control) {
+        control->beginStage(0, 100, qint64(height) * 3);
+    }
+    QExplicitlySharedDataPointer<PlanarBuffer> filtered(new PlanarBuffer(width, height));
+    for (int c = 0; c < 3; ++c) {
+        filter(planar->plane(c), filtered->plane(c), planar->getStride(), 1);
+    }
+    if (control && control->isCancelled()) {
+        return false;
+    }
+    displayPyramid.clear();
+    planar = filtered;
+    interleavedStale = true;
+    return true;
 }
 
-
-
-
+bool MyQImage::applyKernel(const ConvolutionKernel& kernel, ConvolutionOptions options, JobControl* control) {
+    options.control = control;
+    if (format == PixelFormat::Bgr24) {
+        return applyChannelFilter([this, &kernel, &options](const unsigned char* src, unsigned char* dst, qint64 stride, int channels) {
+            Convolution::apply(src, dst, width, height, stride, channels, kernel, options);
+        }, control);
+    }
+    if (control) {
+        control->beginStage(0, 100, height);
+    }
+    return applyFilter([this, &kernel, &options](const unsigned char* src, unsigned char* dst) {
+        FormatKernels::convolve(format, src, dst, width, height, rowSize, kernel, options);
+    }, control);
+}
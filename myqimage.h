@@ -5,18 +5,65 @@
 #include <QSize>
 #include <QLabel>
 #include <QPainter>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <functional>
+#include <future>
+#include <memory>
+#include <QExplicitlySharedDataPointer>
+#include "bmpheader.h"
+#include "pixelbuffer.h"
+#include "bmpwriter.h"
+#include "planar.h"
+#include "pixelformat.h"
+#include "colorconvert.h"
+#include "connectedcomponents.h"
+#include "kmeans.h"
 
+class JobControl;
+class ImagePipeline;
+class ConvolutionKernel;
+class PooledBuffer;
+struct ConvolutionOptions;
 
 class MyQImage {
 public:
+    // 加载方式：LoadCopy 将像素读入堆内存；LoadMapped 直接映射文件，
+    // 以文件中的像素阵列作为存储，首次写入时才复制（写时复制）
+    enum LoadMode {
+        LoadCopy,
+        LoadMapped
+    };
+
     MyQImage();
+    // 拷贝只增加像素存储的引用计数，写入时才复制
     MyQImage(const MyQImage& other);
+    MyQImage(MyQImage&& other) noexcept;
     ~MyQImage();
     //重载=
     MyQImage& operator=(const MyQImage& other);
+    MyQImage& operator=(MyQImage&& other) noexcept;
+
+    // 加载 BMP 文件：8 位灰阶调色板为 Gray8，其他 8 位调色板展开为 Bgr24，24 位为 Bgr24，32 位为 Bgra32；
+    // 文件是 .mqt 分块容器时解压整幅图像（此时忽略 mode）
+    bool load(const QString& filePath, LoadMode mode = LoadCopy);
+
+    // 由外部像素构造图像（例如 16 位的相机数据），data 为自下而上的行，每行 stride 字节
+    static MyQImage fromPixels(PixelFormat format, int width, int height, const unsigned char* data, qint64 stride);
+
+    // 按比例缩小到能放进 size 的最大尺寸（按面积平均，不放大），得到独立的新图像；用作交互预览的代理
+    MyQImage scaledToFit(const QSize& size) const;
+
+    // 从 .mqt 分块容器中只加载一个区域（自上而下的图像坐标，超出图像的部分被裁掉），只解压覆盖该区域的分块
+    bool loadRegion(const QString& filePath, const QRect& region);
 
-    // 加载 BMP 文件
-    bool load(const QString& filePath);
+    // 像素数据是否仍直接映射自文件（尚未发生写入）
+    bool isMapped() const { return buffer && buffer->isMapped(); }
+
+    // 像素存储是否与其他 MyQImage 共享
+    bool isShared() const { return buffer && buffer->ref.loadRelaxed() > 1; }
 
     // 获取图像宽度
     int getWidth() const { return width; }
@@ -27,8 +74,34 @@ public:
     // 获取图像的尺寸
     QSize getSize() const { return QSize(width, height); }
 
-    // 获取像素数据
-    const unsigned char* getPixels() const { return pixels; }
+    // 像素格式，决定 getPixels 中每像素的字节数与通道
+    PixelFormat getFormat() const { return format; }
+
+    // 转换为另一种像素格式（灰度化、增减 alpha、8/16 位互转）
+    bool convertToFormat(PixelFormat target);
+
+    // 转换为同位深的灰度格式
+    bool toGrayscale() { return convertToFormat(grayFormat(format)); }
+
+    // 转换到颜色空间 space，写入调用方提供的三个平面（每个 width x height，行序与 getPixels 相同）；
+    // 不是 Bgr24 的图像先转换为 Bgr24
+    bool toColorPlanes(ColorSpace space, unsigned char* c0, unsigned char* c1, unsigned char* c2,
+                       qint64 planeStride, int threads = 0) const;
+
+    // 获取像素数据（按 getFormat() 交错存放）；平面布局下的结果此时才写回交错存储
+    const unsigned char* getPixels() const { syncInterleaved(); return pixels; }
+
+    // 获取可写的像素数据：像素与其他图像共享或映射自文件时先复制出独占的存储
+    unsigned char* getMutablePixels() { detach(); return pixels; }
+
+    // 获取每行的字节数（含 4 字节对齐的填充）
+    int getRowSize() const { return rowSize; }
+
+    // 像素存储布局，默认 Interleaved，只对 Bgr24 生效。设为 Planar 后，逐通道的操作（均衡化、锐化与各卷积滤镜）
+    // 在三个独立的通道平面上执行，连续多步只在第一步拆分一次；只有需要交错像素时
+    // （getPixels、保存、显示、分割、流水线）才合并回交错存储
+    void setStorageLayout(PixelLayout layout) { storageLayout = layout; }
+    PixelLayout getStorageLayout() const { return storageLayout; }
 
     // 显示图像的 RGB 数据
     void show() const;
@@ -36,65 +109,157 @@ public:
     // 将图像绘制到指定的 QLabel 上，保持等比例缩放
     void drawToLabel(QLabel* label);
 
+    // 以下耗时操作都可传入 JobControl 报告进度并响应取消；
+    // 返回 false 表示被取消，此时像素可能只处理了一部分，调用方应丢弃该图像
+
     // 直方图均衡化
-    void HistogramEqualization();
+    bool HistogramEqualization(JobControl* control = nullptr);
+
+    // 限制对比度的自适应直方图均衡化（CLAHE）：每个 tileSize x tileSize 分块各自均衡化，
+    // 计数超过平均值 clipLimit 倍的部分均匀重新分配，像素在相邻分块的结果间双线性插值。
+    // 只支持 8 位格式（Gray8、Bgr24、Bgra32，alpha 保持不变），在交错像素上执行
+    bool clahe(int tileSize = 64, double clipLimit = 2.0, JobControl* control = nullptr);
+
+    // 保边去噪（只支持 8 位格式）：中值滤波各通道独立、每像素代价与半径（1..15）无关，平面布局下逐平面执行；
+    // 双边滤波以双边网格近似，radius 为空间标准差，rangeSigma 为亮度标准差，alpha 保持不变
+    bool medianFilter(int radius = 2, JobControl* control = nullptr);
+    bool bilateralFilter(int radius = 4, double rangeSigma = 30, JobControl* control = nullptr);
 
-    //保存图像
-    bool save(const QString& filePath);
+    //保存图像：先写临时文件再原子替换，Mapped 模式经预分配的文件映射写出；
+    //扩展名为 .mqt 时写成分块压缩容器（TiledImageFile），此时忽略 mode
+    bool save(const QString& filePath, BmpWriter::Mode mode = BmpWriter::Buffered);
+
+    // 在后台线程保存当前像素的快照，调用方可以立即继续修改图像或开始下一个任务
+    std::future<bool> saveAsync(const QString& filePath, BmpWriter::Mode mode = BmpWriter::Buffered) const;
 
     // 图像分割
-    void segmentImage();
+    bool segmentImage(JobControl* control = nullptr);
 
     //锐化
-    void sharpen();
+    bool sharpen(JobControl* control = nullptr);
+
+    // 卷积滤镜：均值模糊、高斯模糊、Sobel 边缘、反锐化掩模（后两种只支持 Gray8 与 Bgr24）
+    void boxBlur(int radius);
+    void gaussianBlur(int radius, double sigma = 0);
+    void sobel();
+    void unsharpMask(int radius, double sigma = 0, double amount = 1.0);
+
+    // 融合执行一条操作流水线（见 ImagePipeline，只支持 Bgr24），多步操作只读写一遍像素；
+    // 只含逐点操作时原地执行，否则写入新的像素缓冲区
+    bool applyPipeline(const ImagePipeline& pipeline, JobControl* control = nullptr);
 
-    // 将RGB像素转换为灰度值（采用常见的加权平均法）
+    // 将RGB像素转换为灰度值（0.299/0.587/0.114 加权，Q14 定点四舍五入，与各灰度化内核一致）
     int rgbToGray(unsigned char r, unsigned char g, unsigned char b) {
-        return static_cast<int>(0.299 * r + 0.587 * g + 0.114 * b);
+        return (4899 * r + 9617 * g + 1868 * b + 8192) >> 14;
     }
 
+    // 逐像素的浮点 HSV 转换：h 为 [0, 360) 度，s、v 为 [0, 1]；ColorConvert 的定点内核以此为精度参照
+    void hsvToRGB(float h, float s, float v, unsigned char& r, unsigned char& g, unsigned char& b);
+    void rgbToHSV(unsigned char r, unsigned char g, unsigned char b, float& h, float& s, float& v);
+
     void changeK(int value){
         this->K=value;
     }
 
+    // 设置图像分割初始中心的随机种子，相同种子得到相同的分割结果
+    void changeSeed(quint32 value){
+        this->seed=value;
+    }
+
+    // 指定图像分割的初始中心（恰好 K 个时生效，例如预览代理上的聚类结果），传入空列表恢复随机选取
+    void setInitialCenters(const QVector<KMeansCenter>& centers){
+        this->initialCenters=centers;
+    }
+
+    // 最近一次图像分割得到的聚类中心
+    const QVector<KMeansCenter>& getSegmentCenters() const { return segmentCenters; }
+
+    // 图像分割使用的参数（K、种子、引擎、初始中心），供 SegmentationSession 等外部分割使用
+    KMeansOptions getSegmentationOptions() const;
+
+    // 分割时保留每个像素的簇号（width*height 字节，行序与像素相同），默认只写回着色后的像素
+    void setKeepSegmentLabels(bool keep){
+        this->keepSegmentLabels=keep;
+        if (!keep) {
+            segmentLabels.reset();
+        }
+    }
+    // 最近一次 Bgr24 分割的簇号，未保留时为空；像素此后被改写（加载、其他操作、缩放等）时清空
+    std::shared_ptr<const PooledBuffer> getSegmentLabels() const { return segmentLabels; }
+    // 由外部分割（SegmentationSession）写入的聚类中心与簇号；未开启保留时只记录中心
+    void setSegmentResult(const QVector<KMeansCenter>& centers, std::shared_ptr<const PooledBuffer> labels);
+
+    // 在保留的簇号上标记连通区域，返回每个区域的面积、外接矩形、质心与平均颜色（自上而下的图像坐标）。
+    // 平均颜色取自 colorSource（为空时取本图像，分割后即为簇中心颜色；可传入分割前的原图），须为同尺寸的 Bgr24；
+    // 没有保留的簇号时返回空结果
+    ComponentResult findRegions(const ComponentOptions& options = ComponentOptions(),
+                                const MyQImage* colorSource = nullptr) const;
+
+    // 选择图像分割引擎；颜色直方图引擎下 colorBits 为每通道保留的位数（8 为精确颜色）
+    void setSegmentationEngine(KMeansEngine engine, int colorBits = 8){
+        this->engine=engine;
+        this->colorBits=colorBits;
+    }
+
 private:
-    // BMP 文件头
-    #pragma pack(1)
-    struct BMPFileHeader {
-        uint16_t type = 0x4D42;  // 'BM' 2字节
-        uint32_t size = 0;//4字节
-        uint16_t reserved1 = 0;//2字节
-        uint16_t reserved2 = 0;//2字节
-        uint32_t offset = 54;  // 54 字节偏移，跳过文件头和信息头，4字节
-    } fileHeader;
-
-    // BMP 信息头
-    struct BMPInfoHeader {
-        uint32_t size = 40;  // 头部大小 4字节
-        int32_t width = 0;   // 图像宽度 4字节
-        int32_t height = 0;  // 图像高度 4字节
-        uint16_t planes = 1; // 目标设备的平面数，始终为1 2字节
-        uint16_t bitsPerPixel = 24; // 24位图像 2字节
-        uint32_t compression = 0; // 无压缩 4字节
-        uint32_t imageSize = 0;//数据大小 4字节
-        int32_t xResolution = 0;//水平分辨率 4字节
-        int32_t yResolution = 0;//垂直分辨率 4字节
-        uint32_t colors = 0;//颜色数 4字节
-        uint32_t importantColors = 0;//重要颜色数 4字节
-    } infoHeader;
+    BMPFileHeader fileHeader;// BMP 文件头
+    BMPInfoHeader infoHeader;// BMP 信息头
 
     struct RGB {
         unsigned char r, g, b;
     };
 
     int width, height;// 图像的宽和高
-    unsigned char* pixels;// 像素数据
+    mutable unsigned char* pixels;// 像素数据，指向 buffer 中的存储
     int rowSize;// 每行的字节数
+    PixelFormat format=PixelFormat::Bgr24;// 像素格式
     int K=1;//用于图像分割中的k-means算法
+    quint32 seed=1;//k-means初始中心的随机种子
+    KMeansEngine engine=KMeansEngine::Pixels;//图像分割使用的聚类引擎
+    int colorBits=8;//颜色直方图引擎每通道保留的位数
+    QVector<KMeansCenter> initialCenters;//图像分割的初始中心，为空时随机选取
+    QVector<KMeansCenter> segmentCenters;//最近一次图像分割得到的聚类中心
+    bool keepSegmentLabels=false;//分割时是否保留簇号
+    std::shared_ptr<const PooledBuffer> segmentLabels;//最近一次分割的簇号，多个副本共享
+    mutable QExplicitlySharedDataPointer<PixelBuffer> buffer;// 共享的像素存储（堆内存或文件映射）
+    QExplicitlySharedDataPointer<PlanarBuffer> planar;// 平面布局的像素，为空表示没有平面副本
+    mutable bool interleavedStale=false;// 最新的像素只在 planar 中，buffer 尚未同步
+    PixelLayout storageLayout=PixelLayout::Interleaved;// 逐通道操作使用的布局
+    QVector<QImage> displayPyramid;// 显示用的 mip 金字塔，第 0 层包装 pixels；像素改变时清空
 
 
-    void hsvToRGB(float h, float s, float v, unsigned char& r, unsigned char& g, unsigned char& b);
-    void rgbToHSV(unsigned char r, unsigned char g, unsigned char b, float& h, float& s, float& v);
+    // 释放像素数据（堆内存或文件映射）
+    void releasePixels();
+    // 写入像素前调用：若像素与其他图像共享或仍映射自文件，则复制出独占的堆内存
+    void detach();
+    // 以新的存储替换当前像素
+    void setBuffer(PixelBuffer* newBuffer);
+
+    // 平面中的像素较新时写回交错存储（布局边界处的转换，const 接口也会调用）
+    void syncInterleaved() const;
+    // 准备独占的平面存储供写入，之后交错存储视为过期
+    void preparePlanar();
+    // 操作声明是否支持平面布局，返回本次使用的布局；平面布局时已准备好平面存储
+    PixelLayout chooseLayout(bool supportsPlanar);
+
+    // 按当前格式与尺寸重新生成 BMP 头（16 位格式对应降为 8 位后的 BMP）
+    void updateHeaders();
+
+    // 用 filter(src, dst) 生成新的像素缓冲区并替换当前像素
+    bool applyFilter(const std::function<void(const unsigned char*, unsigned char*)>& filter,
+                     JobControl* control = nullptr);
+
+    // 各通道独立的滤镜：filter(src, dst, stride, channels) 处理 width x height、每像素 channels 字节的图像。
+    // 平面布局下对三个平面各调用一次（channels 为 1），否则对交错像素调用一次（channels 为每像素字节数，只用于 8 位格式）；
+    // 有 control 时以所有调用要处理的总行数开始进度阶段
+    bool applyChannelFilter(const std::function<void(const unsigned char*, unsigned char*, qint64, int)>& filter,
+                            JobControl* control = nullptr);
+
+    // 以 kernel 卷积：Bgr24 经 applyChannelFilter（支持平面布局），其他格式经 FormatKernels::convolve
+    bool applyKernel(const ConvolutionKernel& kernel, ConvolutionOptions options, JobControl* control = nullptr);
+
+
+    static QImage halveImage(const QImage& src, bool flip);
 
 };
 
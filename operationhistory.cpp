@@ -0,0 +1,307 @@
+#include "operationhistory.h"
+#include "parallel.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const int TileSize = 64;
+
+void writeVarint(QByteArray& out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+quint64 readVarint(const uchar*& p) {
+    quint64 value = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        value |= quint64(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= quint64(*p++) << shift;
+    return value;
+}
+
+// 一块在图像中的范围：行 [y0, y1)，每行字节 [x0, x1)
+struct TileRect {
+    int y0, y1;
+    qint64 x0, x1;
+};
+
+TileRect tileRect(int tile, int width, int height, int bytesPerPixel) {
+    const int tilesX = (width + TileSize - 1) / TileSize;
+    const int tx = tile % tilesX;
+    const int ty = tile / tilesX;
+    TileRect r;
+    r.y0 = ty * TileSize;
+    r.y1 = std::min(height, r.y0 + TileSize);
+    r.x0 = qint64(tx) * TileSize * bytesPerPixel;
+    r.x1 = qint64(std::min(width, (tx + 1) * TileSize)) * bytesPerPixel;
+    return r;
+}
+
+// 尺寸与像素格式都相同时才能以差异表示
+bool sameLayout(const MyQImage& a, const MyQImage& b) {
+    return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() && a.getFormat() == b.getFormat();
+}
+
+// 编码一块的异或值：交替写出 0 的个数与随后非 0 字节的个数和内容；整块未改变时返回空
+QByteArray encodeTile(const uchar* a, const uchar* b, qint64 rowSize, const TileRect& r) {
+    QByteArray out;
+    qint64 zeros = 0;
+    QByteArray literal;
+    bool changed = false;
+    auto flush = [&]() {
+        writeVarint(out, quint64(zeros));
+        writeVarint(out, quint64(literal.size()));
+        out.append(literal);
+        zeros = 0;
+        literal.clear();
+    };
+    for (int y = r.y0; y < r.y1; ++y) {
+        const uchar* pa = a + y * rowSize;
+        const uchar* pb = b + y * rowSize;
+        for (qint64 x = r.x0; x < r.x1; ++x) {
+            uchar v = pa[x] ^ pb[x];
+            if (v == 0) {
+                if (!literal.isEmpty()) {
+                    flush();
+                }
+                ++zeros;
+            } else {
+                literal.append(char(v));
+                changed = true;
+            }
+        }
+    }
+    if (!changed) {
+        return QByteArray();
+    }
+    if (!literal.isEmpty()) {
+        flush();
+    }
+    return out;
+}
+
+void decodeTile(const uchar* p, const uchar* end, uchar* pixels, qint64 rowSize, const TileRect& r) {
+    const qint64 rowBytes = r.x1 - r.x0;
+    qint64 position = 0;  // 块内的字节序号
+    while (p < end) {
+        position += qint64(readVarint(p));
+        qint64 count = qint64(readVarint(p));
+        for (qint64 i = 0; i < count; ++i, ++position) {
+            pixels[(r.y0 + position / rowBytes) * rowSize + r.x0 + position % rowBytes] ^= *p++;
+        }
+    }
+}
+
+}
+
+// ---------------- ImageDelta ----------------
+
+ImageDelta ImageDelta::between(const MyQImage& from, const MyQImage& to) {
+    ImageDelta delta;
+    delta.width = to.getWidth();
+    delta.height = to.getHeight();
+    delta.bytesPerPixel = ::bytesPerPixel(to.getFormat());
+    const int tiles = ((delta.width + TileSize - 1) / TileSize) * ((delta.height + TileSize - 1) / TileSize);
+    QVector<QByteArray> encoded(tiles);
+    // 共享同一像素存储时没有差异
+    if (from.getPixels() != to.getPixels()) {
+        parallelFor(0, tiles, [&](int, int t0, int t1) {
+            for (int t = t0; t < t1; ++t) {
+                encoded[t] = encodeTile(from.getPixels(), to.getPixels(), to.getRowSize(),
+                                        tileRect(t, delta.width, delta.height, delta.bytesPerPixel));
+            }
+        });
+    }
+    delta.offsets.resize(tiles + 1);
+    qint64 total = 0;
+    for (int t = 0; t < tiles; ++t) {
+        delta.offsets[t] = total;
+        total += encoded[t].size();
+    }
+    delta.offsets[tiles] = total;
+    delta.data.reserve(int(total));
+    for (const QByteArray& tile : encoded) {
+        delta.data.append(tile);
+    }
+    return delta;
+}
+
+void ImageDelta::apply(MyQImage& image) const {
+    if (isEmpty() || image.getWidth() != width || image.getHeight() != height
+        || ::bytesPerPixel(image.getFormat()) != bytesPerPixel) {
+        return;
+    }
+    if (data.isEmpty()) {
+        return;
+    }
+    uchar* pixels = image.getMutablePixels();
+    const qint64 rowSize = image.getRowSize();
+    const uchar* base = reinterpret_cast<const uchar*>(data.constData());
+    parallelFor(0, offsets.size() - 1, [&](int, int t0, int t1) {
+        for (int t = t0; t < t1; ++t) {
+            decodeTile(base + offsets[t], base + offsets[t + 1], pixels, rowSize, tileRect(t, width, height, bytesPerPixel));
+        }
+    });
+}
+
+// ---------------- OperationHistory ----------------
+
+OperationHistory::OperationHistory(qint64 memoryLimit) : limit(memoryLimit) {}
+
+void OperationHistory::reset(const MyQImage& image) {
+    original = image;
+    state = image;
+    steps.clear();
+    current = 0;
+}
+
+void OperationHistory::record(const MyQImage& image, const QString& label,
+                              const std::function<void(MyQImage&)>& replay) {
+    steps.resize(current);
+
+    Step step;
+    step.label = label;
+    if (!sameLayout(image, state)) {
+        step.after = image;
+    } else {
+        step.delta = ImageDelta::between(state, image);
+        // 差异超过原图的 1/16 且操作可重放时只保存操作，并暂时缓存前一状态以便立即撤销
+        if (replay && step.delta.bytes() * 16 > imageBytes(image)) {
+            step.delta = ImageDelta();
+            step.replay = replay;
+            step.before = state;
+        }
+    }
+    steps.append(step);
+    current = steps.size();
+    state = image;
+    enforceLimit();
+}
+
+bool OperationHistory::undo(MyQImage& image) {
+    return canUndo() && moveTo(current - 1, image);
+}
+
+bool OperationHistory::redo(MyQImage& image) {
+    return canRedo() && moveTo(current + 1, image);
+}
+
+bool OperationHistory::revertToOriginal(MyQImage& image) {
+    return original.getPixels() && moveTo(0, image);
+}
+
+bool OperationHistory::moveTo(int index, MyQImage& image) {
+    state = reconstruct(index);
+    current = index;
+    image = state;
+    return true;
+}
+
+MyQImage OperationHistory::reconstruct(int index) const {
+    if (index == current) {
+        return state;
+    }
+    if (index == 0) {
+        return original;
+    }
+    // 向后：之间的步骤都是差异时，从当前状态逐步异或回去
+    if (index < current) {
+        bool deltas = true;
+        for (int i = index; i < current && deltas; ++i) {
+            deltas = !steps[i].delta.isEmpty();
+        }
+        if (deltas) {
+            MyQImage image = state;
+            for (int i = current - 1; i >= index; --i) {
+                steps[i].delta.apply(image);
+            }
+            return image;
+        }
+    }
+    // 向前：从 index 之前最近的已知状态出发，依次应用差异或重放
+    int start = 0;
+    MyQImage image = original;
+    for (int j = index; j > 0; --j) {
+        if (j == current) {
+            image = state;
+        } else if (steps[j - 1].after.getPixels()) {
+            image = steps[j - 1].after;
+        } else if (j < steps.size() && steps[j].before.getPixels()) {
+            image = steps[j].before;
+        } else {
+            continue;
+        }
+        start = j;
+        break;
+    }
+    for (int i = start; i < index; ++i) {
+        applyForward(steps[i], image);
+    }
+    return image;
+}
+
+void OperationHistory::applyForward(const Step& step, MyQImage& image) const {
+    if (step.after.getPixels()) {
+        image = step.after;
+    } else if (step.replay) {
+        step.replay(image);
+    } else {
+        step.delta.apply(image);
+    }
+}
+
+qint64 OperationHistory::memoryUsage() const {
+    qint64 total = 0;
+    for (const Step& step : steps) {
+        total += step.delta.bytes() + imageBytes(step.after) + imageBytes(step.before);
+    }
+    return total;
+}
+
+void OperationHistory::setMemoryLimit(qint64 bytes) {
+    limit = bytes;
+    enforceLimit();
+}
+
+void OperationHistory::enforceLimit() {
+    // 1. 丢弃重放步骤缓存的前一状态，从最早的开始
+    for (int i = 0; i < steps.size() && memoryUsage() > limit; ++i) {
+        steps[i].before = MyQImage();
+    }
+    // 2. 合并最早的两步，丢弃第 1 个中间状态；当前状态及之后的步骤不受影响
+    while (memoryUsage() > limit && current >= 2) {
+        Step merged;
+        merged.label = steps[0].label + " + " + steps[1].label;
+        if (steps[0].replay && steps[1].replay) {
+            // 两步都可重放时合并为依次重放，不占用内存
+            auto first = steps[0].replay;
+            auto second = steps[1].replay;
+            merged.replay = [first, second](MyQImage& image) {
+                first(image);
+                second(image);
+            };
+        } else {
+            MyQImage after = reconstruct(2);
+            if (!sameLayout(after, original)) {
+                merged.after = after;
+            } else {
+                merged.delta = ImageDelta::between(original, after);
+            }
+        }
+        steps.remove(0, 2);
+        steps.insert(0, merged);
+        current--;
+        qDebug() << "History: merged the two oldest steps, memory" << memoryUsage() << "bytes";
+    }
+}
+
+qint64 OperationHistory::imageBytes(const MyQImage& image) {
+    return image.getPixels() ? qint64(image.getRowSize()) * image.getHeight() : 0;
+}
@@ -0,0 +1,89 @@
+#ifndef OPERATIONHISTORY_H
+#define OPERATIONHISTORY_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <functional>
+#include "myqimage.h"
+
+// 两幅同尺寸图像之间的差异：按 64x64 像素分块，每块保存像素的异或值，
+// 异或结果中的连续 0 做游程编码，未改变的块不占空间。
+// 异或是对称的，同一个差异既能从前一状态得到后一状态，也能反过来
+class ImageDelta {
+public:
+    // 计算 from 与 to 之间的差异，两者尺寸与像素格式必须相同
+    static ImageDelta between(const MyQImage& from, const MyQImage& to);
+
+    // 将差异异或到 image 上（原地修改）
+    void apply(MyQImage& image) const;
+
+    bool isEmpty() const { return offsets.isEmpty(); }
+    // 编码后占用的字节数
+    qint64 bytes() const { return data.size() + offsets.size() * qint64(sizeof(qint64)); }
+
+private:
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 3;
+    QVector<qint64> offsets;  // 第 t 块的编码位于 [offsets[t], offsets[t+1])，长度为 0 表示未改变
+    QByteArray data;
+};
+
+// 操作历史：原图只保存一次，之后的每一步保存为与前一状态的差异，
+// 或者在重放代价更低时只保存操作本身（重放函数）。
+// 占用内存超过上限时，先丢弃重放步骤缓存的前一状态，再把最早的两步合并为一步（丢弃最早的中间状态）
+class OperationHistory {
+public:
+    explicit OperationHistory(qint64 memoryLimit = qint64(256) << 20);
+
+    // 以 image 为原图开始新的历史
+    void reset(const MyQImage& image);
+
+    // 记录一步操作，image 为操作后的图像；replay 非空表示该操作可确定地重放，
+    // 差异较大时只保存重放函数。当前位置之后的（可重做的）步骤被丢弃
+    void record(const MyQImage& image, const QString& label,
+                const std::function<void(MyQImage&)>& replay = std::function<void(MyQImage&)>());
+
+    bool canUndo() const { return current > 0; }
+    bool canRedo() const { return current < steps.size(); }
+
+    // 撤销、重做、回到原图，成功时把对应状态写入 image
+    bool undo(MyQImage& image);
+    bool redo(MyQImage& image);
+    bool revertToOriginal(MyQImage& image);
+
+    // 当前位置：0 为原图，i 为第 i 步之后
+    int currentIndex() const { return current; }
+    int stepCount() const { return steps.size(); }
+    QString label(int step) const { return steps[step - 1].label; }
+
+    // 差异与缓存状态占用的字节数（不含原图与当前图像）
+    qint64 memoryUsage() const;
+    void setMemoryLimit(qint64 bytes);
+
+private:
+    struct Step {
+        QString label;
+        ImageDelta delta;                         // 与前一状态的差异
+        std::function<void(MyQImage&)> replay;    // 重放函数，delta 为空时使用
+        MyQImage after;                           // 尺寸改变时保存完整的结果
+        MyQImage before;                          // 重放步骤缓存的前一状态，可随时丢弃
+    };
+
+    // 计算第 index 个状态
+    MyQImage reconstruct(int index) const;
+    // 将第 step 步正向作用到 image 上
+    void applyForward(const Step& step, MyQImage& image) const;
+    bool moveTo(int index, MyQImage& image);
+    void enforceLimit();
+    static qint64 imageBytes(const MyQImage& image);
+
+    MyQImage original;
+    MyQImage state;     // 当前位置的图像，与界面上的图像共享像素，操作写入时那一方才复制
+    QVector<Step> steps;
+    int current = 0;
+    qint64 limit;
+};
+
+#endif // OPERATIONHISTORY_H
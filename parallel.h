@@ -0,0 +1,148 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 实际使用的线程数：requested<=0 时取 CPU 核数
+inline int parallelThreadCount(int requested = 0) {
+    if (requested > 0) {
+        return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// 按行条带并行时的线程数：每个线程至少 minRows 行，小图不值得开线程
+inline int parallelRowThreads(int rows, int requested, int minRows = 64) {
+    return std::max(1, std::min(parallelThreadCount(requested), rows / minRows));
+}
+
+// 将 [begin, end) 均分为 threads 个连续区间，第 t 个线程执行 fn(t, blockBegin, blockEnd)
+// 区间划分只取决于区间长度与线程数，结果按线程序号归约即可保证确定性
+template <typename Fn>
+void parallelFor(int begin, int end, Fn fn, int threads = 0) {
+    int total = end - begin;
+    if (total <= 0) {
+        return;
+    }
+    threads = std::min(parallelThreadCount(threads), total);
+    if (threads == 1) {
+        fn(0, begin, end);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; ++t) {
+        int b = begin + int((long long)total * t / threads);
+        int e = begin + int((long long)total * (t + 1) / threads);
+        workers.emplace_back([=, &fn]() { fn(t, b, e); });
+    }
+    fn(0, begin, begin + total / threads);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// 一组常驻线程：构造时创建 threads-1 个工作线程，每次 forRange 都交给同一组线程执行（调用线程为 0 号），
+// 供迭代算法在每次迭代中复用，不再反复创建与回收线程。区间划分与 parallelFor 相同
+class ParallelTeam {
+public:
+    explicit ParallelTeam(int threads = 0) : count(parallelThreadCount(threads)) {
+        workers.reserve(count - 1);
+        for (int t = 1; t < count; ++t) {
+            workers.emplace_back([this, t]() { workerLoop(t); });
+        }
+    }
+
+    ~ParallelTeam() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            ++generation;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ParallelTeam(const ParallelTeam&) = delete;
+    ParallelTeam& operator=(const ParallelTeam&) = delete;
+
+    int size() const { return count; }
+
+    // 与 parallelFor(begin, end, fn, size()) 相同，返回时所有线程都已完成
+    template <typename Fn>
+    void forRange(int begin, int end, Fn fn) {
+        const int total = end - begin;
+        if (total <= 0) {
+            return;
+        }
+        const int threads = std::min(count, total);
+        if (threads == 1) {
+            fn(0, begin, end);
+            return;
+        }
+        run(threads, [&](int t) {
+            fn(t, begin + int((long long)total * t / threads), begin + int((long long)total * (t + 1) / threads));
+        });
+    }
+
+private:
+    void run(int threads, const std::function<void(int)>& fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &fn;
+            active = threads;
+            remaining = threads - 1;
+            ++generation;
+        }
+        wake.notify_all();
+        fn(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return remaining == 0; });
+        task = nullptr;
+    }
+
+    void workerLoop(int t) {
+        unsigned long long seen = 0;
+        for (;;) {
+            const std::function<void(int)>* current = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return generation != seen; });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+                if (t >= active) {
+                    continue;
+                }
+                current = task;
+            }
+            (*current)(t);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    const int count;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* task = nullptr;
+    unsigned long long generation = 0;
+    int active = 0;
+    int remaining = 0;
+    bool stopping = false;
+};
+
+#endif // PARALLEL_H
@@ -0,0 +1,277 @@
+#include "pipeline.h"
+#include "jobcontrol.h"
+#include "bufferpool.h"
+#include "parallel.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// 统计直方图时每攒够这么多行调用一次 accumulateBgrHistogram
+const int kHistogramRows = 16;
+
+// 融合后的一级：可选的卷积（第 0 级没有，直接读源图像）及其后的逐点操作
+struct Stage {
+    const PipelineNode* stencil = nullptr;
+    QVector<PipelineNode> points;
+};
+
+// 相邻的查找表合成一张：先 first 后 second
+void composeLut(BgrLut& first, const BgrLut& second) {
+    for (int i = 0; i < 256; ++i) {
+        first.b[i] = second.b[first.b[i]];
+        first.g[i] = second.g[first.g[i]];
+        first.r[i] = second.r[first.r[i]];
+    }
+}
+
+// 将前 count 个操作（不含 Equalize）按卷积切分为若干级
+QVector<Stage> buildStages(const QVector<PipelineNode>& nodes, int count) {
+    QVector<Stage> stages(1);
+    for (int i = 0; i < count; ++i) {
+        const PipelineNode& node = nodes[i];
+        if (node.kind == PipelineNode::Stencil) {
+            Stage stage;
+            stage.stencil = &node;
+            stages.append(stage);
+            continue;
+        }
+        QVector<PipelineNode>& points = stages.last().points;
+        if (node.kind == PipelineNode::Lut && !points.isEmpty() && points.last().kind == PipelineNode::Lut) {
+            composeLut(points.last().table, node.table);
+        } else {
+            points.append(node);
+        }
+    }
+    return stages;
+}
+
+// 与 MyQImage::rgbToGray、FormatKernels::convert 相同的 Q14 定点加权，四舍五入
+void grayRow(unsigned char* row, int width) {
+    for (int x = 0; x < width; ++x, row += 3) {
+        unsigned char gray = static_cast<unsigned char>((4899 * row[2] + 9617 * row[1] + 1868 * row[0] + 8192) >> 14);
+        row[0] = row[1] = row[2] = gray;
+    }
+}
+
+void applyPoints(const Stage& stage, unsigned char* row, int width) {
+    for (const PipelineNode& node : stage.points) {
+        if (node.kind == PipelineNode::Lut) {
+            applyBgrLut(row, width, 1, 0, node.table);
+        } else {
+            grayRow(row, width);
+        }
+    }
+}
+
+// 一个线程内的融合求值：每级只保留一行输出缓冲，卷积级通过 ConvolutionRowFilter 向上一级按需取行。
+// 按行号递增求值时上一级的每一行只计算一次（分块起点处重算卷积核高度的几行光晕）
+class FusedRows {
+public:
+    FusedRows(const QVector<Stage>& stages, const unsigned char* src, int width, int height, qint64 stride)
+        : stages(stages), src(src), width(width), stride(stride), states(stages.size()) {
+        ScratchArena& arena = ScratchArena::local();
+        for (int s = 0; s < stages.size(); ++s) {
+            states[s].buffer = arena.allocate<unsigned char>(qint64(width) * 3);
+            if (stages[s].stencil) {
+                states[s].filter.reset(new ConvolutionRowFilter(
+                    stages[s].stencil->kernel, width, height, 3, stages[s].stencil->border,
+                    [this, s](int y) { return row(s - 1, y); }));
+            }
+        }
+    }
+
+    // 计算最后一级的第 y 行写入 out（out 可以就是源图像的第 y 行）
+    void produce(int y, unsigned char* out) {
+        const int last = stages.size() - 1;
+        if (stages[last].stencil) {
+            states[last].filter->process(y, out);
+        } else if (out != src + y * stride) {
+            std::memcpy(out, src + y * stride, size_t(width) * 3);
+        }
+        applyPoints(stages[last], out, width);
+    }
+
+private:
+    struct State {
+        unsigned char* buffer = nullptr;
+        int cachedRow = INT_MIN;
+        std::unique_ptr<ConvolutionRowFilter> filter;
+    };
+
+    // 第 s 级输出的第 y 行
+    const unsigned char* row(int s, int y) {
+        State& state = states[s];
+        if (!stages[s].stencil && stages[s].points.isEmpty()) {
+            return src + y * stride;
+        }
+        if (state.cachedRow != y) {
+            if (stages[s].stencil) {
+                state.filter->process(y, state.buffer);
+            } else {
+                std::memcpy(state.buffer, src + y * stride, size_t(width) * 3);
+            }
+            applyPoints(stages[s], state.buffer, width);
+            state.cachedRow = y;
+        }
+        return state.buffer;
+    }
+
+    const QVector<Stage>& stages;
+    const unsigned char* src;
+    const int width;
+    const qint64 stride;
+    std::vector<State> states;
+};
+
+// 按分块并行执行一遍：dst 非空时写出结果，否则只把结果累计进 hist
+bool runPass(const QVector<Stage>& stages, const unsigned char* src, unsigned char* dst, BgrHistogram* hist,
+             int width, int height, qint64 stride, int tileRows, int threads, JobControl* control) {
+    tileRows = std::max(1, tileRows);
+    const int tiles = (height + tileRows - 1) / tileRows;
+    const qint64 n = qint64(width) * 3;
+    // 只统计源图像本身时直接在源图像上累计
+    const bool direct = stages.size() == 1 && stages[0].points.isEmpty();
+    QMutex mutex;
+
+    parallelFor(0, tiles, [&](int, int t0, int t1) {
+        ScratchArena::Scope scope;
+        BgrHistogram local;
+        unsigned char* block = hist && !direct ? ScratchArena::local().allocate<unsigned char>(kHistogramRows * n) : nullptr;
+        int pending = 0;
+        {
+            FusedRows rows(stages, src, width, height, stride);
+            for (int t = t0; t < t1; ++t) {
+                if (control && control->isCancelled()) {
+                    break;
+                }
+                const int y0 = t * tileRows;
+                const int y1 = std::min(height, y0 + tileRows);
+                if (!hist) {
+                    for (int y = y0; y < y1; ++y) {
+                        rows.produce(y, dst + y * stride);
+                    }
+                } else if (direct) {
+                    accumulateBgrHistogram(src + y0 * stride, width, y1 - y0, stride, local);
+                } else {
+                    for (int y = y0; y < y1; ++y) {
+                        rows.produce(y, block + pending * n);
+                        if (++pending == kHistogramRows) {
+                            accumulateBgrHistogram(block, width, pending, n, local);
+                            pending = 0;
+                        }
+                    }
+                }
+                if (control) {
+                    control->advance(y1 - y0);
+                }
+            }
+        }
+        if (!hist) {
+            return;
+        }
+        if (pending > 0) {
+            accumulateBgrHistogram(block, width, pending, n, local);
+        }
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < 256; ++i) {
+            hist->b[i] += local.b[i];
+            hist->g[i] += local.g[i];
+            hist->r[i] += local.r[i];
+        }
+        hist->pixelCount += local.pixelCount;
+    }, threads);
+
+    return !(control && control->isCancelled());
+}
+
+}
+
+ImagePipeline& ImagePipeline::lut(const BgrLut& table) {
+    PipelineNode node;
+    node.kind = PipelineNode::Lut;
+    node.table = table;
+    nodes.append(node);
+    return *this;
+}
+
+ImagePipeline& ImagePipeline::gray() {
+    PipelineNode node;
+    node.kind = PipelineNode::Gray;
+    nodes.append(node);
+    return *this;
+}
+
+ImagePipeline& ImagePipeline::threshold(int level) {
+    BgrLut table;
+    for (int i = 0; i < 256; ++i) {
+        table.b[i] = table.g[i] = table.r[i] = i >= level ? 255 : 0;
+    }
+    return lut(table);
+}
+
+ImagePipeline& ImagePipeline::equalize() {
+    PipelineNode node;
+    node.kind = PipelineNode::Equalize;
+    nodes.append(node);
+    return *this;
+}
+
+ImagePipeline& ImagePipeline::convolve(const ConvolutionKernel& kernel, BorderMode border) {
+    PipelineNode node;
+    node.kind = PipelineNode::Stencil;
+    node.kernel = kernel;
+    node.border = border;
+    nodes.append(node);
+    return *this;
+}
+
+bool ImagePipeline::hasStencil() const {
+    for (const PipelineNode& node : nodes) {
+        if (node.kind == PipelineNode::Stencil) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ImagePipeline::run(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+                        JobControl* control) const {
+    if (width <= 0 || height <= 0) {
+        return true;
+    }
+
+    // 每个均衡化先对它前面的操作链做一遍统计，再换成普通查找表；最后一遍写出结果
+    QVector<PipelineNode> resolved = nodes;
+    int passes = 1;
+    for (const PipelineNode& node : resolved) {
+        passes += node.kind == PipelineNode::Equalize;
+    }
+    int pass = 0;
+    for (int i = 0; i < resolved.size(); ++i) {
+        if (resolved[i].kind != PipelineNode::Equalize) {
+            continue;
+        }
+        if (control) {
+            control->beginStage(100 * pass / passes, 100 * (pass + 1) / passes, height);
+        }
+        ++pass;
+        BgrHistogram hist;
+        if (!runPass(buildStages(resolved, i), src, nullptr, &hist, width, height, stride, tileRows, threads, control)) {
+            return false;
+        }
+        buildEqualizationLut(hist, resolved[i].table);
+        resolved[i].kind = PipelineNode::Lut;
+    }
+
+    if (control) {
+        control->beginStage(100 * pass / passes, 100, height);
+    }
+    return runPass(buildStages(resolved, resolved.size()), src, dst, nullptr, width, height, stride,
+                   tileRows, threads, control);
+}
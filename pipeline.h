@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QtGlobal>
+#include <QVector>
+#include "histogram.h"
+#include "convolution.h"
+
+class JobControl;
+
+// 流水线中记录的一个操作
+struct PipelineNode {
+    enum Kind { Lut, Gray, Equalize, Stencil };
+    Kind kind = Lut;
+    BgrLut table;                                 // Lut：查找表；Equalize 在执行时填入
+    ConvolutionKernel kernel;                     // Stencil：卷积核
+    BorderMode border = BorderMode::Replicate;    // Stencil：边界处理方式
+};
+
+// 延迟执行的图像操作流水线（24 位 BGR）。
+// 先记录操作，run 时再融合执行：相邻的查找表合成一张表，逐点操作在卷积读取输入行时顺带完成，
+// 多级卷积逐行串接，中间结果只保留卷积核高度的几行，不再为每一步读写整幅图像。
+// 均衡化需要其输入的直方图，执行时先对前面的操作链做一遍只统计不写出的融合遍历
+class ImagePipeline {
+public:
+    // 逐点操作
+    ImagePipeline& lut(const BgrLut& table);       // 三通道查找表
+    ImagePipeline& gray();                          // 转为灰度（三个通道都写灰度值）
+    ImagePipeline& threshold(int level);            // 各通道 >= level 取 255，否则取 0
+    ImagePipeline& equalize();                      // 直方图均衡化，查找表由输入的直方图生成
+
+    // 邻域操作
+    ImagePipeline& convolve(const ConvolutionKernel& kernel, BorderMode border = BorderMode::Replicate);
+    ImagePipeline& sharpen() { return convolve(ConvolutionKernel::sharpen()); }
+    ImagePipeline& boxBlur(int radius) { return convolve(ConvolutionKernel::box(radius)); }
+    ImagePipeline& gaussianBlur(int radius, double sigma = 0) {
+        return convolve(ConvolutionKernel::gaussian(radius, sigma));
+    }
+
+    void clear() { nodes.clear(); }
+    bool isEmpty() const { return nodes.isEmpty(); }
+    int size() const { return nodes.size(); }
+
+    // 是否含邻域操作；含邻域操作时不能原地执行
+    bool hasStencil() const;
+
+    // 线程数（<=0 时使用 CPU 核数）与每个分块的行数（进度与取消的粒度）
+    void setThreads(int count) { threads = count; }
+    void setTileRows(int rows) { tileRows = rows; }
+
+    // 对 src 执行整条流水线写入 dst；不含邻域操作时 dst 可以等于 src。
+    // control 非空时按行推进进度，返回 false 表示被取消（dst 中只有部分结果）
+    bool run(const unsigned char* src, unsigned char* dst, int width, int height, qint64 stride,
+             JobControl* control = nullptr) const;
+
+private:
+    QVector<PipelineNode> nodes;
+    int threads = 0;
+    int tileRows = 64;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,29 @@
+#include "pixelbuffer.h"
+#include "bufferpool.h"
+#include <QFile>
+#include <algorithm>
+
+PixelBuffer::PixelBuffer(qint64 size, bool zeroed)
+    : bytes(static_cast<unsigned char*>(BufferPool::instance().allocate(size))), length(size) {
+    if (zeroed) {
+        std::fill(bytes, bytes + length, 0);
+    }
+}
+
+PixelBuffer::PixelBuffer(QFile* file, uchar* base, qint64 offset, qint64 size)
+    : bytes(base + offset), length(size), file(file), mapBase(base) {}
+
+PixelBuffer::PixelBuffer(const PixelBuffer& other)
+    : QSharedData(other), bytes(static_cast<unsigned char*>(BufferPool::instance().allocate(other.length))),
+      length(other.length) {
+    std::copy(other.bytes, other.bytes + length, bytes);
+}
+
+PixelBuffer::~PixelBuffer() {
+    if (file) {
+        file->unmap(mapBase);
+        delete file;
+    } else {
+        BufferPool::instance().release(bytes, length);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef PIXELBUFFER_H
+#define PIXELBUFFER_H
+
+#include <QtGlobal>
+#include <QSharedData>
+
+class QFile;
+
+// 引用计数的像素存储，位于堆内存或文件映射中。
+// MyQImage 之间拷贝时通过 QExplicitlySharedDataPointer 共享同一块存储，
+// 写入前由 MyQImage::detach() 换成独占的堆内存（写时复制）
+class PixelBuffer : public QSharedData {
+public:
+    // 从 BufferPool 分配 size 字节，zeroed 为 true 时清零
+    explicit PixelBuffer(qint64 size, bool zeroed = false);
+    // 接管已映射的文件：像素位于 base + offset，长度 size
+    PixelBuffer(QFile* file, uchar* base, qint64 offset, qint64 size);
+    // 深拷贝到堆内存（映射的存储也复制到堆上）
+    PixelBuffer(const PixelBuffer& other);
+    ~PixelBuffer();
+
+    unsigned char* data() const { return bytes; }
+    qint64 size() const { return length; }
+    bool isMapped() const { return file != nullptr; }
+
+private:
+    PixelBuffer& operator=(const PixelBuffer&) = delete;
+
+    unsigned char* bytes = nullptr;
+    qint64 length = 0;
+    QFile* file = nullptr;      // 映射时持有的文件，堆存储时为空
+    uchar* mapBase = nullptr;   // 映射区域的起始地址
+};
+
+#endif // PIXELBUFFER_H
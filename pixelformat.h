@@ -0,0 +1,79 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <QtGlobal>
+
+// 像素格式，通道均按 B、G、R、A 的顺序存放，16 位通道为本机字节序
+enum class PixelFormat {
+    Gray8,   // 8 位灰度
+    Bgr24,   // 8 位 BGR（BMP 的 24 位格式）
+    Bgra32,  // 8 位 BGRA（BMP 的 32 位格式）
+    Gray16,  // 16 位灰度
+    Bgr48    // 16 位 BGR
+};
+
+// 像素格式的编译期描述。算法以它为模板参数，用 if constexpr 为每种格式生成各自的内层循环，
+// 运行时只在每幅图像上按 PixelFormat 分派一次（dispatchPixelFormat）
+template <PixelFormat F, typename ChannelType, int ChannelCount, int ColorChannelCount>
+struct PixelFormatTraits {
+    using Channel = ChannelType;
+    static constexpr PixelFormat format = F;
+    static constexpr int channels = ChannelCount;            // 每像素的通道数
+    static constexpr int colorChannels = ColorChannelCount;  // 参与计算的颜色通道数，其余为 alpha
+    static constexpr bool hasAlpha = ChannelCount > ColorChannelCount;
+    static constexpr bool isGray = ColorChannelCount == 1;
+    static constexpr int bytesPerPixel = ChannelCount * int(sizeof(ChannelType));
+    static constexpr int maxValue = (1 << (8 * sizeof(ChannelType))) - 1;
+};
+
+using Gray8 = PixelFormatTraits<PixelFormat::Gray8, quint8, 1, 1>;
+using Bgr24 = PixelFormatTraits<PixelFormat::Bgr24, quint8, 3, 3>;
+using Bgra32 = PixelFormatTraits<PixelFormat::Bgra32, quint8, 4, 3>;
+using Gray16 = PixelFormatTraits<PixelFormat::Gray16, quint16, 1, 1>;
+using Bgr48 = PixelFormatTraits<PixelFormat::Bgr48, quint16, 3, 3>;
+
+// 以 format 对应的 traits 对象调用 fn，返回 fn 的结果
+template <typename Fn>
+auto dispatchPixelFormat(PixelFormat format, Fn&& fn) {
+    switch (format) {
+    case PixelFormat::Gray8:
+        return fn(Gray8());
+    case PixelFormat::Bgra32:
+        return fn(Bgra32());
+    case PixelFormat::Gray16:
+        return fn(Gray16());
+    case PixelFormat::Bgr48:
+        return fn(Bgr48());
+    case PixelFormat::Bgr24:
+        break;
+    }
+    return fn(Bgr24());
+}
+
+inline int bytesPerPixel(PixelFormat format) {
+    return dispatchPixelFormat(format, [](auto traits) { return decltype(traits)::bytesPerPixel; });
+}
+
+// 每行字节数（对齐到 4 字节，与 BMP 一致）
+inline qint64 pixelRowSize(PixelFormat format, qint64 width) {
+    return (width * bytesPerPixel(format) + 3) & ~qint64(3);
+}
+
+// 同位深的灰度格式
+inline PixelFormat grayFormat(PixelFormat format) {
+    return format == PixelFormat::Gray16 || format == PixelFormat::Bgr48 ? PixelFormat::Gray16 : PixelFormat::Gray8;
+}
+
+// 可以原样写成 BMP 的 8 位格式：16 位格式降为 8 位，其余不变
+inline PixelFormat bmpFormat(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::Gray16:
+        return PixelFormat::Gray8;
+    case PixelFormat::Bgr48:
+        return PixelFormat::Bgr24;
+    default:
+        return format;
+    }
+}
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,172 @@
+#include "planar.h"
+#include "bufferpool.h"
+#include "parallel.h"
+#include "simd.h"
+#include <cstring>
+
+namespace {
+
+void deinterleaveRowScalar(const unsigned char* src, int width, unsigned char* b, unsigned char* g, unsigned char* r) {
+    for (int x = 0; x < width; ++x, src += 3) {
+        b[x] = src[0];
+        g[x] = src[1];
+        r[x] = src[2];
+    }
+}
+
+void interleaveRowScalar(const unsigned char* b, const unsigned char* g, const unsigned char* r, int width,
+                         unsigned char* dst) {
+    for (int x = 0; x < width; ++x, dst += 3) {
+        dst[0] = b[x];
+        dst[1] = g[x];
+        dst[2] = r[x];
+    }
+}
+
+#if MYQIMAGE_X86_SIMD
+// 16 个像素占 48 字节，即三个 16 字节块。第 k 块的第 j 个字节是像素 (16k+j)/3 的第 (16k+j)%3 个通道：
+// 拆分时每个通道从三块中各 pshufb 出属于自己的字节再相或，合并时反过来从三个平面取字节拼出每一块。
+// 不属于该通道的位置用 0x80 使 pshufb 输出 0
+struct ShuffleMasks {
+    alignas(16) unsigned char split[3][3][16];  // [通道][输入块]
+    alignas(16) unsigned char merge[3][3][16];  // [输出块][通道]
+
+    ShuffleMasks() {
+        std::memset(split, 0x80, sizeof(split));
+        std::memset(merge, 0x80, sizeof(merge));
+        for (int i = 0; i < 48; ++i) {
+            int block = i / 16;
+            int channel = i % 3;
+            int pixel = i / 3;
+            split[channel][block][pixel] = static_cast<unsigned char>(i % 16);
+            merge[block][channel][i % 16] = static_cast<unsigned char>(pixel);
+        }
+    }
+};
+
+const ShuffleMasks& shuffleMasks() {
+    static const ShuffleMasks masks;
+    return masks;
+}
+
+inline __m128i loadMask(const unsigned char* mask) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+MYQIMAGE_TARGET_AVX2
+void deinterleaveRowAvx2(const unsigned char* src, int width, unsigned char* b, unsigned char* g, unsigned char* r) {
+    const ShuffleMasks& m = shuffleMasks();
+    __m128i split[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < 3; ++k) {
+            split[c][k] = loadMask(m.split[c][k]);
+        }
+    }
+    unsigned char* planes[3] = {b, g, r};
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(src + x * 3);
+        __m128i in0 = _mm_loadu_si128(p);
+        __m128i in1 = _mm_loadu_si128(p + 1);
+        __m128i in2 = _mm_loadu_si128(p + 2);
+        for (int c = 0; c < 3; ++c) {
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, split[c][0]), _mm_shuffle_epi8(in1, split[c][1])),
+                                     _mm_shuffle_epi8(in2, split[c][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[c] + x), v);
+        }
+    }
+    deinterleaveRowScalar(src + x * 3, width - x, b + x, g + x, r + x);
+}
+
+MYQIMAGE_TARGET_AVX2
+void interleaveRowAvx2(const unsigned char* b, const unsigned char* g, const unsigned char* r, int width,
+                       unsigned char* dst) {
+    const ShuffleMasks& m = shuffleMasks();
+    __m128i merge[3][3];
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            merge[k][c] = loadMask(m.merge[k][c]);
+        }
+    }
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        __m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + x));
+        __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + x));
+        __m128i* out = reinterpret_cast<__m128i*>(dst + x * 3);
+        for (int k = 0; k < 3; ++k) {
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(vb, merge[k][0]), _mm_shuffle_epi8(vg, merge[k][1])),
+                                     _mm_shuffle_epi8(vr, merge[k][2]));
+            _mm_storeu_si128(out + k, v);
+        }
+    }
+    interleaveRowScalar(b + x, g + x, r + x, width - x, dst + x * 3);
+}
+#endif
+
+}
+
+void deinterleaveBgr(const unsigned char* src, qint64 srcStride, int width, int rows,
+                     unsigned char* b, unsigned char* g, unsigned char* r, qint64 planeStride) {
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        for (int y = 0; y < rows; ++y) {
+            qint64 o = y * planeStride;
+            deinterleaveRowAvx2(src + y * srcStride, width, b + o, g + o, r + o);
+        }
+        return;
+    }
+#endif
+    for (int y = 0; y < rows; ++y) {
+        qint64 o = y * planeStride;
+        deinterleaveRowScalar(src + y * srcStride, width, b + o, g + o, r + o);
+    }
+}
+
+void interleaveBgr(const unsigned char* b, const unsigned char* g, const unsigned char* r, qint64 planeStride,
+                   int width, int rows, unsigned char* dst, qint64 dstStride) {
+#if MYQIMAGE_X86_SIMD
+    if (simdAvx2Enabled()) {
+        for (int y = 0; y < rows; ++y) {
+            qint64 o = y * planeStride;
+            interleaveRowAvx2(b + o, g + o, r + o, width, dst + y * dstStride);
+        }
+        return;
+    }
+#endif
+    for (int y = 0; y < rows; ++y) {
+        qint64 o = y * planeStride;
+        interleaveRowScalar(b + o, g + o, r + o, width, dst + y * dstStride);
+    }
+}
+
+PlanarBuffer::PlanarBuffer(int width, int height)
+    : width(width), height(height), stride((qint64(width) + 63) & ~qint64(63)) {
+    bytes = static_cast<unsigned char*>(BufferPool::instance().allocate(3 * stride * height));
+}
+
+PlanarBuffer::PlanarBuffer(const PlanarBuffer& other)
+    : QSharedData(other), width(other.width), height(other.height), stride(other.stride) {
+    bytes = static_cast<unsigned char*>(BufferPool::instance().allocate(3 * stride * height));
+    std::memcpy(bytes, other.bytes, size_t(3 * stride * height));
+}
+
+PlanarBuffer::~PlanarBuffer() {
+    BufferPool::instance().release(bytes, 3 * stride * height);
+}
+
+void PlanarBuffer::fromInterleaved(const unsigned char* src, qint64 srcStride, int threads) {
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        qint64 o = y0 * stride;
+        deinterleaveBgr(src + y0 * srcStride, srcStride, width, y1 - y0, plane(0) + o, plane(1) + o, plane(2) + o, stride);
+    }, parallelRowThreads(height, threads));
+}
+
+void PlanarBuffer::toInterleaved(unsigned char* dst, qint64 dstStride, int threads) const {
+    parallelFor(0, height, [&](int, int y0, int y1) {
+        qint64 o = y0 * stride;
+        interleaveBgr(plane(0) + o, plane(1) + o, plane(2) + o, stride, width, y1 - y0, dst + y0 * dstStride, dstStride);
+    }, parallelRowThreads(height, threads));
+}
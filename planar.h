@@ -0,0 +1,52 @@
+#ifndef PLANAR_H
+#define PLANAR_H
+
+#include <QtGlobal>
+#include <QSharedData>
+
+// 像素在内存中的布局
+enum class PixelLayout {
+    Interleaved,  // 交错的 BGR，每像素 3 字节（BMP 的布局）
+    Planar        // B、G、R 三个独立的通道平面
+};
+
+// 平面（SoA）像素存储：B、G、R 三个平面连续存放在一块 64 字节对齐的内存中，
+// 每个平面的行宽向上取整到 64 字节，行序与 MyQImage 的交错存储一致（自下而上）。
+// 与 PixelBuffer 一样经 QExplicitlySharedDataPointer 共享，写入前复制
+class PlanarBuffer : public QSharedData {
+public:
+    PlanarBuffer(int width, int height);
+    // 深拷贝
+    PlanarBuffer(const PlanarBuffer& other);
+    ~PlanarBuffer();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // 平面内相邻两行的字节数（64 的倍数）
+    qint64 getStride() const { return stride; }
+    // 第 channel 个平面：0 为 B，1 为 G，2 为 R
+    unsigned char* plane(int channel) const { return bytes + channel * stride * height; }
+
+    // 由交错的 BGR 像素（srcStride 为每行字节数）填充三个平面
+    void fromInterleaved(const unsigned char* src, qint64 srcStride, int threads = 0);
+    // 写回交错的 BGR 像素，行尾的填充字节不写
+    void toInterleaved(unsigned char* dst, qint64 dstStride, int threads = 0) const;
+
+private:
+    PlanarBuffer& operator=(const PlanarBuffer&) = delete;
+
+    int width = 0;
+    int height = 0;
+    qint64 stride = 0;
+    unsigned char* bytes = nullptr;
+};
+
+// 交错 BGR 拆分为三个平面；支持 AVX2 时每次用 pshufb 重排 16 个像素，否则走标量路径
+void deinterleaveBgr(const unsigned char* src, qint64 srcStride, int width, int rows,
+                     unsigned char* b, unsigned char* g, unsigned char* r, qint64 planeStride);
+
+// 三个平面合并为交错 BGR
+void interleaveBgr(const unsigned char* b, const unsigned char* g, const unsigned char* r, qint64 planeStride,
+                   int width, int rows, unsigned char* dst, qint64 dstStride);
+
+#endif // PLANAR_H
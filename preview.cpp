@@ -0,0 +1,118 @@
+#include "preview.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+void PreviewSession::setSource(const MyQImage& full, const QSize& displaySize) {
+    this->full = full;
+    this->displaySize = displaySize;
+    committed.clear();
+    rebuild();
+}
+
+bool PreviewSession::resize(const QSize& displaySize) {
+    this->displaySize = displaySize;
+    if (states.isEmpty()) {
+        return false;
+    }
+    // 代理已经是原图尺寸，或者仍然至少与显示尺寸一样大时只需缩放显示
+    const MyQImage& base = states.first();
+    if (base.getWidth() == full.getWidth() && base.getHeight() == full.getHeight()) {
+        return false;
+    }
+    if (base.getWidth() >= displaySize.width() || base.getHeight() >= displaySize.height()) {
+        return false;
+    }
+    rebuild();
+    return true;
+}
+
+void PreviewSession::discardPending() {
+    operations.clear();
+    if (!states.isEmpty()) {
+        states.resize(1);
+    }
+}
+
+bool PreviewSession::apply(const ImageJobRequest& request) {
+    if (states.isEmpty()) {
+        return false;
+    }
+    MYQIMAGE_TRACE_SCOPE("PreviewSession::apply");
+    MyQImage result = states.last();
+    if (!runOnProxy(request, result)) {
+        return false;
+    }
+    operations.append(request);
+    states.append(result);
+    return true;
+}
+
+bool PreviewSession::replaceLast(const ImageJobRequest& request) {
+    if (operations.isEmpty() || operations.last().type != request.type) {
+        return false;
+    }
+    if (operations.last() == request) {
+        return true;
+    }
+    MyQImage result = states[states.size() - 2];
+    if (!runOnProxy(request, result)) {
+        return false;
+    }
+    operations.last() = request;
+    states.last() = result;
+    return true;
+}
+
+bool PreviewSession::undoLast() {
+    if (operations.isEmpty()) {
+        return false;
+    }
+    operations.removeLast();
+    states.removeLast();
+    return true;
+}
+
+QVector<ImageJobRequest> PreviewSession::takePending() {
+    QVector<ImageJobRequest> taken = operations;
+    for (int i = 0; i < taken.size(); ++i) {
+        if (taken[i].type == ImageJobType::Segment && taken[i].initialCenters.isEmpty()) {
+            taken[i].initialCenters = states[i + 1].getSegmentCenters();
+        }
+        committed.append(taken[i]);
+    }
+    operations.clear();
+    states.remove(0, states.size() - 1);
+    return taken;
+}
+
+bool PreviewSession::runOnProxy(const ImageJobRequest& request, MyQImage& proxy) const {
+    if ((request.type != ImageJobType::Median && request.type != ImageJobType::Bilateral)
+        || full.getWidth() <= 0 || proxy.getWidth() >= full.getWidth()) {
+        return ImageJobRunner::runJob(request, proxy);
+    }
+    ImageJobRequest scaled = request;
+    scaled.radius = std::max(1, int(std::lround(request.radius * double(proxy.getWidth()) / full.getWidth())));
+    return ImageJobRunner::runJob(scaled, proxy);
+}
+
+void PreviewSession::rebuild() {
+    states.clear();
+    if (!full.getPixels() || displaySize.isEmpty()) {
+        return;
+    }
+    MyQImage base = full.scaledToFit(displaySize);
+    for (const ImageJobRequest& request : committed) {
+        runOnProxy(request, base);
+    }
+    states.append(base);
+    // 重放失败（例如格式不支持的操作）的那一步及之后的操作一并丢弃
+    for (int i = 0; i < operations.size(); ++i) {
+        MyQImage result = states.last();
+        if (!runOnProxy(operations[i], result)) {
+            operations.resize(i);
+            break;
+        }
+        states.append(result);
+    }
+}
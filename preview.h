@@ -0,0 +1,59 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <QSize>
+#include <QVector>
+#include "myqimage.h"
+#include "imagejobs.h"
+
+// 交互预览：操作先在与显示区域同尺寸的代理图像上同步执行（毫秒级），
+// 原尺寸的结果推迟到需要时（保存、关闭预览）才由 takePending 交给后台计算。
+// 代理上每一步的结果都保留（像素写时复制），修改最后一步的参数或撤销时只重算代理上的这一步
+class PreviewSession {
+public:
+    // 设置原尺寸图像（加载、后台计算完成或历史跳转之后）：按 displaySize 重建代理并重放尚未提交的操作；
+    // 之前交给原尺寸计算的操作视为已包含在 full 中
+    void setSource(const MyQImage& full, const QSize& displaySize);
+
+    // 显示区域变化：代理比新的显示尺寸小（放大显示）时按新尺寸重建并重放；返回代理是否重建
+    bool resize(const QSize& displaySize);
+
+    // 丢弃所有未提交的操作，代理回到原尺寸图像的缩小结果
+    void discardPending();
+
+    bool isValid() const { return !states.isEmpty(); }
+    bool hasPending() const { return !operations.isEmpty(); }
+    const QVector<ImageJobRequest>& getPending() const { return operations; }
+
+    // 当前的代理结果
+    const MyQImage& getProxy() const { return states.last(); }
+
+    // 在代理上执行一个操作并记为未提交。重复的操作（例如连续两次锐化）各执行一次，
+    // 提交时逐个排队且不合并，原尺寸结果与代理一致
+    bool apply(const ImageJobRequest& request);
+
+    // 替换最后一个未提交操作的参数（例如界面上的 K 改变），只在代理上重新执行这一步；
+    // 没有同类型的未提交操作时返回 false
+    bool replaceLast(const ImageJobRequest& request);
+
+    // 撤销最后一个未提交的操作
+    bool undoLast();
+
+    // 取出所有未提交的操作交给原尺寸计算，分割操作带上代理上得到的聚类中心作为初始中心。
+    // 代理保持当前结果，原尺寸结果就绪后调用 setSource 同步
+    QVector<ImageJobRequest> takePending();
+
+private:
+    // 由原尺寸图像重建代理，依次重放 committed 与 operations
+    void rebuild();
+    // 在代理上执行 request：去噪半径按代理的缩小比例缩小，预览效果接近原尺寸
+    bool runOnProxy(const ImageJobRequest& request, MyQImage& proxy) const;
+
+    MyQImage full;
+    QSize displaySize;
+    QVector<ImageJobRequest> committed;   // 已交给原尺寸计算、结果尚未就绪的操作
+    QVector<ImageJobRequest> operations;  // 只在代理上执行过的操作
+    QVector<MyQImage> states;  // states[0] 为缩小后的原图，states[i + 1] 为执行第 i 个操作之后
+};
+
+#endif // PREVIEW_H
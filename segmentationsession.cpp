@@ -0,0 +1,389 @@
+#include "segmentationsession.h"
+#include "jobcontrol.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const quint64 kPrime1 = 0x9E3779B185EBCA87ull;
+const quint64 kPrime2 = 0xC2B2AE3D27D4EB4Full;
+
+inline quint64 rotateLeft(quint64 v, int bits) {
+    return (v << bits) | (v >> (64 - bits));
+}
+
+inline quint64 mixWord(quint64 lane, quint64 word) {
+    return rotateLeft(lane + word * kPrime2, 31) * kPrime1;
+}
+
+// 由簇号重新统计每簇的像素数、颜色和与平方和，得到簇内平方误差
+void computeStatistics(const unsigned char* pixels, int width, int height, qint64 rowSize,
+                       SegmentationModel& model, int threads) {
+    const int K = model.K;
+    threads = parallelRowThreads(height, threads);
+    std::vector<std::vector<qint64>> partial(threads, std::vector<qint64>(size_t(K) * 7, 0));
+    parallelFor(0, height, [&](int t, int y0, int y1) {
+        // 每簇 7 项：像素数、B、G、R 之和、B、G、R 平方和
+        qint64* stats = partial[t].data();
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char* p = pixels + y * rowSize;
+            const unsigned char* label = model.labels.data() + qint64(y) * width;
+            for (int x = 0; x < width; ++x, p += 3) {
+                qint64* s = stats + label[x] * 7;
+                s[0]++;
+                s[1] += p[0];
+                s[2] += p[1];
+                s[3] += p[2];
+                s[4] += p[0] * p[0];
+                s[5] += p[1] * p[1];
+                s[6] += p[2] * p[2];
+            }
+        }
+    }, threads);
+
+    model.result.counts.fill(0, K);
+    model.result.sums.fill(0, K * 3);
+    model.sumSquares.fill(0, K * 3);
+    for (const std::vector<qint64>& stats : partial) {
+        for (int k = 0; k < K; ++k) {
+            model.result.counts[k] += stats[k * 7];
+            for (int c = 0; c < 3; ++c) {
+                model.result.sums[k * 3 + c] += stats[k * 7 + 1 + c];
+                model.sumSquares[k * 3 + c] += stats[k * 7 + 4 + c];
+            }
+        }
+    }
+    // sum |p - c|^2 = sum p^2 - 2 c sum p + n c^2
+    model.inertia = 0;
+    for (int k = 0; k < K; ++k) {
+        const KMeansCenter& center = model.result.centers[k];
+        const int channel[3] = {center.b, center.g, center.r};
+        for (int c = 0; c < 3; ++c) {
+            model.inertia += double(model.sumSquares[k * 3 + c]) - 2.0 * channel[c] * model.result.sums[k * 3 + c]
+                             + double(model.result.counts[k]) * channel[c] * channel[c];
+        }
+    }
+}
+
+inline int clampChannel(double v) {
+    return std::max(0, std::min(255, int(std::lround(v))));
+}
+
+// K -> K+1：把簇内平方误差最大的簇沿方差最大的通道一分为二，中心为均值加减一个标准差
+QVector<KMeansCenter> splitCluster(const SegmentationModel& model) {
+    const int K = model.K;
+    int worst = 0;
+    double worstError = -1;
+    for (int k = 0; k < K; ++k) {
+        const qint64 n = model.result.counts[k];
+        if (n == 0) {
+            continue;
+        }
+        double error = 0;
+        for (int c = 0; c < 3; ++c) {
+            const double sum = double(model.result.sums[k * 3 + c]);
+            error += double(model.sumSquares[k * 3 + c]) - sum * sum / n;
+        }
+        if (error > worstError) {
+            worstError = error;
+            worst = k;
+        }
+    }
+
+    QVector<KMeansCenter> centers = model.result.centers;
+    const qint64 n = std::max<qint64>(1, model.result.counts[worst]);
+    double mean[3];
+    double deviation[3];
+    for (int c = 0; c < 3; ++c) {
+        mean[c] = double(model.result.sums[worst * 3 + c]) / n;
+        deviation[c] = std::sqrt(std::max(0.0, double(model.sumSquares[worst * 3 + c]) / n - mean[c] * mean[c]));
+    }
+    const int axis = int(std::max_element(deviation, deviation + 3) - deviation);
+    const double step = std::max(1.0, deviation[axis]);
+    double low[3] = {mean[0], mean[1], mean[2]};
+    double high[3] = {mean[0], mean[1], mean[2]};
+    low[axis] -= step;
+    high[axis] += step;
+    centers[worst].b = clampChannel(low[0]);
+    centers[worst].g = clampChannel(low[1]);
+    centers[worst].r = clampChannel(low[2]);
+    KMeansCenter added;
+    added.b = clampChannel(high[0]);
+    added.g = clampChannel(high[1]);
+    added.r = clampChannel(high[2]);
+    centers.append(added);
+    return centers;
+}
+
+// K -> K-1：合并 Ward 代价 n_a n_b / (n_a + n_b) |m_a - m_b|^2 最小的两簇（空簇代价为 0，优先去掉）
+QVector<KMeansCenter> mergeClusters(const SegmentationModel& model) {
+    const int K = model.K;
+    const QVector<KMeansCenter>& centers = model.result.centers;
+    int bestA = 0;
+    int bestB = 1;
+    double bestCost = std::numeric_limits<double>::max();
+    for (int a = 0; a < K; ++a) {
+        for (int b = a + 1; b < K; ++b) {
+            const double na = double(model.result.counts[a]);
+            const double nb = double(model.result.counts[b]);
+            const double db = centers[a].b - centers[b].b;
+            const double dg = centers[a].g - centers[b].g;
+            const double dr = centers[a].r - centers[b].r;
+            const double cost = na + nb > 0 ? na * nb / (na + nb) * (db * db + dg * dg + dr * dr) : 0;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestA = a;
+                bestB = b;
+            }
+        }
+    }
+
+    QVector<KMeansCenter> merged = centers;
+    const qint64 n = model.result.counts[bestA] + model.result.counts[bestB];
+    if (n > 0) {
+        merged[bestA].b = clampChannel(double(model.result.sums[bestA * 3] + model.result.sums[bestB * 3]) / n);
+        merged[bestA].g = clampChannel(double(model.result.sums[bestA * 3 + 1] + model.result.sums[bestB * 3 + 1]) / n);
+        merged[bestA].r = clampChannel(double(model.result.sums[bestA * 3 + 2] + model.result.sums[bestB * 3 + 2]) / n);
+    }
+    merged.remove(bestB);
+    return merged;
+}
+
+}
+
+SegmentationSession::SegmentationSession(qint64 cacheBudget) : cacheBudget(cacheBudget) {}
+
+void SegmentationSession::setCacheBudget(qint64 bytes) {
+    QMutexLocker locker(&mutex);
+    cacheBudget = bytes;
+}
+
+quint64 SegmentationSession::contentHash(const MyQImage& image) {
+    const unsigned char* pixels = image.getPixels();
+    quint64 hash = kPrime1 ^ (quint64(quint32(image.getWidth())) << 32 | quint32(image.getHeight()));
+    hash = mixWord(hash, quint64(image.getFormat()));
+    if (!pixels) {
+        return hash;
+    }
+    const qint64 rowBytes = qint64(image.getWidth()) * bytesPerPixel(image.getFormat());
+    for (int y = 0; y < image.getHeight(); ++y) {
+        const unsigned char* row = pixels + qint64(y) * image.getRowSize();
+        // 四路独立累加，乘法链互不依赖
+        quint64 lanes[4] = {hash, hash + kPrime2, hash ^ kPrime1, hash - kPrime1};
+        qint64 i = 0;
+        for (; i + 32 <= rowBytes; i += 32) {
+            for (int l = 0; l < 4; ++l) {
+                quint64 word;
+                std::memcpy(&word, row + i + l * 8, sizeof(word));
+                lanes[l] = mixWord(lanes[l], word);
+            }
+        }
+        quint64 tail = 0;
+        for (; i < rowBytes; ++i) {
+            tail = (tail << 8) | row[i];
+        }
+        hash = mixWord(rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12)
+                           + rotateLeft(lanes[3], 18),
+                       tail);
+    }
+    return hash;
+}
+
+void SegmentationSession::setSource(const MyQImage& image) {
+    const quint64 hash = contentHash(image);
+    if (source.getPixels() && (hash == sourceHash || hash == renderedHash)) {
+        return;
+    }
+    source = image;
+    sourceHash = hash;
+    renderedHash = 0;
+}
+
+std::shared_ptr<const SegmentationModel> SegmentationSession::find(int K, const KMeansOptions& options) {
+    QMutexLocker locker(&mutex);
+    for (CacheEntry& entry : cache) {
+        if (entry.hash == sourceHash && entry.K == K && entry.engine == options.engine
+            && entry.colorBits == options.colorBits) {
+            entry.lastUsed = ++useCounter;
+            return entry.model;
+        }
+    }
+    return nullptr;
+}
+
+void SegmentationSession::insert(const KMeansOptions& options, const std::shared_ptr<const SegmentationModel>& model) {
+    QMutexLocker locker(&mutex);
+    CacheEntry entry = {sourceHash, model->K, options.engine, options.colorBits, ++useCounter, model};
+    cache.push_back(entry);
+    // 超出预算时丢弃最久未使用的结果，刚加入的结果总是保留
+    qint64 total = 0;
+    for (const CacheEntry& cached : cache) {
+        total += cached.model->labels.size();
+    }
+    while (total > cacheBudget && cache.size() > 1) {
+        auto oldest = std::min_element(cache.begin(), cache.end(), [](const CacheEntry& a, const CacheEntry& b) {
+            return a.lastUsed < b.lastUsed;
+        });
+        total -= oldest->model->labels.size();
+        cache.erase(oldest);
+    }
+}
+
+std::shared_ptr<SegmentationModel> SegmentationSession::compute(const KMeansOptions& options) const {
+    MYQIMAGE_TRACE_SCOPE("SegmentationSession::compute");
+    const int width = source.getWidth();
+    const int height = source.getHeight();
+    std::shared_ptr<SegmentationModel> model = std::make_shared<SegmentationModel>();
+    model->K = options.K;
+    model->labels = PooledBuffer(qint64(width) * height);
+    model->result = KMeans::segment(source.getPixels(), width, height, source.getRowSize(), options,
+                                    model->labels.data());
+    if (model->result.cancelled || model->result.invalid) {
+        return nullptr;
+    }
+    computeStatistics(source.getPixels(), width, height, source.getRowSize(), *model, options.threads);
+    return model;
+}
+
+std::shared_ptr<const SegmentationModel> SegmentationSession::segment(const KMeansOptions& options) {
+    if (!source.getPixels() || source.getFormat() != PixelFormat::Bgr24 || !KMeans::isValidK(options.K)) {
+        return nullptr;
+    }
+    const int K = options.K;
+    std::shared_ptr<const SegmentationModel> cached = find(K, options);
+    if (cached) {
+        return cached;
+    }
+
+    KMeansOptions run = options;
+    run.K = K;
+    bool warm = false;
+    if (run.initialCenters.size() != K) {
+        std::shared_ptr<const SegmentationModel> smaller = K > 1 ? find(K - 1, options) : nullptr;
+        std::shared_ptr<const SegmentationModel> larger = K < KMeans::kMaxClusters ? find(K + 1, options) : nullptr;
+        if (smaller) {
+            run.initialCenters = splitCluster(*smaller);
+            warm = true;
+        } else if (larger) {
+            run.initialCenters = mergeClusters(*larger);
+            warm = true;
+        }
+    }
+    std::shared_ptr<SegmentationModel> model = compute(run);
+    if (!model) {
+        return nullptr;
+    }
+    model->warmStarted = warm;
+    insert(options, model);
+    return model;
+}
+
+QVector<SegmentationSweepPoint> SegmentationSession::sweep(int minK, int maxK, const KMeansOptions& options,
+                                                           int threads, JobControl* control) {
+    QVector<SegmentationSweepPoint> points;
+    if (!source.getPixels() || source.getFormat() != PixelFormat::Bgr24 || !KMeans::isValidK(minK)
+        || !KMeans::isValidK(maxK) || minK > maxK) {
+        return points;
+    }
+    const int count = maxK - minK + 1;
+    const int workers = std::min(parallelThreadCount(threads), count);
+    std::vector<SegmentationSweepPoint> results(count);
+    std::vector<char> done(count, 0);
+    if (control) {
+        control->beginStage(0, 100, count);
+    }
+    // 每个工作线程按步长 workers 交错领取 K，大小 K 混在一起，各线程的工作量接近
+    parallelFor(0, workers, [&](int, int w0, int w1) {
+        for (int worker = w0; worker < w1; ++worker) {
+            for (int i = worker; i < count; i += workers) {
+                if (control && control->isCancelled()) {
+                    return;
+                }
+                KMeansOptions run = options;
+                run.K = minK + i;
+                run.threads = 1;
+                run.control = nullptr;
+                run.initialCenters.clear();
+                std::shared_ptr<const SegmentationModel> model = find(run.K, run);
+                if (!model) {
+                    std::shared_ptr<SegmentationModel> computed = compute(run);
+                    insert(run, computed);
+                    model = computed;
+                }
+                results[i].K = run.K;
+                results[i].inertia = model->inertia;
+                results[i].iterations = model->result.iterations;
+                done[i] = 1;
+                if (control) {
+                    control->advance(1);
+                }
+            }
+        }
+    }, workers);
+
+    for (int i = 0; i < count; ++i) {
+        if (done[i]) {
+            points.append(results[i]);
+        }
+    }
+    return points;
+}
+
+bool SegmentationSession::segmentImage(MyQImage& image, JobControl* control) {
+    MYQIMAGE_TRACE_SCOPE("SegmentationSession::segmentImage");
+    if (!image.getPixels() || image.getFormat() != PixelFormat::Bgr24) {
+        return false;
+    }
+    setSource(image);
+    if (source.getWidth() != image.getWidth() || source.getHeight() != image.getHeight()) {
+        return false;
+    }
+    KMeansOptions options = image.getSegmentationOptions();
+    options.control = control;
+    if (control) {
+        // 与 MyQImage::segmentImage 相同，按最大迭代次数推进；命中缓存时直接完成
+        control->beginStage(0, 100, options.maxIterations);
+    }
+    std::shared_ptr<const SegmentationModel> model = segment(options);
+    if (!model) {
+        return false;
+    }
+    KMeans::recolor(image.getMutablePixels(), image.getWidth(), image.getHeight(), image.getRowSize(),
+                    model->labels.data(), model->result.centers);
+    image.setSegmentResult(model->result.centers, std::shared_ptr<const PooledBuffer>(model, &model->labels));
+    renderedHash = contentHash(image);
+    return true;
+}
+
+ComponentResult SegmentationSession::regions(const KMeansOptions& options, const ComponentOptions& componentOptions) {
+    if (!KMeans::isValidK(options.K)) {
+        return ComponentResult();
+    }
+    std::shared_ptr<const SegmentationModel> model = segment(options);
+    if (!model) {
+        ComponentResult result;
+        result.cancelled = true;
+        return result;
+    }
+    ComponentOptions regionOptions = componentOptions;
+    regionOptions.bottomUp = true;
+    return ConnectedComponents::label(model->labels.data(), source.getWidth(), source.getHeight(), source.getWidth(),
+                                      source.getPixels(), source.getRowSize(), regionOptions);
+}
+
+void SegmentationSession::clear() {
+    QMutexLocker locker(&mutex);
+    cache.clear();
+    source = MyQImage();
+    sourceHash = 0;
+    renderedHash = 0;
+}
+
+int SegmentationSession::cachedCount() const {
+    QMutexLocker locker(&mutex);
+    return int(cache.size());
+}
@@ -0,0 +1,94 @@
+#ifndef SEGMENTATIONSESSION_H
+#define SEGMENTATIONSESSION_H
+
+#include <QMutex>
+#include <QVector>
+#include <memory>
+#include <vector>
+#include "bufferpool.h"
+#include "kmeans.h"
+#include "myqimage.h"
+
+class JobControl;
+
+// 一次分割的最终结果：最后一次迭代的中心、每簇的像素数与颜色和、每个像素的簇号，
+// 以及选择 K 用的簇内平方误差。counts、sums 与 sumSquares 由 labels 重新统计，三者一致
+struct SegmentationModel {
+    int K = 0;
+    KMeansResult result;         // centers、counts、sums（长度 3K）与迭代次数
+    QVector<qint64> sumSquares;  // 每簇 B、G、R 的平方和，长度 3K
+    double inertia = 0;          // 所有像素到所属中心的距离平方和
+    PooledBuffer labels;         // width*height 字节，按行优先记录每个像素的簇号
+    bool warmStarted = false;    // 初始中心由相邻 K 的结果分裂或合并得到
+};
+
+// 扫描 K 时每个 K 的结果摘要
+struct SegmentationSweepPoint {
+    int K = 0;
+    double inertia = 0;
+    int iterations = 0;
+};
+
+// 分割会话：在同一幅原图上尝试不同的 K。
+// 结果按（图像内容哈希、K、引擎、颜色位数）缓存；K 变为 K±1 时由缓存中相邻 K 的结果
+// 分裂误差最大的簇或合并代价最小的两簇作为初始中心，通常几次迭代即可收敛。
+// 只支持 Bgr24；segment 与 segmentImage 不能在多个线程中同时调用，sweep 内部自行并行
+class SegmentationSession {
+public:
+    explicit SegmentationSession(qint64 cacheBudget = qint64(256) * 1024 * 1024);
+
+    // 缓存的簇号占用的内存上限，超出时丢弃最久未使用的结果（至少保留一个）
+    void setCacheBudget(qint64 bytes);
+
+    // 设置原图。image 与上一次 segmentImage 写出的结果内容相同时保留原来的原图，
+    // 即以新的 K 重新分割原图，而不是分割已经分割过的图像
+    void setSource(const MyQImage& image);
+    const MyQImage& getSource() const { return source; }
+
+    // 按 options 分割原图（options.K 为簇数）：命中缓存时直接返回；给定初始中心时使用给定的中心，
+    // 否则缓存中有 K-1 或 K+1 的结果时热启动。K 超出 [1, KMeans::kMaxClusters] 或被取消时返回空指针
+    std::shared_ptr<const SegmentationModel> segment(const KMeansOptions& options);
+
+    // 并行扫描 [minK, maxK]：多个 K 同时计算、每个 K 单线程，已缓存的 K 不再计算，结果进入缓存。
+    // 返回按 K 排列的簇内平方误差曲线，可按"肘部"选择 K；被取消时只含已完成的 K，范围超出 [1, KMeans::kMaxClusters] 时为空
+    QVector<SegmentationSweepPoint> sweep(int minK, int maxK, const KMeansOptions& options, int threads = 0,
+                                          JobControl* control = nullptr);
+
+    // 以 image 设置原图并按 image 的分割参数分割，把 image 的像素替换为所属簇中心的颜色；
+    // image 开启了保留簇号时与缓存共享簇号，不复制
+    bool segmentImage(MyQImage& image, JobControl* control = nullptr);
+
+    // 分割原图并标记连通区域，平均颜色取自原图（自上而下的图像坐标）
+    ComponentResult regions(const KMeansOptions& options, const ComponentOptions& componentOptions = ComponentOptions());
+
+    void clear();
+    int cachedCount() const;
+
+    // 有效像素（不含行尾填充）、尺寸与格式的 64 位哈希
+    static quint64 contentHash(const MyQImage& image);
+
+private:
+    struct CacheEntry {
+        quint64 hash;
+        int K;
+        KMeansEngine engine;
+        int colorBits;
+        quint64 lastUsed;
+        std::shared_ptr<const SegmentationModel> model;
+    };
+
+    std::shared_ptr<const SegmentationModel> find(int K, const KMeansOptions& options);
+    void insert(const KMeansOptions& options, const std::shared_ptr<const SegmentationModel>& model);
+    // 在原图上执行一次 K-means 并统计各簇数据；被取消时返回空指针
+    std::shared_ptr<SegmentationModel> compute(const KMeansOptions& options) const;
+
+    MyQImage source;
+    quint64 sourceHash = 0;
+    quint64 renderedHash = 0;  // 上一次 segmentImage 写出的结果
+    qint64 cacheBudget;
+    quint64 useCounter = 0;
+    std::vector<CacheEntry> cache;
+    mutable QMutex mutex;  // 保护 cache，sweep 的工作线程会并发读写
+};
+
+#endif // SEGMENTATIONSESSION_H
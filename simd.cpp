@@ -0,0 +1,26 @@
+#include "simd.h"
+#include <atomic>
+
+namespace {
+
+bool detectAvx2() {
+#if MYQIMAGE_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+std::atomic<bool> simdEnabled(true);
+
+}
+
+bool simdAvx2Enabled() {
+    static const bool available = detectAvx2();
+    return available && simdEnabled.load(std::memory_order_relaxed);
+}
+
+void setSimdEnabled(bool enabled) {
+    simdEnabled.store(enabled, std::memory_order_relaxed);
+}
@@ -0,0 +1,21 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// x86 上使用 GCC/Clang 的 target 属性按函数启用 AVX2，运行时再按 CPU 能力分派，
+// 因此整个工程无需以 -mavx2 编译，在不支持的 CPU 上自动走标量路径
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MYQIMAGE_X86_SIMD 1
+#define MYQIMAGE_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#else
+#define MYQIMAGE_X86_SIMD 0
+#define MYQIMAGE_TARGET_AVX2
+#endif
+
+// 当前 CPU 支持 AVX2 且未被 setSimdEnabled(false) 关闭
+bool simdAvx2Enabled();
+
+// 关闭后所有内核都走标量路径（用于对比结果与性能）
+void setSimdEnabled(bool enabled);
+
+#endif // SIMD_H
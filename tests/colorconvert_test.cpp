@@ -0,0 +1,229 @@
+#include "../colorconvert.h"
+#include "../myqimage.h"
+#include "../simd.h"
+
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// ColorConvert 的精度与一致性测试：
+// 1. 全部 2^24 种 BGR 输入的灰度与浮点加权公式、HSV 与 MyQImage 的浮点参照 rgbToHSV 比较，误差不超过给定上限，
+//    灰度还须与 MyQImage::rgbToGray 完全相同；
+// 2. 全部 180x256x256 种 HSV 输入转回 BGR，与 hsvToRGB 比较；
+// 3. 各颜色空间正反变换的标量路径与 AVX2 路径逐位相同（CPU 不支持 AVX2 时跳过）。
+// 全部通过时返回 0
+
+namespace {
+
+// 误差上限（8 位平面的量化单位，H 为度）
+const int kGrayTolerance = 1;
+const double kHueToleranceDegrees = 2.0;
+const int kSaturationTolerance = 1;
+const int kHsvInverseTolerance = 1;
+const int kYCbCrTolerance = 1;
+const double kLabTolerance = 2.0;
+
+// 4096 x 4096 正好覆盖全部 2^24 种颜色：x 的低 8 位为 B，y 的低 8 位为 G，(y >> 8) * 16 + (x >> 8) 为 R
+const int kCubeSide = 4096;
+
+int failures = 0;
+
+void expect(bool ok, const QString& what) {
+    QTextStream out(stdout);
+    out << (ok ? "PASS " : "FAIL ") << what << Qt::endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+std::vector<unsigned char> colorCube() {
+    std::vector<unsigned char> pixels(size_t(kCubeSide) * kCubeSide * 3);
+    for (int y = 0; y < kCubeSide; ++y) {
+        unsigned char* p = pixels.data() + size_t(y) * kCubeSide * 3;
+        for (int x = 0; x < kCubeSide; ++x, p += 3) {
+            p[0] = static_cast<unsigned char>(x & 0xFF);
+            p[1] = static_cast<unsigned char>(y & 0xFF);
+            p[2] = static_cast<unsigned char>((y >> 8) * 16 + (x >> 8));
+        }
+    }
+    return pixels;
+}
+
+struct Planes {
+    std::vector<unsigned char> c[3];
+
+    explicit Planes(size_t size) {
+        for (std::vector<unsigned char>& plane : c) {
+            plane.assign(size, 0);
+        }
+    }
+    bool operator==(const Planes& other) const {
+        return c[0] == other.c[0] && c[1] == other.c[1] && c[2] == other.c[2];
+    }
+};
+
+Planes forward(ColorSpace space, const std::vector<unsigned char>& pixels, int width, int height) {
+    Planes planes(size_t(width) * height);
+    ColorConvert::bgrToPlanes(space, pixels.data(), qint64(width) * 3, width, height, planes.c[0].data(),
+                              planes.c[1].data(), planes.c[2].data(), width);
+    return planes;
+}
+
+std::vector<unsigned char> inverse(ColorSpace space, const Planes& planes, int width, int height) {
+    std::vector<unsigned char> pixels(size_t(width) * height * 3);
+    ColorConvert::planesToBgr(space, planes.c[0].data(), planes.c[1].data(), planes.c[2].data(), width, width, height,
+                              pixels.data(), qint64(width) * 3);
+    return pixels;
+}
+
+std::vector<unsigned char> gray(const std::vector<unsigned char>& pixels, int width, int height) {
+    std::vector<unsigned char> result(size_t(width) * height);
+    ColorConvert::bgrToGray(pixels.data(), qint64(width) * 3, width, height, result.data(), width);
+    return result;
+}
+
+// CIE L*a*b*（sRGB，D65），与 ColorConvert 使用相同的常数
+void referenceLab(int b, int g, int r, double& l, double& a, double& bb) {
+    auto linear = [](int c) {
+        double v = c / 255.0;
+        return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+    };
+    auto f = [](double t) { return t > 0.008856 ? std::cbrt(t) : 7.787 * t + 16.0 / 116.0; };
+    const double lr = linear(r), lg = linear(g), lb = linear(b);
+    const double x = (0.412453 * lr + 0.357580 * lg + 0.180423 * lb) / 0.950456;
+    const double y = 0.212671 * lr + 0.715160 * lg + 0.072169 * lb;
+    const double z = (0.019334 * lr + 0.119193 * lg + 0.950227 * lb) / 1.088754;
+    l = 116 * f(y) - 16;
+    a = 500 * (f(x) - f(y));
+    bb = 200 * (f(y) - f(z));
+}
+
+void testForward(const std::vector<unsigned char>& cube) {
+    QTextStream out(stdout);
+    MyQImage reference;
+    const std::vector<unsigned char> grayPlane = gray(cube, kCubeSide, kCubeSide);
+    const Planes hsv = forward(ColorSpace::Hsv, cube, kCubeSide, kCubeSide);
+    const Planes ycc = forward(ColorSpace::YCbCr, cube, kCubeSide, kCubeSide);
+    const Planes lab = forward(ColorSpace::Lab, cube, kCubeSide, kCubeSide);
+
+    int grayError = 0, grayMismatches = 0, hueSaturationError = 0, valueError = 0, yccError = 0;
+    double hueError = 0, labError = 0;
+    for (size_t i = 0; i < grayPlane.size(); ++i) {
+        const int b = cube[i * 3], g = cube[i * 3 + 1], r = cube[i * 3 + 2];
+        grayError = std::max(grayError, std::abs(grayPlane[i] - int(std::lround(0.299 * r + 0.587 * g + 0.114 * b))));
+        grayMismatches += grayPlane[i] != reference.rgbToGray(r, g, b);
+
+        float h, s, v;
+        reference.rgbToHSV(r, g, b, h, s, v);
+        double dh = std::fabs(hsv.c[0][i] * 2.0 - h);
+        hueError = std::max(hueError, std::min(dh, 360.0 - dh));
+        hueSaturationError = std::max(hueSaturationError, std::abs(hsv.c[1][i] - int(std::lround(s * 255))));
+        valueError = std::max(valueError, std::abs(hsv.c[2][i] - int(std::lround(v * 255))));
+
+        const double y = 0.299 * r + 0.587 * g + 0.114 * b;
+        const double cb = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+        const double cr = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b;
+        yccError = std::max({yccError, std::abs(ycc.c[0][i] - int(std::lround(y))),
+                             std::abs(ycc.c[1][i] - int(std::min(255.0, std::floor(cb + 0.5)))),
+                             std::abs(ycc.c[2][i] - int(std::min(255.0, std::floor(cr + 0.5))))});
+
+        double l, a, bb;
+        referenceLab(b, g, r, l, a, bb);
+        labError = std::max({labError, std::fabs(lab.c[0][i] - l * 2.55), std::fabs(lab.c[1][i] - 128 - a),
+                             std::fabs(lab.c[2][i] - 128 - bb)});
+    }
+    out << "max error: gray " << grayError << ", H " << hueError << " deg, S " << hueSaturationError << ", V "
+        << valueError << ", YCbCr " << yccError << ", Lab " << labError << Qt::endl;
+    expect(grayError <= kGrayTolerance, "bgrToGray vs BT.601 formula, all 2^24 inputs");
+    expect(grayMismatches == 0, "bgrToGray == rgbToGray, all 2^24 inputs");
+    expect(hueError <= kHueToleranceDegrees, "HSV hue vs rgbToHSV, all 2^24 inputs");
+    expect(hueSaturationError <= kSaturationTolerance, "HSV saturation vs rgbToHSV, all 2^24 inputs");
+    expect(valueError == 0, "HSV value vs rgbToHSV, all 2^24 inputs");
+    expect(yccError <= kYCbCrTolerance, "YCbCr vs BT.601 formula, all 2^24 inputs");
+    expect(labError <= kLabTolerance, "Lab vs CIE formula, all 2^24 inputs");
+}
+
+// 全部合法的 HSV 输入：H 在 [0, 180)，每个 H 一行 256x256 的 S、V
+Planes hsvInputs(int& width, int& height) {
+    width = 256 * 256;
+    height = 180;
+    Planes planes(size_t(width) * height);
+    for (int h = 0; h < height; ++h) {
+        for (int i = 0; i < width; ++i) {
+            const size_t index = size_t(h) * width + i;
+            planes.c[0][index] = static_cast<unsigned char>(h);
+            planes.c[1][index] = static_cast<unsigned char>(i >> 8);
+            planes.c[2][index] = static_cast<unsigned char>(i & 0xFF);
+        }
+    }
+    return planes;
+}
+
+void testHsvInverse() {
+    QTextStream out(stdout);
+    MyQImage reference;
+    int width, height;
+    const Planes hsv = hsvInputs(width, height);
+    const std::vector<unsigned char> bgr = inverse(ColorSpace::Hsv, hsv, width, height);
+    int error = 0;
+    for (size_t i = 0; i < hsv.c[0].size(); ++i) {
+        unsigned char r, g, b;
+        reference.hsvToRGB(hsv.c[0][i] * 2.0f, hsv.c[1][i] / 255.0f, hsv.c[2][i] / 255.0f, r, g, b);
+        error = std::max({error, std::abs(bgr[i * 3] - b), std::abs(bgr[i * 3 + 1] - g), std::abs(bgr[i * 3 + 2] - r)});
+    }
+    out << "max error: HSV to BGR " << error << Qt::endl;
+    expect(error <= kHsvInverseTolerance, "HSV to BGR vs hsvToRGB, all 180x256x256 inputs");
+}
+
+void testScalarMatchesAvx2(const std::vector<unsigned char>& cube) {
+    setSimdEnabled(true);
+    if (!simdAvx2Enabled()) {
+        QTextStream(stdout) << "SKIP scalar vs AVX2: CPU has no AVX2" << Qt::endl;
+        return;
+    }
+    int hsvWidth, hsvHeight;
+    const Planes hsvIn = hsvInputs(hsvWidth, hsvHeight);
+    // 逆变换的输入取全部 2^24 种三元组（Lab、YCbCr 的平面取任意值都合法）
+    Planes cubeIn(cube.size() / 3);
+    for (size_t i = 0; i < cubeIn.c[0].size(); ++i) {
+        for (int c = 0; c < 3; ++c) {
+            cubeIn.c[c][i] = cube[i * 3 + c];
+        }
+    }
+
+    std::vector<unsigned char> grayResult[2];
+    Planes forwardResult[2][3] = {{Planes(0), Planes(0), Planes(0)}, {Planes(0), Planes(0), Planes(0)}};
+    std::vector<unsigned char> inverseResult[2][3];
+    const ColorSpace spaces[3] = {ColorSpace::Hsv, ColorSpace::YCbCr, ColorSpace::Lab};
+    for (int simd = 0; simd < 2; ++simd) {
+        setSimdEnabled(simd == 1);
+        grayResult[simd] = gray(cube, kCubeSide, kCubeSide);
+        for (int s = 0; s < 3; ++s) {
+            forwardResult[simd][s] = forward(spaces[s], cube, kCubeSide, kCubeSide);
+            inverseResult[simd][s] = s == 0 ? inverse(spaces[s], hsvIn, hsvWidth, hsvHeight)
+                                            : inverse(spaces[s], cubeIn, kCubeSide, kCubeSide);
+        }
+    }
+    setSimdEnabled(true);
+
+    const char* names[3] = {"HSV", "YCbCr", "Lab"};
+    expect(grayResult[0] == grayResult[1], "bgrToGray scalar == AVX2");
+    for (int s = 0; s < 3; ++s) {
+        expect(forwardResult[0][s] == forwardResult[1][s], QString("BGR to %1 scalar == AVX2").arg(names[s]));
+        expect(inverseResult[0][s] == inverseResult[1][s], QString("%1 to BGR scalar == AVX2").arg(names[s]));
+    }
+}
+
+}
+
+int main()
+{
+    const std::vector<unsigned char> cube = colorCube();
+    testForward(cube);
+    testHsvInverse();
+    testScalarMatchesAvx2(cube);
+    QTextStream(stdout) << (failures ? "FAILED" : "ALL PASSED") << Qt::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
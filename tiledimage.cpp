@@ -0,0 +1,472 @@
+#include "tiledimage.h"
+#include "parallel.h"
+#include "trace.h"
+#include <QSaveFile>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// 分块的编码方式
+enum TileCodec : uint32_t {
+    TileRaw = 0,
+    TileDeltaLz = 1
+};
+
+// 每批并行编码的最少分块数（每线程），批内编码完成后按顺序写出
+const int kTilesPerThread = 2;
+
+// ---- LZ 风格的字节编码 ----
+// 序列格式：token（高 4 位字面量长度，低 4 位匹配长度 - 4，取值 15 时后接 255 累加的扩展长度）、
+// 字面量、2 字节小端的匹配距离、匹配长度扩展。最后一个序列只有字面量
+
+const size_t kMinMatch = 4;
+const int kHashBits = 14;
+const size_t kMaxOffset = 65535;
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void writeLength(std::vector<unsigned char>& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back(static_cast<unsigned char>(len));
+}
+
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& len) {
+    unsigned char b;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// matchLen 为 0 表示最后一个只含字面量的序列
+void emitSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalLen,
+                  size_t offset, size_t matchLen) {
+    size_t extra = matchLen ? matchLen - kMinMatch : 0;
+    out.push_back(static_cast<unsigned char>((std::min<size_t>(literalLen, 15) << 4) | std::min<size_t>(extra, 15)));
+    if (literalLen >= 15) {
+        writeLength(out, literalLen - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLen);
+    if (matchLen) {
+        out.push_back(static_cast<unsigned char>(offset & 0xFF));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+        if (extra >= 15) {
+            writeLength(out, extra - 15);
+        }
+    }
+}
+
+void lzCompress(const unsigned char* src, size_t n, std::vector<unsigned char>& out) {
+    thread_local std::vector<int32_t> table;
+    table.assign(size_t(1) << kHashBits, -1);
+    out.clear();
+    out.reserve(n + n / 255 + 16);
+
+    size_t anchor = 0;
+    size_t i = 0;
+    unsigned misses = 0;
+    while (i + kMinMatch <= n) {
+        uint32_t v = read32(src + i);
+        uint32_t h = hash32(v);
+        int32_t candidate = table[h];
+        table[h] = int32_t(i);
+        if (candidate >= 0 && i - size_t(candidate) <= kMaxOffset && read32(src + candidate) == v) {
+            size_t len = kMinMatch;
+            while (i + len < n && src[candidate + len] == src[i + len]) {
+                ++len;
+            }
+            emitSequence(out, src + anchor, i - anchor, i - size_t(candidate), len);
+            i += len;
+            anchor = i;
+            misses = 0;
+        } else {
+            // 连续找不到匹配（噪声类数据）时加大步长，避免在不可压缩的数据上耗时
+            i += 1 + (misses++ >> 5);
+        }
+    }
+    emitSequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+// 解码到恰好 size 字节；数据损坏（越界、距离非法、长度不符）时返回 false
+bool lzDecompress(const unsigned char* src, size_t n, unsigned char* dst, size_t size) {
+    const unsigned char* ip = src;
+    const unsigned char* const iend = src + n;
+    unsigned char* op = dst;
+    unsigned char* const oend = dst + size;
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t literalLen = token >> 4;
+        if (literalLen == 15 && !readLength(ip, iend, literalLen)) {
+            return false;
+        }
+        if (size_t(iend - ip) < literalLen || size_t(oend - op) < literalLen) {
+            return false;
+        }
+        std::memcpy(op, ip, literalLen);
+        ip += literalLen;
+        op += literalLen;
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > size_t(op - dst)) {
+            return false;
+        }
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && !readLength(ip, iend, matchLen)) {
+            return false;
+        }
+        matchLen += kMinMatch;
+        if (size_t(oend - op) < matchLen) {
+            return false;
+        }
+        const unsigned char* match = op - offset;
+        if (offset >= matchLen) {
+            std::memcpy(op, match, matchLen);
+        } else if (offset == 1) {
+            std::memset(op, *match, matchLen);
+        } else {
+            // 重叠的匹配必须逐字节复制
+            for (size_t k = 0; k < matchLen; ++k) {
+                op[k] = match[k];
+            }
+        }
+        op += matchLen;
+    }
+    return op == oend;
+}
+
+// ---- 分块的编码与解码 ----
+
+// 分块在图像中的范围（自上而下的坐标）
+struct TileRect {
+    int x, y, w, h;
+};
+
+TileRect tileRect(const MqtHeader& header, int tilesX, int index) {
+    TileRect r;
+    r.x = (index % tilesX) * header.tileWidth;
+    r.y = (index / tilesX) * header.tileHeight;
+    r.w = std::min<int>(header.tileWidth, header.width - r.x);
+    r.h = std::min<int>(header.tileHeight, header.height - r.y);
+    return r;
+}
+
+// 自上而下的第 y 行在自下而上存储中的起点
+inline const unsigned char* sourceRow(const unsigned char* pixels, qint64 stride, int height, int y) {
+    return pixels + qint64(height - 1 - y) * stride;
+}
+
+// 分离为 G、B-G、R-G 三个字节平面，并对每个平面做左邻差分（每行首个像素与上一行首个像素差分）
+void forwardTransform(const unsigned char* pixels, qint64 stride, int height, const TileRect& r, unsigned char* planes) {
+    const qint64 planeSize = qint64(r.w) * r.h;
+    unsigned char* p0 = planes;
+    unsigned char* p1 = planes + planeSize;
+    unsigned char* p2 = planes + 2 * planeSize;
+    unsigned char up[3] = {0, 0, 0};
+    for (int row = 0; row < r.h; ++row) {
+        const unsigned char* src = sourceRow(pixels, stride, height, r.y + row) + qint64(r.x) * 3;
+        unsigned char left[3] = {up[0], up[1], up[2]};
+        qint64 o = qint64(row) * r.w;
+        for (int x = 0; x < r.w; ++x, src += 3, ++o) {
+            unsigned char g = src[1];
+            unsigned char b = static_cast<unsigned char>(src[0] - g);
+            unsigned char rr = static_cast<unsigned char>(src[2] - g);
+            p0[o] = static_cast<unsigned char>(g - left[0]);
+            p1[o] = static_cast<unsigned char>(b - left[1]);
+            p2[o] = static_cast<unsigned char>(rr - left[2]);
+            left[0] = g;
+            left[1] = b;
+            left[2] = rr;
+            if (x == 0) {
+                up[0] = g;
+                up[1] = b;
+                up[2] = rr;
+            }
+        }
+    }
+}
+
+// forwardTransform 的逆变换；区域 clip（分块内坐标）之外的像素只参与差分累加，不写出
+void inverseTransform(const unsigned char* planes, const TileRect& r, const QRect& clip,
+                      unsigned char* dst, qint64 dstStride, int dstRows, int dstX0, int dstY0) {
+    const qint64 planeSize = qint64(r.w) * r.h;
+    const unsigned char* p0 = planes;
+    const unsigned char* p1 = planes + planeSize;
+    const unsigned char* p2 = planes + 2 * planeSize;
+    unsigned char up[3] = {0, 0, 0};
+    const int rowEnd = clip.y() + clip.height();
+    const int colBegin = clip.x();
+    const int colEnd = clip.x() + clip.width();
+    for (int row = 0; row < rowEnd; ++row) {
+        qint64 o = qint64(row) * r.w;
+        unsigned char g = static_cast<unsigned char>(up[0] + p0[o]);
+        unsigned char b = static_cast<unsigned char>(up[1] + p1[o]);
+        unsigned char rr = static_cast<unsigned char>(up[2] + p2[o]);
+        up[0] = g;
+        up[1] = b;
+        up[2] = rr;
+        if (row < clip.y()) {
+            continue;
+        }
+        // 目标按自下而上存放：区域内第 k 行写在 dst 的第 dstRows-1-k 行
+        unsigned char* out = dst + qint64(dstRows - 1 - (r.y + row - dstY0)) * dstStride;
+        for (int x = 0; x < colEnd; ++x) {
+            if (x > 0) {
+                g = static_cast<unsigned char>(g + p0[o + x]);
+                b = static_cast<unsigned char>(b + p1[o + x]);
+                rr = static_cast<unsigned char>(rr + p2[o + x]);
+            }
+            if (x >= colBegin) {
+                unsigned char* px = out + qint64(r.x + x - dstX0) * 3;
+                px[0] = static_cast<unsigned char>(b + g);
+                px[1] = g;
+                px[2] = static_cast<unsigned char>(rr + g);
+            }
+        }
+    }
+}
+
+// 编码一个分块；压缩后不小于原始大小时改为原样存储
+uint32_t encodeTile(const unsigned char* pixels, qint64 stride, int height, const TileRect& r,
+                    std::vector<unsigned char>& out) {
+    const size_t rawSize = size_t(r.w) * r.h * 3;
+    thread_local std::vector<unsigned char> planes;
+    planes.resize(rawSize);
+    forwardTransform(pixels, stride, height, r, planes.data());
+    lzCompress(planes.data(), rawSize, out);
+    if (out.size() < rawSize) {
+        return TileDeltaLz;
+    }
+
+    out.resize(rawSize);
+    for (int row = 0; row < r.h; ++row) {
+        std::memcpy(out.data() + size_t(row) * r.w * 3,
+                    sourceRow(pixels, stride, height, r.y + row) + qint64(r.x) * 3, size_t(r.w) * 3);
+    }
+    return TileRaw;
+}
+
+bool decodeTile(const MqtTileEntry& entry, const unsigned char* data, const TileRect& r, const QRect& clip,
+                unsigned char* dst, qint64 dstStride, int dstRows, int dstX0, int dstY0) {
+    const size_t rawSize = size_t(r.w) * r.h * 3;
+    if (entry.codec == TileRaw) {
+        if (entry.size != rawSize) {
+            return false;
+        }
+        for (int row = clip.y(); row < clip.y() + clip.height(); ++row) {
+            unsigned char* out = dst + qint64(dstRows - 1 - (r.y + row - dstY0)) * dstStride
+                                 + qint64(r.x + clip.x() - dstX0) * 3;
+            std::memcpy(out, data + (size_t(row) * r.w + clip.x()) * 3, size_t(clip.width()) * 3);
+        }
+        return true;
+    }
+    if (entry.codec != TileDeltaLz) {
+        return false;
+    }
+    thread_local std::vector<unsigned char> planes;
+    planes.resize(rawSize);
+    if (!lzDecompress(data, entry.size, planes.data(), rawSize)) {
+        return false;
+    }
+    inverseTransform(planes.data(), r, clip, dst, dstStride, dstRows, dstX0, dstY0);
+    return true;
+}
+
+} // namespace
+
+bool TiledImageFile::write(const QString& filePath, const unsigned char* pixels, int width, int height, qint64 stride,
+                           int tileSize, int threads) {
+    MYQIMAGE_TRACE_SCOPE("TiledImageFile::write");
+    if (!pixels || width <= 0 || height <= 0 || tileSize <= 0 || tileSize > kMaxTileSize) {
+        qDebug() << "Error: Invalid image for tiled file:" << filePath;
+        return false;
+    }
+
+    MqtHeader header;
+    header.width = width;
+    header.height = height;
+    header.tileWidth = static_cast<uint16_t>(tileSize);
+    header.tileHeight = static_cast<uint16_t>(tileSize);
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const int tileCount = tilesX * tilesY;
+    header.tileCount = uint32_t(tileCount);
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Error: Cannot open file for writing:" << filePath;
+        return false;
+    }
+
+    // 先为索引留出位置，分块写完后再回填
+    std::vector<MqtTileEntry> entries(tileCount);
+    const qint64 indexBytes = qint64(sizeof(MqtTileEntry)) * tileCount;
+    bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header)
+              && file.write(reinterpret_cast<const char*>(entries.data()), indexBytes) == indexBytes;
+
+    // 按批并行编码，批内按分块顺序写出；内存中只保留一批的压缩结果
+    threads = parallelThreadCount(threads);
+    const int batch = std::max(tilesX, threads * kTilesPerThread);
+    std::vector<std::vector<unsigned char>> encoded(std::min(batch, tileCount));
+    qint64 offset = qint64(sizeof(header)) + indexBytes;
+    for (int first = 0; ok && first < tileCount; first += batch) {
+        const int count = std::min(batch, tileCount - first);
+        parallelFor(0, count, [&](int, int b, int e) {
+            for (int i = b; i < e; ++i) {
+                entries[first + i].codec = encodeTile(pixels, stride, height, tileRect(header, tilesX, first + i), encoded[i]);
+            }
+        }, threads);
+        for (int i = 0; ok && i < count; ++i) {
+            MqtTileEntry& entry = entries[first + i];
+            entry.offset = uint64_t(offset);
+            entry.size = uint32_t(encoded[i].size());
+            ok = file.write(reinterpret_cast<const char*>(encoded[i].data()), entry.size) == qint64(entry.size);
+            offset += entry.size;
+        }
+    }
+
+    ok = ok && file.seek(sizeof(header))
+         && file.write(reinterpret_cast<const char*>(entries.data()), indexBytes) == indexBytes;
+    if (!ok) {
+        qDebug() << "Error: Failed to write tiled file:" << filePath;
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        qDebug() << "Error: Cannot commit file:" << filePath;
+        return false;
+    }
+    MYQIMAGE_TRACE_COUNTER("bytes_written", offset);
+    return true;
+}
+
+bool TiledImageFile::isTiledFile(const QString& filePath) {
+    QFile probe(filePath);
+    char magic[4];
+    return probe.open(QIODevice::ReadOnly) && probe.read(magic, sizeof(magic)) == sizeof(magic)
+           && std::memcmp(magic, MqtHeader().magic, sizeof(magic)) == 0;
+}
+
+bool TiledImageFile::open(const QString& filePath) {
+    file.close();
+    file.setFileName(filePath);
+    index.clear();
+    tilesX = tilesY = 0;
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error: Cannot open file" << filePath;
+        return false;
+    }
+
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, MqtHeader().magic, sizeof(header.magic)) != 0
+        || header.version != 1 || header.channels != 3
+        || header.width <= 0 || header.height <= 0 || header.tileWidth == 0 || header.tileHeight == 0
+        || header.tileWidth > kMaxTileSize || header.tileHeight > kMaxTileSize) {
+        qDebug() << "Error: Not a valid tiled image file:" << filePath;
+        file.close();
+        return false;
+    }
+    tilesX = (header.width + header.tileWidth - 1) / header.tileWidth;
+    tilesY = (header.height + header.tileHeight - 1) / header.tileHeight;
+    const qint64 fileSize = file.size();
+    if (qint64(header.tileCount) != qint64(tilesX) * tilesY
+        || qint64(sizeof(header)) + qint64(sizeof(MqtTileEntry)) * header.tileCount > fileSize) {
+        qDebug() << "Error: Corrupt tile index:" << filePath;
+        file.close();
+        return false;
+    }
+
+    index.resize(int(header.tileCount));
+    const qint64 indexBytes = qint64(sizeof(MqtTileEntry)) * header.tileCount;
+    if (file.read(reinterpret_cast<char*>(index.data()), indexBytes) != indexBytes) {
+        file.close();
+        return false;
+    }
+    for (const MqtTileEntry& entry : index) {
+        if (entry.offset > uint64_t(fileSize) || entry.size > uint64_t(fileSize) - entry.offset) {
+            qDebug() << "Error: Corrupt tile index:" << filePath;
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TiledImageFile::readRegion(const QRect& region, unsigned char* dst, qint64 dstStride, int threads) {
+    MYQIMAGE_TRACE_SCOPE("TiledImageFile::readRegion");
+    if (!file.isOpen() || region.isEmpty() || region.x() < 0 || region.y() < 0
+        || region.x() + region.width() > header.width || region.y() + region.height() > header.height) {
+        return false;
+    }
+
+    // 只读取与区域相交的分块；各分块的数据读入后并行解码
+    const int tx0 = region.x() / header.tileWidth;
+    const int tx1 = (region.x() + region.width() - 1) / header.tileWidth;
+    const int ty0 = region.y() / header.tileHeight;
+    const int ty1 = (region.y() + region.height() - 1) / header.tileHeight;
+    std::vector<int> tiles;
+    std::vector<qint64> starts;
+    qint64 total = 0;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            int i = ty * tilesX + tx;
+            tiles.push_back(i);
+            starts.push_back(total);
+            total += index[i].size;
+        }
+    }
+
+    std::vector<unsigned char> data(static_cast<size_t>(total));
+    for (size_t k = 0; k < tiles.size(); ++k) {
+        const MqtTileEntry& entry = index[tiles[k]];
+        if (!file.seek(qint64(entry.offset))
+            || file.read(reinterpret_cast<char*>(data.data() + starts[k]), entry.size) != qint64(entry.size)) {
+            qDebug() << "Error: Cannot read tile" << tiles[k];
+            return false;
+        }
+    }
+    MYQIMAGE_TRACE_COUNTER("bytes_read", total);
+
+    std::atomic<bool> ok(true);
+    parallelFor(0, int(tiles.size()), [&](int, int b, int e) {
+        for (int k = b; k < e && ok.load(std::memory_order_relaxed); ++k) {
+            TileRect r = tileRect(header, tilesX, tiles[k]);
+            // 分块与区域的交集，换算为分块内的坐标
+            QRect clip = QRect(r.x, r.y, r.w, r.h).intersected(region);
+            clip = QRect(clip.x() - r.x, clip.y() - r.y, clip.width(), clip.height());
+            if (!decodeTile(index[tiles[k]], data.data() + starts[k], r, clip,
+                            dst, dstStride, region.height(), region.x(), region.y())) {
+                ok = false;
+            }
+        }
+    }, threads);
+    if (!ok) {
+        qDebug() << "Error: Corrupt tile data in" << file.fileName();
+    }
+    return ok;
+}
@@ -0,0 +1,69 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QString>
+#include <QFile>
+#include <QRect>
+#include <QVector>
+#include <cstdint>
+
+// .mqt 分块容器的文件头
+#pragma pack(push, 1)
+struct MqtHeader {
+    char magic[4] = {'M', 'Q', 'T', '1'};
+    uint16_t version = 1;
+    uint16_t channels = 3;      // 目前只有 24 位 BGR
+    int32_t width = 0;
+    int32_t height = 0;
+    uint16_t tileWidth = 256;
+    uint16_t tileHeight = 256;
+    uint32_t tileCount = 0;     // 其后紧跟 tileCount 个 MqtTileEntry，按行优先的分块顺序
+};
+
+// 分块索引项
+struct MqtTileEntry {
+    uint64_t offset = 0;        // 压缩数据在文件中的偏移
+    uint32_t size = 0;          // 压缩数据的字节数
+    uint32_t codec = 0;         // 0：原样存储；1：通道去相关 + 左邻差分 + LZ
+};
+#pragma pack(pop)
+
+// 中间结果用的分块压缩容器（.mqt）。
+// 图像按自上而下的坐标切成固定大小的分块，每块独立压缩：先做 G、B-G、R-G 的字节平面分离与左邻差分，
+// 再用 LZ 风格的编码器压缩，压缩无益时原样存储。头部之后是分块索引，
+// 读取区域时只读取并解压覆盖该区域的分块；编码与解码都按分块并行
+class TiledImageFile {
+public:
+    // 分块边长上限：编码器的 32 位哈希位置与索引中 32 位的分块字节数都须容纳一整块
+    static const int kMaxTileSize = 4096;
+
+    // 写出 width x height 的 24 位像素（自下而上的行，与 MyQImage 布局一致），tileSize 取值 [1, kMaxTileSize]；
+    // 先写临时文件再原子替换目标文件
+    static bool write(const QString& filePath, const unsigned char* pixels, int width, int height, qint64 stride,
+                      int tileSize = 256, int threads = 0);
+
+    // 文件是否以 .mqt 的标识开头
+    static bool isTiledFile(const QString& filePath);
+
+    bool open(const QString& filePath);
+    void close() { file.close(); }
+
+    int getWidth() const { return header.width; }
+    int getHeight() const { return header.height; }
+    int getTileWidth() const { return header.tileWidth; }
+    int getTileHeight() const { return header.tileHeight; }
+    QRect bounds() const { return QRect(0, 0, header.width, header.height); }
+
+    // 读取 region（自上而下的图像坐标，须位于图像之内），结果按自下而上的行写入 dst，
+    // 即 region 的最后一行写在 dst 的第 0 行，相邻两行相距 dstStride 字节
+    bool readRegion(const QRect& region, unsigned char* dst, qint64 dstStride, int threads = 0);
+
+private:
+    QFile file;
+    MqtHeader header;
+    QVector<MqtTileEntry> index;
+    int tilesX = 0;
+    int tilesY = 0;
+};
+
+#endif // TILEDIMAGE_H
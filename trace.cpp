@@ -0,0 +1,163 @@
+#include "trace.h"
+
+#ifdef MYQIMAGE_TRACE
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    qint64 timestamp;  // 纳秒
+    qint64 value;      // 'X'：持续时间（纳秒）；'C'：计数器的值
+    char phase;        // Chrome trace 的事件类型
+};
+
+// 单个线程的环形缓冲：只有所属线程写入，head 以 release 语义发布
+struct ThreadBuffer {
+    ThreadBuffer(int capacity, int threadId) : events(std::max(1, capacity)), threadId(threadId) {}
+
+    void push(const char* name, qint64 timestamp, qint64 value, char phase) {
+        quint64 index = head.load(std::memory_order_relaxed);
+        TraceEvent& event = events[index % events.size()];
+        event.name = name;
+        event.timestamp = timestamp;
+        event.value = value;
+        event.phase = phase;
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    std::vector<TraceEvent> events;
+    std::atomic<quint64> head{0};  // 写入过的事件总数
+    const int threadId;
+};
+
+// 所有线程缓冲的登记表；只在线程第一次记录事件和导出时加锁
+struct Registry {
+    QMutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+std::atomic<bool> traceEnabled{false};
+std::atomic<int> bufferCapacity{1 << 16};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer* localBuffer() {
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        Registry& r = registry();
+        QMutexLocker locker(&r.mutex);
+        r.buffers.emplace_back(new ThreadBuffer(bufferCapacity.load(std::memory_order_relaxed),
+                                                int(r.buffers.size()) + 1));
+        buffer = r.buffers.back().get();
+    }
+    return buffer;
+}
+
+}
+
+void Trace::setEnabled(bool enabled) {
+    traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Trace::isEnabled() {
+    return traceEnabled.load(std::memory_order_relaxed);
+}
+
+void Trace::setBufferCapacity(int events) {
+    bufferCapacity.store(std::max(1, events), std::memory_order_relaxed);
+}
+
+void Trace::clear() {
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : r.buffers) {
+        buffer->head.store(0, std::memory_order_release);
+    }
+}
+
+void Trace::complete(const char* name, qint64 startNs, qint64 endNs) {
+    localBuffer()->push(name, startNs, endNs - startNs, 'X');
+}
+
+void Trace::counter(const char* name, qint64 value) {
+    localBuffer()->push(name, now(), value, 'C');
+}
+
+bool Trace::writeChromeJson(const QString& filePath) {
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+
+    // 时间戳以最早的事件为零点，单位为微秒
+    qint64 origin = std::numeric_limits<qint64>::max();
+    for (const std::unique_ptr<ThreadBuffer>& buffer : r.buffers) {
+        quint64 count = buffer->head.load(std::memory_order_acquire);
+        quint64 first = count > buffer->events.size() ? count - buffer->events.size() : 0;
+        for (quint64 i = first; i < count; ++i) {
+            origin = std::min(origin, buffer->events[i % buffer->events.size()].timestamp);
+        }
+    }
+
+    QJsonArray events;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : r.buffers) {
+        quint64 count = buffer->head.load(std::memory_order_acquire);
+        if (count == 0) {
+            continue;
+        }
+        QJsonObject args;
+        args["name"] = QString("thread %1").arg(buffer->threadId);
+        QJsonObject metadata;
+        metadata["name"] = "thread_name";
+        metadata["ph"] = "M";
+        metadata["pid"] = 1;
+        metadata["tid"] = buffer->threadId;
+        metadata["args"] = args;
+        events.append(metadata);
+
+        quint64 first = count > buffer->events.size() ? count - buffer->events.size() : 0;
+        for (quint64 i = first; i < count; ++i) {
+            const TraceEvent& event = buffer->events[i % buffer->events.size()];
+            QJsonObject object;
+            object["name"] = QString::fromLatin1(event.name);
+            object["ph"] = QString(QChar(event.phase));
+            object["pid"] = 1;
+            object["tid"] = buffer->threadId;
+            object["ts"] = (event.timestamp - origin) / 1000.0;
+            if (event.phase == 'X') {
+                object["dur"] = event.value / 1000.0;
+            } else {
+                QJsonObject value;
+                value["value"] = double(event.value);
+                object["args"] = value;
+            }
+            events.append(object);
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ns";
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    return file.write(json) == json.size();
+}
+
+#endif // MYQIMAGE_TRACE
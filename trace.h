@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// 热点路径的轻量追踪：作用域计时与计数器，导出为 Chrome trace / Perfetto 可打开的 JSON。
+// 以 MYQIMAGE_TRACE 宏编译时生效；未定义时下面的宏展开为空，不产生任何代码与数据。
+//
+//   MYQIMAGE_TRACE_SCOPE("MyQImage::load");            // 记录所在作用域的起止时间
+//   MYQIMAGE_TRACE_COUNTER("bytes_read", bytes);         // 记录计数器在当前时刻的值
+//
+// 名称必须是字符串字面量（只保存指针）。每个线程写自己的环形缓冲，写入无锁；
+// 缓冲满后覆盖最旧的事件。线程退出后其缓冲仍保留到 Trace::clear()，便于导出线程池中的事件
+
+#ifdef MYQIMAGE_TRACE
+
+#include <QtGlobal>
+#include <QString>
+#include <chrono>
+
+class Trace {
+public:
+    // 运行时开关，默认关闭；关闭时每个追踪点只有一次原子读
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // 每个线程环形缓冲的事件数，对之后新建的缓冲生效
+    static void setBufferCapacity(int events);
+
+    // 丢弃所有已记录的事件
+    static void clear();
+
+    // 导出 Chrome trace JSON（chrome://tracing、ui.perfetto.dev 可直接打开）；
+    // 应在被追踪的工作结束后调用，此时其它线程不再写入
+    static bool writeChromeJson(const QString& filePath);
+
+    static qint64 now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void complete(const char* name, qint64 startNs, qint64 endNs);
+    static void counter(const char* name, qint64 value);
+};
+
+// 作用域计时器
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name(Trace::isEnabled() ? name : nullptr), start(this->name ? Trace::now() : 0) {}
+    ~TraceScope() {
+        if (name) {
+            Trace::complete(name, start, Trace::now());
+        }
+    }
+
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    const char* name;
+    qint64 start;
+};
+
+#define MYQIMAGE_TRACE_CONCAT_(a, b) a##b
+#define MYQIMAGE_TRACE_CONCAT(a, b) MYQIMAGE_TRACE_CONCAT_(a, b)
+#define MYQIMAGE_TRACE_SCOPE(name) TraceScope MYQIMAGE_TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define MYQIMAGE_TRACE_COUNTER(name, value) \
+    do { if (Trace::isEnabled()) Trace::counter(name, qint64(value)); } while (0)
+
+#else
+
+#define MYQIMAGE_TRACE_SCOPE(name) do {} while (0)
+#define MYQIMAGE_TRACE_COUNTER(name, value) do {} while (0)
+
+#endif // MYQIMAGE_TRACE
+
+#endif // TRACE_H
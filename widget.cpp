@@ -3,53 +3,88 @@
 #include <QFileDialog>
 #include <QFile>
 #include <QMessageBox>
+#include <QResizeEvent>
+#include <QProgressBar>
 Widget::Widget(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::Widget)
 {
     ui->setupUi(this);
+    // 交互分割使用颜色直方图引擎，较大的 K 也能快速得到结果
+    image.setSegmentationEngine(KMeansEngine::ColorHistogram);
+    connect(&jobs, &ImageJobRunner::progressChanged, ui->progressBar, &QProgressBar::setValue);
+    connect(&jobs, &ImageJobRunner::jobFinished, this, &Widget::onJobFinished);
+    connect(&jobs, &ImageJobRunner::jobStarted, this, &Widget::onJobStateChanged);
+    connect(&jobs, &ImageJobRunner::jobCancelled, this, &Widget::onJobStateChanged);
+    ui->progressBar->setValue(0);
+    updateHistoryButtons();
 }
 
 Widget::~Widget()
 {
+    // 先停止后台作业，避免结果送达已销毁的界面
+    jobs.cancel();
+    disconnect(&jobs, nullptr, this, nullptr);
     delete ui;
 }
 
+void Widget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if (image.getPixels()) {
+        // 预览模式下显示区域超过代理尺寸时按新尺寸重建代理
+        if (ui->previewMode->isChecked()) {
+            preview.resize(ui->Image_show->size());
+        }
+        showImage();
+    }
+}
+
 
 void Widget::on_Image_Choose_Button_clicked()
 {
     // 打开文件对话框，并让用户选择文件
-    QString filePath = QFileDialog::getOpenFileName(this, "Select File", "", "All Files (*.*);;Text Files (*.txt)");
+    QString filePath = QFileDialog::getOpenFileName(this, "Select File", "", "Images (*.bmp *.mqt);;BMP Files (*.bmp);;Tiled Files (*.mqt);;All Files (*.*)");
 
     // 如果用户选择了文件，则将文件路径设置到QLineEdit中
     if (!filePath.isEmpty()) {
+        // 正在处理的是旧图像，结果已无意义
+        jobs.cancel();
+        pendingSavePath.clear();
+        preview.discardPending();
         ui->image_path->setText(filePath);
         if(!image.load(filePath)){
             ui->image_path->setText("图像加载失败！");
         }
         else{
-            image.drawToLabel(ui->Image_show);
+            if (ui->previewMode->isChecked()) {
+                preview.setSource(image, ui->Image_show->size());
+            }
+            showImage();
         }
 
     }
     else{
         ui->image_path->setText("文件路径读取失败！");
     }
-    origin_image=image;
+    history.reset(image);
+    updateHistoryButtons();
 }
 
 void Widget::on_origin_image_clicked()
 {
-    origin_image.drawToLabel(ui->Image_show);
-    image=origin_image;
+    // 回到原图；之后仍可通过重做恢复各步结果
+    jobs.cancel();
+    if (history.revertToOriginal(image)) {
+        showHistoryState();
+    }
 }
 
 void Widget::on_image_enhancement_clicked()
 {
-    //image=origin_image;
-    image.HistogramEqualization();
-    enhanced_image=image;
-    enhanced_image.drawToLabel(ui->Image_show);
+    ImageJobRequest request;
+    request.type = ImageJobType::Equalize;
+    runOperation(request);
 }
 
 void Widget::on_save_image_clicked()
@@ -59,36 +94,291 @@ void Widget::on_save_image_clicked()
         this,
         tr("Save Image"),
         "",
-        tr("BMP Files (*.bmp);;All Files (*)")
+        tr("BMP Files (*.bmp);;Tiled Files (*.mqt);;All Files (*)")
     );
 
     // 确保用户选择了一个有效的文件路径
     if (!filePath.isEmpty()) {
-        // 使用 MyQImage 的 saveImage 函数保存图像
-        bool success = image.save(filePath);
-        if (success) {
-            QMessageBox::information(this, tr("Save Image"), tr("Image saved successfully!"));
-        } else {
-            QMessageBox::warning(this, tr("Save Image"), tr("Failed to save the image."));
+        // 预览中的操作或后台作业尚未得到原尺寸结果：先计算，完成后再保存
+        if (preview.hasPending() || jobs.isBusy()) {
+            pendingSavePath = filePath;
+            commitPreview();
+            return;
         }
+        saveTo(filePath);
+    }
+}
+
+void Widget::saveTo(const QString& filePath)
+{
+    // 使用 MyQImage 的 saveImage 函数保存图像
+    bool success = image.save(filePath);
+    if (success) {
+        QMessageBox::information(this, tr("Save Image"), tr("Image saved successfully!"));
+    } else {
+        QMessageBox::warning(this, tr("Save Image"), tr("Failed to save the image."));
     }
 }
 
 void Widget::on_pushButton_clicked()
 {
-    image.segmentImage();
-    segmented_image=image;
-    segmented_image.drawToLabel(ui->Image_show);
+    ImageJobRequest request;
+    request.type = ImageJobType::Segment;
+    request.K = ui->spinBox->value();
+    runOperation(request);
 }
 
 void Widget::on_sharpen_clicked()
 {
-    image.sharpen();
-    image.drawToLabel(ui->Image_show);
+    ImageJobRequest request;
+    request.type = ImageJobType::Sharpen;
+    runOperation(request);
+}
+
+void Widget::on_clahe_clicked()
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Clahe;
+    request.tileSize = ui->claheTileSize->value();
+    request.clipLimit = ui->claheClipLimit->value();
+    runOperation(request);
+}
+
+void Widget::on_claheTileSize_valueChanged(int arg1)
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Clahe;
+    request.tileSize = arg1;
+    request.clipLimit = ui->claheClipLimit->value();
+    updatePreviewParameters(request);
+}
+
+void Widget::on_claheClipLimit_valueChanged(double arg1)
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Clahe;
+    request.tileSize = ui->claheTileSize->value();
+    request.clipLimit = arg1;
+    updatePreviewParameters(request);
+}
+
+void Widget::on_median_clicked()
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Median;
+    request.radius = ui->denoiseRadius->value();
+    runOperation(request);
+}
+
+void Widget::on_bilateral_clicked()
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Bilateral;
+    request.radius = ui->denoiseRadius->value();
+    request.rangeSigma = ui->bilateralRange->value();
+    runOperation(request);
+}
+
+void Widget::on_denoiseRadius_valueChanged(int arg1)
+{
+    // 预览中最后一步是哪种去噪就重算哪种
+    ImageJobRequest request;
+    request.type = ImageJobType::Median;
+    request.radius = arg1;
+    updatePreviewParameters(request);
+    request.type = ImageJobType::Bilateral;
+    request.rangeSigma = ui->bilateralRange->value();
+    updatePreviewParameters(request);
+}
+
+void Widget::on_bilateralRange_valueChanged(int arg1)
+{
+    ImageJobRequest request;
+    request.type = ImageJobType::Bilateral;
+    request.radius = ui->denoiseRadius->value();
+    request.rangeSigma = arg1;
+    updatePreviewParameters(request);
+}
+
+void Widget::on_previewMode_toggled(bool checked)
+{
+    if (checked) {
+        preview.setSource(image, ui->Image_show->size());
+    } else {
+        // 离开预览模式：原尺寸结果在后台补算
+        commitPreview();
+    }
+    showImage();
 }
 
 
 void Widget::on_spinBox_valueChanged(int arg1)
 {
     image.changeK(arg1);
+    ImageJobRequest request;
+    request.type = ImageJobType::Segment;
+    request.K = arg1;
+    updatePreviewParameters(request);
+}
+
+void Widget::on_undo_clicked()
+{
+    // 先撤销只在代理上执行过的操作
+    if (preview.undoLast()) {
+        showImage();
+        updateHistoryButtons();
+        return;
+    }
+    jobs.cancel();
+    if (history.undo(image)) {
+        showHistoryState();
+    }
+}
+
+void Widget::on_redo_clicked()
+{
+    jobs.cancel();
+    if (history.redo(image)) {
+        showHistoryState();
+    }
+}
+
+void Widget::on_cancel_clicked()
+{
+    jobs.cancel();
+    pendingSavePath.clear();
+    // 交给后台的预览操作随之取消，代理回到当前的原尺寸图像
+    if (ui->previewMode->isChecked()) {
+        preview.setSource(image, ui->Image_show->size());
+        showImage();
+    }
+}
+
+// 作业在后台线程完成，结果经排队信号回到界面线程
+void Widget::onJobFinished(ImageJobRequest request, MyQImage result)
+{
+    image = result;
+    image.changeK(ui->spinBox->value());
+    switch (request.type) {
+    case ImageJobType::Equalize:
+        // 均衡化可确定地快速重放，历史中只记录操作本身
+        history.record(image, "图像增强", [](MyQImage& target) { target.HistogramEqualization(); });
+        break;
+    case ImageJobType::Segment:
+        // 分割重放代价较高，保存与前一状态的差异
+        history.record(image, "图像分割");
+        break;
+    case ImageJobType::Sharpen:
+        history.record(image, "锐化", [](MyQImage& target) { target.sharpen(); });
+        break;
+    case ImageJobType::Clahe: {
+        // 参数随操作一起记录，重放结果与本次相同
+        const int tileSize = request.tileSize;
+        const double clipLimit = request.clipLimit;
+        history.record(image, "自适应增强", [tileSize, clipLimit](MyQImage& target) {
+            target.clahe(tileSize, clipLimit);
+        });
+        break;
+    }
+    case ImageJobType::Median: {
+        const int radius = request.radius;
+        history.record(image, "中值去噪", [radius](MyQImage& target) { target.medianFilter(radius); });
+        break;
+    }
+    case ImageJobType::Bilateral: {
+        const int radius = request.radius;
+        const double rangeSigma = request.rangeSigma;
+        history.record(image, "双边去噪", [radius, rangeSigma](MyQImage& target) {
+            target.bilateralFilter(radius, rangeSigma);
+        });
+        break;
+    }
+    }
+    if (jobs.pendingCount() == 0) {
+        // 原尺寸结果全部就绪：同步代理，执行等待中的保存
+        if (ui->previewMode->isChecked()) {
+            preview.setSource(image, ui->Image_show->size());
+        }
+        if (!pendingSavePath.isEmpty()) {
+            const QString filePath = pendingSavePath;
+            pendingSavePath.clear();
+            saveTo(filePath);
+        }
+    }
+    showImage();
+    updateHistoryButtons();
+    onJobStateChanged();
+}
+
+void Widget::onJobStateChanged()
+{
+    ui->cancel->setEnabled(jobs.isBusy());
+    if (!jobs.isBusy()) {
+        ui->progressBar->setValue(0);
+    }
+}
+
+void Widget::showHistoryState()
+{
+    image.changeK(ui->spinBox->value());
+    // 历史跳转后代理上未提交的操作不再适用
+    preview.discardPending();
+    if (ui->previewMode->isChecked()) {
+        preview.setSource(image, ui->Image_show->size());
+    }
+    showImage();
+    updateHistoryButtons();
+}
+
+void Widget::updateHistoryButtons()
+{
+    ui->undo->setEnabled(history.canUndo() || preview.hasPending());
+    ui->redo->setEnabled(history.canRedo());
+}
+
+void Widget::runOperation(const ImageJobRequest& request)
+{
+    if (!ui->previewMode->isChecked()) {
+        ImageJobRequest job = request;
+        job.session = segmentation;
+        jobs.submit(job, image);
+        return;
+    }
+    if (!preview.isValid()) {
+        preview.setSource(image, ui->Image_show->size());
+    }
+    if (preview.apply(request)) {
+        showImage();
+        updateHistoryButtons();
+    }
+}
+
+void Widget::updatePreviewParameters(const ImageJobRequest& request)
+{
+    if (ui->previewMode->isChecked() && preview.replaceLast(request)) {
+        showImage();
+    }
+}
+
+void Widget::commitPreview()
+{
+    // 按顺序排队，后一个操作以前一个的结果为输入；分割以代理上的聚类中心为初始中心。
+    // 代理上重复执行的操作在原尺寸上同样执行，不合并
+    const QVector<ImageJobRequest> requests = preview.takePending();
+    for (ImageJobRequest request : requests) {
+        request.session = segmentation;
+        jobs.submit(request, image, false);
+    }
+    updateHistoryButtons();
+}
+
+void Widget::showImage()
+{
+    if (ui->previewMode->isChecked() && preview.isValid()) {
+        // 绘制的是共享像素的副本，代理本身保持不变
+        MyQImage proxy = preview.getProxy();
+        proxy.drawToLabel(ui->Image_show);
+    } else if (image.getPixels()) {
+        image.drawToLabel(ui->Image_show);
+    }
 }
@@ -3,6 +3,11 @@
 
 #include <QWidget>
 #include "myqimage.h"
+#include "operationhistory.h"
+#include "imagejobs.h"
+#include "preview.h"
+#include "segmentationsession.h"
+#include <memory>
 QT_BEGIN_NAMESPACE
 namespace Ui { class Widget; }
 QT_END_NAMESPACE
@@ -15,9 +20,15 @@ public:
     Widget(QWidget *parent = nullptr);
     ~Widget();
     MyQImage image;
-    MyQImage origin_image;
-    MyQImage enhanced_image;
-    MyQImage segmented_image;
+    OperationHistory history;  // 原图与之后每一步的差异，用于撤销/重做
+    ImageJobRunner jobs;       // 在后台执行增强、分割、锐化
+    PreviewSession preview;    // 预览模式下先在显示尺寸的代理上执行操作
+    // 原尺寸分割的结果缓存：改变 K 后重新分割时热启动，并分割原图而不是上一次的分割结果
+    std::shared_ptr<SegmentationSession> segmentation = std::make_shared<SegmentationSession>();
+
+protected:
+    // 窗口尺寸变化时按新的标签大小重绘（缩放结果来自缓存的金字塔，代价很小）
+    void resizeEvent(QResizeEvent *event) override;
 
 private slots:
     void on_Image_Choose_Button_clicked();
@@ -32,9 +43,51 @@ private slots:
 
     void on_sharpen_clicked();
 
+    void on_clahe_clicked();
+
+    void on_claheTileSize_valueChanged(int arg1);
+
+    void on_claheClipLimit_valueChanged(double arg1);
+
+    void on_median_clicked();
+
+    void on_bilateral_clicked();
+
+    void on_denoiseRadius_valueChanged(int arg1);
+
+    void on_bilateralRange_valueChanged(int arg1);
+
+    void on_previewMode_toggled(bool checked);
+
     void on_spinBox_valueChanged(int arg1);
 
+    void on_undo_clicked();
+
+    void on_redo_clicked();
+
+    void on_cancel_clicked();
+
+    void onJobFinished(ImageJobRequest request, MyQImage result);
+
+    void onJobStateChanged();
+
 private:
+    // 显示历史中的某个状态后调用：恢复界面上的 K 值、重绘并更新撤销/重做按钮
+    void showHistoryState();
+    void updateHistoryButtons();
+
+    // 预览模式下在代理上执行，否则交给后台作业
+    void runOperation(const ImageJobRequest& request);
+    // 预览模式下修改了最后一个操作的参数：只在代理上重算这一步
+    void updatePreviewParameters(const ImageJobRequest& request);
+    // 把代理上未提交的操作交给后台按原尺寸计算
+    void commitPreview();
+    // 绘制当前图像：预览模式下绘制代理
+    void showImage();
+    void saveTo(const QString& filePath);
+
+    QString pendingSavePath;  // 原尺寸结果计算完成后要保存到的路径
+
     Ui::Widget *ui;
 };
 #endif // WIDGET_H